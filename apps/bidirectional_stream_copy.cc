@@ -1,135 +1,315 @@
 #include "bidirectional_stream_copy.hh"
 
+#include "async.hh"
 #include "byte_stream.hh"
 #include "eventloop.hh"
+#include "exception.hh"
 
 #include <algorithm>
+#include <array>
+#include <cerrno>
+#include <fcntl.h>
+#include <functional>
 #include <iostream>
+#include <string>
 #include <unistd.h>
 
 using namespace std;
 
-void bidirectional_stream_copy( Socket& socket, string_view peer_name )
+void bidirectional_stream_copy( Socket& socket, string_view peer_name, const StreamCopyMode mode )
 {
-  constexpr size_t buffer_size = 1048576;
+  EventLoop eventloop;
+  bidirectional_stream_copy(
+    socket, peer_name, FileDescriptor { STDIN_FILENO }, FileDescriptor { STDOUT_FILENO }, eventloop, mode );
+}
 
-  EventLoop _eventloop {};
-  FileDescriptor _input { STDIN_FILENO };
-  FileDescriptor _output { STDOUT_FILENO };
-  ByteStream _outbound { buffer_size };
-  ByteStream _inbound { buffer_size };
-  bool _outbound_shutdown { false };
-  bool _inbound_shutdown { false };
+namespace {
 
-  socket.set_blocking( false );
-  _input.set_blocking( false );
-  _output.set_blocking( false );
+//! What the four copying tasks share
+struct Copy
+{
+  ByteStream outbound;
+  ByteStream inbound;
+  Scheduler& scheduler;
+  unsigned draining { 2 }; //!< tasks still writing a stream out
 
-  // rule 1: read from stdin into outbound byte stream
-  _eventloop.add_rule(
-    "read from stdin into outbound byte stream",
-    _input,
-    Direction::In,
-    [&] {
-      string data;
-      data.resize( _outbound.writer().available_capacity() );
-      _input.read( data );
-      _outbound.writer().push( move( data ) );
-      if ( _input.eof() ) {
-        _outbound.writer().close();
-      }
-    },
-    [&] {
-      return !_outbound.has_error() and !_inbound.has_error() and ( _outbound.writer().available_capacity() > 0 )
-             and !_outbound.writer().is_closed();
-    },
-    [&] { _outbound.writer().close(); },
-    [&] {
-      cerr << "DEBUG: Outbound stream had error from source.\n";
-      _outbound.set_error();
-      _inbound.set_error();
-    } );
-
-  // rule 2: read from outbound byte stream into socket
-  _eventloop.add_rule(
-    "read from outbound byte stream into socket",
-    socket,
-    Direction::Out,
-    [&] {
-      if ( _outbound.reader().bytes_buffered() ) {
-        _outbound.reader().pop( socket.write( _outbound.reader().peek() ) );
+  // (a task splicing may be waiting on an fd, not a stream, so the failure cannot wait for it to notice)
+  void fail()
+  {
+    outbound.set_error();
+    inbound.set_error();
+    scheduler.stop();
+  }
+
+  bool failed() const { return outbound.has_error() or inbound.has_error(); }
+
+  // once both streams have been written out (or given up on), nothing that is still reading matters
+  void drained()
+  {
+    if ( --draining == 0 ) {
+      scheduler.stop();
+    }
+  }
+};
+
+//! Reads `source` into `stream` until EOF (or until either direction fails)
+Task read_into( FileDescriptor& source, Writer& stream, Copy& copy, string error_message )
+{
+  while ( true ) {
+    co_await stream.space();
+    if ( copy.failed() or stream.is_closed() ) {
+      co_return;
+    }
+    const bool readable = co_await source.readable();
+    if ( not readable ) {
+      cerr << error_message;
+      copy.fail();
+      co_return;
+    }
+
+    string data;
+    data.resize( stream.available_capacity() );
+    source.read( data );
+    stream.push( move( data ) );
+    if ( source.eof() ) {
+      stream.close();
+      co_return;
+    }
+  }
+}
+
+//! Writes `stream` into `destination` until the stream is finished (then calls `finish`), or fails
+Task write_from( Reader& stream,
+                 FileDescriptor& destination,
+                 Copy& copy,
+                 function<void()> finish,
+                 string error_message )
+{
+  while ( true ) {
+    co_await stream.data();
+    if ( stream.has_error() ) {
+      break;
+    }
+    if ( stream.bytes_buffered() ) {
+      // write first, and wait only if the destination is full (so its rule is not woken while there is nothing
+      // to write)
+      const size_t written = destination.write( stream.peek() );
+      if ( written == 0 ) {
+        const bool writable = co_await destination.writable();
+        if ( not writable ) {
+          cerr << error_message;
+          copy.fail();
+          break;
+        }
+        continue;
       }
-      if ( _outbound.reader().is_finished() ) {
-        socket.shutdown( SHUT_WR );
-        _outbound_shutdown = true;
-        cerr << "DEBUG: Outbound stream to " << peer_name << " finished.\n";
+      stream.pop( written );
+    }
+    if ( stream.is_finished() ) {
+      finish();
+      break;
+    }
+  }
+  copy.drained();
+}
+
+//! Writes `stream` into `socket` with zero-copy sends until the stream is finished (then calls `finish`), or
+//! fails. The bytes sent stay in the stream (`pinned`) until every send has completed: the kernel reads them in
+//! place, and popping would move the rest of the buffer under it.
+Task write_zerocopy_from( Reader& stream,
+                          Socket& socket,
+                          Copy& copy,
+                          function<void()> finish,
+                          string error_message )
+{
+  size_t pinned = 0;
+  while ( not stream.has_error() ) {
+    bool ready = true;
+    bool reap = false;
+    if ( stream.bytes_buffered() > pinned ) {
+      const size_t sent = socket.write_zerocopy( stream.peek().substr( pinned ) );
+      pinned += sent;
+      if ( sent == 0 ) {
+        // (the socket is full, or its completions are waiting to be read)
+        if ( socket.zerocopy_pending() ) {
+          ready = co_await socket.error_queue();
+          reap = true;
+        } else {
+          ready = co_await socket.writable();
+        }
       }
-    },
-    [&] {
-      return _outbound.reader().bytes_buffered() or ( _outbound.reader().is_finished() and not _outbound_shutdown );
-    },
-    [&] { _outbound.writer().close(); },
-    [&] {
-      cerr << "DEBUG: Outbound stream had error from destination.\n";
-      _outbound.set_error();
-      _inbound.set_error();
-    } );
-
-  // rule 3: read from socket into inbound byte stream
-  _eventloop.add_rule(
-    "read from socket into inbound byte stream",
-    socket,
-    Direction::In,
-    [&] {
-      string data;
-      data.resize( _inbound.writer().available_capacity() );
-      socket.read( data );
-      _inbound.writer().push( move( data ) );
-      if ( socket.eof() ) {
-        _inbound.writer().close();
+    } else if ( socket.zerocopy_pending() ) {
+      ready = co_await socket.error_queue();
+      reap = true;
+    } else if ( pinned ) {
+      stream.pop( pinned );
+      pinned = 0;
+    } else if ( stream.is_finished() ) {
+      finish();
+      break;
+    } else {
+      co_await stream.data();
+    }
+
+    if ( not ready ) {
+      cerr << error_message;
+      copy.fail();
+      break;
+    }
+    if ( reap ) {
+      socket.reap_zerocopy();
+    }
+  }
+  copy.drained();
+}
+
+//! One direction of the copy
+struct Leg
+{
+  FileDescriptor& source;
+  FileDescriptor& destination;
+  ByteStream& stream; //!< (only if the copy falls back to read_into and write_from)
+  function<void()> finish;
+  string source_error;
+  string destination_error;
+};
+
+//! Copies through a ByteStream: read_into, and write_from (or write_zerocopy_from, to a `zerocopy` socket)
+void spawn_buffered( Leg& leg, Copy& copy, Socket* zerocopy = nullptr )
+{
+  copy.scheduler.spawn( read_into( leg.source, leg.stream.writer(), copy, leg.source_error ) );
+  if ( zerocopy ) {
+    copy.scheduler.spawn(
+      write_zerocopy_from( leg.stream.reader(), *zerocopy, copy, leg.finish, leg.destination_error ) );
+  } else {
+    copy.scheduler.spawn(
+      write_from( leg.stream.reader(), leg.destination, copy, leg.finish, leg.destination_error ) );
+  }
+}
+
+//! Moves `leg.source` to `leg.destination` through a pipe with splice() until EOF (then calls `leg.finish`), or
+//! fails. If either fd cannot splice, the bytes in the pipe go to `leg.stream`, and read_into and write_from take
+//! over.
+Task splice_relay( Leg& leg, Copy& copy )
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe2", ::pipe2( fds.data(), O_NONBLOCK ) );
+  FileDescriptor pipe_out { fds[0] };
+  FileDescriptor pipe_in { fds[1] };
+
+  // (the pipe holds no more than the stream that may have to take its contents)
+  const size_t capacity = leg.stream.writer().available_capacity();
+  const int pipe_size = ::fcntl( fds[1], F_SETPIPE_SZ, static_cast<int>( capacity ) ); // NOLINT(*-vararg)
+  const size_t chunk = pipe_size > 0 ? min<size_t>( pipe_size, capacity ) : 65536;
+
+  size_t in_pipe = 0;
+  bool fall_back = false;
+  while ( not copy.failed() ) {
+    size_t moved = 0;
+    try {
+      moved = in_pipe ? pipe_out.splice( leg.destination, in_pipe ) : leg.source.splice( pipe_in, chunk );
+    } catch ( const unix_error& e ) {
+      if ( e.code().value() != EINVAL ) {
+        throw;
       }
-    },
-    [&] {
-      return !_inbound.has_error() and !_outbound.has_error() and ( _inbound.writer().available_capacity() > 0 )
-             and !_inbound.writer().is_closed();
-    },
-    [&] { _inbound.writer().close(); },
-    [&] {
-      cerr << "DEBUG: Inbound stream had error from source.\n";
-      _outbound.set_error();
-      _inbound.set_error();
-    } );
-
-  // rule 4: read from inbound byte stream into stdout
-  _eventloop.add_rule(
-    "read from inbound byte stream into stdout",
-    _output,
-    Direction::Out,
-    [&] {
-      if ( _inbound.reader().bytes_buffered() ) {
-        _inbound.reader().pop( _output.write( _inbound.reader().peek() ) );
+      fall_back = true;
+      break;
+    }
+
+    if ( in_pipe ) {
+      in_pipe -= moved;
+      if ( moved == 0 ) {
+        const bool writable = co_await leg.destination.writable();
+        if ( not writable ) {
+          cerr << leg.destination_error;
+          copy.fail();
+          break;
+        }
       }
-      if ( _inbound.reader().is_finished() ) {
-        _output.close();
-        _inbound_shutdown = true;
-        cerr << "DEBUG: Inbound stream from " << peer_name << " finished"
-             << ( _inbound.has_error() ? " uncleanly.\n" : ".\n" );
+    } else if ( leg.source.eof() ) {
+      leg.finish();
+      break;
+    } else if ( moved == 0 ) {
+      const bool readable = co_await leg.source.readable();
+      if ( not readable ) {
+        cerr << leg.source_error;
+        copy.fail();
+        break;
       }
-    },
-    [&] {
-      return _inbound.reader().bytes_buffered() or ( _inbound.reader().is_finished() and not _inbound_shutdown );
-    },
-    [&] { _inbound.writer().close(); },
-    [&] {
-      cerr << "DEBUG: Inbound stream had error from destination.\n";
-      _outbound.set_error();
-      _inbound.set_error();
-    } );
-
-  // loop until completion
-  while ( true ) {
-    if ( EventLoop::Result::Exit == _eventloop.wait_next_event( -1 ) ) {
-      return;
+    } else {
+      in_pipe = moved;
     }
   }
+
+  if ( not fall_back ) {
+    copy.drained();
+    co_return;
+  }
+
+  while ( in_pipe ) {
+    string data( in_pipe, 0 );
+    pipe_out.read( data );
+    in_pipe -= data.size();
+    leg.stream.writer().push( move( data ) );
+  }
+  spawn_buffered( leg, copy );
+}
+
+} // namespace
+
+void bidirectional_stream_copy( Socket& socket,
+                                string_view peer_name,
+                                FileDescriptor&& input,
+                                FileDescriptor&& output,
+                                EventLoop& eventloop,
+                                const StreamCopyMode mode )
+{
+  constexpr size_t buffer_size = 1048576;
+
+  Scheduler scheduler { eventloop };
+  FileDescriptor _input { move( input ) };
+  FileDescriptor _output { move( output ) };
+  Copy copy { ByteStream { buffer_size }, ByteStream { buffer_size }, scheduler };
+
+  socket.set_blocking( false );
+  _input.set_blocking( false );
+  _output.set_blocking( false );
+
+  // stdin -> outbound -> socket, and socket -> inbound -> stdout
+  array<Leg, 2> legs { Leg { _input,
+                             socket,
+                             copy.outbound,
+                             [&] {
+                               socket.shutdown( SHUT_WR );
+                               cerr << "DEBUG: Outbound stream to " << peer_name << " finished.\n";
+                             },
+                             "DEBUG: Outbound stream had error from source.\n",
+                             "DEBUG: Outbound stream had error from destination.\n" },
+                       Leg { socket,
+                             _output,
+                             copy.inbound,
+                             [&] {
+                               _output.close();
+                               cerr << "DEBUG: Inbound stream from " << peer_name << " finished"
+                                    << ( copy.inbound.has_error() ? " uncleanly.\n" : ".\n" );
+                             },
+                             "DEBUG: Inbound stream had error from source.\n",
+                             "DEBUG: Inbound stream had error from destination.\n" } };
+
+  switch ( mode ) {
+    case StreamCopyMode::Buffered:
+      spawn_buffered( legs[0], copy );
+      spawn_buffered( legs[1], copy );
+      break;
+    case StreamCopyMode::ZeroCopy:
+      spawn_buffered( legs[0], copy, socket.enable_zerocopy() ? &socket : nullptr );
+      spawn_buffered( legs[1], copy );
+      break;
+    case StreamCopyMode::Splice:
+      scheduler.spawn( splice_relay( legs[0], copy ) );
+      scheduler.spawn( splice_relay( legs[1], copy ) );
+      break;
+  }
+
+  scheduler.run();
 }
@@ -1,6 +1,28 @@
 #pragma once
 
+#include "eventloop.hh"
 #include "socket.hh"
 
+//! How bidirectional_stream_copy moves the bytes
+enum class StreamCopyMode
+{
+  Buffered, //!< read into a ByteStream, and write from it
+  ZeroCopy, //!< the same, but the socket sends from the ByteStream with MSG_ZEROCOPY (Socket::write_zerocopy)
+  Splice    //!< through a pipe with splice(2), never copying the bytes into userspace
+};
+
 //! Copy socket input/output to stdin/stdout until finished
-void bidirectional_stream_copy( Socket& socket, std::string_view peer_name );
+//! \details Splice is for kernel sockets, pipes and files; a direction whose fds cannot splice falls back to
+//! copying through a ByteStream. ZeroCopy is for kernel TCP and UDP sockets; without it, the socket is written as
+//! in Buffered mode. Its bytes stay in the ByteStream until their sends complete.
+void bidirectional_stream_copy( Socket& socket,
+                                std::string_view peer_name,
+                                StreamCopyMode mode = StreamCopyMode::Buffered );
+
+//! Copy socket input/output to `input`/`output` until finished, using `eventloop` (which should have no rules)
+void bidirectional_stream_copy( Socket& socket,
+                                std::string_view peer_name,
+                                FileDescriptor&& input,
+                                FileDescriptor&& output,
+                                EventLoop& eventloop,
+                                StreamCopyMode mode = StreamCopyMode::Buffered );
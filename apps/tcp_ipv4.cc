@@ -3,6 +3,7 @@
 #include "tcp_minnow_socket.hh"
 #include "tun.hh"
 
+#include <csignal>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
@@ -158,6 +159,10 @@ int main( int argc, char** argv )
     }
 
     auto [c_fsm, c_filt, listen, tun_dev_name] = get_config( args );
+
+    // `kill -USR1` prints where each event loop's time goes
+    EventLoop::dump_summaries_on( SIGUSR1 );
+
     LossyTCPOverIPv4MinnowSocket tcp_socket( LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>(
       TCPOverIPv4OverTunFdAdapter( TunFD( tun_dev_name == nullptr ? TUN_DFLT : tun_dev_name ) ) ) );
 
@@ -1,31 +1,61 @@
+#include "async.hh"
 #include "socket.hh"
 #include "tcp_minnow_socket.hh"
 
 #include <cstdlib>
 #include <iostream>
 #include <span>
+#include <stdexcept>
 #include <string>
 
 using namespace std;
 
+// Sends the request, then reads the response until the server closes the connection
+Task fetch( CS144TCPSocket& client, string request, string& response )
+{
+  for ( size_t sent = 0; sent < request.size(); ) {
+    const size_t written = client.write( string_view { request }.substr( sent ) );
+    if ( written == 0 ) {
+      const bool writable = co_await client.writable();
+      if ( not writable ) {
+        throw runtime_error( "connection failed while sending the request" );
+      }
+    }
+    sent += written;
+  }
+
+  string buffer;
+  while ( not client.eof() ) {
+    buffer.clear();
+    client.read( buffer );
+    if ( buffer.empty() and not client.eof() ) {
+      const bool readable = co_await client.readable(); // nothing has arrived yet
+      if ( not readable ) {
+        throw runtime_error( "connection failed while reading the response" );
+      }
+    }
+    response += buffer; // Append new data to the complete response
+  }
+}
+
 void get_URL( const std::string& host, const std::string& path )
 {
   CS144TCPSocket client;
   Address server( host, "http" ); // Port should be 80 by default for HTTP
 
   client.connect( server );
+  client.set_blocking( false );
 
   // Properly formatted HTTP GET request
-  client.write( "GET " + path + " HTTP/1.1\r\n" );
-  client.write( "Host: " + host + "\r\n" );
-  client.write( "Connection: close\r\n\r\n" ); // Note the double \r\n
+  string request = "GET " + path + " HTTP/1.1\r\n";
+  request += "Host: " + host + "\r\n";
+  request += "Connection: close\r\n\r\n"; // Note the double \r\n
 
   std::string response;
-  std::string buffer;
-  while ( !client.eof() ) {
-    client.read( buffer );
-    response += buffer; // Append new data to the complete response
-  }
+  EventLoop eventloop;
+  Scheduler scheduler { eventloop };
+  scheduler.spawn( fetch( client, move( request ), response ) );
+  scheduler.run();
 
   std::cout << response;
   client.close();
@@ -6,3 +6,10 @@ set(SANITIZING_FLAGS -fno-sanitize-recover=all -fsanitize=undefined -fsanitize=a
 # ask for more warnings from the compiler
 set (CMAKE_BASE_CXX_FLAGS "${CMAKE_CXX_FLAGS}")
 set (CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -Wall -Wpedantic -Wextra -Weffc++ -Werror -Wshadow -Wpointer-arith -Wcast-qual -Wformat=2 -Wno-unqualified-std-cast-call -Wno-non-virtual-dtor")
+
+# time EventLoop callbacks and waits per rule category (see EventLoop::summary); off by default, since it reads
+# the clock around every callback and wait (configure with -DMINNOW_EVENTLOOP_PROFILING=ON to turn it on)
+option(MINNOW_EVENTLOOP_PROFILING "Profile EventLoop rule categories" OFF)
+if (MINNOW_EVENTLOOP_PROFILING)
+  add_compile_definitions(MINNOW_EVENTLOOP_PROFILING)
+endif()
@@ -45,6 +45,7 @@ ttest(recv_reorder)
 ttest(recv_reorder_more)
 ttest(recv_close)
 ttest(recv_special)
+ttest(recv_batch)
 
 ttest(send_connect)
 ttest(send_transmit)
@@ -53,6 +54,20 @@ ttest(send_window)
 ttest(send_ack)
 ttest(send_close)
 ttest(send_extra)
+ttest(send_gso)
+ttest(tcp_peer_batch)
+
+ttest(tcp_stack)
+ttest(timer_wheel)
+ttest(eventloop)
+ttest(async)
+ttest(sharded_eventloop)
+ttest(buffer_pool)
+ttest(shared_buffer)
+ttest(packet_buffer)
+ttest(header_layout)
+ttest(checksum)
+ttest(tcp_over_udp)
 
 ttest(net_interface)
 
@@ -90,3 +105,18 @@ set_tests_properties(${compile_name_opt} PROPERTIES FIXTURES_SETUP compile_opt)
 
 stest(byte_stream_speed_test)
 stest(reassembler_speed_test)
+stest(recv_batch_speed_test)
+stest(tcp_header_speed_test)
+stest(parser_speed_test)
+stest(header_parse_speed_test)
+stest(checksum_speed_test)
+stest(tcp_stack_speed_test)
+stest(timer_wheel_speed_test)
+stest(minnow_socket_timer_speed_test)
+stest(eventloop_speed_test)
+stest(eventloop_datagram_speed_test)
+stest(syn_flood_speed_test)
+stest(stream_copy_speed_test)
+stest(sharded_eventloop_speed_test)
+stest(tun_offload_speed_test)
+stest(packet_ring_speed_test)
@@ -11,7 +11,7 @@ bool Writer::is_closed() const
   return close_;
 }
 
-void Writer::push( std::string data )
+void Writer::push( std::string_view data )
 {
   if ( has_error() ) {
     close();
@@ -37,12 +37,19 @@ protected:
 class Writer : public ByteStream
 {
 public:
-  void push( std::string data ); // Push data to stream, but only as much as available capacity allows.
-  void close();                  // Signal that the stream has reached its ending. Nothing more will be written.
+  void push( std::string_view data ); // Push data to stream, but only as much as available capacity allows.
+  void close();                       // Signal that the stream has ended. Nothing more will be written.
 
   bool is_closed() const;              // Has the stream been closed?
   uint64_t available_capacity() const; // How many bytes can be pushed to the stream right now?
   uint64_t bytes_pushed() const;       // Total number of bytes cumulatively pushed to the stream
+
+  // Awaitable (see util/async.hh): resumes once there is capacity (or the stream is closed or has an error)
+  struct Space
+  {
+    const Writer& writer;
+  };
+  Space space() const { return { *this }; }
 };
 
 class Reader : public ByteStream
@@ -54,6 +61,13 @@ public:
   bool is_finished() const;        // Is the stream finished (closed and fully popped)?
   uint64_t bytes_buffered() const; // Number of bytes currently buffered (pushed and not popped)
   uint64_t bytes_popped() const;   // Total number of bytes cumulatively popped from stream
+
+  // Awaitable (see util/async.hh): resumes once bytes are buffered (or the stream is finished or has an error)
+  struct Data
+  {
+    const Reader& reader;
+  };
+  Data data() const { return { *this }; }
 };
 
 /*
@@ -39,11 +39,10 @@ void NetworkInterface::send_datagram( const InternetDatagram& dgram, const Addre
     return;
   }
 
-  // 如果未知目标以太网地址，发送ARP请求
-  if ( ( ( currentTime - recent_arp_requests[next_hop_ip] ) >= 5 * 1000 )
-       || ( !recent_arp_requests[next_hop_ip] && !currentTime ) ) {
+  // 如果未知目标以太网地址，且5秒内没有请求过，发送ARP请求
+  if ( !recent_arp_requests.contains( next_hop_ip ) ) {
     send_arp_request( next_hop_ip );
-    recent_arp_requests[next_hop_ip] = currentTime;
+    recent_arp_requests[next_hop_ip] = timers_.schedule( 5 * 1000, { .ip = next_hop_ip } );
   }
 
   // 待排队发送的的数据报
@@ -72,9 +71,7 @@ void NetworkInterface::recv_frame( const EthernetFrame& frame )
     // 处理ARP帧
     ARPMessage arp_msg;
     if ( parse( arp_msg, frame.payload ) ) {
-      ipToEthernetMap[arp_msg.sender_ip_address] = arp_msg.sender_ethernet_address;
-
-      recent_arp_requests[arp_msg.sender_ip_address] = currentTime;
+      learn_mapping( arp_msg.sender_ip_address, arp_msg.sender_ethernet_address );
       // 如果是ARP请求并且目标是我们的IP地址，发送ARP回复
       if ( reply_arp_request( arp_msg ) ) {
         return;
@@ -91,16 +88,28 @@ void NetworkInterface::recv_frame( const EthernetFrame& frame )
 //! \param[in] ms_since_last_tick 自上次调用此方法以来的毫秒数
 void NetworkInterface::tick( const size_t ms_since_last_tick )
 {
-  currentTime += ms_since_last_tick;
-  for ( auto it = recent_arp_requests.begin(); it != recent_arp_requests.end(); ) {
-    // ARP映射记录时间超过30秒删除
-    if ( it->second + 30 * 1000 <= currentTime ) {
-      ipToEthernetMap.erase( it->first );
-      it = recent_arp_requests.erase( it );
-      currentTime = 0;
+  // 只有到期的定时器会被处理（映射过期、ARP请求可以重发）
+  timers_.advance( ms_since_last_tick, [this]( ArpTimer&& timer ) {
+    if ( timer.mapping_expired ) {
+      ipToEthernetMap.erase( timer.ip );
     } else {
-      ++it;
+      recent_arp_requests.erase( timer.ip );
     }
+  } );
+}
+
+// 学习映射：重新学习时刷新30秒的过期时间
+void NetworkInterface::learn_mapping( uint32_t ip, const EthernetAddress& ethernet_address )
+{
+  auto& mapping = ipToEthernetMap[ip];
+  mapping.ethernet_address = ethernet_address;
+  timers_.cancel( mapping.expiry );
+  mapping.expiry = timers_.schedule( 30 * 1000, { .ip = ip, .mapping_expired = true } );
+
+  // 已知映射后不再需要等待ARP请求
+  if ( auto it = recent_arp_requests.find( ip ); it != recent_arp_requests.end() ) {
+    timers_.cancel( it->second );
+    recent_arp_requests.erase( it );
   }
 }
 
@@ -110,11 +119,11 @@ bool NetworkInterface::create_IPv4frame( const InternetDatagram& dgram, uint32_t
   auto it = ipToEthernetMap.find( next_hop );
   if ( it != ipToEthernetMap.end() ) {
     frame.header.type = EthernetHeader::TYPE_IPv4;
-    frame.header.dst = it->second;
+    frame.header.dst = it->second.ethernet_address;
     frame.header.src = ethernet_address_;
 
     // 序列化IPv4
-    frame.payload = serialize( dgram );
+    frame.payload = serialize_payload( dgram );
     return true;
   }
   return false; // 返回 false 表示没有找到对应的以太网地址
@@ -131,7 +140,7 @@ bool NetworkInterface::create_ARPframe( const ARPMessage& arp_msg )
       frame_.header.type = EthernetHeader::TYPE_IPv4;
       frame_.header.src = ethernet_address_;
       frame_.header.dst = arp_msg.sender_ethernet_address;
-      frame_.payload = serialize( it->second );
+      frame_.payload = serialize_payload( it->second );
       transmit( frame_ );
       waiting_datagrams_.erase( it );
     }
@@ -161,9 +170,7 @@ void NetworkInterface::send_arp_request( uint32_t next_hop_ip )
   frame.header.type = EthernetHeader::TYPE_ARP;
 
   // 序列化ARP请求
-  Serializer serializer;
-  arp_request.serialize( serializer );
-  frame.payload = serializer.output();
+  frame.payload = serialize_payload( arp_request );
 
   transmit( frame );
 }
@@ -184,7 +191,7 @@ bool NetworkInterface::reply_arp_request( const ARPMessage& arp_msg )
     reply_frame.header.type = EthernetHeader::TYPE_ARP;
     reply_frame.header.src = ethernet_address_;
     reply_frame.header.dst = arp_msg.sender_ethernet_address;
-    reply_frame.payload = serialize( arp_reply );
+    reply_frame.payload = serialize_payload( arp_reply );
     transmit( reply_frame );
     return true;
   } else {
@@ -197,8 +204,7 @@ void NetworkInterface::prints()
   cout << "当前所有映射 " << endl;
   for ( auto it = ipToEthernetMap.begin(); it != ipToEthernetMap.end(); it++ ) {
     cout << "IP序列:  " << it->first << endl;
-    cout << "MAC地址: " << to_string( it->second ) << endl;
-    cout << "对应时间" << recent_arp_requests[it->first] << endl;
-    cout << "当前时间" << currentTime << endl;
+    cout << "MAC地址: " << to_string( it->second.ethernet_address ) << endl;
+    cout << "当前时间" << timers_.now() << endl;
   }
 }
\ No newline at end of file
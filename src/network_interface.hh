@@ -5,6 +5,7 @@
 #include "arp_message.hh"
 #include "ethernet_frame.hh"
 #include "ipv4_datagram.hh"
+#include "timer_wheel.hh"
 #include <memory>
 #include <queue>
 #include <unordered_map>
@@ -65,6 +66,9 @@ private:
   // 发送ARP请求获取目标MAC地址
   void send_arp_request( uint32_t next_hop_ip );
 
+  // 学习IP到以太网地址的映射，30秒后过期
+  void learn_mapping( uint32_t ip, const EthernetAddress& ethernet_address );
+
   bool reply_arp_request( const ARPMessage& arp_msg );
 
   void prints();
@@ -85,15 +89,27 @@ private:
   // 已接收的数据报
   std::queue<InternetDatagram> datagrams_received_ {};
 
-  // ARP映射
-  std::unordered_map<uint32_t, EthernetAddress> ipToEthernetMap;
+  // 定时器到期时要处理的事件：映射过期，或者ARP请求可以重发
+  struct ArpTimer
+  {
+    uint32_t ip {};
+    bool mapping_expired {};
+  };
+
+  // ARP映射（以太网地址及其过期定时器）
+  struct Mapping
+  {
+    EthernetAddress ethernet_address {};
+    TimerWheel<ArpTimer>::Handle expiry {};
+  };
+  std::unordered_map<uint32_t, Mapping> ipToEthernetMap;
 
-  // ARP请求时间队列
-  std::unordered_map<uint32_t, uint64_t> recent_arp_requests;
+  // 5秒内已发送过的ARP请求（到期前不重复发送）
+  std::unordered_map<uint32_t, TimerWheel<ArpTimer>::Handle> recent_arp_requests;
 
   // 等待发送的数据报
   std::unordered_map<uint32_t, InternetDatagram> waiting_datagrams_;
 
-  // 当前时间
-  uint64_t currentTime = 0;
+  // 定时器：tick只处理到期的映射和ARP请求，而不是扫描全部
+  TimerWheel<ArpTimer> timers_ {};
 };
@@ -160,7 +160,19 @@ void Reassembler::push_buffer_data()
     buffer_.erase( it_++ );
   }
 }
-void Reassembler::insert( uint64_t first_index, string data, bool is_last_substring )
+/*
+ * 功能：插入一个子串。收到的 payload 是读入缓冲区的视图：能直接写入输出流时不做拷贝，
+ *       否则拷贝成 string 暂存。
+ */
+void Reassembler::insert( uint64_t first_index, SharedBuffer data, bool is_last_substring )
+{
+  if ( push_in_order( first_index, { &data, 1 }, is_last_substring ) ) {
+    return;
+  }
+  insert_owned( first_index, static_cast<string>( data ), is_last_substring );
+}
+
+void Reassembler::insert_owned( uint64_t first_index, string data, bool is_last_substring )
 {
   uint64_t unpopped_index = output_.writer().getUnpoppedIndex();
   uint64_t capacity_index = unpopped_index + output_.writer().getCapacity();
@@ -181,6 +193,56 @@ void Reassembler::insert( uint64_t first_index, string data, bool is_last_substr
   }
 }
 
+/*
+ * 功能：插入由多个首尾相接的片段组成的子串。
+ *       若子串正好从下一个待组装字节开始、缓冲区为空且容量足够，则逐段直接写入输出流，
+ *       否则拼接后走常规 insert 路径。
+ */
+void Reassembler::insert( uint64_t first_index, vector<SharedBuffer> pieces, bool is_last_substring )
+{
+  if ( push_in_order( first_index, pieces, is_last_substring ) ) {
+    return;
+  }
+
+  string data;
+  for ( const auto& piece : pieces ) {
+    data.append( piece );
+  }
+  insert_owned( first_index, std::move( data ), is_last_substring );
+}
+
+/*
+ * 功能：若子串正好从下一个待组装字节开始、缓冲区为空且容量足够，则逐段直接写入输出流。
+ * @return 是否已写入（否则由调用者走常规路径）
+ */
+bool Reassembler::push_in_order( uint64_t first_index, span<const SharedBuffer> pieces, bool is_last_substring )
+{
+  uint64_t total_size = 0;
+  for ( const auto& piece : pieces ) {
+    total_size += piece.size();
+  }
+
+  const uint64_t capacity_index = output_.writer().getUnpoppedIndex() + output_.writer().getCapacity();
+
+  if ( !total_size || !buffer_.empty() || first_index != unassemble_index
+       || total_size > output_.writer().available_capacity() ) {
+    return false;
+  }
+
+  for ( const auto& piece : pieces ) {
+    output_.writer().push( piece );
+  }
+  unassemble_index += total_size;
+
+  if ( is_last_substring && first_index + total_size <= capacity_index - 1 ) {
+    eof = true;
+  }
+  if ( eof ) {
+    output_.writer().close();
+  }
+  return true;
+}
+
 uint64_t Reassembler::bytes_pending() const
 {
   uint64_t bytes = 0;
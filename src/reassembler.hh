@@ -1,7 +1,12 @@
 #pragma once
 
 #include "byte_stream.hh"
+#include "shared_buffer.hh"
 #include <map>
+#include <span>
+#include <string>
+#include <vector>
+
 class Reassembler
 {
 public:
@@ -28,7 +33,14 @@ public:
    *
    * The Reassembler should close the stream after writing the last byte.
    */
-  void insert( uint64_t first_index, std::string data, bool is_last_substring );
+  void insert( uint64_t first_index, SharedBuffer data, bool is_last_substring );
+
+  /*
+   * Insert a substring that arrives as several contiguous pieces (e.g. coalesced TCP segments).
+   * Equivalent to inserting the concatenation of `pieces`, but avoids building that concatenation
+   * when the pieces can be written straight to the output.
+   */
+  void insert( uint64_t first_index, std::vector<SharedBuffer> pieces, bool is_last_substring );
 
   // How many bytes are stored in the Reassembler itself?
   uint64_t bytes_pending() const;
@@ -41,6 +53,11 @@ public:
   const Writer& writer() const { return output_.writer(); }
 
 private:
+  // 乱序、越界或重叠的子串：拷贝成自己的 string 暂存
+  void insert_owned( uint64_t first_index, std::string data, bool is_last_substring );
+  // 子串正好从下一个待组装字节开始、缓冲区为空且容量足够时，直接写入输出流（不拷贝成 string）
+  bool push_in_order( uint64_t first_index, std::span<const SharedBuffer> pieces, bool is_last_substring );
+
   bool merge_prev( uint64_t& first, uint64_t& end, std::string& data );
   bool merge_next( uint64_t& first, uint64_t& end, std::string& data );
   bool delete_repeating( uint64_t& first, uint64_t& end );
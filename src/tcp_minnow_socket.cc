@@ -4,3 +4,8 @@
 template class TCPMinnowSocket<TCPOverIPv4OverTunFdAdapter>;
 
 template class TCPMinnowSocket<LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>>;
+
+//! Specializations of TCPMinnowSocket for TCPOverUDPSocketAdapter and its lossy version
+template class TCPMinnowSocket<TCPOverUDPSocketAdapter>;
+
+template class TCPMinnowSocket<LossyFdAdapter<TCPOverUDPSocketAdapter>>;
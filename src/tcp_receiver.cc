@@ -15,14 +15,33 @@ using namespace std;
  *
  */
 void TCPReceiver::receive( TCPSenderMessage message )
+{
+  const optional<uint64_t> first_index = stream_index( message );
+  if ( !first_index.has_value() ) {
+    return;
+  }
+
+  // 插入到btyestream
+  reassembler_.insert( first_index.value(), move( message.payload ), message.FIN );
+
+  update_ackno();
+}
+
+/**
+ * 目的：处理消息的 RST/SYN 标志，并计算 payload 第一个字节在字节流中的索引。
+ *
+ * @param message 收到的TCP消息（若带SYN，其序列号会被调整到payload的第一个字节）
+ * @return payload 首字节的流索引；若该段应被丢弃，则返回空
+ */
+optional<uint64_t> TCPReceiver::stream_index( TCPSenderMessage& message )
 {
   // 直接检查和处理 RST 标志
   if ( message.RST ) {
     reassembler_.reader().set_error();
     RST_ = reassembler_.reader().has_error();
-    return;
+    return {};
   } else if ( RST_ ) {
-    return;
+    return {};
   }
 
   // 处理 SYN 标志
@@ -34,25 +53,22 @@ void TCPReceiver::receive( TCPSenderMessage message )
 
   // 如果 zero_point 尚未设置，则不继续执行
   if ( !is_zero_point_set ) {
-    return;
+    return {};
   }
 
   // 获取当前数据首绝对序列号 ( >0 ) 已排除SYN
-  uint64_t first_index = message.seqno.unwrap( zero_point, reassembler_.writer().bytes_pushed() );
+  const uint64_t first_index = message.seqno.unwrap( zero_point, reassembler_.writer().bytes_pushed() );
 
   // 如果为0，说明当前数据报payload序列号在SYN的位置，无效
   if ( first_index == 0 ) {
-    return;
-  } else {
-    first_index--;
+    return {};
   }
+  return first_index - 1;
+}
 
-  bool FIN = message.FIN;
-
-  // 插入到btyestream
-  reassembler_.insert( first_index, message.payload, FIN );
-
-  // 下一个相对序列号
+// 更新下一个相对序列号
+void TCPReceiver::update_ackno()
+{
   next_ackno
     = zero_point + is_zero_point_set + reassembler_.writer().bytes_pushed() + reassembler_.writer().is_closed();
 }
@@ -84,3 +100,47 @@ TCPReceiverMessage TCPReceiver::send() const
 
   return ReceiverMessage;
 }
+
+/**
+ * 目的：批量处理一次读取到的多个TCP消息（软件GRO）。
+ * 功能：把序列号首尾相接的连续段合并为一次 Reassembler::insert（各段 payload 不做拼接拷贝），
+ *       整个区间只计算一次 ackno。带有 SYN/RST 的段或 FIN 之后的段不参与合并，按原样交给 receive() 处理。
+ *
+ * @param messages 同一次突发读取到的TCP消息（按到达顺序）
+ */
+void TCPReceiver::receive_batch( vector<TCPSenderMessage> messages )
+{
+  for ( size_t first = 0; first < messages.size(); ) {
+    // 找出从 first 开始可以合并的最长连续区间 [first, last)
+    size_t last = first + 1;
+    Wrap32 next_seqno = messages[first].seqno + messages[first].sequence_length();
+    bool can_extend = !messages[first].RST && !messages[first].FIN;
+    while ( can_extend && last < messages.size() ) {
+      const TCPSenderMessage& next = messages[last];
+      if ( next.SYN || next.RST || !( next.seqno == next_seqno ) ) {
+        break;
+      }
+      next_seqno = next_seqno + next.sequence_length();
+      can_extend = !next.FIN;
+      ++last;
+    }
+
+    if ( last == first + 1 ) {
+      receive( move( messages[first] ) );
+      first = last;
+      continue;
+    }
+
+    const optional<uint64_t> first_index = stream_index( messages[first] );
+    if ( first_index.has_value() ) {
+      vector<SharedBuffer> pieces;
+      pieces.reserve( last - first );
+      for ( size_t i = first; i < last; ++i ) {
+        pieces.push_back( move( messages[i].payload ) );
+      }
+      reassembler_.insert( first_index.value(), move( pieces ), messages[last - 1].FIN );
+      update_ackno();
+    }
+    first = last;
+  }
+}
@@ -4,6 +4,9 @@
 #include "tcp_receiver_message.hh"
 #include "tcp_sender_message.hh"
 
+#include <optional>
+#include <vector>
+
 class TCPReceiver
 {
 public:
@@ -16,6 +19,13 @@ public:
    */
   void receive( TCPSenderMessage message );
 
+  /*
+   * Receive a burst of TCPSenderMessages (e.g. everything one adapter read returned). Runs of
+   * back-to-back in-sequence segments are coalesced into a single Reassembler insert, and the
+   * ackno is recomputed once per run instead of once per segment.
+   */
+  void receive_batch( std::vector<TCPSenderMessage> messages );
+
   // The TCPReceiver sends TCPReceiverMessages to the peer's TCPSender.
   TCPReceiverMessage send() const;
 
@@ -26,6 +36,12 @@ public:
   const Writer& writer() const { return reassembler_.writer(); }
 
 private:
+  // 处理 RST/SYN 并返回 payload 首字节的流索引（段无效时为空）
+  std::optional<uint64_t> stream_index( TCPSenderMessage& message );
+
+  // 根据已写入的字节数和关闭状态更新 ackno
+  void update_ackno();
+
   Reassembler reassembler_;
 
   // 起始相对序列号
@@ -1,5 +1,4 @@
 #include "tcp_sender.hh"
-#include "tcp_config.hh"
 #include <iostream>
 
 using namespace std;
@@ -25,6 +24,23 @@ uint64_t TCPSender::consecutive_retransmissions() const
   return exponent + is_RTO_double;
 }
 
+bool TCPSender::syn_acked() const
+{
+  // checkout为已确认的绝对序列号，SYN占用绝对序列号0
+  return checkout > 0;
+}
+
+std::optional<uint64_t> TCPSender::ms_until_timeout() const
+{
+  if ( !sequence_numbers_in_flight() ) {
+    return std::nullopt;
+  }
+
+  // 退避在下一次tick时才生效（零窗口时不退避），这里提前算上
+  const uint64_t rto = ( is_RTO_double && window_size_ != 0 ) ? initial_RTO_ms_ * 2 : initial_RTO_ms_;
+  return rto > since_last_send ? rto - since_last_send : 0;
+}
+
 TCPSenderMessage TCPSender::make_empty_message() const
 {
   TCPSenderMessage message;
@@ -45,7 +61,7 @@ void TCPSender::push( const TransmitFunction& transmit )
   uint64_t bytes_to_send = input_.reader().bytes_buffered(); // 总共需要发送的字节长度
   uint64_t payload_len
     = min( { input_.reader().bytes_buffered(),
-             static_cast<uint64_t>( TCPConfig::MAX_PAYLOAD_SIZE ),
+             max_payload_size_,
              static_cast<uint64_t>( window_size_ == 0 ? 1 : window_size_ ) - sequence_numbers_in_flight() } );
 
   TCPSenderMessage message = make_empty_message();
@@ -156,9 +172,9 @@ void TCPSender::tick( uint64_t ms_since_last_tick, const TransmitFunction& trans
 
     is_RTO_double = true;
 
-    // 传输未确认段
+    // 传输未确认段（超级分段只重传一个MSS切片，而不是整个分段）
     if ( !unAckedSegments.empty() ) {
-      transmit( unAckedSegments.begin()->second );
+      transmit( retransmission() );
     }
   }
 }
@@ -206,7 +222,7 @@ void TCPSender::handlePayload( TCPSenderMessage& message )
 {
 
   uint64_t payload_len = min( { input_.reader().bytes_buffered(),
-                                static_cast<uint64_t>( TCPConfig::MAX_PAYLOAD_SIZE ),
+                                max_payload_size_,
                                 static_cast<uint64_t>( window_size_ == 0 ? 1 : window_size_ ) - message.SYN
                                   - sequence_numbers_in_flight() } );
 
@@ -319,11 +335,32 @@ void TCPSender::handle_RTO()
   }
 }
 
+// 超时重传的分段
+TCPSenderMessage TCPSender::retransmission() const
+{
+  const auto& [start, segment] = *unAckedSegments.begin();
+  if ( segment.payload.size() <= mss_ ) {
+    return segment;
+  }
+
+  // 跳过已被完整确认的切片（切片的边界与适配器切分线上分段时相同：SYN在第一片，FIN在最后一片）
+  const uint64_t acked = checkout > start ? checkout - start : 0;
+  const uint64_t acked_payload = acked > segment.SYN ? acked - segment.SYN : 0;
+  const uint64_t slice = min( acked_payload / mss_, ( segment.payload.size() - 1 ) / mss_ );
+
+  TCPSenderMessage message = segment;
+  message.seqno = segment.seqno + static_cast<uint32_t>( slice == 0 ? 0 : segment.SYN + slice * mss_ );
+  message.SYN = segment.SYN && slice == 0;
+  message.payload = segment.payload.substr( slice * mss_, mss_ );
+  message.FIN = segment.FIN && ( slice + 1 ) * mss_ >= segment.payload.size();
+  return message;
+}
+
 void print( TCPSenderMessage message )
 {
   std::cout << "Current Sequence Number: " << message.seqno.getuint32_t() << std::endl;
   std::cout << "SYN: " << ( message.SYN ? "true" : "false" ) << std::endl;
-  std::cout << "payload: " << message.payload << std::endl;
+  std::cout << "payload: " << message.payload.view() << std::endl;
   std::cout << "FIN: " << ( message.FIN ? "true" : "false" ) << std::endl;
   std::cout << "RST: " << ( message.RST ? "true" : "false" ) << std::endl;
   std::cout << "sequence_length: " << message.sequence_length() << std::endl;
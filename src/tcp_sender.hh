@@ -1,6 +1,7 @@
 #pragma once
 
 #include "byte_stream.hh"
+#include "tcp_config.hh"
 #include "tcp_receiver_message.hh"
 #include "tcp_sender_message.hh"
 
@@ -16,11 +17,19 @@ class TCPSender
 {
 public:
   /* 用给定的默认重传超时时间和可能的初始序列号构造TCP发送者 */
-  TCPSender( ByteStream&& input, Wrap32 isn, uint64_t initial_RTO_ms )
+  /* max_payload_size 为单个消息的最大负载；开启GSO时可大于MSS，由数据报适配器切分成线上分段 */
+  /* mss 为单个线上分段的最大负载：超时重传时超级分段只重传其中一个MSS大小的切片 */
+  TCPSender( ByteStream&& input,
+             Wrap32 isn,
+             uint64_t initial_RTO_ms,
+             uint64_t max_payload_size = TCPConfig::MAX_PAYLOAD_SIZE,
+             uint64_t mss = TCPConfig::MAX_PAYLOAD_SIZE )
     : input_( std::move( input ) )
     , isn_( isn )
     , initial_RTO_ms_( initial_RTO_ms )
     , raw_RTO_ms( initial_RTO_ms )
+    , max_payload_size_( max_payload_size )
+    , mss_( mss )
     , currentSeqNum_( isn )
     , last_Ack_Seq( isn )
     , window_size_( 2 )
@@ -45,6 +54,10 @@ public:
   // 访问器
   uint64_t sequence_numbers_in_flight() const;  // 当前有多少序列号未确认？
   uint64_t consecutive_retransmissions() const; // 发生了多少次连续的重传？
+  bool syn_acked() const;                       // 对端是否已确认SYN？
+
+  // 距离重传定时器到期还有多少毫秒（没有在途数据时没有定时器）
+  std::optional<uint64_t> ms_until_timeout() const;
   Writer& writer() { return input_.writer(); }
   const Writer& writer() const { return input_.writer(); }
 
@@ -97,11 +110,16 @@ private:
   //  TCP 使用指数退避策略来调整重传超时时间
   void handle_RTO();
 
+  // 超时重传的分段：最早未确认分段中第一个未被完整确认的MSS切片（与适配器切分出的线上分段相同）
+  TCPSenderMessage retransmission() const;
+
   // 构造函数中初始化的变量
-  ByteStream input_;        // 输入流
-  Wrap32 isn_;              // 初始序列号
-  uint64_t initial_RTO_ms_; // 重传超时时间（毫秒）
-  uint64_t raw_RTO_ms;      // 初始重传超时时间（毫秒
+  ByteStream input_;          // 输入流
+  Wrap32 isn_;                // 初始序列号
+  uint64_t initial_RTO_ms_;   // 重传超时时间（毫秒）
+  uint64_t raw_RTO_ms;        // 初始重传超时时间（毫秒
+  uint64_t max_payload_size_; // 单个消息的最大负载（字节）
+  uint64_t mss_;              // 单个线上分段的最大负载（字节）
 
   Wrap32 currentSeqNum_;              // 当前发送数据分段的序列号
   std::optional<Wrap32> last_Ack_Seq; // 上一个发送数据分段的序列号
@@ -0,0 +1,412 @@
+#include "tcp_stack.hh"
+
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "random.hh"
+#include "tcp_segment.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+Address to_address( uint32_t ip, uint16_t port )
+{
+  return Address { Address::from_ipv4_numeric( ip ).ip(), port };
+}
+
+uint64_t mix( uint64_t h )
+{
+  h ^= h >> 30;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 27;
+  h *= 0x94D049BB133111EBULL;
+  return h ^ ( h >> 31 );
+}
+
+// layout of a SYN cookie: | 5-bit timestamp | 3-bit MSS index | 24-bit keyed hash |
+constexpr unsigned COOKIE_COUNTER_SHIFT = 27;
+constexpr unsigned COOKIE_MSS_SHIFT = 24;
+constexpr uint32_t COOKIE_HASH_MASK = ( 1U << COOKIE_MSS_SHIFT ) - 1;
+
+} // namespace
+
+TCPStack::Connection::Connection( const TCPConfig& cfg, const FourTuple& id, size_t max_payload, uint64_t now )
+  : adapter(), peer( cfg ), mss( max_payload ), ticked_at( now )
+{
+  adapter.config_mut().source = to_address( id.local_ip, id.local_port );
+  adapter.config_mut().destination = to_address( id.remote_ip, id.remote_port );
+}
+
+TCPStack::TCPStack( const TCPConfig& cfg, TransmitFunction transmit, size_t mss )
+  : cfg_( cfg )
+  , transmit_( move( transmit ) )
+  , mss_( mss )
+  , rand_( get_random_engine() )
+  , syn_cookie_secret_( uniform_int_distribution<uint64_t> {}( rand_ ) )
+{
+  if ( mss_ == 0 ) {
+    throw runtime_error( "TCPStack: mss must be positive" );
+  }
+}
+
+void TCPStack::listen( const Address& local, size_t backlog, size_t syn_backlog )
+{
+  const Listener listener { .ip = local.ipv4_numeric(), .backlog = backlog, .syn_backlog = syn_backlog };
+  if ( not listeners_.emplace( local.port(), listener ).second ) {
+    throw runtime_error( "TCPStack: already listening on port " + to_string( local.port() ) );
+  }
+}
+
+optional<FourTuple> TCPStack::accept( uint16_t local_port )
+{
+  const auto listener = listeners_.find( local_port );
+  if ( listener == listeners_.end() or listener->second.accept_queue.empty() ) {
+    return {};
+  }
+
+  const FourTuple id = listener->second.accept_queue.front();
+  listener->second.accept_queue.pop_front();
+  return id;
+}
+
+FourTuple TCPStack::connect( const Address& local, const Address& remote )
+{
+  const FourTuple id { .local_ip = local.ipv4_numeric(),
+                       .remote_ip = remote.ipv4_numeric(),
+                       .local_port = local.port(),
+                       .remote_port = remote.port() };
+
+  if ( find( id ) ) {
+    throw runtime_error( "TCPStack: connection from " + local.to_string() + " to " + remote.to_string()
+                         + " already exists" );
+  }
+
+  Connection& conn = add_connection( id, cfg_, mss_ );
+  conn.peer.push( transmit_for( conn ) );
+  settle( id, conn );
+  return id;
+}
+
+TCPStack::Connection* TCPStack::find( const FourTuple& id )
+{
+  auto* const conn = connections_.find( id );
+  return conn ? conn->get() : nullptr;
+}
+
+TCPStack::Connection& TCPStack::add_connection( const FourTuple& id, const TCPConfig& cfg, size_t mss )
+{
+  TCPConfig conn_cfg = cfg;
+  conn_cfg.mss = mss; // the sender retransmits one wire segment of a lost super-segment, not all of it
+  return **connections_.emplace( id, make_unique<Connection>( conn_cfg, id, mss, timers_.now() ) ).first;
+}
+
+TCPStack::Listener* TCPStack::find_listener( const FourTuple& id )
+{
+  const auto listener = listeners_.find( id.local_port );
+  if ( listener == listeners_.end() or ( listener->second.ip != 0 and listener->second.ip != id.local_ip ) ) {
+    return nullptr;
+  }
+  return &listener->second;
+}
+
+TCPPeer* TCPStack::peer( const FourTuple& id )
+{
+  Connection* const conn = find( id );
+  return conn ? &conn->peer : nullptr;
+}
+
+//! \details The datagram is only checked for being a well-formed TCP segment. Its four-tuple selects the
+//! connection (one hash lookup per datagram); segments for unknown connections go to the listening path, and
+//! anything it does not want is dropped silently, like unrelated segments in
+//! TCPOverIPv4Adapter::unwrap_tcp_in_ip.
+void TCPStack::receive( const InternetDatagram& dgram )
+{
+  if ( dgram.header.proto != IPv4Header::PROTO_TCP ) {
+    return;
+  }
+
+  TCPSegment seg;
+  if ( not parse( seg, dgram.payload, dgram.header.pseudo_checksum() ) ) {
+    return;
+  }
+
+  const FourTuple id { .local_ip = dgram.header.dst,
+                       .remote_ip = dgram.header.src,
+                       .local_port = seg.udinfo.dst_port,
+                       .remote_port = seg.udinfo.src_port };
+
+  if ( Connection* const conn = find( id ) ) {
+    catch_up( *conn );
+    conn->peer.receive( move( seg.message ), transmit_for( *conn ) );
+    settle( id, *conn );
+    return;
+  }
+
+  Listener* const listener = find_listener( id );
+  if ( not listener ) {
+    return;
+  }
+
+  const TCPMessage& msg = seg.message;
+  if ( msg.sender.RST or msg.receiver.RST ) {
+    if ( SynQueueEntry* const entry = syn_queue_.find( id ) ) {
+      drop_half_open( id, *entry );
+    }
+  } else if ( msg.sender.SYN and not msg.receiver.ackno.has_value() ) {
+    receive_syn( id, *listener, msg );
+  } else if ( not msg.sender.SYN and msg.receiver.ackno.has_value() ) {
+    receive_handshake_ack( id, *listener, move( seg.message ) );
+  }
+}
+
+void TCPStack::receive_syn( const FourTuple& id, Listener& listener, const TCPMessage& msg )
+{
+  // With the accept queue full, drop the SYN and let the client retransmit it.
+  if ( listener.accept_queue.size() >= listener.backlog ) {
+    return;
+  }
+
+  const Wrap32 remote_isn = msg.sender.seqno;
+
+  // A retransmitted SYN means our SYN/ACK was probably lost.
+  if ( const SynQueueEntry* const entry = syn_queue_.find( id ) ) {
+    if ( entry->remote_isn == remote_isn ) {
+      send_stateless( id, syn_ack( entry->local_isn, entry->remote_isn ) );
+    }
+    return;
+  }
+
+  if ( listener.syn_queue_size < listener.syn_backlog ) {
+    const SynQueueEntry entry { .local_isn = Wrap32 { uniform_int_distribution<uint32_t> {}( rand_ ) },
+                                .remote_isn = remote_isn,
+                                .retransmit_timer = timers_.schedule( cfg_.rt_timeout, { id, true } ) };
+    syn_queue_.emplace( id, entry );
+    ++listener.syn_queue_size;
+    send_stateless( id, syn_ack( entry.local_isn, entry.remote_isn ) );
+    return;
+  }
+
+  // The SYN queue is full: keep no state at all, and encode what is needed to validate the ACK in our ISN. (An
+  // MSS below every one a cookie can encode takes the smallest; the connection is clamped back to mss_.)
+  const auto larger_mss = upper_bound( SYN_COOKIE_MSS.begin(), SYN_COOKIE_MSS.end(), mss_ );
+  const size_t mss_index = larger_mss == SYN_COOKIE_MSS.begin() ? 0 : larger_mss - SYN_COOKIE_MSS.begin() - 1;
+  const Wrap32 cookie { syn_cookie( id, remote_isn, timers_.now() / SYN_COOKIE_PERIOD_MS, mss_index ) };
+  send_stateless( id, syn_ack( cookie, remote_isn ) );
+}
+
+void TCPStack::receive_handshake_ack( const FourTuple& id, Listener& listener, TCPMessage msg )
+{
+  // With the accept queue full, drop the ACK; a retransmission (of our SYN/ACK or of the client's data) brings
+  // the handshake back later.
+  if ( listener.accept_queue.size() >= listener.backlog ) {
+    return;
+  }
+
+  const Wrap32 remote_isn { msg.sender.seqno.getuint32_t() - 1 };
+  const Wrap32 local_isn { msg.receiver.ackno->getuint32_t() - 1 };
+
+  Connection* conn = nullptr;
+  if ( SynQueueEntry* const entry = syn_queue_.find( id ) ) {
+    if ( not( entry->local_isn == local_isn ) or not( entry->remote_isn == remote_isn ) ) {
+      return;
+    }
+    drop_half_open( id, *entry );
+    conn = &establish( id, listener, local_isn, remote_isn, msg.receiver.window_size, mss_ );
+  } else if ( const auto mss_index = check_syn_cookie( id, remote_isn, local_isn ) ) {
+    const size_t mss = min<size_t>( SYN_COOKIE_MSS.at( mss_index.value() ), mss_ );
+    conn = &establish( id, listener, local_isn, remote_isn, msg.receiver.window_size, mss );
+  } else {
+    return;
+  }
+
+  conn->peer.receive( move( msg ), transmit_for( *conn ) );
+  settle( id, *conn );
+}
+
+//! \details The SYN and our SYN/ACK have both been on the wire already, so they are replayed into the new
+//! TCPPeer with its output discarded; the final ACK, given to the peer next, then completes its handshake.
+TCPStack::Connection& TCPStack::establish( const FourTuple& id,
+                                           Listener& listener,
+                                           Wrap32 local_isn,
+                                           Wrap32 remote_isn,
+                                           uint16_t window,
+                                           size_t mss )
+{
+  TCPConfig cfg = cfg_;
+  cfg.isn = local_isn;
+  Connection& conn = add_connection( id, cfg, mss );
+
+  const auto discard = []( const TCPMessage& ) {};
+  // (TCPSender treats a message with neither ackno nor window as an error, so the replayed SYN advertises the
+  // window of the final ACK, or at least one byte.)
+  const TCPMessage syn { .sender = { .seqno = remote_isn, .SYN = true },
+                         .receiver = { .window_size = max<uint16_t>( window, 1 ) } };
+  conn.peer.receive( syn, discard );
+  conn.peer.push( discard );
+
+  listener.accept_queue.push_back( id );
+  return conn;
+}
+
+//! \details A keyed hash of the four-tuple, the client's ISN, the timestamp and the MSS index, so that a cookie
+//! can neither be forged nor replayed for another connection or after it expires. (It is not cryptographically
+//! strong: the secret is only as unpredictable as the random engine.)
+uint32_t TCPStack::syn_cookie( const FourTuple& id, Wrap32 remote_isn, uint64_t counter, size_t mss_index ) const
+{
+  const uint64_t fields
+    = ( static_cast<uint64_t>( remote_isn.getuint32_t() ) << 32 ) | ( counter << 3 ) | mss_index;
+  const uint64_t h = mix( mix( syn_cookie_secret_ ^ id.hash() ) ^ fields );
+  return static_cast<uint32_t>( ( counter % 32 ) << COOKIE_COUNTER_SHIFT | mss_index << COOKIE_MSS_SHIFT
+                                | ( h & COOKIE_HASH_MASK ) );
+}
+
+optional<size_t> TCPStack::check_syn_cookie( const FourTuple& id, Wrap32 remote_isn, Wrap32 cookie ) const
+{
+  const uint32_t raw = cookie.getuint32_t();
+  const size_t mss_index = ( raw >> COOKIE_MSS_SHIFT ) % SYN_COOKIE_MSS.size();
+  const uint64_t now = timers_.now() / SYN_COOKIE_PERIOD_MS;
+
+  for ( uint64_t age = 0; age < 2 and age <= now; ++age ) {
+    if ( syn_cookie( id, remote_isn, now - age, mss_index ) == raw ) {
+      return mss_index;
+    }
+  }
+  return {};
+}
+
+TCPMessage TCPStack::syn_ack( Wrap32 local_isn, Wrap32 remote_isn ) const
+{
+  const auto window = static_cast<uint16_t>( min<size_t>( cfg_.recv_capacity, UINT16_MAX ) );
+  return { .sender = { .seqno = local_isn, .SYN = true },
+           .receiver = { .ackno = remote_isn + 1, .window_size = window } };
+}
+
+void TCPStack::send_stateless( const FourTuple& id, const TCPMessage& msg )
+{
+  TCPSegment seg { .message = msg,
+                   .udinfo = { .src_port = id.local_port, .dst_port = id.remote_port, .cksum = 0 } };
+
+  IPv4Header header;
+  header.src = id.local_ip;
+  header.dst = id.remote_ip;
+  header.len = header.hlen * 4 + 20 /* tcp header len */ + msg.sender.payload.size();
+
+  seg.compute_checksum( header.pseudo_checksum() );
+  header.compute_checksum();
+
+  Serializer serializer;
+  header.serialize( serializer );
+  seg.serialize( serializer );
+  string headers;
+  for ( const auto& piece : serializer.output() ) {
+    headers.append( piece );
+  }
+  transmit_( headers, {} );
+}
+
+void TCPStack::push( const FourTuple& id )
+{
+  Connection* const conn = find( id );
+  if ( not conn ) {
+    throw runtime_error( "TCPStack: push to unknown connection" );
+  }
+  catch_up( *conn );
+  conn->peer.push( transmit_for( *conn ) );
+  settle( id, *conn );
+}
+
+void TCPStack::release( const FourTuple& id )
+{
+  if ( Connection* const conn = find( id ) ) {
+    conn->released = true;
+    settle( id, *conn );
+  }
+}
+
+//! \details A connection is forgotten once its TCPPeer is no longer active and the application released it.
+//! Half-open connections resend their SYN/ACK with exponential backoff, and are forgotten after
+//! TCPConfig::MAX_RETX_ATTEMPTS retransmissions.
+void TCPStack::tick( uint64_t ms_since_last_tick )
+{
+  timers_.advance( ms_since_last_tick, [this]( Timer&& timer ) { expire( timer ); } );
+}
+
+void TCPStack::expire( const Timer& timer )
+{
+  if ( timer.half_open ) {
+    retransmit_syn_ack( timer.id );
+  } else if ( Connection* const conn = find( timer.id ) ) {
+    catch_up( *conn );
+    settle( timer.id, *conn );
+  }
+}
+
+void TCPStack::catch_up( Connection& conn )
+{
+  const uint64_t elapsed = timers_.now() - conn.ticked_at;
+  conn.ticked_at = timers_.now();
+  if ( elapsed > 0 and conn.peer.active() ) {
+    conn.peer.tick( elapsed, transmit_for( conn ) );
+  }
+}
+
+void TCPStack::settle( const FourTuple& id, Connection& conn )
+{
+  timers_.cancel( conn.timer );
+  if ( not conn.peer.active() and conn.released ) {
+    connections_.erase( id );
+    return;
+  }
+  if ( const auto deadline = conn.peer.next_deadline() ) {
+    conn.timer = timers_.schedule( deadline.value(), { id, false } );
+  }
+}
+
+void TCPStack::retransmit_syn_ack( const FourTuple& id )
+{
+  SynQueueEntry* const entry = syn_queue_.find( id );
+  if ( not entry ) {
+    return;
+  }
+  if ( entry->retransmissions >= TCPConfig::MAX_RETX_ATTEMPTS ) {
+    drop_half_open( id, *entry );
+    return;
+  }
+
+  ++entry->retransmissions;
+  entry->retransmit_timer = timers_.schedule( cfg_.rt_timeout << entry->retransmissions, { id, true } );
+  send_stateless( id, syn_ack( entry->local_isn, entry->remote_isn ) );
+}
+
+void TCPStack::drop_half_open( const FourTuple& id, SynQueueEntry& entry )
+{
+  timers_.cancel( entry.retransmit_timer );
+  syn_queue_.erase( id );
+  if ( Listener* const listener = find_listener( id ) ) {
+    --listener->syn_queue_size;
+  }
+}
+
+void TCPStack::send( Connection& conn, const TCPMessage& msg )
+{
+  if ( msg.sender.payload.size() <= conn.mss ) {
+    TCPOverIPv4Adapter::Headers headers;
+    conn.adapter.stamp_tcp_in_ip( msg, headers );
+    transmit_( { headers.data(), headers.size() }, msg.sender.payload );
+    return;
+  }
+
+  for ( const auto& wire : conn.adapter.segment_tcp_in_ip( msg, conn.mss ) ) {
+    transmit_( { wire.headers.data(), wire.headers.size() }, wire.payload );
+  }
+}
+
+TCPPeer::TransmitFunction TCPStack::transmit_for( Connection& conn )
+{
+  return [this, &conn]( const TCPMessage& msg ) { send( conn, msg ); };
+}
@@ -0,0 +1,272 @@
+#include "async.hh"
+#include "common.hh"
+#include "exception.hh"
+#include "socket.hh"
+
+#include <array>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe2", ::pipe2( fds.data(), O_NONBLOCK ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+pair<LocalStreamSocket, LocalStreamSocket> make_socket_pair()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds.data() ) );
+  return { LocalStreamSocket { FileDescriptor { fds[0] } }, LocalStreamSocket { FileDescriptor { fds[1] } } };
+}
+
+Task produce( Writer& writer, const string& data )
+{
+  for ( size_t i = 0; i < data.size(); ) {
+    co_await writer.space();
+    const size_t length = min( data.size() - i, writer.available_capacity() );
+    writer.push( data.substr( i, length ) );
+    i += length;
+  }
+  writer.close();
+}
+
+Task consume( Reader& reader, string& out )
+{
+  while ( true ) {
+    co_await reader.data();
+    if ( reader.is_finished() ) {
+      co_return;
+    }
+    out += reader.peek();
+    reader.pop( reader.bytes_buffered() );
+  }
+}
+
+// Tasks hand data to each other through a ByteStream, many more times than the EventLoop would let a non-fd
+// rule run in one call
+void test_streams()
+{
+  EventLoop loop;
+  Scheduler scheduler { loop };
+  ByteStream stream { 3 };
+  const string data( 1000, 'x' );
+  string out;
+  scheduler.spawn( consume( stream.reader(), out ) );
+  scheduler.spawn( produce( stream.writer(), data ) );
+  scheduler.run();
+  check( out == data, "stream tasks lost data" );
+  check( scheduler.tasks() == 0, "stream tasks did not finish" );
+}
+
+Task read_all( FileDescriptor& fd, string& out )
+{
+  while ( not fd.eof() ) {
+    check( co_await fd.readable(), "error on pipe" );
+    string buffer( 4096, 0 );
+    fd.read( buffer );
+    out += buffer;
+  }
+}
+
+Task write_all( FileDescriptor& fd, const string& data )
+{
+  for ( size_t i = 0; i < data.size(); ) {
+    check( co_await fd.writable(), "error on pipe" );
+    i += fd.write( string_view { data }.substr( i ) );
+  }
+  fd.close();
+}
+
+// Tasks wait for fds to be ready (a pipe larger than its buffer); their rules go with them
+void test_fds()
+{
+  EventLoop loop;
+  Scheduler scheduler { loop };
+  auto [read_end, write_end] = make_pipe();
+  const string data( 1 << 20, 'y' );
+  string out;
+  scheduler.spawn( read_all( read_end, out ) );
+  scheduler.spawn( write_all( write_end, data ) );
+  scheduler.run();
+  check( out == data, "pipe tasks lost data" );
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Exit, "finished tasks left rules behind" );
+}
+
+Task read_twice( string& out )
+{
+  string buffer;
+  auto [first_read, first_write] = make_pipe();
+  first_write.write( "a" );
+  check( co_await first_read.readable(), "error on first pipe" );
+  first_read.read( buffer );
+  out += buffer;
+  const int reused = first_read.fd_num();
+  first_read.close();
+
+  auto [second_read, second_write] = make_pipe();
+  check( second_read.fd_num() == reused, "second pipe did not take the closed fd's number" );
+  second_write.write( "b" );
+  check( co_await second_read.readable(), "error on second pipe" );
+  second_read.read( buffer );
+  out += buffer;
+}
+
+// a Task that awaits a new file under the number of one it closed leaves no rule behind for the old one
+void test_reused_fd_number()
+{
+  EventLoop loop;
+  Scheduler scheduler { loop };
+  string out;
+  scheduler.spawn( read_twice( out ) );
+  scheduler.run();
+  check( out == "ab", "reused-fd task lost data" );
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Exit, "the closed file's rule was left behind" );
+}
+
+Task fail_after( FileDescriptor& fd )
+{
+  co_await fd.readable();
+  throw runtime_error( "child failed" );
+}
+
+Task parent( FileDescriptor& fd, string& log )
+{
+  try {
+    co_await fail_after( fd );
+  } catch ( const runtime_error& e ) {
+    log += e.what();
+  }
+  log += ", parent resumed";
+  throw runtime_error( "parent failed" );
+}
+
+// a Task awaiting another runs it, and gets its exception; a spawned Task's exception comes out of run()
+void test_children_and_exceptions()
+{
+  EventLoop loop;
+  Scheduler scheduler { loop };
+  auto [read_end, write_end] = make_pipe();
+  write_end.write( "x" );
+  string log;
+  scheduler.spawn( parent( read_end, log ) );
+  bool thrown = false;
+  try {
+    scheduler.run();
+  } catch ( const runtime_error& e ) {
+    thrown = string { e.what() } == "parent failed";
+  }
+  check( thrown, "run() did not throw the task's exception" );
+  check( log == "child failed, parent resumed", "unexpected log: " + log );
+}
+
+Task echo( LocalStreamSocket& socket )
+{
+  string buffer;
+  while ( true ) {
+    co_await socket.readable();
+    buffer.resize( 64 );
+    socket.read( buffer );
+    if ( socket.eof() ) {
+      co_return;
+    }
+    co_await socket.writable();
+    socket.write( buffer );
+  }
+}
+
+Task ask( LocalStreamSocket& socket, string question, size_t& answered )
+{
+  co_await socket.writable();
+  socket.write( question );
+  string answer;
+  while ( answer.size() < question.size() ) {
+    co_await socket.readable();
+    string buffer( 64, 0 );
+    socket.read( buffer );
+    answer += buffer;
+  }
+  answered += answer == question;
+  socket.shutdown( SHUT_WR );
+}
+
+// one thread runs a thousand connections, each one a pair of lightweight tasks
+void test_many_connections()
+{
+  constexpr size_t connections = 1000;
+  EventLoop loop;
+  Scheduler scheduler { loop };
+  vector<pair<LocalStreamSocket, LocalStreamSocket>> sockets;
+  sockets.reserve( connections );
+  size_t answered = 0;
+  for ( size_t i = 0; i < connections; ++i ) {
+    auto& [client, server] = sockets.emplace_back( make_socket_pair() );
+    scheduler.spawn( echo( server ) );
+    scheduler.spawn( ask( client, "question " + to_string( i ), answered ) );
+  }
+  scheduler.run();
+  check( answered == connections, "only " + to_string( answered ) + " connections were answered" );
+}
+
+Task wait_forever( Reader& reader )
+{
+  co_await reader.data();
+}
+
+Task stop_after( Scheduler& scheduler, FileDescriptor& fd )
+{
+  co_await fd.readable();
+  scheduler.stop();
+}
+
+// Tasks that can never resume are reported; stop() leaves the others suspended
+void test_deadlock_and_stop()
+{
+  EventLoop loop;
+  Scheduler scheduler { loop };
+  ByteStream stream { 10 };
+  scheduler.spawn( wait_forever( stream.reader() ) );
+  bool thrown = false;
+  try {
+    scheduler.run();
+  } catch ( const runtime_error& ) {
+    thrown = true;
+  }
+  check( thrown, "run() did not report a task that can never resume" );
+
+  auto [read_end, write_end] = make_pipe();
+  write_end.write( "x" );
+  scheduler.spawn( stop_after( scheduler, read_end ) );
+  scheduler.run();
+  check( scheduler.tasks() == 1, "stop() did not leave the waiting task suspended" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    test_streams();
+    test_fds();
+    test_reused_fd_number();
+    test_children_and_exceptions();
+    test_many_connections();
+    test_deadlock_and_stop();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,245 @@
+#include "buffer_pool.hh"
+#include "common.hh"
+#include "exception.hh"
+#include "file_descriptor.hh"
+#include "ipv4_datagram.hh"
+#include "parser.hh"
+#include "shared_buffer.hh"
+#include "tcp_segment.hh"
+
+#include <array>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+// allocation-counting hook: every operator new in this program is counted
+namespace {
+size_t allocations = 0; // NOLINT(*-avoid-non-const-global-variables)
+}
+
+void* operator new( size_t size )
+{
+  ++allocations;
+  if ( void* p = malloc( size ) ) { // NOLINT(*-no-malloc)
+    return p;
+  }
+  throw bad_alloc {};
+}
+
+void operator delete( void* p ) noexcept
+{
+  free( p ); // NOLINT(*-no-malloc)
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+  free( p ); // NOLINT(*-no-malloc)
+}
+
+namespace {
+
+// views share a buffer, which goes back to the pool (and is handed out again) when the last is dropped
+void test_views()
+{
+  BufferPool pool { 64, 2 };
+  PooledBuffer buffer = pool.get();
+  check( buffer.size() == 64 and buffer.capacity() == 64, "a new buffer is not whole" );
+  const char* const storage = buffer.data();
+  string { "hello, world" }.copy( buffer.data(), 12 );
+  buffer.resize( 12 );
+
+  PooledBuffer world = buffer.substr( 7 );
+  PooledBuffer hello = buffer.substr( 0, 5 );
+  check( world.view() == "world" and hello.view() == "hello", "substr views have the wrong bytes" );
+  check( buffer.use_count() == 3 and pool.in_use() == 1, "views do not share the buffer" );
+
+  buffer = {};
+  hello = {};
+  check( pool.in_use() == 1, "the buffer was released while a view still held it" );
+  world.remove_prefix( 2 );
+  check( world.view() == "rld", "remove_prefix narrowed the wrong bytes" );
+
+  world = {};
+  check( pool.in_use() == 0, "dropping the last view did not release the buffer" );
+  check( pool.get().data() == storage, "a released buffer was not handed out again" );
+
+  // a third buffer takes a second slab
+  PooledBuffer a = pool.get();
+  PooledBuffer b = pool.get();
+  PooledBuffer c = pool.get();
+  check( pool.slabs() == 2 and pool.in_use() == 3, "the pool did not grow by a slab" );
+}
+
+// views may outlive their pool
+void test_orphaned_views()
+{
+  PooledBuffer kept;
+  {
+    BufferPool pool { 16, 1 };
+    kept = pool.get();
+    string { "survivor" }.copy( kept.data(), 8 );
+    kept.resize( 8 );
+  }
+  check( kept.view() == "survivor", "a view did not outlive its pool" );
+}
+
+// once the pool has grown to what is held at once, reading datagrams allocates nothing
+void test_steady_state()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  const FileDescriptor sender { fds[0] };
+  FileDescriptor receiver { fds[1] };
+
+  constexpr size_t rounds = 10000;
+  constexpr size_t held = 8; // views kept from recent datagrams, as a parser's output would be
+  const string datagram( 1400, 'x' );
+  BufferPool pool { 2048, 4 };
+  array<PooledBuffer, held> recent {};
+
+  const auto one_round = [&]( size_t i ) {
+    CheckSystemCall( "write", ::write( sender.fd_num(), datagram.data(), datagram.size() ) );
+    PooledBuffer buffer = pool.get();
+    receiver.read( buffer );
+    if ( buffer.view() != datagram ) { // (not check(): its message would be an allocation)
+      throw runtime_error( "datagram was read wrong" );
+    }
+    recent[i % held] = buffer.substr( 40 ); // (past the headers)
+  };
+
+  for ( size_t i = 0; i < held * 2; ++i ) {
+    one_round( i );
+  }
+  const size_t before = allocations;
+  for ( size_t i = 0; i < rounds; ++i ) {
+    one_round( i );
+  }
+  const size_t pooled = allocations - before;
+  check( pooled == 0, to_string( pooled ) + " allocations while reading " + to_string( rounds ) + " datagrams" );
+  check( pool.in_use() == held, "views were lost or leaked" );
+
+  // for comparison, a read into a fresh string allocates every time
+  const size_t before_strings = allocations;
+  for ( size_t i = 0; i < 100; ++i ) {
+    CheckSystemCall( "write", ::write( sender.fd_num(), datagram.data(), datagram.size() ) );
+    string buffer;
+    receiver.read( buffer );
+  }
+  check( allocations - before_strings >= 100, "the allocation-counting hook is not counting" );
+}
+
+// An IPv4 datagram carrying a TCP segment with `payload`
+string make_datagram( const string& payload )
+{
+  TCPSegment seg;
+  seg.udinfo = { .src_port = 1234, .dst_port = 5678, .cksum = 0 };
+  seg.message.sender = { .seqno = Wrap32 { 1000 }, .payload = payload };
+  seg.message.receiver = { .ackno = Wrap32 { 2000 }, .window_size = 10000 };
+
+  IPv4Header ip;
+  ip.src = 0x0a000001;
+  ip.dst = 0x0a000002;
+  ip.proto = IPv4Header::PROTO_TCP;
+  ip.len = IPv4Header::LENGTH + 20 + payload.size();
+  ip.compute_checksum();
+  seg.compute_checksum( ip.pseudo_checksum() );
+
+  string wire;
+  for ( const auto& piece : serialize( ip ) ) {
+    wire += piece;
+  }
+  for ( const auto& piece : serialize( seg ) ) {
+    wire += piece;
+  }
+  return wire;
+}
+
+// what reading and parsing a datagram allocates, the way the TUN adapter does it: the pooled buffer is shared
+// with the segment's payload through its own reference count, so only the parsers' lists of buffers allocate
+void test_read_and_parse()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  const FileDescriptor sender { fds[0] };
+  FileDescriptor receiver { fds[1] };
+
+  constexpr size_t rounds = 1000;
+  constexpr size_t held = 8;
+  const string payload( 1000, 'x' );
+  const string datagram = make_datagram( payload );
+  BufferPool pool { 2048, 4 };
+  array<SharedBuffer, held> recent {};
+
+  const auto one_round = [&]( size_t i ) {
+    CheckSystemCall( "write", ::write( sender.fd_num(), datagram.data(), datagram.size() ) );
+    PooledBuffer buffer = pool.get();
+    receiver.read( buffer );
+
+    InternetDatagram ip;
+    TCPSegment seg;
+    if ( not parse( ip, vector<SharedBuffer> { SharedBuffer { move( buffer ) } } )
+         or not parse( seg, ip.payload, ip.header.pseudo_checksum() ) ) {
+      throw runtime_error( "datagram did not parse" );
+    }
+    if ( seg.message.sender.payload != payload ) {
+      throw runtime_error( "payload was parsed wrong" );
+    }
+    recent[i % held] = move( seg.message.sender.payload );
+  };
+
+  for ( size_t i = 0; i < held * 2; ++i ) {
+    one_round( i );
+  }
+  check( recent[0].use_count() == 1 and pool.in_use() == held, "the payloads do not share the pooled buffers" );
+
+  // a SharedBuffer of a pooled buffer, and its copies and views, allocate nothing
+  PooledBuffer spare = pool.get();
+  const size_t before_views = allocations;
+  long shared = 0;
+  {
+    const SharedBuffer whole { move( spare ) };
+    const SharedBuffer copy { whole };
+    const SharedBuffer part = copy.substr( 10, 20 );
+    shared = part.use_count();
+  }
+  const bool allocated = allocations != before_views;
+  check( not allocated, "sharing a pooled buffer allocated" );
+  check( shared == 3, "views of a pooled buffer do not share it" );
+
+  const size_t before = allocations;
+  for ( size_t i = 0; i < rounds; ++i ) {
+    one_round( i );
+  }
+  const double per_datagram = static_cast<double>( allocations - before ) / static_cast<double>( rounds );
+
+  // the parsers' buffer lists: the IPv4 datagram's input and payload, and the TCP segment's input
+  constexpr double expected = 3;
+  check( per_datagram <= expected,
+         to_string( per_datagram ) + " allocations per datagram read and parsed (expected at most "
+           + to_string( expected ) + ")" );
+  check( pool.in_use() == held, "views were lost or leaked" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    test_views();
+    test_orphaned_views();
+    test_steady_state();
+    test_read_and_parse();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,132 @@
+#include "checksum.hh"
+#include "common.hh"
+#include "random.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// the internet checksum a byte at a time (as InternetChecksum took it before it summed whole words)
+class ReferenceChecksum
+{
+  uint64_t sum_;
+  bool parity_ {};
+
+public:
+  explicit ReferenceChecksum( const uint32_t sum = 0 ) : sum_( sum ) {}
+
+  void add( string_view data )
+  {
+    for ( const uint8_t i : data ) {
+      uint16_t val = i;
+      if ( not parity_ ) {
+        val <<= 8;
+      }
+      sum_ += val;
+      parity_ = !parity_;
+    }
+  }
+
+  uint16_t value() const
+  {
+    uint64_t ret = sum_;
+    while ( ret > 0xffff ) {
+      ret = ( ret >> 16 ) + static_cast<uint16_t>( ret );
+    }
+    return ~ret;
+  }
+};
+
+const vector<InternetChecksum::Kernel> kernels { InternetChecksum::Kernel::Scalar,
+                                                 InternetChecksum::Kernel::SSE2,
+                                                 InternetChecksum::Kernel::AVX2 };
+
+// checksums `pieces` with the reference and with every kernel the CPU supports
+void compare( const vector<string_view>& pieces, const uint32_t seed, const string& what )
+{
+  ReferenceChecksum reference { seed };
+  for ( const auto piece : pieces ) {
+    reference.add( piece );
+  }
+
+  for ( const auto kernel : kernels ) {
+    if ( not InternetChecksum::supported( kernel ) ) {
+      continue;
+    }
+    InternetChecksum sum { seed };
+    for ( const auto piece : pieces ) {
+      sum.add( piece, kernel );
+    }
+    check( sum.value() == reference.value(),
+           what + ": kernel " + to_string( static_cast<int>( kernel ) ) + " disagrees with the reference" );
+  }
+}
+
+// random buffers, split into random (odd-length, misaligned) pieces
+void test_random_pieces()
+{
+  auto rd = get_random_engine();
+  uniform_int_distribution<int> byte { 0, 255 };
+
+  string data( 1 << 16, 0 );
+  for ( auto& c : data ) {
+    c = static_cast<char>( byte( rd ) );
+  }
+
+  for ( size_t i = 0; i < 2000; ++i ) {
+    const size_t start = uniform_int_distribution<size_t> { 0, 63 }( rd );
+    const size_t length = uniform_int_distribution<size_t> { 0, i % 10 ? 2000 : data.size() - start }( rd );
+    string_view rest = string_view { data }.substr( start, length );
+
+    vector<string_view> pieces;
+    while ( not rest.empty() ) {
+      const size_t cut = uniform_int_distribution<size_t> { 0, rest.size() }( rd );
+      pieces.push_back( rest.substr( 0, cut ) );
+      rest.remove_prefix( cut );
+    }
+    compare( pieces, uniform_int_distribution<uint32_t> { 0, 0x3ffff }( rd ), "random pieces" );
+  }
+}
+
+// buffers of zeros and of 0xff bytes (the sums at either end of the one's-complement range), and one long
+// enough that the vector kernels empty their lanes several times
+void test_extremes()
+{
+  for ( const char c : { '\0', '\xff' } ) {
+    for ( const size_t length : { 0UL, 1UL, 2UL, 31UL, 32UL, 33UL, 1500UL, 65535UL } ) {
+      const string data( length, c );
+      compare( { data }, 0, "extremes" );
+      compare( { data }, 0xffff, "extremes" );
+    }
+  }
+
+  string big( 3 << 20, 0 );
+  for ( size_t i = 0; i < big.size(); ++i ) {
+    big[i] = static_cast<char>( i % 7 == 0 ? 0xff : i );
+  }
+  compare( { big }, 0, "a long buffer" );
+  compare( { string_view { big }.substr( 1 ) }, 0, "a long, misaligned buffer" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    test_random_pieces();
+    test_extremes();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
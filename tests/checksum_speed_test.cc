@@ -0,0 +1,108 @@
+#include "checksum.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+// the internet checksum a byte at a time (as InternetChecksum took it before it summed whole words)
+uint16_t bytewise_checksum( const string_view data )
+{
+  uint64_t sum = 0;
+  bool parity = false;
+  for ( const uint8_t i : data ) {
+    sum += parity ? i : i << 8;
+    parity = not parity;
+  }
+  while ( sum > 0xffff ) {
+    sum = ( sum >> 16 ) + static_cast<uint16_t>( sum );
+  }
+  return ~sum;
+}
+
+// Checksums `buffer` (starting one byte in, so it is misaligned) `iterations` times. Returns GB/s.
+double speed_test( const string& buffer, const size_t iterations, const int kernel, uint16_t& result )
+{
+  const string_view data = string_view { buffer }.substr( 1 );
+  uint64_t sink = 0;
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < iterations; ++i ) {
+    if ( kernel < 0 ) {
+      sink += bytewise_checksum( data );
+    } else {
+      InternetChecksum sum;
+      sum.add( data, static_cast<InternetChecksum::Kernel>( kernel ) );
+      sink += sum.value();
+    }
+  }
+  const auto stop = steady_clock::now();
+  result = sink / iterations;
+
+  return static_cast<double>( data.size() * iterations )
+         / static_cast<double>( duration_cast<nanoseconds>( stop - start ).count() );
+}
+
+void speed_test( const size_t size, const size_t iterations )
+{
+  string buffer( size + 1, 0 );
+  for ( size_t i = 0; i < buffer.size(); ++i ) {
+    buffer[i] = static_cast<char>( i * 7 );
+  }
+
+  uint16_t expected {};
+  const double bytewise = speed_test( buffer, iterations / 10, -1, expected );
+
+  cout << "Internet checksum of " << size << "-byte buffers: " << fixed << setprecision( 2 ) << bytewise
+       << " GB/s a byte at a time";
+
+  double best = 0;
+  for ( const auto& [kernel, name] : { pair { InternetChecksum::Kernel::Scalar, "64-bit words" },
+                                       pair { InternetChecksum::Kernel::SSE2, "SSE2" },
+                                       pair { InternetChecksum::Kernel::AVX2, "AVX2" } } ) {
+    if ( not InternetChecksum::supported( kernel ) ) {
+      continue;
+    }
+    uint16_t result {};
+    const double rate = speed_test( buffer, iterations, static_cast<int>( kernel ), result );
+    if ( result != expected ) {
+      throw runtime_error( string { name } + " checksum disagrees with the byte-at-a-time checksum" );
+    }
+    cout << ", " << rate << " GB/s with " << name;
+    best = max( best, rate );
+  }
+  cout << ".\n";
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+  debug_output << "      Internet checksum (" << size << " bytes): " << fixed << setprecision( 2 ) << best
+               << " GB/s (" << best / bytewise << "x)\n";
+
+  if ( best < bytewise ) {
+    throw runtime_error( "the word-at-a-time checksum was slower than the byte-at-a-time one" );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    speed_test( 1500, 400000 );
+    speed_test( 65536, 10000 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -35,6 +35,15 @@ inline ExpectationViolation::ExpectationViolation( const std::string& property_n
                            + ", but instead it was " + boolstr( actual ) + "." }
 {}
 
+//! Throws an ExpectationViolation with `what` unless `condition` holds (for tests written as plain functions)
+//! \note Inline, so that the speed tests (which do not link common.cc) can use it too.
+inline void check( bool condition, const std::string& what )
+{
+  if ( not condition ) {
+    throw ExpectationViolation { what };
+  }
+}
+
 template<class T>
 struct TestStep
 {
@@ -0,0 +1,548 @@
+#include "common.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+#include "socket.hh"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+struct Pipe
+{
+  FileDescriptor read_end;
+  FileDescriptor write_end;
+};
+
+Pipe make_pipe()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe2", ::pipe2( fds.data(), O_NONBLOCK ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+// every ready rule is served by one call, and rules that lose interest stop being served until it returns
+void test_ready_and_interest()
+{
+  EventLoop loop;
+  vector<Pipe> pipes;
+  for ( unsigned i = 0; i < 3; ++i ) {
+    pipes.push_back( make_pipe() );
+  }
+
+  vector<string> received( pipes.size() );
+  bool paused = false;
+  for ( size_t i = 0; i < pipes.size(); ++i ) {
+    loop.add_rule(
+      "read pipe " + to_string( i ),
+      pipes[i].read_end,
+      Direction::In,
+      [&, i] {
+        string data;
+        pipes[i].read_end.read( data );
+        received[i] += data;
+      },
+      [&, i] { return i != 0 or not paused; } );
+  }
+
+  for ( auto& pipe : pipes ) {
+    pipe.write_end.write( "x" );
+  }
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Success, "expected ready rules" );
+  check( received == vector<string>( pipes.size(), "x" ), "one call did not serve every ready rule" );
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, "expected nothing ready" );
+
+  paused = true;
+  pipes[0].write_end.write( "y" );
+  loop.wait_next_event( 0 );
+  loop.wait_next_event( 0 );
+  check( received[0] == "x", "an uninterested rule was served" );
+
+  paused = false;
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Success and received[0] == "xy",
+         "a rule whose interest returned was not served" );
+}
+
+// one-rule dispatch takes turns among ready fds; serve-all dispatch serves a rule that stays ready up to its
+// budget, giving every other ready rule a turn in each round; and the counters show who was served
+void test_dispatch()
+{
+  EventLoop loop;
+  vector<Pipe> pipes;
+  for ( unsigned i = 0; i < 2; ++i ) {
+    pipes.push_back( make_pipe() );
+  }
+
+  vector<size_t> categories;
+  string served;
+  for ( size_t i = 0; i < pipes.size(); ++i ) {
+    categories.push_back( loop.add_category( "pipe " + to_string( i ) ) );
+    loop.add_rule( categories.back(), pipes[i].read_end, Direction::In, [&, i] {
+      string byte( 1, '\0' ); // one byte per call, so the pipe stays ready
+      pipes[i].read_end.read( byte );
+      served += to_string( i );
+    } );
+  }
+  for ( auto& pipe : pipes ) {
+    pipe.write_end.write( "abcdefgh" );
+  }
+
+  loop.set_dispatch( { .serve_all = false, .budget = 1 } );
+  loop.wait_next_event( 0 );
+  loop.wait_next_event( 0 );
+  check( served == "01" or served == "10", "one-rule dispatch did not take turns" );
+
+  served.clear();
+  loop.set_dispatch( { .serve_all = true, .budget = 3 } );
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Success, "expected ready rules" );
+  check( served.size() == 6 and ranges::count( served, '0' ) == 3, "serve-all dispatch did not use the budget" );
+  for ( size_t i = 0; i < served.size(); i += 2 ) {
+    check( served[i] != served[i + 1], "a rule was served twice before the other took its turn" );
+  }
+  check( loop.served( categories[0] ) == 4 and loop.served( categories[1] ) == 4, "service counters are wrong" );
+}
+
+// the summary shows each category's callbacks (and, when profiling, their time and bytes), and is printed to
+// stderr when the process gets the signal asked for
+void test_summary()
+{
+  EventLoop loop;
+  Pipe pipe = make_pipe();
+  loop.add_rule( "read pipe", pipe.read_end, Direction::In, [&] {
+    string data;
+    pipe.read_end.read( data );
+    this_thread::sleep_for( milliseconds { 2 } );
+  } );
+  pipe.write_end.write( "12345678" );
+  loop.wait_next_event( 0 );
+
+  ostringstream summary;
+  loop.summary( summary );
+  check( summary.str().find( "           1" ) != string::npos, "summary does not count the callback" );
+#ifdef MINNOW_EVENTLOOP_PROFILING
+  istringstream lines { summary.str() };
+  string line;
+  while ( getline( lines, line ) and line.find( "read pipe" ) == string::npos ) {}
+  istringstream fields { line };
+  uint64_t served = 0;
+  double total_ms = 0;
+  double mean_us = 0;
+  double max_us = 0;
+  uint64_t bytes = 0;
+  fields >> served >> total_ms >> mean_us >> max_us >> bytes;
+  check( served == 1 and total_ms >= 2 and max_us >= 2000 and bytes == 8, "profile is wrong: " + line );
+
+  EventLoop::dump_summaries_on( SIGUSR1 );
+  ostringstream dumped;
+  auto* const original = cerr.rdbuf( dumped.rdbuf() );
+  ::raise( SIGUSR1 );
+  loop.wait_next_event( 0 );
+  cerr.rdbuf( original );
+  check( dumped.str().find( "read pipe" ) != string::npos, "SIGUSR1 did not print the summary" );
+#endif
+}
+
+// cancelled rules are forgotten, finished fds call their cancel callback, and the loop exits when nothing is
+// left to wait for
+void test_cancel_and_exit()
+{
+  EventLoop loop;
+  Pipe cancelled = make_pipe();
+  Pipe finishing = make_pipe();
+
+  bool cancelled_served = false;
+  auto handle = loop.add_rule( "cancelled", cancelled.read_end, Direction::In, [&] { cancelled_served = true; } );
+
+  bool finishing_cancelled = false;
+  loop.add_rule(
+    "finishing",
+    finishing.read_end,
+    Direction::In,
+    [&] {
+      string data;
+      finishing.read_end.read( data );
+    },
+    [] { return true; },
+    [&] { finishing_cancelled = true; } );
+
+  handle.cancel();
+  cancelled.write_end.write( "x" );
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout and not cancelled_served,
+         "a cancelled rule was served" );
+
+  finishing.write_end.close();
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Success, "EOF was not served" );
+  check( finishing_cancelled, "reaching EOF did not cancel the rule" );
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Exit, "loop did not exit with no rules left" );
+
+  // an fd closed behind the loop's back finishes its rules, even if its number is reused right away
+  Pipe closed = make_pipe();
+  bool closed_cancelled = false;
+  loop.add_rule(
+    "closed", closed.read_end, Direction::In, [] {}, [] { return true; }, [&] { closed_cancelled = true; } );
+  const int closed_fd_num = closed.read_end.fd_num();
+  closed.read_end.close();
+
+  Pipe reused = make_pipe();
+  check( reused.read_end.fd_num() == closed_fd_num, "expected the fd number to be reused" );
+  bool reused_served = false;
+  loop.add_rule( "reused", reused.read_end, Direction::In, [&] {
+    string data;
+    reused.read_end.read( data );
+    reused_served = true;
+  } );
+  check( closed_cancelled, "rule on a closed fd was not cancelled" );
+  reused.write_end.write( "x" );
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Success and reused_served, "new rule was not served" );
+
+  // a loop whose only rule is uninterested exits, and a loop with an idle interested rule times out
+  bool interested = false;
+  Pipe idle = make_pipe();
+  loop.add_rule(
+    "idle", idle.read_end, Direction::In, [] {}, [&] { return interested; } );
+  reused.write_end.close();
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Success, "EOF was not served" );
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Exit, "loop with no interested rule did not exit" );
+  interested = true;
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Timeout, "interested rule should keep the loop going" );
+}
+
+// epoll cannot watch regular files; rules on them are always ready
+void test_regular_file()
+{
+  char name[] = "/tmp/eventloop_test_XXXXXX";
+  FileDescriptor file { CheckSystemCall( "mkstemp", ::mkstemp( name ) ) };
+  ::unlink( name );
+  file.write( "contents" );
+  CheckSystemCall( "lseek", static_cast<int>( ::lseek( file.fd_num(), 0, SEEK_SET ) ) );
+
+  EventLoop loop;
+  string contents;
+  loop.add_rule( "read file", file, Direction::In, [&] {
+    string data;
+    file.read( data );
+    contents += data;
+  } );
+
+  while ( loop.wait_next_event( -1 ) != EventLoop::Result::Exit ) {}
+  check( contents == "contents", "regular file was not read to EOF" );
+}
+
+// datagram rules get every datagram received, in order, held back while they are uninterested; with either
+// backend, and on sockets (multishot receives) as well as pipes (reads)
+void test_datagram_rule( const EventLoop::Backend backend )
+{
+  EventLoop loop { backend };
+  check( backend == EventLoop::Backend::Epoll or loop.backend() == backend or not IoUring::supported(),
+         "io_uring is supported but the loop did not use it" );
+
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  FileDescriptor receiver { fds[0] };
+  FileDescriptor sender { fds[1] };
+
+  vector<string> received;
+  bool interested = true;
+  auto handle = loop.add_datagram_rule(
+    "datagrams",
+    receiver,
+    [&]( const vector<string_view>& datagrams ) {
+      check( not datagrams.empty(), "callback without datagrams" );
+      received.insert( received.end(), datagrams.begin(), datagrams.end() );
+    },
+    [&] { return interested; } );
+
+  const auto receive = [&]( const size_t expected ) {
+    for ( unsigned i = 0; i < 100 and received.size() < expected; ++i ) {
+      loop.wait_next_event( 10 );
+    }
+  };
+
+  for ( const string datagram : { "one", "two", "three" } ) {
+    sender.write( datagram );
+  }
+  receive( 3 );
+  check( received == vector<string> { "one", "two", "three" }, "datagrams were not received in order" );
+
+  interested = false;
+  sender.write( "four" );
+  check( loop.wait_next_event( 10 ) == EventLoop::Result::Exit, "uninterested datagram rule kept the loop going" );
+  check( received.size() == 3, "an uninterested datagram rule was served" );
+  interested = true;
+  receive( 4 );
+  check( received.size() == 4 and received.back() == "four", "held-back datagram was not delivered" );
+
+  handle.cancel();
+  sender.write( "five" );
+  check( loop.wait_next_event( 10 ) == EventLoop::Result::Exit and received.size() == 4,
+         "a cancelled datagram rule was served" );
+
+  // reads of a pipe end at EOF, which cancels the rule
+  Pipe pipe = make_pipe();
+  string contents;
+  bool cancelled = false;
+  loop.add_datagram_rule(
+    "pipe",
+    pipe.read_end,
+    [&]( const vector<string_view>& chunks ) {
+      for ( const auto chunk : chunks ) {
+        contents += chunk;
+      }
+    },
+    [] { return true; },
+    [&] { cancelled = true; } );
+  pipe.write_end.write( "contents" );
+  pipe.write_end.close();
+  for ( unsigned i = 0; i < 100 and not cancelled; ++i ) {
+    loop.wait_next_event( 10 );
+  }
+  check( contents == "contents" and cancelled, "pipe was not read to EOF" );
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Exit, "loop did not exit with no rules left" );
+}
+
+// a datagram too long for its rule's buffer is dropped, not passed on cut short; a pipe's reads are pieces of a
+// stream, which a short buffer only splits
+void test_datagram_buffer_size( const EventLoop::Backend backend )
+{
+  EventLoop loop { backend };
+
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  FileDescriptor receiver { fds[0] };
+  FileDescriptor sender { fds[1] };
+
+  vector<string> received;
+  loop.add_datagram_rule(
+    "datagrams",
+    receiver,
+    [&]( const vector<string_view>& datagrams ) {
+      received.insert( received.end(), datagrams.begin(), datagrams.end() );
+    },
+    [] { return true; },
+    [] {},
+    [] {},
+    100 );
+
+  for ( const size_t length : { 99, 150, 100, 7 } ) {
+    sender.write( string( length, 'x' ) );
+  }
+  for ( unsigned i = 0; i < 100 and received.size() < 3; ++i ) {
+    loop.wait_next_event( 10 );
+  }
+  check( received.size() == 3 and received[0].size() == 99 and received[1].size() == 100
+           and received[2].size() == 7,
+         "datagrams that fit the buffer were not received whole" );
+  check( loop.truncated_datagrams() == 1, "the datagram too long for the buffer was not dropped" );
+
+  Pipe pipe = make_pipe();
+  string contents;
+  loop.add_datagram_rule(
+    "pipe",
+    pipe.read_end,
+    [&]( const vector<string_view>& chunks ) {
+      for ( const auto chunk : chunks ) {
+        contents += chunk;
+      }
+    },
+    [] { return true; },
+    [] {},
+    [] {},
+    100 );
+  pipe.write_end.write( string( 250, 'y' ) );
+  for ( unsigned i = 0; i < 100 and contents.size() < 250; ++i ) {
+    loop.wait_next_event( 10 );
+  }
+  check( contents == string( 250, 'y' ) and loop.truncated_datagrams() == 1, "a pipe's reads were dropped" );
+}
+
+// An error-queue rule reads the completions of zero-copy sends, which do not look like an error to the socket's
+// other rules
+void test_error_queue_rule()
+{
+  TCPSocket listener;
+  listener.bind( Address { "127.0.0.1", 0 } );
+  listener.listen();
+  TCPSocket sender;
+  sender.connect( listener.local_address() );
+  TCPSocket receiver = listener.accept();
+  if ( not sender.enable_zerocopy() ) {
+    cerr << "(MSG_ZEROCOPY not supported here: skipping the error-queue test)\n";
+    return;
+  }
+  sender.set_blocking( false );
+  receiver.set_blocking( false );
+
+  string data;
+  for ( size_t i = 0; i < 8 * 16384; ++i ) {
+    data.push_back( static_cast<char>( 'a' + i % 26 ) );
+  }
+
+  EventLoop loop;
+  unsigned reaps = 0;
+  loop.add_error_queue_rule(
+    "completions",
+    sender,
+    [&] {
+      sender.reap_zerocopy();
+      ++reaps;
+    },
+    [&] { return sender.zerocopy_pending() > 0; } );
+  string received;
+  loop.add_rule(
+    "receive",
+    receiver,
+    Direction::In,
+    [&] {
+      string chunk;
+      receiver.read( chunk );
+      received += chunk;
+    },
+    [&] { return received.size() < data.size(); } );
+  string reply;
+  loop.add_rule( "reply", sender, Direction::In, [&] {
+    string chunk;
+    sender.read( chunk );
+    reply += chunk;
+  } );
+
+  for ( size_t offset = 0; offset < data.size(); offset += 16384 ) {
+    check( sender.write_zerocopy( string_view { data }.substr( offset, 16384 ) ) == 16384, "short zero-copy send" );
+  }
+  check( sender.zerocopy_pending() == 8, "zero-copy sends were not counted" );
+
+  for ( unsigned i = 0; i < 100 and ( sender.zerocopy_pending() > 0 or received.size() < data.size() ); ++i ) {
+    loop.wait_next_event( 10 );
+  }
+  check( received == data, "the zero-copy sends were garbled" );
+  check( sender.zerocopy_pending() == 0 and reaps > 0, "the zero-copy completions were not reaped" );
+
+  // the completions did not cancel the sender's other rule
+  receiver.write( "reply" );
+  for ( unsigned i = 0; i < 100 and reply.empty(); ++i ) {
+    loop.wait_next_event( 10 );
+  }
+  check( reply == "reply", "a rule on the sender did not survive its zero-copy completions" );
+}
+
+// Completions that no error-queue rule is interested in do not run its callback, nor have the loop wake up for
+// them again and again (epoll reports an error queue that is not empty at every wait)
+void test_uninterested_error_queue_rule()
+{
+  TCPSocket listener;
+  listener.bind( Address { "127.0.0.1", 0 } );
+  listener.listen();
+  TCPSocket sender;
+  sender.connect( listener.local_address() );
+  TCPSocket receiver = listener.accept();
+  if ( not sender.enable_zerocopy() ) {
+    return;
+  }
+
+  // (a rule on an idle pipe keeps the loop waiting)
+  EventLoop loop;
+  Pipe idle = make_pipe();
+  loop.add_rule( "idle", idle.read_end, Direction::In, [] {} );
+  unsigned runs = 0;
+  bool cancelled = false;
+  loop.add_error_queue_rule(
+    "completions", sender, [&] { ++runs; }, [] { return false; }, [&] { cancelled = true; } );
+
+  const string data( 16384, 'x' );
+  check( sender.write_zerocopy( data ) == data.size(), "short zero-copy send" );
+  string received;
+  while ( received.size() < data.size() ) {
+    string chunk;
+    receiver.read( chunk );
+    received += chunk;
+  }
+
+  // the completion reaches the error queue once the receiver has the bytes
+  for ( unsigned i = 0; i < 100 and not cancelled; ++i ) {
+    loop.wait_next_event( 10 );
+  }
+  check( runs == 0, "an uninterested error-queue rule was run" );
+  check( cancelled, "an error nobody was interested in did not finish the error-queue rule" );
+  check( loop.wait_next_event( 10 ) == EventLoop::Result::Timeout, "the loop woke up for the error queue again" );
+
+  sender.reap_zerocopy();
+  check( sender.zerocopy_pending() == 0, "the completion was lost" );
+}
+
+// timers run once or periodically, no earlier than their deadlines, keep the loop waiting for them (and no
+// longer), and stop when cancelled
+void test_timers()
+{
+  EventLoop loop;
+  const auto start = steady_clock::now();
+  const auto elapsed_ms = [&] { return duration_cast<milliseconds>( steady_clock::now() - start ).count(); };
+
+  int64_t one_shot_at = -1;
+  loop.add_timer_rule( "one-shot", 30, [&] { one_shot_at = elapsed_ms(); } );
+  vector<int64_t> periodic_at;
+  auto periodic = loop.add_timer_rule( "periodic", 10, [&] { periodic_at.push_back( elapsed_ms() ); }, 10 );
+  bool cancelled_ran = false;
+  loop.add_timer_rule( "cancelled", 5, [&] { cancelled_ran = true; } ).cancel();
+
+  while ( one_shot_at < 0 ) {
+    check( loop.wait_next_event( -1 ) == EventLoop::Result::Success, "a wait for a timer ended without it" );
+  }
+  check( one_shot_at >= 30, "one-shot timer ran early" );
+  check( not cancelled_ran, "a cancelled timer ran" );
+  check( periodic_at.size() >= 2 and periodic_at.front() >= 10, "periodic timer did not run every period" );
+  for ( size_t i = 1; i < periodic_at.size(); ++i ) {
+    check( periodic_at[i] - periodic_at[i - 1] >= 9, "periodic timer ran early" );
+  }
+
+  periodic.cancel();
+  const size_t periodic_runs = periodic_at.size();
+  check( loop.wait_next_event( -1 ) == EventLoop::Result::Exit, "loop did not exit once no timer was left" );
+  check( periodic_at.size() == periodic_runs, "a cancelled periodic timer ran" );
+
+  // a timer shortens a wait on an fd rule, and an fd rule served first does not delay a timer that is due
+  Pipe pipe = make_pipe();
+  loop.add_rule( "idle pipe", pipe.read_end, Direction::In, [] {} );
+  bool ran = false;
+  loop.add_timer_rule( "timer", 20, [&] { ran = true; } );
+  const auto wait_start = steady_clock::now();
+  check( loop.wait_next_event( 1000 ) == EventLoop::Result::Success and ran, "timer did not end the wait" );
+  check( steady_clock::now() - wait_start < milliseconds { 500 }, "timer did not shorten the wait" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    test_ready_and_interest();
+    test_dispatch();
+    test_summary();
+    test_cancel_and_exit();
+    test_regular_file();
+    test_datagram_rule( EventLoop::Backend::Epoll );
+    test_datagram_rule( EventLoop::Backend::IoUring );
+    test_datagram_buffer_size( EventLoop::Backend::Epoll );
+    test_datagram_buffer_size( EventLoop::Backend::IoUring );
+    test_timers();
+    test_error_queue_rule();
+    test_uninterested_error_queue_rule();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "socket.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+struct Result
+{
+  double syscalls_per_datagram;
+  double datagrams_per_second;
+};
+
+// Bursts of `burst` UDP datagrams over loopback, each burst received by a datagram rule before the next is sent:
+// what receiving costs per datagram, in system calls made by the loop and in time (including the sender's)
+Result receive_bursts( const EventLoop::Backend backend, const size_t datagrams, const size_t burst )
+{
+  EventLoop loop { backend };
+
+  UDPSocket receiver;
+  receiver.bind( Address { "127.0.0.1", 0 } );
+  UDPSocket sender;
+  sender.connect( receiver.local_address() );
+
+  size_t received = 0;
+  size_t received_bytes = 0;
+  loop.add_datagram_rule( "receive datagrams", receiver, [&]( const vector<string_view>& batch ) {
+    received += batch.size();
+    for ( const auto datagram : batch ) {
+      received_bytes += datagram.size();
+    }
+  } );
+
+  const string payload( 1000, 'x' );
+  const uint64_t syscalls_before = loop.syscalls();
+  const auto start = steady_clock::now();
+  for ( size_t sent = 0; sent < datagrams; ) {
+    for ( size_t i = 0; i < burst; ++i, ++sent ) {
+      sender.send( payload );
+    }
+    while ( received < sent ) {
+      if ( loop.wait_next_event( 1000 ) != EventLoop::Result::Success ) {
+        throw runtime_error( "datagrams were lost (received " + to_string( received ) + " of " + to_string( sent )
+                             + ")" );
+      }
+    }
+  }
+  const auto stop = steady_clock::now();
+
+  if ( received_bytes != datagrams * payload.size() ) {
+    throw runtime_error( "datagrams were truncated" );
+  }
+
+  const double seconds = duration<double>( stop - start ).count();
+  return { static_cast<double>( loop.syscalls() - syscalls_before ) / static_cast<double>( datagrams ),
+           static_cast<double>( datagrams ) / seconds };
+}
+
+} // namespace
+
+void speed_test( const size_t datagrams, const size_t burst )
+{
+  const Result epoll = receive_bursts( EventLoop::Backend::Epoll, datagrams, burst );
+  const bool io_uring_supported = EventLoop { EventLoop::Backend::IoUring }.backend() == EventLoop::Backend::IoUring;
+  const Result io_uring = receive_bursts( EventLoop::Backend::IoUring, datagrams, burst );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Receiving " << datagrams << " loopback UDP datagrams in bursts of " << burst << ": epoll " << fixed
+       << setprecision( 2 ) << epoll.syscalls_per_datagram << " syscalls/datagram, " << setprecision( 0 )
+       << epoll.datagrams_per_second << " datagrams/s; io_uring"
+       << ( io_uring_supported ? "" : " (not supported, fell back to epoll)" ) << " " << setprecision( 2 )
+       << io_uring.syscalls_per_datagram << " syscalls/datagram, " << setprecision( 0 )
+       << io_uring.datagrams_per_second << " datagrams/s.\n";
+
+  debug_output << "      EventLoop datagram rules: epoll " << fixed << setprecision( 2 )
+               << epoll.syscalls_per_datagram << " syscalls/datagram, io_uring " << io_uring.syscalls_per_datagram
+               << " syscalls/datagram\n";
+
+  if ( io_uring_supported and io_uring.syscalls_per_datagram >= epoll.syscalls_per_datagram ) {
+    throw runtime_error( "io_uring backend made as many system calls per datagram as epoll" );
+  }
+}
+
+int main()
+{
+  try {
+    speed_test( 200000, 32 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
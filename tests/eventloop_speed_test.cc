@@ -0,0 +1,86 @@
+#include "eventloop.hh"
+#include "exception.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// `idle` fds that never become ready (eventfds nobody signals) and one pipe that carries a byte per event:
+// what one wakeup costs when almost every registered fd is idle
+void speed_test( const size_t idle, const size_t events )
+{
+  EventLoop loop;
+
+  vector<FileDescriptor> idle_fds;
+  idle_fds.reserve( idle );
+  const size_t idle_category = loop.add_category( "idle fd" );
+  for ( size_t i = 0; i < idle; ++i ) {
+    idle_fds.emplace_back( CheckSystemCall( "eventfd", ::eventfd( 0, EFD_NONBLOCK ) ) );
+    loop.add_rule( idle_category, idle_fds.back(), Direction::In, [] {} );
+  }
+
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe2", ::pipe2( fds.data(), O_NONBLOCK ) );
+  FileDescriptor read_end { fds[0] };
+  FileDescriptor write_end { fds[1] };
+
+  size_t served = 0;
+  string buffer;
+  loop.add_rule( "active fd", read_end, Direction::In, [&] {
+    buffer.clear();
+    read_end.read( buffer );
+    served += buffer.size();
+  } );
+
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < events; ++i ) {
+    write_end.write( "x" );
+    if ( loop.wait_next_event( -1 ) != EventLoop::Result::Success ) {
+      throw runtime_error( "expected the active fd to be served" );
+    }
+  }
+  const auto stop = steady_clock::now();
+
+  if ( served != events ) {
+    throw runtime_error( "served " + to_string( served ) + " of " + to_string( events ) + " events" );
+  }
+
+  const double ns_per_event = static_cast<double>( duration_cast<nanoseconds>( stop - start ).count() )
+                              / static_cast<double>( events );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "EventLoop with " << idle << " idle fds and 1 active fd: " << fixed << setprecision( 0 ) << ns_per_event
+       << " ns per event (" << events << " events).\n";
+
+  debug_output << "      EventLoop (" << idle << " idle fds): " << fixed << setprecision( 2 )
+               << ns_per_event / 1000 << " us/event\n";
+
+  if ( ns_per_event > 100000 ) {
+    throw runtime_error( "EventLoop took " + to_string( ns_per_event ) + " ns per event" );
+  }
+}
+
+int main()
+{
+  try {
+    speed_test( 10000, 20000 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+#include "arp_message.hh"
+#include "common.hh"
+#include "ethernet_header.hh"
+#include "header_layout.hh"
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "random.hh"
+#include "tcp_segment.hh"
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+string joined( const vector<string>& pieces )
+{
+  string ret;
+  for ( const auto& piece : pieces ) {
+    ret += piece;
+  }
+  return ret;
+}
+
+bool same( const IPv4Header& a, const IPv4Header& b )
+{
+  return a.ver == b.ver and a.hlen == b.hlen and a.tos == b.tos and a.len == b.len and a.id == b.id
+         and a.df == b.df and a.mf == b.mf and a.offset == b.offset and a.ttl == b.ttl and a.proto == b.proto
+         and a.cksum == b.cksum and a.src == b.src and a.dst == b.dst;
+}
+
+bool same( const EthernetHeader& a, const EthernetHeader& b )
+{
+  return a.dst == b.dst and a.src == b.src and a.type == b.type;
+}
+
+bool same( const ARPMessage& a, const ARPMessage& b )
+{
+  return a.hardware_type == b.hardware_type and a.protocol_type == b.protocol_type
+         and a.hardware_address_size == b.hardware_address_size
+         and a.protocol_address_size == b.protocol_address_size and a.opcode == b.opcode
+         and a.sender_ethernet_address == b.sender_ethernet_address and a.sender_ip_address == b.sender_ip_address
+         and a.target_ethernet_address == b.target_ethernet_address and a.target_ip_address == b.target_ip_address;
+}
+
+bool same( const TCPSegment& a, const TCPSegment& b )
+{
+  return a.udinfo.src_port == b.udinfo.src_port and a.udinfo.dst_port == b.udinfo.dst_port
+         and a.udinfo.cksum == b.udinfo.cksum and a.message.sender == b.message.sender
+         and a.message.receiver.ackno == b.message.receiver.ackno
+         and a.message.receiver.window_size == b.message.receiver.window_size
+         and a.message.receiver.RST == b.message.receiver.RST;
+}
+
+// Parses `wire` (split in two at `split`) with the generated and the hand-written parser: both must agree on
+// whether it parsed, and on every field if it did.
+template<class Header>
+bool compare_parses( const string& wire, const size_t split, const string& what )
+{
+  const size_t cut = min( split, wire.size() );
+  const vector<string> pieces { wire.substr( 0, cut ), wire.substr( cut ) };
+
+  Header generated {};
+  Parser generated_parser { pieces };
+  generated.parse( generated_parser );
+
+  Header by_hand {};
+  Parser by_hand_parser { pieces };
+  by_hand.parse_by_hand( by_hand_parser );
+
+  check( generated_parser.has_error() == by_hand_parser.has_error(), what + ": the parsers disagree on an error" );
+  check( generated_parser.has_error() or same( generated, by_hand ), what + ": the parsers disagree on a field" );
+  return not generated_parser.has_error();
+}
+
+// serializes `header` with the generated and the hand-written serializer, which must produce the same bytes
+template<class Header>
+void compare_serializations( const Header& header, const string& what )
+{
+  Serializer generated;
+  header.serialize( generated );
+  Serializer by_hand;
+  header.serialize_by_hand( by_hand );
+  check( joined( generated.output() ) == joined( by_hand.output() ), what + ": the serializers disagree" );
+}
+
+// random bytes (a valid header of each kind, now and then, to get past the parsers' checks)
+void test_random_parses()
+{
+  auto rd = get_random_engine();
+  uniform_int_distribution<int> byte { 0, 255 };
+
+  size_t ip_parsed = 0;
+  size_t arp_parsed = 0;
+  for ( size_t i = 0; i < 20000; ++i ) {
+    string wire( 64, 0 );
+    for ( auto& c : wire ) {
+      c = static_cast<char>( byte( rd ) );
+    }
+    const size_t split = uniform_int_distribution<size_t> { 0, wire.size() }( rd );
+    const size_t length = uniform_int_distribution<size_t> { 0, wire.size() }( rd );
+
+    compare_parses<EthernetHeader>( wire.substr( 0, length ), split, "Ethernet" );
+    compare_parses<TCPSegment>( wire.substr( 0, length ), split, "TCP" );
+
+    string ip_wire = wire;
+    string arp_wire = wire;
+    if ( i % 2 ) {
+      ip_wire[0] = 0x45; // IPv4, 20-byte header
+      IPv4Header ip;
+      Parser parser { vector<string> { ip_wire } };
+      ip.parse_by_hand( parser );
+      ip.compute_checksum();
+      Serializer s;
+      ip.serialize_by_hand( s );
+      ip_wire.replace( 0, IPv4Header::LENGTH, joined( s.output() ) );
+
+      arp_wire.replace( 0, 8, string { 0, 1, 8, 0, 6, 4, 0, static_cast<char>( 1 + i % 4 ) } ); // (mostly valid)
+    }
+    ip_parsed += compare_parses<IPv4Header>( ip_wire.substr( 0, length ), split, "IPv4" );
+    arp_parsed += compare_parses<ARPMessage>( arp_wire.substr( 0, length ), split, "ARP" );
+  }
+  check( ip_parsed > 1000 and arp_parsed > 1000, "too few of the random headers were valid" );
+}
+
+// random field values (masked to their widths by both serializers)
+void test_random_serializations()
+{
+  auto rd = get_random_engine();
+  auto random = [&]<class T>( T& field ) {
+    if constexpr ( is_same_v<T, bool> ) {
+      field = uniform_int_distribution<int> { 0, 1 }( rd );
+    } else {
+      field = static_cast<T>( uniform_int_distribution<uint64_t> {}( rd ) );
+    }
+  };
+
+  for ( size_t i = 0; i < 20000; ++i ) {
+    IPv4Header ip;
+    for ( auto* field : { &ip.hlen, &ip.tos, &ip.ttl, &ip.proto } ) {
+      random( *field );
+    }
+    for ( auto* field : { &ip.len, &ip.id, &ip.offset, &ip.cksum } ) {
+      random( *field );
+    }
+    random( ip.df );
+    random( ip.mf );
+    random( ip.src );
+    random( ip.dst );
+    compare_serializations( ip, "IPv4" );
+
+    EthernetHeader ethernet {};
+    for ( auto& b : ethernet.dst ) {
+      random( b );
+    }
+    for ( auto& b : ethernet.src ) {
+      random( b );
+    }
+    random( ethernet.type );
+    compare_serializations( ethernet, "Ethernet" );
+
+    ARPMessage arp;
+    arp.opcode = 1 + i % 2;
+    for ( auto& b : arp.sender_ethernet_address ) {
+      random( b );
+    }
+    random( arp.sender_ip_address );
+    random( arp.target_ip_address );
+    compare_serializations( arp, "ARP" );
+
+    TCPSegment seg;
+    random( seg.udinfo.src_port );
+    random( seg.udinfo.dst_port );
+    random( seg.udinfo.cksum );
+    uint32_t raw {};
+    random( raw );
+    seg.message.sender.seqno = Wrap32 { raw };
+    random( raw );
+    if ( i % 3 ) {
+      seg.message.receiver.ackno = Wrap32 { raw };
+    }
+    random( seg.message.sender.SYN );
+    random( seg.message.sender.FIN );
+    random( seg.message.sender.RST );
+    random( seg.message.receiver.RST );
+    random( seg.message.receiver.window_size );
+    seg.message.sender.payload = string( i % 5, 'x' );
+    compare_serializations( seg, "TCP" );
+  }
+}
+
+// the layout checks its fields at compile time; at run time, a field that shares its bytes leaves its
+// neighbours alone
+void test_bitfields()
+{
+  struct Header
+  {
+    uint8_t a {};
+    uint16_t b {};
+    bool c {};
+  };
+  using Layout = header_layout::
+    Layout<3, header_layout::Field<0, 3, &Header::a>, header_layout::Field<3, 12, &Header::b>,
+           header_layout::Reserved<15, 8>, header_layout::Field<23, 1, &Header::c>>;
+
+  const Header header { .a = 0b101, .b = 0xabc, .c = true };
+  string wire( 3, 0 );
+  Layout::serialize( header, span<char, 3> { wire.data(), 3 } );
+  check( wire == string { static_cast<char>( 0b1011'0101 ), static_cast<char>( 0b0111'1000 ), 1 },
+         "the bitfields were packed wrong" );
+
+  wire[1] = static_cast<char>( wire[1] | 1 ); // (reserved bits are ignored)
+  Header parsed;
+  Layout::parse( parsed, span<const char, 3> { wire.data(), 3 } );
+  check( parsed.a == header.a and parsed.b == header.b and parsed.c, "the bitfields were unpacked wrong" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    test_bitfields();
+    test_random_parses();
+    test_random_serializations();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "tcp_segment.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+// the IPv4 and TCP headers of a datagram carrying an empty ACK
+pair<IPv4Header, TCPSegment> make_headers()
+{
+  IPv4Header ip;
+  ip.src = 0x0a000001;
+  ip.dst = 0x0a000002;
+  ip.len = IPv4Header::LENGTH + 20;
+  ip.compute_checksum();
+
+  TCPSegment seg;
+  seg.udinfo = { .src_port = 1234, .dst_port = 5678, .cksum = 0 };
+  seg.message.sender = { .seqno = Wrap32 { 0x12345678 } };
+  seg.message.receiver = { .ackno = Wrap32 { 0x9abcdef0 }, .window_size = 10000 };
+  seg.compute_checksum( ip.pseudo_checksum() );
+  return { ip, seg };
+}
+
+// Parses the IPv4 and TCP headers out of `wire` (which the Parser either sees whole, or a byte at a time), with the
+// parsers generated from the header layouts or with the hand-written ones.
+uint64_t parse_headers( const vector<SharedBuffer>& wire, const bool by_hand = false )
+{
+  Parser parser { wire };
+  IPv4Header ip;
+  TCPSegment seg;
+  if ( by_hand ) {
+    ip.parse_by_hand( parser );
+    seg.parse_by_hand( parser );
+  } else {
+    ip.parse( parser );
+    seg.parse( parser );
+  }
+  if ( parser.has_error() ) {
+    throw runtime_error( "header parse failed" );
+  }
+  return ip.src + ip.dst + seg.udinfo.src_port + seg.message.receiver.window_size;
+}
+
+double ns_per( const steady_clock::time_point start, const steady_clock::time_point stop, const size_t iterations )
+{
+  return static_cast<double>( duration_cast<nanoseconds>( stop - start ).count() )
+         / static_cast<double>( iterations );
+}
+
+} // namespace
+
+// Parses and serializes `iterations` IPv4+TCP headers, and reports ns per header pair, with the code generated
+// from the header layouts and with the hand-written code. The generated parse is also timed from a buffer per byte
+// (so that each field straddles buffers).
+int main()
+{
+  try {
+    constexpr size_t iterations = 1000000;
+    const auto [ip, seg] = make_headers();
+
+    uint64_t sink = 0;
+    const auto serialize_start = steady_clock::now();
+    for ( size_t i = 0; i < iterations; ++i ) {
+      Serializer s;
+      ip.serialize( s );
+      seg.serialize( s );
+      sink += s.output().front().size();
+    }
+    const auto serialize_stop = steady_clock::now();
+
+    const auto by_hand_serialize_start = steady_clock::now();
+    for ( size_t i = 0; i < iterations; ++i ) {
+      Serializer s;
+      ip.serialize_by_hand( s );
+      seg.serialize_by_hand( s );
+      sink += s.output().front().size();
+    }
+    const auto by_hand_serialize_stop = steady_clock::now();
+
+    string wire;
+    for ( const auto& piece : serialize( ip ) ) {
+      wire += piece;
+    }
+    for ( const auto& piece : serialize( seg ) ) {
+      wire += piece;
+    }
+    const vector<SharedBuffer> whole { wire };
+    vector<SharedBuffer> bytes;
+    for ( const char c : wire ) {
+      bytes.emplace_back( string( 1, c ) );
+    }
+    const uint64_t expected = parse_headers( whole );
+    if ( parse_headers( bytes ) != expected or parse_headers( whole, true ) != expected ) {
+      throw runtime_error( "the parses disagree" );
+    }
+
+    const auto contiguous_start = steady_clock::now();
+    for ( size_t i = 0; i < iterations; ++i ) {
+      sink += parse_headers( whole );
+    }
+    const auto contiguous_stop = steady_clock::now();
+
+    const auto by_hand_start = steady_clock::now();
+    for ( size_t i = 0; i < iterations; ++i ) {
+      sink += parse_headers( whole, true );
+    }
+    const auto by_hand_stop = steady_clock::now();
+
+    const auto straddling_start = steady_clock::now();
+    for ( size_t i = 0; i < iterations / 10; ++i ) {
+      sink += parse_headers( bytes );
+    }
+    const auto straddling_stop = steady_clock::now();
+
+    const double serialize_ns = ns_per( serialize_start, serialize_stop, iterations );
+    const double by_hand_serialize_ns = ns_per( by_hand_serialize_start, by_hand_serialize_stop, iterations );
+    const double contiguous_ns = ns_per( contiguous_start, contiguous_stop, iterations );
+    const double by_hand_ns = ns_per( by_hand_start, by_hand_stop, iterations );
+    const double straddling_ns = ns_per( straddling_start, straddling_stop, iterations / 10 );
+
+    fstream debug_output;
+    debug_output.open( "/dev/tty" );
+
+    cout << "IPv4+TCP headers: " << fixed << setprecision( 1 ) << serialize_ns
+         << " ns serialized from the layouts (" << by_hand_serialize_ns << " by hand), " << contiguous_ns
+         << " ns parsed from one buffer (" << by_hand_ns << " by hand), " << straddling_ns
+         << " ns parsed from a buffer per byte. (" << sink % 2 << ")\n";
+
+    debug_output << "      IPv4+TCP header parse: " << fixed << setprecision( 1 ) << contiguous_ns
+                 << " ns, serialize: " << serialize_ns << " ns (by hand: " << by_hand_ns << ", "
+                 << by_hand_serialize_ns << ")\n";
+
+    if ( contiguous_ns > straddling_ns ) {
+      throw runtime_error( "parsing contiguous headers was slower than parsing them a byte at a time" );
+    }
+    if ( contiguous_ns > by_hand_ns ) {
+      throw runtime_error( "the parsers generated from the layouts were slower than the hand-written ones" );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,168 @@
+#include "tcp_minnow_socket_impl.hh"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <poll.h>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+//! IPv4 datagrams carrying TCP over one end of a Unix datagram socketpair (stands in for the TUN device)
+class SocketPairAdapter : public TCPOverIPv4Adapter
+{
+  FileDescriptor fd_;
+
+public:
+  explicit SocketPairAdapter( FileDescriptor&& fd ) : fd_( std::move( fd ) ) {}
+
+  optional<TCPMessage> read()
+  {
+    string bytes;
+    fd_.read( bytes );
+    InternetDatagram dgram;
+    if ( not parse( dgram, vector<string> { bytes } ) ) {
+      return {};
+    }
+    return unwrap_tcp_in_ip( dgram );
+  }
+
+  void write( const TCPMessage& msg ) { fd_.write( serialize( wrap_tcp_in_ip( msg ) ) ); }
+
+  FileDescriptor& fd() { return fd_; }
+};
+
+template class TCPMinnowSocket<SocketPairAdapter>;
+
+namespace {
+
+//! The far end: receives the socket's segments and answers by hand
+struct FarEnd
+{
+  FileDescriptor fd;
+  TCPOverIPv4Adapter adapter {};
+
+  optional<TCPMessage> receive( int timeout_ms )
+  {
+    pollfd pfd { fd.fd_num(), POLLIN, 0 };
+    if ( ::poll( &pfd, 1, timeout_ms ) != 1 ) {
+      return {};
+    }
+    string bytes;
+    fd.read( bytes );
+    InternetDatagram dgram;
+    if ( not parse( dgram, vector<string> { bytes } ) ) {
+      return {};
+    }
+    return adapter.unwrap_tcp_in_ip( dgram );
+  }
+
+  void send( const TCPMessage& msg ) { fd.write( serialize( adapter.wrap_tcp_in_ip( msg ) ) ); }
+};
+
+struct Usage
+{
+  double cpu_seconds;
+  long voluntary_switches;
+};
+
+Usage usage()
+{
+  rusage ru {};
+  getrusage( RUSAGE_SELF, &ru );
+  const auto seconds = []( const timeval& tv ) { return static_cast<double>( tv.tv_sec ) + tv.tv_usec / 1e6; };
+  return { seconds( ru.ru_utime ) + seconds( ru.ru_stime ), ru.ru_nvcsw };
+}
+
+} // namespace
+
+// Connect to a far end that ignores the first SYNs, measuring when each retransmission arrives against the
+// RTO schedule, then measure what the established but idle connection costs.
+void timer_test( const uint64_t rt_timeout, const unsigned retransmissions, const unsigned idle_ms )
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  FarEnd far { FileDescriptor { fds[1] } };
+  far.adapter.config_mut().source = Address { "10.144.0.2", 80 };
+  far.adapter.config_mut().destination = Address { "10.144.0.1", 40000 };
+
+  TCPMinnowSocket<SocketPairAdapter> socket { SocketPairAdapter { FileDescriptor { fds[0] } } };
+  TCPConfig tcp_config;
+  tcp_config.rt_timeout = rt_timeout;
+  FdAdapterConfig adapter_config;
+  adapter_config.source = Address { "10.144.0.1", 40000 };
+  adapter_config.destination = Address { "10.144.0.2", 80 };
+
+  thread connecting { [&] { socket.connect( tcp_config, adapter_config ); } };
+
+  vector<steady_clock::time_point> arrivals;
+  optional<TCPMessage> syn;
+  while ( arrivals.size() <= retransmissions ) {
+    syn = far.receive( 10000 );
+    if ( not syn.has_value() or not syn->sender.SYN ) {
+      throw runtime_error( "expected a SYN" );
+    }
+    arrivals.push_back( steady_clock::now() );
+  }
+
+  double total_error_ms = 0;
+  double max_error_ms = 0;
+  for ( unsigned i = 1; i < arrivals.size(); ++i ) {
+    const double expected = static_cast<double>( rt_timeout << ( i - 1 ) );
+    const double actual = duration<double, milli>( arrivals[i] - arrivals[i - 1] ).count();
+    total_error_ms += fabs( actual - expected );
+    max_error_ms = max( max_error_ms, fabs( actual - expected ) );
+  }
+
+  far.send( { .sender = { .seqno = Wrap32 { 0 }, .SYN = true },
+              .receiver = { .ackno = syn->sender.seqno + 1, .window_size = 1000 } } );
+  connecting.join();
+  far.receive( 1000 ); // the ACK of our SYN
+
+  const Usage before = usage();
+  this_thread::sleep_for( milliseconds( idle_ms ) );
+  const Usage after = usage();
+
+  far.send( { .sender = { .seqno = Wrap32 { 1 } }, .receiver = { .RST = true } } );
+  socket.wait_until_closed();
+
+  const double idle_seconds = idle_ms / 1000.0;
+  // (one of the voluntary switches is this thread going to sleep)
+  const double wakeups
+    = static_cast<double>( after.voluntary_switches - before.voluntary_switches - 1 ) / idle_seconds;
+  const double cpu_percent = 100 * ( after.cpu_seconds - before.cpu_seconds ) / idle_seconds;
+  const double mean_error_ms = total_error_ms / retransmissions;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "SYN retransmissions (RTO " << rt_timeout << " ms): " << fixed << setprecision( 1 ) << mean_error_ms
+       << " ms mean error, " << max_error_ms << " ms max error. Idle established connection: " << wakeups
+       << " wakeups/s, " << setprecision( 3 ) << cpu_percent << "% CPU.\n";
+
+  debug_output << "      TCPMinnowSocket timers: RTO error " << fixed << setprecision( 1 ) << mean_error_ms
+               << " ms mean, idle " << wakeups << " wakeups/s\n";
+
+  if ( wakeups > 50 ) {
+    throw runtime_error( "idle connection woke up " + to_string( wakeups ) + " times per second" );
+  }
+}
+
+int main()
+{
+  try {
+    timer_test( 25, 5, 1000 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
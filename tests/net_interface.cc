@@ -56,7 +56,7 @@ EthernetFrame make_frame( const EthernetAddress& src,
   frame.header.src = src;
   frame.header.dst = dst;
   frame.header.type = type;
-  frame.payload = std::move( payload );
+  frame.payload = { payload.begin(), payload.end() };
   return frame;
 }
 
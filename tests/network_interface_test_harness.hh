@@ -49,9 +49,14 @@ struct SendDatagram : public Action<InterfaceAndOutput>
   SendDatagram( InternetDatagram d, Address n ) : dgram( std::move( d ) ), next_hop( n ) {}
 };
 
-inline std::string concat( const std::vector<std::string>& buffers )
+template<class Buffer>
+std::string concat( const std::vector<Buffer>& buffers )
 {
-  return std::accumulate( buffers.begin(), buffers.end(), std::string {} );
+  std::string ret;
+  for ( const auto& buffer : buffers ) {
+    ret.append( std::string_view { buffer } );
+  }
+  return ret;
 }
 
 template<class T>
@@ -0,0 +1,103 @@
+#include "common.hh"
+#include "ethernet_frame.hh"
+#include "ipv4_datagram.hh"
+#include "packet_buffer.hh"
+#include "parser.hh"
+#include "tcp_segment.hh"
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// the bytes of an object, serialized (the way the layers did before they shared a PacketBuffer)
+template<class T>
+string joined( const T& obj )
+{
+  string ret;
+  for ( const auto& piece : serialize( obj ) ) {
+    ret += piece;
+  }
+  return ret;
+}
+
+// Each layer writes its header into the headroom in front of the one above, so the frame ends up as one buffer
+// holding the only copy of the payload.
+void test_layers_prepend_in_place()
+{
+  TCPSegment seg;
+  seg.udinfo = { .src_port = 1234, .dst_port = 5678, .cksum = 0 };
+  seg.message.sender = { .seqno = Wrap32 { 7 }, .payload = string( 1000, 'x' ) };
+  seg.message.receiver = { .ackno = Wrap32 { 9 }, .window_size = 5000 };
+
+  IPv4Datagram dgram;
+  dgram.header.src = 0x0a000001;
+  dgram.header.dst = 0x0a000002;
+  dgram.header.len = IPv4Header::LENGTH + 20 + seg.message.sender.payload.size();
+  seg.compute_checksum( dgram.header.pseudo_checksum() );
+  dgram.header.compute_checksum();
+  dgram.payload = serialize_payload( seg );
+  check( dgram.payload.size() == 1 and dgram.payload.front() == joined( seg ), "the segment was garbled" );
+  const char* const segment_start = dgram.payload.front().data();
+
+  EthernetFrame frame;
+  frame.header.type = EthernetHeader::TYPE_IPv4;
+  frame.payload = serialize_payload( dgram );
+  check( frame.payload.size() == 1 and frame.payload.front() == joined( dgram ), "the datagram was garbled" );
+  check( frame.payload.front().data() == segment_start - IPv4Header::LENGTH,
+         "the IPv4 header was not written in front of the segment" );
+
+  const SharedBuffer wire = frame.serialize_packet();
+  check( wire == joined( frame ), "the frame was garbled" );
+  check( wire.data() == segment_start - IPv4Header::LENGTH - EthernetHeader::LENGTH,
+         "the Ethernet header was not written in front of the datagram" );
+  check( wire.use_count() == 3, "the layers do not share one buffer" );
+
+  // the datagram's headroom has been claimed: a second frame (to another next hop, say) is a copy of its own
+  frame.header.dst = { 1, 2, 3, 4, 5, 6 };
+  const SharedBuffer second = frame.serialize_packet();
+  check( second == joined( frame ) and second.data() != wire.data(), "the second frame was not a copy" );
+  check( wire.view().substr( 0, 6 ) == string( 6, '\0' ), "the second frame overwrote the first" );
+}
+
+// a payload that is not a PacketBuffer (or is in pieces) is copied, once, into a new one
+void test_copy_into_packet()
+{
+  const vector<SharedBuffer> payload { "abc", "def" };
+  const SharedBuffer packet = prepend_header( vector<string> { "head" }, payload );
+  check( packet == "headabcdef", "the packet was garbled" );
+
+  const vector<SharedBuffer> whole { packet };
+  const SharedBuffer outer = prepend_header( vector<string> { "outer-" }, whole );
+  check( outer == "outer-headabcdef" and outer.data() + 6 == packet.data(),
+         "the header was not prepended in place" );
+
+  bool threw = false;
+  try {
+    PacketBuffer small { payload, 2 };
+    small.prepend( vector<string> { "too long" } );
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  check( threw, "a header longer than the headroom was written" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    test_layers_prepend_in_place();
+    test_copy_into_packet();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
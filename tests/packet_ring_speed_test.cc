@@ -0,0 +1,197 @@
+#include "common.hh"
+#include "ethernet_header.hh"
+#include "exception.hh"
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "socket.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <netinet/in.h>
+#include <span>
+#include <sys/socket.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t PAYLOAD_SIZE = 200;
+constexpr size_t FRAME_SIZE = IPv4Header::LENGTH + 8 + PAYLOAD_SIZE; // (an IP datagram: the link header is gone)
+
+// a packet socket that sees the IP datagrams arriving on loopback (and not, a second time, as they leave)
+PacketSocket loopback_listener()
+{
+  PacketSocket socket { SOCK_DGRAM, htons( ETH_P_IP ) };
+  socket.set_ignore_outgoing();
+  socket.bind_to_interface( "lo" );
+  return socket;
+}
+
+// an Ethernet frame carrying a UDP datagram (without checksum) from 127.0.0.1 to `destination`
+string loopback_frame( const Address& destination, const string& payload )
+{
+  const auto& to = *destination.as<sockaddr_in>();
+  IPv4Header ip;
+  ip.proto = IPPROTO_UDP;
+  ip.len = IPv4Header::LENGTH + 8 + payload.size();
+  ip.src = ntohl( to.sin_addr.s_addr );
+  ip.dst = ip.src;
+  ip.compute_checksum();
+
+  string frame;
+  for ( const auto& piece : serialize( EthernetHeader { {}, {}, EthernetHeader::TYPE_IPv4 } ) ) {
+    frame += piece;
+  }
+  for ( const auto& piece : serialize( ip ) ) {
+    frame += piece;
+  }
+  const uint16_t port = ntohs( to.sin_port );
+  const uint16_t udp_length = 8 + payload.size();
+  for ( const uint16_t field : { port, port, udp_length, uint16_t {} } ) {
+    frame.push_back( static_cast<char>( field >> 8 ) );
+    frame.push_back( static_cast<char>( field ) );
+  }
+  return frame + payload;
+}
+
+// Frames queued in the transmit ring go out with one system call, and come back in through the receive ring.
+// (Only as far as the packet sockets, though: IP drops a datagram from 127.0.0.1 that has no route attached.)
+void test_round_trip()
+{
+  PacketSocket listener = loopback_listener();
+  listener.map_rings( { .block_size = 1 << 16, .rx_blocks = 4, .tx_blocks = 0 } );
+
+  PacketSocket sender { SOCK_RAW, 0 }; // (protocol 0: it receives nothing)
+  sender.bind_to_interface( "lo" );
+  sender.map_rings( { .block_size = 1 << 16, .rx_blocks = 1, .tx_blocks = 1 } );
+
+  constexpr size_t count = 16;
+  for ( size_t i = 0; i < count; ++i ) {
+    const string frame = loopback_frame( Address { "127.0.0.1", 9 }, string( PAYLOAD_SIZE, 'a' + i ) );
+    check( sender.queue_tx( frame ), "the transmit ring was full" );
+  }
+  sender.flush_tx();
+  this_thread::sleep_for( milliseconds( 10 ) ); // (the kernel retires a partly filled block after a timeout)
+
+  size_t seen = 0;
+  for ( auto frames = listener.next_rx_block(); not frames.empty(); frames = listener.next_rx_block() ) {
+    for ( const string_view frame : frames ) {
+      if ( frame.size() == FRAME_SIZE and frame.ends_with( string( PAYLOAD_SIZE, 'a' + seen ) ) ) {
+        ++seen;
+      }
+    }
+  }
+  check( seen == count, "the receive ring saw " + to_string( seen ) + " of " + to_string( count ) + " frames" );
+}
+
+// sends `count` UDP datagrams over loopback, in batches of 64
+void send_datagrams( UDPSocket& sender, const Address& destination, const size_t count )
+{
+  static const string payload( PAYLOAD_SIZE, 'x' );
+  vector<iovec> iovecs( 64, iovec { const_cast<char*>( payload.data() ), payload.size() } ); // NOLINT
+  vector<mmsghdr> messages( 64 );
+  for ( size_t sent = 0; sent < count; ) {
+    const size_t batch = min<size_t>( 64, count - sent );
+    for ( size_t i = 0; i < batch; ++i ) {
+      messages[i] = {};
+      messages[i].msg_hdr.msg_name = const_cast<sockaddr*>( destination.raw() ); // NOLINT(*-const-cast)
+      messages[i].msg_hdr.msg_namelen = destination.size();
+      messages[i].msg_hdr.msg_iov = &iovecs[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    sent += sender.send_batch( span { messages.data(), batch } );
+  }
+}
+
+// Sends `rounds` rounds of `burst` datagrams over loopback, and times how fast a packet socket drains each round,
+// one recv() per frame or a ring block at a time. Returns frames per second.
+double drain_rate( const bool ring, const size_t rounds, const size_t burst )
+{
+  UDPSocket sink;
+  sink.bind( Address { "127.0.0.1", 0 } );
+  UDPSocket sender;
+
+  PacketSocket listener = loopback_listener();
+  listener.set_blocking( false );
+  if ( ring ) {
+    listener.map_rings( { .rx_blocks = 16, .tx_blocks = 0 } );
+  } else {
+    const int buffer_size = 64 << 20; // (room for a whole round)
+    CheckSystemCall( "setsockopt",
+                     ::setsockopt( listener.fd_num(), SOL_SOCKET, SO_RCVBUFFORCE, &buffer_size, sizeof( int ) ) );
+  }
+
+  size_t frames = 0;
+  duration<double> elapsed {};
+  for ( size_t round = 0; round < rounds; ++round ) {
+    send_datagrams( sender, sink.local_address(), burst );
+    this_thread::sleep_for( milliseconds( 5 ) ); // (for the ring: the last block is retired after a timeout)
+
+    const auto start = steady_clock::now();
+    if ( ring ) {
+      for ( auto block = listener.next_rx_block(); not block.empty(); block = listener.next_rx_block() ) {
+        for ( const string_view frame : block ) {
+          frames += frame.size() == FRAME_SIZE;
+        }
+      }
+    } else {
+      for ( string frame; listener.read( frame ), not frame.empty(); ) {
+        frames += frame.size() == FRAME_SIZE;
+      }
+    }
+    elapsed += steady_clock::now() - start;
+  }
+
+  const uint64_t drops = listener.take_drops();
+  const string path = ring ? "the ring" : "recv()";
+  check( frames + drops >= rounds * burst,
+         path + " saw " + to_string( frames ) + " of " + to_string( rounds * burst ) + " frames (and dropped "
+           + to_string( drops ) + ")" );
+  return static_cast<double>( frames ) / elapsed.count();
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    try {
+      const PacketSocket probe { SOCK_DGRAM, htons( ETH_P_IP ) };
+    } catch ( const unix_error& e ) {
+      cout << "(packet sockets need CAP_NET_RAW, so skipping)\n";
+      return EXIT_SUCCESS;
+    }
+
+    test_round_trip();
+
+    constexpr size_t rounds = 80;
+    constexpr size_t burst = 1024;
+    const double recv_rate = drain_rate( false, rounds, burst );
+    const double ring_rate = drain_rate( true, rounds, burst );
+
+    fstream debug_output;
+    debug_output.open( "/dev/tty" );
+
+    cout << "Packet socket on lo, " << FRAME_SIZE << "-byte frames: " << fixed << setprecision( 2 )
+         << recv_rate / 1e6 << " Mframes/s with recv(), " << ring_rate / 1e6
+         << " Mframes/s from the TPACKET_V3 ring (" << ring_rate / recv_rate << "x).\n";
+
+    debug_output << "      PACKET_MMAP ring speedup: " << fixed << setprecision( 2 ) << ring_rate / recv_rate
+                 << "x\n";
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+#include "buffer_pool.hh"
+#include "ethernet_frame.hh"
+#include "ipv4_datagram.hh"
+#include "parser.hh"
+#include "reassembler.hh"
+#include "tcp_segment.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// allocation-counting hook: the bytes of every operator new in this program are counted (each copy of a payload
+// into a string of its own is one such allocation)
+namespace {
+size_t allocated_bytes = 0; // NOLINT(*-avoid-non-const-global-variables)
+}
+
+void* operator new( size_t size )
+{
+  allocated_bytes += size;
+  if ( void* p = malloc( size ) ) { // NOLINT(*-no-malloc)
+    return p;
+  }
+  throw bad_alloc {};
+}
+
+void operator delete( void* p ) noexcept
+{
+  free( p ); // NOLINT(*-no-malloc)
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+  free( p ); // NOLINT(*-no-malloc)
+}
+
+namespace {
+
+constexpr size_t PAYLOAD_SIZE = 1400;
+
+// an Ethernet frame carrying an IPv4 datagram carrying a TCP segment with `PAYLOAD_SIZE` bytes of payload
+string make_frame()
+{
+  IPv4Datagram dgram;
+  dgram.header.src = 0x0a000001;
+  dgram.header.dst = 0x0a000002;
+  dgram.header.len = IPv4Header::LENGTH + 20 + PAYLOAD_SIZE;
+
+  TCPSegment seg;
+  seg.udinfo = { .src_port = 1234, .dst_port = 5678, .cksum = 0 };
+  seg.message.sender = { .seqno = Wrap32 { 0 }, .payload = string( PAYLOAD_SIZE, 'x' ) };
+  seg.message.receiver = { .ackno = Wrap32 { 1 }, .window_size = 10000 };
+  seg.compute_checksum( dgram.header.pseudo_checksum() );
+  dgram.payload = serialize_payload( seg );
+  dgram.header.compute_checksum();
+
+  EthernetFrame frame;
+  frame.header.type = EthernetHeader::TYPE_IPv4;
+  frame.payload = serialize_payload( dgram );
+
+  string ret;
+  for ( const auto& piece : serialize( frame ) ) {
+    ret += piece;
+  }
+  return ret;
+}
+
+// each layer parses a copy of the buffers of the one before, as the parsers did before they shared their input
+TCPSenderMessage parse_copying( const string_view wire )
+{
+  Parser frame_parser { vector<string> { string { wire } } };
+  EthernetHeader ethernet;
+  ethernet.parse( frame_parser );
+  vector<string> frame_payload;
+  frame_parser.all_remaining( frame_payload );
+
+  Parser datagram_parser { frame_payload };
+  IPv4Header ip;
+  ip.parse( datagram_parser );
+  vector<string> datagram_payload;
+  datagram_parser.all_remaining( datagram_payload );
+
+  TCPSegment seg;
+  if ( not parse( seg, datagram_payload, ip.pseudo_checksum() ) ) {
+    throw runtime_error( "copying parse failed" );
+  }
+  return { .seqno = seg.message.sender.seqno, .payload = static_cast<string>( seg.message.sender.payload ) };
+}
+
+// each layer narrows a view of the buffer the frame was read into
+TCPSenderMessage parse_sharing( PooledBuffer&& buffer )
+{
+  EthernetFrame frame;
+  IPv4Datagram dgram;
+  TCPSegment seg;
+  if ( not parse( frame, vector<SharedBuffer> { SharedBuffer { move( buffer ) } } )
+       or not parse( dgram, frame.payload ) or not parse( seg, dgram.payload, dgram.header.pseudo_checksum() ) ) {
+    throw runtime_error( "sharing parse failed" );
+  }
+  return seg.message.sender;
+}
+
+// Parses `iterations` frames (each first "read" into a pooled buffer) down to the TCP payload, and hands the
+// payload to a Reassembler. Returns ns per frame and heap bytes allocated per payload byte.
+pair<double, double> speed_test( const bool sharing, const size_t iterations )
+{
+  const string wire = make_frame();
+  BufferPool pool { 2048 };
+  Reassembler reassembler { ByteStream { 1 << 20 } };
+
+  uint64_t index = 0;
+  const size_t allocated_before = allocated_bytes;
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < iterations; ++i ) {
+    PooledBuffer buffer = pool.get();
+    memcpy( buffer.data(), wire.data(), wire.size() );
+    buffer.resize( wire.size() );
+
+    TCPSenderMessage msg = sharing ? parse_sharing( move( buffer ) ) : parse_copying( buffer );
+    if ( msg.payload.size() != PAYLOAD_SIZE ) {
+      throw runtime_error( "wrong payload size" );
+    }
+    reassembler.insert( index, move( msg.payload ), false );
+    index += PAYLOAD_SIZE;
+    reassembler.reader().pop( reassembler.reader().bytes_buffered() );
+  }
+  const auto stop = steady_clock::now();
+  const size_t allocated = allocated_bytes - allocated_before;
+
+  if ( reassembler.reader().bytes_popped() != iterations * PAYLOAD_SIZE ) {
+    throw runtime_error( "the Reassembler lost bytes" );
+  }
+  return { static_cast<double>( duration_cast<nanoseconds>( stop - start ).count() )
+             / static_cast<double>( iterations ),
+           static_cast<double>( allocated ) / static_cast<double>( iterations * PAYLOAD_SIZE ) };
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    constexpr size_t iterations = 200000;
+    const auto [copying_ns, copying_bytes] = speed_test( false, iterations );
+    const auto [sharing_ns, sharing_bytes] = speed_test( true, iterations );
+
+    fstream debug_output;
+    debug_output.open( "/dev/tty" );
+
+    cout << "Ethernet/IPv4/TCP parse of " << PAYLOAD_SIZE << "-byte payloads into a Reassembler: " << fixed
+         << setprecision( 1 ) << copying_ns << " ns/frame and " << setprecision( 2 ) << copying_bytes
+         << " heap bytes per payload byte copying each layer, " << setprecision( 1 ) << sharing_ns
+         << " ns/frame and " << setprecision( 2 ) << sharing_bytes << " sharing the read buffer.\n";
+
+    debug_output << "      zero-copy parse: " << fixed << setprecision( 1 ) << sharing_ns << " ns/frame ("
+                 << copying_ns / sharing_ns << "x), " << setprecision( 2 ) << sharing_bytes
+                 << " heap bytes/payload byte\n";
+
+    if ( sharing_bytes >= 1 ) {
+      throw runtime_error( "the parse copied the payload" );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
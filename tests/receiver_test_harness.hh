@@ -8,6 +8,7 @@
 #include <optional>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 template<std::derived_from<TestStep<Reassembler>> T>
 struct DirectReassemblerTest : public TestStep<TCPReceiver>
@@ -191,3 +192,39 @@ struct SegmentArrives : public Action<TCPReceiver>
     return ss.str();
   }
 };
+
+struct SegmentsArrive : public Action<TCPReceiver>
+{
+  std::vector<TCPSenderMessage> msgs_ {};
+
+  SegmentsArrive& with_segment( const SegmentArrives& seg )
+  {
+    msgs_.push_back( seg.msg_ );
+    return *this;
+  }
+
+  void execute( TCPReceiver& rs ) const override { rs.receive_batch( msgs_ ); }
+
+  std::string description() const override
+  {
+    std::ostringstream ss;
+    ss << "receive batch of " << msgs_.size() << " segment" << ( msgs_.size() == 1 ? "" : "s" ) << ":";
+    for ( const auto& msg : msgs_ ) {
+      ss << " (seqno=" << msg.seqno;
+      if ( msg.SYN ) {
+        ss << " +SYN";
+      }
+      if ( not msg.payload.empty() ) {
+        ss << " payload=\"" << Printer::prettify( msg.payload ) << "\"";
+      }
+      if ( msg.FIN ) {
+        ss << " +FIN";
+      }
+      if ( msg.RST ) {
+        ss << " +RST";
+      }
+      ss << ")";
+    }
+    return ss.str();
+  }
+};
@@ -0,0 +1,87 @@
+#include "random.hh"
+#include "receiver_test_harness.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "batch of in-order segments", 4000 };
+      test.execute( SegmentsArrive {}
+                      .with_segment( SegmentArrives {}.with_syn().with_seqno( isn ).with_data( "ab" ) )
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 3 ).with_data( "cd" ) )
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 5 ).with_data( "ef" ) ) );
+      test.execute( ExpectAckno { Wrap32 { isn + 7 } } );
+      test.execute( BytesPending { 0 } );
+      test.execute( ReadAll { "abcdef" } );
+      test.execute( IsClosed { false } );
+    }
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "batch ending in FIN", 4000 };
+      test.execute( SegmentArrives {}.with_syn().with_seqno( isn ) );
+      test.execute( SegmentsArrive {}
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 1 ).with_data( "abc" ) )
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 4 ).with_data( "def" ).with_fin() ) );
+      test.execute( ExpectAckno { Wrap32 { isn + 8 } } );
+      test.execute( ReadAll { "abcdef" } );
+      test.execute( IsFinished { true } );
+    }
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "batch with a hole", 4000 };
+      test.execute( SegmentArrives {}.with_syn().with_seqno( isn ) );
+      test.execute( SegmentsArrive {}
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 1 ).with_data( "abc" ) )
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 7 ).with_data( "ghi" ) )
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 10 ).with_data( "jkl" ) ) );
+      test.execute( ExpectAckno { Wrap32 { isn + 4 } } );
+      test.execute( BytesPending { 6 } );
+      test.execute( ReadAll { "abc" } );
+      test.execute( SegmentArrives {}.with_seqno( isn + 4 ).with_data( "def" ) );
+      test.execute( ExpectAckno { Wrap32 { isn + 13 } } );
+      test.execute( ReadAll { "defghijkl" } );
+    }
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "batch with duplicate and data after FIN", 4000 };
+      test.execute( SegmentArrives {}.with_syn().with_seqno( isn ) );
+      test.execute( SegmentsArrive {}
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 1 ).with_data( "abc" ) )
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 1 ).with_data( "abc" ) )
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 4 ).with_data( "d" ).with_fin() )
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 6 ).with_data( "zz" ) ) );
+      test.execute( ExpectAckno { Wrap32 { isn + 6 } } );
+      test.execute( ReadAll { "abcd" } );
+      test.execute( IsFinished { true } );
+    }
+
+    {
+      const uint32_t isn = uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd );
+      TCPReceiverTestHarness test { "batch with RST", 4000 };
+      test.execute( SegmentArrives {}.with_syn().with_seqno( isn ) );
+      test.execute( SegmentsArrive {}
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 1 ).with_data( "abc" ) )
+                      .with_segment( SegmentArrives {}.with_seqno( isn + 4 ).with_rst() ) );
+      test.execute( ExpectReset { true } );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
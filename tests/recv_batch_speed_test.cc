@@ -0,0 +1,92 @@
+#include "tcp_config.hh"
+#include "tcp_receiver.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// Feed `num_segments` back-to-back segments of `mss` bytes through a TCPReceiver, either one at a time or in
+// bursts of `burst` segments via receive_batch(), and return the achieved segments per second.
+double receive_rate( const size_t num_segments, const size_t mss, const size_t burst, const string& data )
+{
+  const Wrap32 isn { 1 };
+  TCPReceiver receiver { Reassembler { ByteStream { TCPConfig::DEFAULT_CAPACITY } } };
+  receiver.receive( TCPSenderMessage { .seqno = isn, .SYN = true } );
+
+  vector<TCPSenderMessage> batch;
+  batch.reserve( burst );
+  size_t bytes_read = 0;
+
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_segments; ++i ) {
+    const uint64_t offset = i * mss;
+    TCPSenderMessage msg { .seqno = isn + 1 + offset, .payload = data.substr( offset % data.size(), mss ) };
+    if ( burst == 1 ) {
+      receiver.receive( move( msg ) );
+    } else {
+      batch.push_back( move( msg ) );
+      if ( batch.size() == burst or i + 1 == num_segments ) {
+        receiver.receive_batch( move( batch ) );
+        batch.clear();
+      }
+    }
+
+    if ( batch.empty() ) {
+      bytes_read += receiver.reader().bytes_buffered();
+      receiver.reader().pop( receiver.reader().bytes_buffered() );
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( bytes_read != num_segments * mss or receiver.reassembler().bytes_pending() ) {
+    throw runtime_error( "TCPReceiver did not deliver every byte in order" );
+  }
+
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  return static_cast<double>( num_segments ) / test_duration.count();
+}
+
+void speed_test( const size_t num_segments, const size_t mss, const size_t burst )
+{
+  const string data = [&] {
+    default_random_engine rd { 144 };
+    uniform_int_distribution<char> ud;
+    string ret;
+    for ( size_t i = 0; i < 64 * mss; ++i ) {
+      ret += ud( rd );
+    }
+    return ret;
+  }();
+
+  const double single_rate = receive_rate( num_segments, mss, 1, data );
+  const double batch_rate = receive_rate( num_segments, mss, burst, data );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "TCPReceiver with MSS=" << mss << ": " << fixed << setprecision( 2 ) << single_rate / 1e6
+       << " Msegments/s one at a time, " << batch_rate / 1e6 << " Msegments/s in bursts of " << burst << " ("
+       << batch_rate / single_rate << "x).\n";
+
+  debug_output << "             TCPReceiver batch speedup: " << fixed << setprecision( 2 )
+               << batch_rate / single_rate << "x\n";
+}
+
+int main()
+{
+  try {
+    speed_test( 200000, TCPConfig::MAX_PAYLOAD_SIZE, 32 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,258 @@
+#include "random.hh"
+#include "tcp_config.hh"
+#include "tcp_over_ip.hh"
+#include "tcp_peer.hh"
+#include "tcp_sender.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+TCPOverIPv4Adapter make_adapter()
+{
+  TCPOverIPv4Adapter adapter;
+  adapter.config_mut().source = Address { "169.254.144.9", 40000 };
+  adapter.config_mut().destination = Address { "169.254.144.1", 8080 };
+  return adapter;
+}
+
+// wire bytes of each datagram, wrapping every message as-is
+vector<string> wire_plain( TCPOverIPv4Adapter& adapter, const vector<TCPMessage>& msgs )
+{
+  vector<string> ret;
+  for ( const auto& msg : msgs ) {
+    string& dgram = ret.emplace_back();
+    for ( const auto& piece : serialize( adapter.wrap_tcp_in_ip( msg ) ) ) {
+      dgram.append( piece );
+    }
+  }
+  return ret;
+}
+
+// wire bytes of each datagram, splitting every message into `mss`-sized wire segments
+vector<string> wire_gso( TCPOverIPv4Adapter& adapter, const vector<TCPMessage>& msgs, size_t mss )
+{
+  vector<string> ret;
+  for ( const auto& msg : msgs ) {
+    for ( const auto& wire : adapter.segment_tcp_in_ip( msg, mss ) ) {
+      ret.push_back( string { wire.headers.begin(), wire.headers.end() } + string { wire.payload } );
+    }
+  }
+  return ret;
+}
+
+// wire bytes of each datagram, stamped from the adapter's header template
+vector<string> wire_stamped( TCPOverIPv4Adapter& adapter, const vector<TCPMessage>& msgs )
+{
+  vector<string> ret;
+  for ( const auto& msg : msgs ) {
+    TCPOverIPv4Adapter::Headers headers;
+    adapter.stamp_tcp_in_ip( msg, headers );
+    ret.push_back( string { headers.begin(), headers.end() }.append( msg.sender.payload ) );
+  }
+  return ret;
+}
+
+void expect_identical( const string& test_name, const vector<string>& expected, const vector<string>& actual )
+{
+  if ( expected.size() != actual.size() ) {
+    throw runtime_error( test_name + ": expected " + to_string( expected.size() ) + " wire segments, got "
+                         + to_string( actual.size() ) );
+  }
+  for ( size_t i = 0; i < expected.size(); ++i ) {
+    if ( expected[i] != actual[i] ) {
+      throw runtime_error( test_name + ": wire segment " + to_string( i ) + " differs from the non-GSO path" );
+    }
+  }
+}
+
+string random_string( default_random_engine& rd, size_t len )
+{
+  uniform_int_distribution<char> ud;
+  string ret;
+  for ( size_t i = 0; i < len; ++i ) {
+    ret += ud( rd );
+  }
+  return ret;
+}
+
+// run the same stream through two senders with different maximum payloads and return what they transmitted
+vector<TCPMessage> run_sender( uint64_t max_payload, Wrap32 isn, const string& data, uint16_t window )
+{
+  TCPSender sender { ByteStream { TCPConfig::DEFAULT_CAPACITY }, isn, TCPConfig::TIMEOUT_DFLT, max_payload };
+  const TCPReceiverMessage receiver_msg { .ackno = Wrap32 { 31337 }, .window_size = 4000 };
+  vector<TCPMessage> sent;
+  const auto transmit = [&]( const TCPSenderMessage& x ) { sent.push_back( { x, receiver_msg } ); };
+
+  sender.push( transmit );
+  sender.receive( { .ackno = isn + 1, .window_size = window } );
+  sender.writer().push( data );
+  sender.writer().close();
+  sender.push( transmit );
+  return sent;
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    auto rd = get_random_engine();
+
+    {
+      auto adapter = make_adapter();
+      const string payload = random_string( rd, 2501 );
+      const TCPMessage super { .sender = { .seqno = Wrap32 { 1000 }, .SYN = true, .payload = payload, .FIN = true },
+                               .receiver = { .ackno = Wrap32 { 99 }, .window_size = 1234 } };
+
+      vector<TCPMessage> split;
+      split.push_back( { { .seqno = Wrap32 { 1000 }, .SYN = true, .payload = payload.substr( 0, 1000 ) },
+                         super.receiver } );
+      split.push_back( { { .seqno = Wrap32 { 2001 }, .payload = payload.substr( 1000, 1000 ) }, super.receiver } );
+      split.push_back(
+        { { .seqno = Wrap32 { 3001 }, .payload = payload.substr( 2000 ), .FIN = true }, super.receiver } );
+
+      expect_identical( "SYN + payload + FIN super-segment", wire_plain( adapter, split ),
+                        wire_gso( adapter, { super }, 1000 ) );
+    }
+
+    {
+      auto adapter = make_adapter();
+      const TCPMessage bare { .sender = { .seqno = Wrap32 { UINT32_MAX }, .SYN = true } };
+      expect_identical( "SYN without ackno", wire_plain( adapter, { bare } ), wire_gso( adapter, { bare }, 1000 ) );
+    }
+
+    {
+      auto adapter = make_adapter();
+      const TCPMessage odd {
+        .sender = { .seqno = Wrap32 { UINT32_MAX - 500 }, .payload = random_string( rd, 1500 ) },
+        .receiver = { .ackno = Wrap32 { 5 }, .window_size = 7 } };
+      vector<TCPMessage> split;
+      for ( size_t offset = 0; offset < odd.sender.payload.size(); offset += 333 ) {
+        split.push_back(
+          { { .seqno = odd.sender.seqno + offset, .payload = odd.sender.payload.substr( offset, 333 ) },
+            odd.receiver } );
+      }
+      expect_identical( "odd MSS across seqno wraparound", wire_plain( adapter, split ),
+                        wire_gso( adapter, { odd }, 333 ) );
+    }
+
+    {
+      auto adapter = make_adapter();
+      const vector<TCPMessage> msgs {
+        { .sender = { .seqno = Wrap32 { 7 }, .SYN = true } },
+        { .sender = { .seqno = Wrap32 { 8 }, .payload = random_string( rd, 777 ) },
+          .receiver = { .ackno = Wrap32 { UINT32_MAX }, .window_size = UINT16_MAX } },
+        { .sender = { .seqno = Wrap32 { 785 }, .FIN = true, .RST = true },
+          .receiver = { .ackno = Wrap32 { 0 }, .window_size = 0 } } };
+      expect_identical( "header template", wire_plain( adapter, msgs ), wire_stamped( adapter, msgs ) );
+
+      adapter.config_mut().destination = Address { "10.144.0.7", 443 };
+      expect_identical(
+        "header template after config change", wire_plain( adapter, msgs ), wire_stamped( adapter, msgs ) );
+    }
+
+    {
+      auto adapter = make_adapter();
+      const Wrap32 isn { uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd ) };
+      const string data = random_string( rd, 20000 );
+      const auto plain = run_sender( TCPConfig::MAX_PAYLOAD_SIZE, isn, data, 50000 );
+      const auto gso = run_sender( TCPConfig::GSO_MAX_SIZE, isn, data, 50000 );
+      if ( gso.size() >= plain.size() ) {
+        throw runtime_error( "GSO sender did not emit fewer messages than the plain sender" );
+      }
+      expect_identical( "TCPSender stream with and without GSO", wire_plain( adapter, plain ),
+                        wire_gso( adapter, gso, TCPConfig::MAX_PAYLOAD_SIZE ) );
+    }
+
+    {
+      // with loss, a timeout retransmits the first wire segment of the super-segment that is not yet
+      // acknowledged, not the whole super-segment
+      auto adapter = make_adapter();
+      const Wrap32 isn { uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd ) };
+      TCPSender sender {
+        ByteStream { TCPConfig::DEFAULT_CAPACITY }, isn, TCPConfig::TIMEOUT_DFLT, TCPConfig::GSO_MAX_SIZE };
+      const TCPReceiverMessage receiver_msg { .ackno = Wrap32 { 31337 }, .window_size = 4000 };
+      vector<TCPMessage> sent;
+      const auto transmit = [&]( const TCPSenderMessage& x ) { sent.push_back( { x, receiver_msg } ); };
+
+      sender.push( transmit );
+      sender.receive( { .ackno = isn + 1, .window_size = 50000 } );
+      sender.writer().push( random_string( rd, 4500 ) );
+      sender.writer().close();
+      sender.push( transmit );
+      const vector<string> wire = wire_gso( adapter, { sent.back() }, TCPConfig::MAX_PAYLOAD_SIZE );
+      if ( wire.size() != 5 ) {
+        throw runtime_error( "expected one super-segment of five wire segments" );
+      }
+
+      // every wire segment is lost
+      sent.clear();
+      sender.tick( TCPConfig::TIMEOUT_DFLT, transmit );
+      expect_identical(
+        "retransmission after losing a whole super-segment", { wire[0] }, wire_plain( adapter, sent ) );
+
+      // the third is lost: the receiver acknowledges the two before it
+      sent.clear();
+      sender.receive( { .ackno = isn + 1 + 2000, .window_size = 50000 } );
+      sender.tick( TCPConfig::TIMEOUT_DFLT, transmit );
+      expect_identical( "retransmission of a lost wire segment", { wire[2] }, wire_plain( adapter, sent ) );
+
+      // the last is lost (and the FIN with it)
+      sent.clear();
+      sender.receive( { .ackno = isn + 1 + 4000, .window_size = 50000 } );
+      sender.tick( TCPConfig::TIMEOUT_DFLT, transmit );
+      expect_identical( "retransmission of the last wire segment", { wire[4] }, wire_plain( adapter, sent ) );
+    }
+
+    {
+      // a TCPPeer retransmits in slices of its configured MSS, the size the adapter splits super-segments at
+      auto adapter = make_adapter();
+      const Wrap32 isn { uniform_int_distribution<uint32_t> { 0, UINT32_MAX }( rd ) };
+      const Wrap32 remote_isn { 7777 };
+      TCPConfig cfg;
+      cfg.isn = isn;
+      cfg.gso = true;
+      cfg.mss = 333;
+      TCPPeer peer { cfg };
+      vector<TCPMessage> sent;
+      const auto transmit = [&]( TCPMessage x ) { sent.push_back( move( x ) ); };
+
+      peer.push( transmit );
+      peer.receive( { .sender = { .seqno = remote_isn, .SYN = true },
+                      .receiver = { .ackno = isn + 1, .window_size = 50000 } },
+                    transmit );
+      sent.clear();
+      peer.outbound_writer().push( random_string( rd, 2000 ) );
+      peer.push( transmit );
+      if ( sent.size() != 1 ) {
+        throw runtime_error( "expected the peer to send one super-segment" );
+      }
+      const vector<string> wire = wire_gso( adapter, sent, cfg.mss );
+      if ( wire.size() != 7 ) {
+        throw runtime_error( "expected one super-segment of seven wire segments" );
+      }
+
+      // the fourth is lost: the receiver acknowledges the three before it
+      sent.clear();
+      const TCPMessage ack { .sender = { .seqno = remote_isn + 1 },
+                             .receiver = { .ackno = isn + 1 + 999, .window_size = 50000 } };
+      peer.receive( ack, transmit );
+      peer.tick( TCPConfig::TIMEOUT_DFLT, transmit );
+      expect_identical( "TCPPeer retransmission with mss 333", { wire[3] }, wire_plain( adapter, sent ) );
+    }
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+#include "common.hh"
+#include "sharded_eventloop.hh"
+#include "socket.hh"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// jobs posted from several threads all run, in order per poster, each on the thread of the shard it was posted to
+void test_jobs()
+{
+  constexpr size_t shards = 4;
+  constexpr size_t posters = 4;
+  constexpr size_t jobs_per_poster = 10000;
+
+  struct Tally
+  {
+    size_t jobs {};
+    thread::id runner {};
+    bool one_runner { true };
+    vector<size_t> last_seen = vector<size_t>( posters );
+    bool in_order { true };
+  };
+  vector<Tally> tallies( shards ); // each only touched by its shard's thread
+
+  ShardedEventLoop loop { shards };
+  vector<thread> threads;
+  for ( size_t p = 0; p < posters; ++p ) {
+    threads.emplace_back( [&, p] {
+      for ( size_t i = 1; i <= jobs_per_poster; ++i ) {
+        loop.post( ( p + i ) % shards, [&tallies, p, i]( size_t shard, EventLoop& ) {
+          Tally& tally = tallies[shard];
+          if ( tally.jobs++ == 0 ) {
+            tally.runner = this_thread::get_id();
+          }
+          tally.one_runner &= tally.runner == this_thread::get_id();
+          tally.in_order &= tally.last_seen[p] < i;
+          tally.last_seen[p] = i;
+        } );
+      }
+    } );
+  }
+  for ( auto& t : threads ) {
+    t.join();
+  }
+  loop.stop(); // (runs the jobs posted so far)
+
+  size_t total = 0;
+  for ( size_t shard = 0; shard < shards; ++shard ) {
+    total += tallies[shard].jobs;
+    check( tallies[shard].jobs == posters * jobs_per_poster / shards, "jobs were lost, or ran on the wrong shard" );
+    check( tallies[shard].one_runner, "a shard's jobs ran on more than one thread" );
+    check( tallies[shard].runner != this_thread::get_id(), "a shard's jobs ran on the posting thread" );
+    check( tallies[shard].in_order, "a poster's jobs ran out of order" );
+  }
+  check( total == posters * jobs_per_poster, "jobs were lost" );
+}
+
+// connections that differ only in the remote port spread evenly across the shards
+void test_spread()
+{
+  constexpr size_t shards = 4;
+  constexpr size_t connections = 20000;
+  ShardedEventLoop loop { shards, false };
+  vector<size_t> counts( shards );
+  for ( size_t i = 0; i < connections; ++i ) {
+    const FourTuple id { .local_ip = 0x0a000001,
+                         .remote_ip = 0x0a000002,
+                         .local_port = 443,
+                         .remote_port = static_cast<uint16_t>( 1024 + i ) };
+    check( loop.shard_for( id ) == loop.shard_for( id ), "shard_for is not deterministic" );
+    ++counts[loop.shard_for( id )];
+  }
+  for ( const size_t count : counts ) {
+    check( count > connections / shards * 9 / 10 and count < connections / shards * 11 / 10,
+           "connections were spread unevenly: " + to_string( count ) );
+  }
+}
+
+// a listener hands each connection it accepts to the shard its four-tuple hashes to
+void test_distribute()
+{
+  constexpr size_t shards = 4;
+  constexpr size_t connections = 64;
+
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  listener.bind( Address { "127.0.0.1", 0 } );
+  listener.listen();
+  const Address server = listener.local_address();
+
+  ShardedEventLoop loop { shards };
+  atomic<size_t> mismatched {};
+  loop.distribute( move( listener ),
+                   [&]( size_t shard, EventLoop&, TCPSocket&& socket ) {
+                     if ( loop.shard_for( socket ) != shard ) {
+                       ++mismatched;
+                     }
+                     socket.write( to_string( shard ) );
+                   } );
+
+  vector<size_t> served( shards );
+  for ( size_t i = 0; i < connections; ++i ) {
+    TCPSocket client;
+    client.connect( server );
+    // from the server's side, the client's address is the remote one
+    const FourTuple id { .local_ip = server.ipv4_numeric(),
+                         .remote_ip = client.local_address().ipv4_numeric(),
+                         .local_port = server.port(),
+                         .remote_port = client.local_address().port() };
+    string reply;
+    while ( not client.eof() ) {
+      string buffer;
+      client.read( buffer );
+      reply += buffer;
+    }
+    check( reply == to_string( loop.shard_for( id ) ), "connection was served by shard " + reply );
+    ++served[loop.shard_for( id )];
+  }
+  loop.stop();
+
+  check( mismatched == 0, "a handler ran on the wrong shard" );
+  for ( const size_t count : served ) {
+    check( count > 0, "a shard was given no connections" );
+  }
+}
+
+// a job that throws stops its shard, and stop() rethrows its exception
+void test_exception()
+{
+  ShardedEventLoop loop { 2 };
+  loop.post( 1, []( size_t, EventLoop& ) { throw runtime_error( "job failed" ); } );
+  bool thrown = false;
+  try {
+    loop.stop();
+  } catch ( const runtime_error& e ) {
+    thrown = string { e.what() } == "job failed";
+  }
+  check( thrown, "stop() did not rethrow the job's exception" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    test_jobs();
+    test_spread();
+    test_distribute();
+    test_exception();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
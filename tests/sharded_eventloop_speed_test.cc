@@ -0,0 +1,145 @@
+#include "exception.hh"
+#include "sharded_eventloop.hh"
+#include "tcp_config.hh"
+#include "tcp_peer.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sched.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+// one connection's work, all in memory: two TCPPeers joined back to back move `bytes` from client to server
+size_t transfer( const size_t bytes )
+{
+  const TCPConfig cfg {};
+  TCPPeer client { cfg };
+  TCPPeer server { cfg };
+  vector<TCPMessage> to_server;
+  vector<TCPMessage> to_client;
+  vector<TCPMessage> arriving;
+  const TCPPeer::TransmitFunction send_to_server = [&]( TCPMessage msg ) { to_server.push_back( move( msg ) ); };
+  const TCPPeer::TransmitFunction send_to_client = [&]( TCPMessage msg ) { to_client.push_back( move( msg ) ); };
+
+  const string chunk( cfg.send_capacity, 'x' );
+  size_t sent = 0;
+  size_t received = 0;
+  while ( received < bytes ) {
+    Writer& writer = client.outbound_writer();
+    const size_t length = min( { writer.available_capacity(), bytes - sent, chunk.size() } );
+    writer.push( chunk.substr( 0, length ) );
+    sent += length;
+    client.push( send_to_server );
+    server.push( send_to_client );
+
+    swap( arriving, to_server );
+    for ( auto& msg : arriving ) {
+      server.receive( move( msg ), send_to_client );
+    }
+    arriving.clear();
+
+    Reader& reader = server.inbound_reader();
+    received += reader.bytes_buffered();
+    reader.pop( reader.bytes_buffered() );
+
+    swap( arriving, to_client );
+    for ( auto& msg : arriving ) {
+      client.receive( move( msg ), send_to_server );
+    }
+    arriving.clear();
+  }
+  return received;
+}
+
+size_t usable_cpus()
+{
+  cpu_set_t allowed;
+  CPU_ZERO( &allowed );
+  CheckSystemCall( "sched_getaffinity", ::sched_getaffinity( 0, sizeof( allowed ), &allowed ) );
+  return CPU_COUNT( &allowed );
+}
+
+// Posts `connections` in-memory connections, each to the shard its four-tuple hashes to, and waits for the shards
+// to finish them. Returns the aggregate throughput in Gbit/s.
+double sharded_test( const size_t shards, const size_t connections, const size_t bytes_per_connection )
+{
+  ShardedEventLoop loop { shards };
+  vector<size_t> moved( shards ); // each only touched by its shard's thread
+
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < connections; ++i ) {
+    const FourTuple id { .local_ip = 0x0a000001,
+                         .remote_ip = 0x0a100000U + static_cast<uint32_t>( i % 64 ),
+                         .local_port = 443,
+                         .remote_port = static_cast<uint16_t>( 1024 + i ) };
+    loop.post( loop.shard_for( id ), [&moved, bytes_per_connection]( size_t shard, EventLoop& ) {
+      moved[shard] += transfer( bytes_per_connection );
+    } );
+  }
+  loop.stop(); // (runs every job posted)
+  const auto stop = steady_clock::now();
+
+  size_t total = 0;
+  for ( const size_t m : moved ) {
+    total += m;
+  }
+  if ( total != connections * bytes_per_connection ) {
+    throw runtime_error( "sharded transfers lost bytes" );
+  }
+
+  const double seconds = duration<double>( stop - start ).count();
+  const double gbit_per_second = static_cast<double>( total ) * 8 / seconds / 1e9;
+  const auto [fewest, most] = minmax_element( moved.begin(), moved.end() );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Sharded EventLoop, " << shards << " shard(s): " << fixed << setprecision( 2 ) << gbit_per_second
+       << " Gbit/s aggregate over " << connections << " in-memory connections (busiest shard moved "
+       << setprecision( 1 ) << static_cast<double>( *most ) / static_cast<double>( max<size_t>( *fewest, 1 ) )
+       << "x the idlest).\n";
+
+  debug_output << "      Sharded EventLoop (" << shards << " shard(s)): " << fixed << setprecision( 2 )
+               << gbit_per_second << " Gbit/s\n";
+
+  return gbit_per_second;
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    constexpr size_t connections = 256;
+    constexpr size_t bytes_per_connection = 1024000; // (whole segments: TCPSender::push spins on a short tail)
+    const size_t cpus = usable_cpus();
+
+    const double one_shard = sharded_test( 1, connections, bytes_per_connection );
+    for ( const size_t shards : { 2UL, 4UL, 8UL } ) {
+      const double speedup = sharded_test( shards, connections, bytes_per_connection ) / one_shard;
+      cout << "  speedup over one shard: " << fixed << setprecision( 2 ) << speedup << "x"
+           << ( shards > cpus ? " (more shards than CPUs)" : "" ) << "\n";
+      // (only as many shards as there are CPUs can run at once)
+      if ( shards <= cpus and speedup < static_cast<double>( shards ) / 2 ) {
+        throw runtime_error( "throughput did not scale with the number of shards" );
+      }
+    }
+    if ( cpus < 8 ) {
+      cout << "(only " << cpus << " CPU(s) available: shards beyond that share them)\n";
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
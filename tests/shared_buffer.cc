@@ -0,0 +1,109 @@
+#include "buffer_pool.hh"
+#include "common.hh"
+#include "ipv4_datagram.hh"
+#include "parser.hh"
+#include "shared_buffer.hh"
+#include "tcp_segment.hh"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// views share the bytes they were made from, and narrow without copying them
+void test_views()
+{
+  const SharedBuffer empty;
+  check( empty.empty() and empty.use_count() == 0, "an empty buffer has an owner" );
+
+  string text = "hello, world (too long for a short string)";
+  const string expected = text;
+  const char* const bytes = text.data();
+  SharedBuffer whole { move( text ) };
+  check( whole == expected and whole.data() == bytes, "the string's bytes were copied" );
+
+  SharedBuffer part = whole.substr( 7, 5 );
+  part.remove_suffix( 1 );
+  check( part == "worl" and part.data() == bytes + 7, "substr did not narrow the view" );
+  check( whole.use_count() == 2, "the views do not share the string" );
+  check( static_cast<string>( part ) == "worl", "a copy of the view has the wrong bytes" );
+
+  bool threw = false;
+  try {
+    part.remove_prefix( 5 );
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  check( threw, "remove_prefix went beyond the end of the view" );
+}
+
+// a TCP segment parsed from a pooled buffer has a payload that is a view of that buffer, which goes back to its
+// pool with the payload
+void test_parse_in_place()
+{
+  IPv4Datagram dgram;
+  dgram.header.src = 0x0a000001;
+  dgram.header.dst = 0x0a000002;
+  TCPSegment seg;
+  seg.udinfo = { .src_port = 1234, .dst_port = 5678, .cksum = 0 };
+  seg.message.sender = { .seqno = Wrap32 { 7 }, .SYN = true, .payload = "payload bytes" };
+  dgram.header.len = IPv4Header::LENGTH + 20 + seg.message.sender.payload.size();
+  seg.compute_checksum( dgram.header.pseudo_checksum() );
+  dgram.payload = serialize_payload( seg );
+  dgram.header.compute_checksum();
+
+  string wire;
+  for ( const auto& piece : serialize( dgram ) ) {
+    wire += piece;
+  }
+
+  BufferPool pool { 2048 };
+  PooledBuffer buffer = pool.get();
+  memcpy( buffer.data(), wire.data(), wire.size() );
+  buffer.resize( wire.size() );
+  const char* const start = buffer.data();
+
+  TCPSegment parsed;
+  {
+    IPv4Datagram parsed_dgram;
+    check( parse( parsed_dgram, vector<SharedBuffer> { SharedBuffer { move( buffer ) } } ), "IPv4 parse failed" );
+    check( parsed_dgram.payload.size() == 1 and parsed_dgram.payload.front().data() == start + IPv4Header::LENGTH,
+           "the datagram's payload is not a view of the buffer" );
+    check( parse( parsed, parsed_dgram.payload, parsed_dgram.header.pseudo_checksum() ), "TCP parse failed" );
+  }
+
+  const SharedBuffer& payload = parsed.message.sender.payload;
+  check( payload == "payload bytes" and parsed.message.sender.SYN, "the segment was garbled" );
+  check( payload.data() == start + IPv4Header::LENGTH + 20, "the segment's payload is not a view of the buffer" );
+  check( pool.in_use() == 1, "the buffer went back to the pool while the payload still refers to it" );
+
+  parsed = {};
+  check( pool.in_use() == 0, "the buffer did not go back to the pool with the payload" );
+
+  // a payload that spans several buffers is put together in a string of its own
+  Parser parser { vector<SharedBuffer> { "ab", "cd" } };
+  SharedBuffer joined;
+  parser.all_remaining( joined );
+  check( joined == "abcd" and joined.use_count() == 1, "the buffers were not joined" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    test_views();
+    test_parse_in_place();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,301 @@
+#include "bidirectional_stream_copy.hh"
+#include "byte_stream.hh"
+#include "exception.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe", ::pipe( fds.data() ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+void write_bytes( FileDescriptor& fd, size_t bytes )
+{
+  const string chunk( 65536, 'x' );
+  while ( bytes > 0 ) {
+    bytes -= fd.write( string_view { chunk }.substr( 0, min( bytes, chunk.size() ) ) );
+  }
+}
+
+// CPU time used by the calling thread (the one running the event loop), user and system
+double thread_cpu_seconds()
+{
+  rusage usage {};
+  CheckSystemCall( "getrusage", ::getrusage( RUSAGE_THREAD, &usage ) );
+  const auto seconds = []( const timeval& t ) { return static_cast<double>( t.tv_sec ) + t.tv_usec / 1e6; };
+  return seconds( usage.ru_utime ) + seconds( usage.ru_stime );
+}
+
+size_t read_to_eof( FileDescriptor& fd )
+{
+  size_t total = 0;
+  string buffer;
+  while ( not fd.eof() ) {
+    buffer.resize( 65536 );
+    fd.read( buffer );
+    total += buffer.size();
+  }
+  return total;
+}
+
+// bidirectional_stream_copy as it was before its port to coroutines: one EventLoop rule per step
+void copy_with_callbacks( Socket& socket,
+                          string_view peer_name,
+                          FileDescriptor&& input,
+                          FileDescriptor&& output,
+                          EventLoop& eventloop )
+{
+  constexpr size_t buffer_size = 1048576;
+
+  EventLoop& _eventloop = eventloop;
+  FileDescriptor _input { move( input ) };
+  FileDescriptor _output { move( output ) };
+  ByteStream _outbound { buffer_size };
+  ByteStream _inbound { buffer_size };
+  bool _outbound_shutdown { false };
+  bool _inbound_shutdown { false };
+
+  socket.set_blocking( false );
+  _input.set_blocking( false );
+  _output.set_blocking( false );
+
+  // rule 1: read from stdin into outbound byte stream
+  _eventloop.add_rule(
+    "read from stdin into outbound byte stream",
+    _input,
+    Direction::In,
+    [&] {
+      string data;
+      data.resize( _outbound.writer().available_capacity() );
+      _input.read( data );
+      _outbound.writer().push( move( data ) );
+      if ( _input.eof() ) {
+        _outbound.writer().close();
+      }
+    },
+    [&] {
+      return !_outbound.has_error() and !_inbound.has_error() and ( _outbound.writer().available_capacity() > 0 )
+             and !_outbound.writer().is_closed();
+    },
+    [&] { _outbound.writer().close(); },
+    [&] {
+      cerr << "DEBUG: Outbound stream had error from source.\n";
+      _outbound.set_error();
+      _inbound.set_error();
+    } );
+
+  // rule 2: read from outbound byte stream into socket
+  _eventloop.add_rule(
+    "read from outbound byte stream into socket",
+    socket,
+    Direction::Out,
+    [&] {
+      if ( _outbound.reader().bytes_buffered() ) {
+        _outbound.reader().pop( socket.write( _outbound.reader().peek() ) );
+      }
+      if ( _outbound.reader().is_finished() ) {
+        socket.shutdown( SHUT_WR );
+        _outbound_shutdown = true;
+        cerr << "DEBUG: Outbound stream to " << peer_name << " finished.\n";
+      }
+    },
+    [&] {
+      return _outbound.reader().bytes_buffered() or ( _outbound.reader().is_finished() and not _outbound_shutdown );
+    },
+    [&] { _outbound.writer().close(); },
+    [&] {
+      cerr << "DEBUG: Outbound stream had error from destination.\n";
+      _outbound.set_error();
+      _inbound.set_error();
+    } );
+
+  // rule 3: read from socket into inbound byte stream
+  _eventloop.add_rule(
+    "read from socket into inbound byte stream",
+    socket,
+    Direction::In,
+    [&] {
+      string data;
+      data.resize( _inbound.writer().available_capacity() );
+      socket.read( data );
+      _inbound.writer().push( move( data ) );
+      if ( socket.eof() ) {
+        _inbound.writer().close();
+      }
+    },
+    [&] {
+      return !_inbound.has_error() and !_outbound.has_error() and ( _inbound.writer().available_capacity() > 0 )
+             and !_inbound.writer().is_closed();
+    },
+    [&] { _inbound.writer().close(); },
+    [&] {
+      cerr << "DEBUG: Inbound stream had error from source.\n";
+      _outbound.set_error();
+      _inbound.set_error();
+    } );
+
+  // rule 4: read from inbound byte stream into stdout
+  _eventloop.add_rule(
+    "read from inbound byte stream into stdout",
+    _output,
+    Direction::Out,
+    [&] {
+      if ( _inbound.reader().bytes_buffered() ) {
+        _inbound.reader().pop( _output.write( _inbound.reader().peek() ) );
+      }
+      if ( _inbound.reader().is_finished() ) {
+        _output.close();
+        _inbound_shutdown = true;
+        cerr << "DEBUG: Inbound stream from " << peer_name << " finished"
+             << ( _inbound.has_error() ? " uncleanly.\n" : ".\n" );
+      }
+    },
+    [&] {
+      return _inbound.reader().bytes_buffered() or ( _inbound.reader().is_finished() and not _inbound_shutdown );
+    },
+    [&] { _inbound.writer().close(); },
+    [&] {
+      cerr << "DEBUG: Inbound stream had error from destination.\n";
+      _outbound.set_error();
+      _inbound.set_error();
+    } );
+
+  // loop until completion
+  while ( true ) {
+    if ( EventLoop::Result::Exit == _eventloop.wait_next_event( -1 ) ) {
+      return;
+    }
+  }
+}
+
+} // namespace
+
+enum class Implementation
+{
+  Callbacks,
+  Coroutines,
+  ZeroCopy,
+  Splice
+};
+
+pair<Socket, Socket> local_socket_pair()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM, 0, fds.data() ) );
+  return { LocalStreamSocket { FileDescriptor { fds[0] } }, LocalStreamSocket { FileDescriptor { fds[1] } } };
+}
+
+// (MSG_ZEROCOPY needs a TCP or UDP socket: over loopback, the kernel copies the bytes after all)
+pair<Socket, Socket> tcp_socket_pair()
+{
+  TCPSocket listener;
+  listener.bind( Address { "127.0.0.1", 0 } );
+  listener.listen();
+  TCPSocket client;
+  client.connect( listener.local_address() );
+  return { move( client ), listener.accept() };
+}
+
+// bidirectional_stream_copy with both directions saturated (stdin and the peer always have more to send, stdout
+// and the peer always drain): every one of its four steps is ready on most wakeups
+void copy_test( const string& mode,
+                const Implementation implementation,
+                const EventLoop::Dispatch& dispatch,
+                const size_t bytes,
+                const bool over_tcp = false )
+{
+  auto [input_read, input_write] = make_pipe();
+  auto [output_read, output_write] = make_pipe();
+  auto [socket, peer] = over_tcp ? tcp_socket_pair() : local_socket_pair();
+
+  size_t peer_received = 0;
+  size_t output_received = 0;
+  thread feed_input { [&] {
+    write_bytes( input_write, bytes );
+    input_write.close();
+  } };
+  thread drain_output { [&] { output_received = read_to_eof( output_read ); } };
+  thread feed_peer { [&] {
+    write_bytes( peer, bytes );
+    peer.shutdown( SHUT_WR );
+  } };
+  thread drain_peer { [&] { peer_received = read_to_eof( peer ); } };
+
+  EventLoop loop;
+  loop.set_dispatch( dispatch );
+  const auto start = steady_clock::now();
+  const double cpu_start = thread_cpu_seconds();
+  if ( implementation == Implementation::Callbacks ) {
+    copy_with_callbacks( socket, "peer", move( input_read ), move( output_write ), loop );
+  } else {
+    const StreamCopyMode copy_mode = implementation == Implementation::Splice     ? StreamCopyMode::Splice
+                                     : implementation == Implementation::ZeroCopy ? StreamCopyMode::ZeroCopy
+                                                                                  : StreamCopyMode::Buffered;
+    bidirectional_stream_copy( socket, "peer", move( input_read ), move( output_write ), loop, copy_mode );
+  }
+  const double cpu_seconds = thread_cpu_seconds() - cpu_start;
+  const auto stop = steady_clock::now();
+
+  feed_input.join();
+  drain_output.join();
+  feed_peer.join();
+  drain_peer.join();
+
+  if ( peer_received != bytes or output_received != bytes ) {
+    throw runtime_error( "stream copy lost bytes" );
+  }
+
+  const double seconds = duration<double>( stop - start ).count();
+  const double mbit_per_second = 2 * static_cast<double>( bytes ) * 8 / seconds / 1e6;
+  const double cpu_ns_per_byte = cpu_seconds * 1e9 / ( 2 * static_cast<double>( bytes ) );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "bidirectional_stream_copy, " << mode << ": " << fixed << setprecision( 0 ) << mbit_per_second
+       << " Mbit/s (both directions), " << setprecision( 2 ) << cpu_ns_per_byte << " CPU ns/byte, "
+       << loop.syscalls() << " loop system calls.\n";
+  loop.summary( cout );
+
+  debug_output << "      stream copy (" << mode << "): " << fixed << setprecision( 0 ) << mbit_per_second
+               << " Mbit/s, " << setprecision( 2 ) << cpu_ns_per_byte << " CPU ns/byte, " << loop.syscalls()
+               << " loop system calls\n";
+}
+
+int main()
+{
+  try {
+    constexpr size_t bytes = 256UL << 20;
+    using enum Implementation;
+    copy_test( "callbacks, one rule per call", Callbacks, { .serve_all = false, .budget = 1 }, bytes );
+    copy_test( "callbacks, all ready rules", Callbacks, { .serve_all = true, .budget = 1 }, bytes );
+    copy_test( "callbacks, all ready rules, budget 4", Callbacks, { .serve_all = true, .budget = 4 }, bytes );
+    copy_test( "coroutines, all ready rules", Coroutines, { .serve_all = true, .budget = 1 }, bytes );
+    copy_test( "coroutines, splice", Splice, { .serve_all = true, .budget = 1 }, bytes );
+    copy_test( "coroutines, TCP", Coroutines, { .serve_all = true, .budget = 1 }, bytes / 4, true );
+    copy_test( "coroutines, TCP, MSG_ZEROCOPY", ZeroCopy, { .serve_all = true, .budget = 1 }, bytes / 4, true );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+#include "random.hh"
+#include "tcp_stack.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <malloc.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr uint32_t SERVER_IP = 0x0a900001;
+constexpr uint16_t SERVER_PORT = 80;
+
+size_t heap_in_use()
+{
+  const auto info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
+
+InternetDatagram make_datagram( uint32_t src_ip, uint16_t src_port, const TCPMessage& msg )
+{
+  TCPSegment seg { .message = msg, .udinfo = { .src_port = src_port, .dst_port = SERVER_PORT, .cksum = 0 } };
+  InternetDatagram dgram;
+  dgram.header.src = src_ip;
+  dgram.header.dst = SERVER_IP;
+  dgram.header.len = dgram.header.hlen * 4 + 20 + msg.sender.payload.size();
+  seg.compute_checksum( dgram.header.pseudo_checksum() );
+  dgram.header.compute_checksum();
+  dgram.payload = serialize_payload( seg );
+  return dgram;
+}
+
+// SYNs from `syns` spoofed sources that never complete their handshakes
+void flood( const size_t syns )
+{
+  auto rd = get_random_engine();
+  size_t syn_acks = 0;
+  TCPStack server { TCPConfig {}, [&]( string_view, string_view ) { ++syn_acks; } };
+  server.listen( Address { "0", SERVER_PORT } );
+
+  vector<InternetDatagram> datagrams;
+  datagrams.reserve( syns );
+  for ( size_t i = 0; i < syns; ++i ) {
+    const TCPMessage syn { .sender = { .seqno = Wrap32 { static_cast<uint32_t>( rd() ) }, .SYN = true },
+                           .receiver = { .window_size = 65535 } };
+    datagrams.push_back( make_datagram( 0x0b000000U + static_cast<uint32_t>( rd() % 0xffffff ),
+                                        static_cast<uint16_t>( 1024 + rd() % 60000 ),
+                                        syn ) );
+  }
+
+  const size_t heap_before = heap_in_use();
+  const auto start = steady_clock::now();
+  for ( const auto& dgram : datagrams ) {
+    server.receive( dgram );
+  }
+  const auto stop = steady_clock::now();
+  const size_t heap_growth = heap_in_use() - heap_before;
+
+  // what one fully allocated TCPPeer costs, for comparison
+  const size_t heap_before_peer = heap_in_use();
+  const auto peer = make_unique<TCPPeer>( TCPConfig {} );
+  const size_t peer_bytes = heap_in_use() - heap_before_peer;
+
+  const double seconds = duration<double>( stop - start ).count();
+  const double rate = static_cast<double>( syns ) / seconds;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "SYN flood of " << syns << " SYNs: " << fixed << setprecision( 0 ) << rate << " SYNs/s, " << syn_acks
+       << " SYN/ACKs, " << server.syn_queue_size() << " SYN queue entries, heap grew by " << heap_growth / 1024
+       << " KiB (one TCPPeer is " << peer_bytes / 1024 << " KiB).\n";
+
+  debug_output << "      SYN flood (" << syns << " SYNs): " << fixed << setprecision( 0 ) << rate / 1000
+               << "k SYNs/s, heap +" << heap_growth / 1024 << " KiB\n";
+
+  if ( syn_acks != syns or server.connection_count() != 0 ) {
+    throw runtime_error( "SYN flood was not answered statelessly" );
+  }
+  if ( heap_growth > syns * 64 ) {
+    throw runtime_error( "SYN flood grew the heap by " + to_string( heap_growth ) + " bytes" );
+  }
+}
+
+// full handshakes from `connections` clients, answered from the SYN queue or with SYN cookies
+void handshakes( const size_t connections, const size_t syn_backlog )
+{
+  auto rd = get_random_engine();
+
+  // keep each connection small: this measures the handshake, not ByteStream allocation
+  TCPConfig cfg;
+  cfg.recv_capacity = cfg.send_capacity = 1000;
+
+  string last_syn_ack;
+  TCPStack server { cfg, [&]( string_view headers, string_view ) { last_syn_ack = headers; } };
+  server.listen( Address { "0", SERVER_PORT }, connections, syn_backlog );
+
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < connections; ++i ) {
+    const uint32_t client_ip = 0x0b000000U + static_cast<uint32_t>( i >> 16 );
+    const auto client_port = static_cast<uint16_t>( i );
+    const Wrap32 client_isn { static_cast<uint32_t>( rd() ) };
+
+    const TCPMessage syn { .sender = { .seqno = client_isn, .SYN = true }, .receiver = { .window_size = 1000 } };
+    server.receive( make_datagram( client_ip, client_port, syn ) );
+
+    InternetDatagram syn_ack_dgram;
+    TCPSegment syn_ack;
+    if ( not parse( syn_ack_dgram, vector<string> { last_syn_ack } )
+         or not parse( syn_ack, syn_ack_dgram.payload, syn_ack_dgram.header.pseudo_checksum() ) ) {
+      throw runtime_error( "unparseable SYN/ACK" );
+    }
+
+    const TCPMessage ack { .sender = { .seqno = client_isn + 1 },
+                           .receiver = { .ackno = syn_ack.message.sender.seqno + 1, .window_size = 1000 } };
+    server.receive( make_datagram( client_ip, client_port, ack ) );
+  }
+  const auto stop = steady_clock::now();
+
+  size_t accepted = 0;
+  while ( server.accept( SERVER_PORT ) ) {
+    ++accepted;
+  }
+  if ( accepted != connections ) {
+    throw runtime_error( "only " + to_string( accepted ) + " of " + to_string( connections )
+                         + " handshakes completed" );
+  }
+
+  const double rate = static_cast<double>( connections ) / duration<double>( stop - start ).count();
+  const string how = syn_backlog ? "SYN queue" : "SYN cookies";
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Handshakes through " << how << ": " << fixed << setprecision( 0 ) << rate << " connections/s ("
+       << connections << " connections, including building the client segments).\n";
+  debug_output << "      Handshakes (" << how << "): " << fixed << setprecision( 0 ) << rate / 1000
+               << "k connections/s\n";
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    flood( 200000 );
+    handshakes( 20000, 20000 );
+    handshakes( 20000, 0 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
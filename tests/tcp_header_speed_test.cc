@@ -0,0 +1,76 @@
+#include "tcp_over_ip.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace std::chrono;
+
+// Build the IPv4 + TCP headers for `iterations` outbound messages, first by wrapping and serializing each message,
+// then by stamping the per-connection header template, and report ns per header.
+void speed_test( const size_t iterations, const size_t payload_size )
+{
+  TCPOverIPv4Adapter adapter;
+  adapter.config_mut().source = Address { "169.254.144.9", 40000 };
+  adapter.config_mut().destination = Address { "169.254.144.1", 8080 };
+
+  TCPMessage msg { .sender = { .seqno = Wrap32 { 1 }, .payload = string( payload_size, 'x' ) },
+                   .receiver = { .ackno = Wrap32 { 1000 }, .window_size = 5000 } };
+
+  uint64_t sink = 0;
+
+  const auto wrap_start = steady_clock::now();
+  for ( size_t i = 0; i < iterations; ++i ) {
+    msg.sender.seqno = msg.sender.seqno + 1;
+    const auto pieces = serialize( adapter.wrap_tcp_in_ip( msg ) );
+    sink += static_cast<uint8_t>( pieces.front().back() );
+  }
+  const auto wrap_stop = steady_clock::now();
+
+  TCPOverIPv4Adapter::Headers headers {};
+  const auto stamp_start = steady_clock::now();
+  for ( size_t i = 0; i < iterations; ++i ) {
+    msg.sender.seqno = msg.sender.seqno + 1;
+    adapter.stamp_tcp_in_ip( msg, headers );
+    sink += static_cast<uint8_t>( headers.back() );
+  }
+  const auto stamp_stop = steady_clock::now();
+
+  const auto ns_per = [&]( auto start, auto stop ) {
+    return static_cast<double>( duration_cast<nanoseconds>( stop - start ).count() )
+           / static_cast<double>( iterations );
+  };
+  const double wrap_ns = ns_per( wrap_start, wrap_stop );
+  const double stamp_ns = ns_per( stamp_start, stamp_stop );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "IPv4+TCP headers with payload=" << payload_size << ": " << fixed << setprecision( 1 ) << wrap_ns
+       << " ns/segment wrapped and serialized, " << stamp_ns << " ns/segment stamped from template. (" << sink % 2
+       << ")\n";
+
+  debug_output << "             TCP header template (payload=" << payload_size << "): " << fixed
+               << setprecision( 1 ) << stamp_ns << " ns/segment\n";
+
+  if ( stamp_ns > wrap_ns ) {
+    throw runtime_error( "stamping headers from the template was slower than serializing them" );
+  }
+}
+
+int main()
+{
+  try {
+    speed_test( 1000000, 0 );
+    speed_test( 100000, 1000 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
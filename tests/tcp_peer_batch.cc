@@ -0,0 +1,143 @@
+#include "common.hh"
+#include "tcp_config.hh"
+#include "tcp_peer.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const Wrap32 LOCAL_ISN { 137 }; // (TCPConfig's default)
+const Wrap32 REMOTE_ISN { 5000 };
+
+// A segment from the remote peer, `offset` sequence numbers after its SYN, acknowledging our SYN
+TCPMessage segment( const uint32_t offset, const string& payload, const bool fin = false, const bool rst = false )
+{
+  TCPMessage msg;
+  msg.sender.seqno = REMOTE_ISN + offset;
+  msg.sender.payload = payload;
+  msg.sender.FIN = fin;
+  msg.sender.RST = rst;
+  msg.receiver = { LOCAL_ISN + 1, 60000, false };
+  return msg;
+}
+
+// What a test can see of a peer
+struct State
+{
+  uint64_t inbound_pushed;
+  string inbound;
+  optional<Wrap32> ackno;
+  uint16_t window_size;
+  bool inbound_closed;
+  bool error;
+  uint64_t in_flight;
+  bool active_once_finished; //!< after the outbound stream is closed and its FIN acknowledged
+  bool active_after_linger;  //!< ...and then ten RTOs later
+
+  bool operator==( const State& other ) const = default;
+};
+
+// Connects a peer, has it receive `script` (one message at a time, or as one batch), and then finishes its
+// outbound stream
+State run( const vector<TCPMessage>& script, const bool batch, size_t& replies )
+{
+  const TCPConfig config;
+  TCPPeer peer { config };
+  vector<TCPMessage> sent;
+  const auto transmit = [&]( const TCPMessage& msg ) { sent.push_back( msg ); };
+
+  peer.push( transmit );
+  TCPMessage syn_ack;
+  syn_ack.sender.seqno = REMOTE_ISN;
+  syn_ack.sender.SYN = true;
+  syn_ack.receiver = { LOCAL_ISN + 1, 60000, false };
+  peer.receive( syn_ack, transmit );
+  check( peer.established(), "peer did not connect" );
+
+  const size_t sent_before = sent.size();
+  if ( batch ) {
+    peer.receive_batch( script, transmit );
+  } else {
+    for ( const auto& msg : script ) {
+      peer.receive( msg, transmit );
+    }
+  }
+  replies = sent.size() - sent_before;
+
+  State state {};
+  state.inbound_pushed = peer.receiver().writer().bytes_pushed();
+  while ( peer.inbound_reader().bytes_buffered() > 0 and not peer.inbound_reader().has_error() ) {
+    state.inbound += peer.inbound_reader().peek();
+    peer.inbound_reader().pop( peer.inbound_reader().peek().size() );
+  }
+  const TCPReceiverMessage ours = peer.receiver().send();
+  state.ackno = ours.ackno;
+  state.window_size = ours.window_size;
+  state.inbound_closed = peer.receiver().writer().is_closed();
+  state.error = peer.inbound_reader().has_error() or peer.outbound_writer().has_error();
+  state.in_flight = peer.sender().sequence_numbers_in_flight();
+
+  peer.outbound_writer().close();
+  peer.push( transmit );
+  TCPMessage fin_ack = segment( 0, "" );
+  fin_ack.sender.seqno = ours.ackno.value_or( REMOTE_ISN );
+  fin_ack.receiver.ackno = LOCAL_ISN + 2;
+  peer.receive( fin_ack, transmit );
+  state.active_once_finished = peer.active();
+  peer.tick( 10UL * config.rt_timeout, transmit );
+  state.active_after_linger = peer.active();
+  return state;
+}
+
+void check_same_outcome( const string& name, const vector<TCPMessage>& script )
+{
+  size_t replies_one_by_one = 0;
+  size_t replies_batched = 0;
+  const State one_by_one = run( script, false, replies_one_by_one );
+  const State batched = run( script, true, replies_batched );
+  check( batched == one_by_one, name + ": receive_batch ended in a different state than receive() on each" );
+  check( replies_batched <= 1, name + ": receive_batch replied more than once" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    check_same_outcome( "in-sequence data", { segment( 1, "abc" ), segment( 4, "def" ), segment( 7, "gh" ) } );
+
+    // messages after a FIN see the inbound stream closed (so the peer need not linger), and a keep-alive is
+    // checked against the ackno that follows the FIN
+    check_same_outcome( "FIN mid-batch",
+                        { segment( 1, "abc" ),
+                          segment( 4, "def" ),
+                          segment( 7, "gh", true ),
+                          segment( 9, "" ),
+                          segment( 10, "z" ) } );
+
+    // a FIN that arrives out of order closes the stream when a later segment fills the gap before it
+    check_same_outcome( "out-of-order FIN",
+                        { segment( 4, "def", true ), segment( 1, "abc" ), segment( 8, "zz" ) } );
+
+    // nothing after a RST is received
+    check_same_outcome( "RST mid-batch",
+                        { segment( 1, "abc" ), segment( 4, "", false, true ), segment( 4, "def" ) } );
+
+    // a RST from the remote's receiver aborts the connection too
+    TCPMessage receiver_rst = segment( 4, "def" );
+    receiver_rst.receiver.RST = true;
+    check_same_outcome( "receiver RST mid-batch", { segment( 1, "abc" ), receiver_rst, segment( 7, "gh" ) } );
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
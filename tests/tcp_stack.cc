@@ -0,0 +1,291 @@
+#include "common.hh"
+#include "random.hh"
+#include "tcp_config.hh"
+#include "tcp_stack.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+void test_map()
+{
+  auto rd = get_random_engine();
+  FourTupleMap<uint64_t> table;
+  map<tuple<uint32_t, uint32_t, uint16_t, uint16_t>, uint64_t> reference;
+
+  const auto key
+    = []( const FourTuple& t ) { return tuple { t.local_ip, t.remote_ip, t.local_port, t.remote_port }; };
+
+  // many connections to one listening socket differ only in the remote port, so make those collide often
+  for ( uint64_t i = 0; i < 20000; ++i ) {
+    const FourTuple t { .local_ip = 0x0a000001,
+                        .remote_ip = 0x0a000000U + static_cast<uint32_t>( rd() % 4 ),
+                        .local_port = 80,
+                        .remote_port = static_cast<uint16_t>( rd() % 8192 ) };
+    const bool inserted = table.emplace( t, i ).second;
+    check( inserted == reference.emplace( key( t ), i ).second, "emplace disagrees with reference" );
+
+    if ( rd() % 3 == 0 ) {
+      const FourTuple victim { .local_ip = 0x0a000001,
+                               .remote_ip = 0x0a000000U + static_cast<uint32_t>( rd() % 4 ),
+                               .local_port = 80,
+                               .remote_port = static_cast<uint16_t>( rd() % 8192 ) };
+      check( table.erase( victim ) == ( reference.erase( key( victim ) ) == 1 ), "erase disagrees with reference" );
+    }
+  }
+
+  check( table.size() == reference.size(), "size disagrees with reference" );
+  for ( const auto& [k, value] : reference ) {
+    const FourTuple t { get<0>( k ), get<1>( k ), get<2>( k ), get<3>( k ) };
+    const uint64_t* found = table.find( t );
+    check( found and *found == value, "lookup disagrees with reference" );
+  }
+
+  size_t visited = 0;
+  table.for_each( [&]( const FourTuple&, uint64_t& ) { ++visited; } );
+  check( visited == reference.size(), "for_each visited the wrong number of entries" );
+}
+
+// two stacks joined back to back, with the datagrams in flight queued in each direction
+struct Network
+{
+  vector<string> to_server {};
+  vector<string> to_client {};
+
+  static TCPStack::TransmitFunction queue( vector<string>& q )
+  {
+    return [&q]( string_view headers, string_view payload ) {
+      q.push_back( string { headers } + string { payload } );
+    };
+  }
+
+  static size_t deliver( vector<string>& q, TCPStack& dst )
+  {
+    const vector<string> in_flight = std::move( q );
+    q.clear();
+    for ( const auto& bytes : in_flight ) {
+      InternetDatagram dgram;
+      check( parse( dgram, vector<string> { bytes } ), "stack sent an unparseable datagram" );
+      dst.receive( dgram );
+    }
+    return in_flight.size();
+  }
+
+  void exchange( TCPStack& client, TCPStack& server )
+  {
+    while ( deliver( to_server, server ) + deliver( to_client, client ) > 0 ) {}
+  }
+};
+
+string read_all( TCPPeer& peer )
+{
+  string data;
+  read( peer.inbound_reader(), peer.inbound_reader().bytes_buffered(), data );
+  return data;
+}
+
+void test_stack()
+{
+  TCPConfig cfg;
+  Network net;
+  TCPStack client { cfg, Network::queue( net.to_server ) };
+  TCPStack server { cfg, Network::queue( net.to_client ) };
+
+  const Address server_addr { "10.144.0.1", 80 };
+  server.listen( Address { "0", 80 }, 2 );
+
+  // a SYN to a port nobody listens on is dropped
+  client.connect( Address { "10.144.0.2", 999 }, Address { "10.144.0.1", 81 } );
+  net.exchange( client, server );
+  check( server.connection_count() == 0, "SYN to an unlistened port created a connection" );
+
+  // three connections from different ports; the accept queue holds two, so the third handshake stays half-open
+  vector<FourTuple> ids;
+  for ( uint16_t port = 1000; port < 1003; ++port ) {
+    ids.push_back( client.connect( Address { "10.144.0.2", port }, server_addr ) );
+  }
+  net.exchange( client, server );
+  check( server.connection_count() == 2, "backlog did not limit the accept queue" );
+  check( server.syn_queue_size() == 1, "the third handshake should wait in the SYN queue" );
+
+  vector<FourTuple> accepted;
+  while ( const auto id = server.accept( 80 ) ) {
+    accepted.push_back( id.value() );
+  }
+  check( accepted.size() == 2, "expected two connections in the accept queue" );
+
+  // with the accept queue drained, the retransmitted SYN/ACK completes the third handshake
+  server.tick( cfg.rt_timeout );
+  net.exchange( client, server );
+  const auto third = server.accept( 80 );
+  check( third.has_value(), "third connection was not accepted after the SYN/ACK retransmission" );
+  check( server.syn_queue_size() == 0, "SYN queue entry outlived its handshake" );
+  accepted.push_back( third.value() );
+  check( not server.accept( 80 ).has_value(), "accept queue should be empty" );
+
+  for ( const auto& id : ids ) {
+    check( client.peer( id )->established(), "client connection did not become established" );
+  }
+
+  // data is demultiplexed to the right connection in each direction
+  for ( const auto& id : ids ) {
+    client.peer( id )->outbound_writer().push( "hello from " + to_string( id.local_port ) );
+    client.push( id );
+  }
+  for ( const auto& id : accepted ) {
+    server.peer( id )->outbound_writer().push( "welcome " + to_string( id.remote_port ) );
+    server.push( id );
+  }
+  net.exchange( client, server );
+
+  for ( const auto& id : accepted ) {
+    check( read_all( *server.peer( id ) ) == "hello from " + to_string( id.remote_port ),
+           "server connection received another connection's data" );
+  }
+  for ( const auto& id : ids ) {
+    check( read_all( *client.peer( id ) ) == "welcome " + to_string( id.local_port ),
+           "client connection received another connection's data" );
+  }
+
+  // close everything; connections are forgotten once finished and released
+  for ( const auto& id : ids ) {
+    client.peer( id )->outbound_writer().close();
+    client.push( id );
+    client.release( id );
+  }
+  net.exchange( client, server );
+  for ( const auto& id : accepted ) {
+    server.peer( id )->outbound_writer().close();
+    server.push( id );
+    server.release( id );
+  }
+  net.exchange( client, server );
+
+  for ( unsigned i = 0; i < 20; ++i ) {
+    client.tick( cfg.rt_timeout );
+    server.tick( cfg.rt_timeout );
+    net.exchange( client, server );
+  }
+  check( server.connection_count() == 0, "server kept finished connections" );
+  check( client.connection_count() == 1, "client should keep only the unreleased, refused connection" );
+}
+
+void test_syn_cookies()
+{
+  TCPConfig cfg;
+  Network net;
+  TCPStack client { cfg, Network::queue( net.to_server ) };
+  TCPStack server { cfg, Network::queue( net.to_client ) };
+
+  const Address server_addr { "10.144.0.1", 443 };
+  server.listen( server_addr, 16, 1 );
+
+  // the first SYN fills the one-entry SYN queue; the second is answered with a cookie and leaves no state
+  const FourTuple queued = client.connect( Address { "10.144.0.2", 2000 }, server_addr );
+  const FourTuple cookied = client.connect( Address { "10.144.0.2", 2001 }, server_addr );
+  Network::deliver( net.to_server, server );
+  check( server.syn_queue_size() == 1 and server.connection_count() == 0, "half-open connections allocated peers" );
+
+  net.exchange( client, server );
+  check( server.syn_queue_size() == 0 and server.connection_count() == 2, "handshakes did not complete" );
+  const auto first = server.accept( 443 );
+  const auto second = server.accept( 443 );
+  check( first.has_value() and second.has_value(), "expected two connections in the accept queue" );
+
+  for ( const auto& id : { queued, cookied } ) {
+    client.peer( id )->outbound_writer().push( "via " + to_string( id.local_port ) );
+    client.push( id );
+  }
+  net.exchange( client, server );
+  for ( const auto& id : { first.value(), second.value() } ) {
+    check( read_all( *server.peer( id ) ) == "via " + to_string( id.remote_port ),
+           "data lost on a connection established from the SYN queue or a cookie" );
+  }
+
+  // an ACK that acknowledges no SYN/ACK we sent is ignored
+  TCPOverIPv4Adapter forger;
+  forger.config_mut().source = Address { "10.144.0.3", 3000 };
+  forger.config_mut().destination = server_addr;
+  for ( uint32_t guess = 0; guess < 1000; ++guess ) {
+    const TCPMessage forged { .sender = { .seqno = Wrap32 { 1 + guess } },
+                              .receiver = { .ackno = Wrap32 { guess * 4294967U }, .window_size = 1000 } };
+    server.receive( forger.wrap_tcp_in_ip( forged ) );
+  }
+  check( server.connection_count() == 2, "a forged ACK created a connection" );
+
+  // a cookie expires after two periods of its timestamp (while a SYN queue entry does not)
+  const FourTuple fresh = client.connect( Address { "10.144.0.2", 2002 }, server_addr );
+  const FourTuple stale = client.connect( Address { "10.144.0.2", 2003 }, server_addr );
+  Network::deliver( net.to_server, server );
+  server.tick( 3 * TCPStack::SYN_COOKIE_PERIOD_MS );
+  net.exchange( client, server );
+  check( client.peer( fresh )->established() and client.peer( stale )->established(),
+         "client did not see the SYN/ACKs" );
+  const auto accepted = server.accept( 443 );
+  check( accepted.has_value() and accepted->remote_port == fresh.local_port, "SYN queue entry was not accepted" );
+  check( server.connection_count() == 3 and not server.accept( 443 ).has_value(),
+         "an expired cookie was accepted" );
+}
+
+// a connection established from a cookie never sends segments larger than the stack's MSS, even one smaller
+// than every MSS a cookie can encode
+void test_syn_cookie_small_mss()
+{
+  TCPConfig cfg;
+  Network net;
+  constexpr size_t mss = 300;
+  size_t largest_payload = 0;
+  TCPStack client { cfg, Network::queue( net.to_server ) };
+  TCPStack server { cfg,
+                    [&]( string_view headers, string_view payload ) {
+                      largest_payload = max( largest_payload, payload.size() );
+                      net.to_client.push_back( string { headers } + string { payload } );
+                    },
+                    mss };
+
+  const Address server_addr { "10.144.0.1", 443 };
+  server.listen( server_addr, 16, 1 );
+  client.connect( Address { "10.144.0.2", 2000 }, server_addr );
+  const FourTuple cookied = client.connect( Address { "10.144.0.2", 2001 }, server_addr );
+  net.exchange( client, server );
+  server.accept( 443 );
+  const auto id = server.accept( 443 );
+  check( id.has_value() and id->remote_port == cookied.local_port, "the cookie's handshake did not complete" );
+
+  const string data( 4 * TCPConfig::MAX_PAYLOAD_SIZE, 'x' );
+  server.peer( id.value() )->outbound_writer().push( data );
+  server.push( id.value() );
+  net.exchange( client, server );
+  check( read_all( *client.peer( cookied ) ) == data, "data lost on a connection established from a cookie" );
+  check( largest_payload > 0 and largest_payload <= mss,
+         "a cookie's connection sent " + to_string( largest_payload ) + "-byte segments (MSS is "
+           + to_string( mss ) + ")" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    test_map();
+    test_stack();
+    test_syn_cookies();
+    test_syn_cookie_small_mss();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+#include "four_tuple_map.hh"
+#include "random.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+struct FourTupleHash
+{
+  size_t operator()( const FourTuple& t ) const { return t.hash(); }
+};
+
+// Look up `lookups` random connections among `connections` established ones (as a busy server would, many
+// clients on few addresses talking to one listening port), in FourTupleMap and in std::unordered_map.
+void speed_test( const size_t connections, const size_t lookups )
+{
+  auto rd = get_random_engine();
+
+  vector<FourTuple> keys;
+  keys.reserve( connections );
+  FourTupleMap<uint32_t> flat;
+  unordered_map<FourTuple, uint32_t, FourTupleHash> node_based;
+  while ( keys.size() < connections ) {
+    const FourTuple t { .local_ip = 0x0a000001,
+                        .remote_ip = 0x0a100000U + static_cast<uint32_t>( rd() % 64 ),
+                        .local_port = 443,
+                        .remote_port = static_cast<uint16_t>( 1024 + rd() % 64512 ) };
+    const auto value = static_cast<uint32_t>( keys.size() );
+    if ( flat.emplace( t, value ).second ) {
+      node_based.emplace( t, value );
+      keys.push_back( t );
+    }
+  }
+
+  vector<FourTuple> order;
+  order.reserve( lookups );
+  for ( size_t i = 0; i < lookups; ++i ) {
+    order.push_back( keys[rd() % keys.size()] );
+  }
+
+  uint64_t flat_sum = 0;
+  const auto flat_start = steady_clock::now();
+  for ( const auto& t : order ) {
+    flat_sum += *flat.find( t );
+  }
+  const auto flat_stop = steady_clock::now();
+
+  uint64_t node_sum = 0;
+  const auto node_start = steady_clock::now();
+  for ( const auto& t : order ) {
+    node_sum += node_based.find( t )->second;
+  }
+  const auto node_stop = steady_clock::now();
+
+  if ( flat_sum != node_sum ) {
+    throw runtime_error( "FourTupleMap and std::unordered_map disagree" );
+  }
+
+  const auto ns_per = [&]( auto start, auto stop ) {
+    return static_cast<double>( duration_cast<nanoseconds>( stop - start ).count() )
+           / static_cast<double>( lookups );
+  };
+  const double flat_ns = ns_per( flat_start, flat_stop );
+  const double node_ns = ns_per( node_start, node_stop );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Four-tuple lookup among " << connections << " connections: " << fixed << setprecision( 1 ) << flat_ns
+       << " ns/lookup (FourTupleMap), " << node_ns << " ns/lookup (std::unordered_map).\n";
+
+  debug_output << "            Connection table (" << connections << " entries): " << fixed << setprecision( 1 )
+               << flat_ns << " ns/lookup\n";
+
+  if ( flat_ns > 2 * node_ns ) {
+    throw runtime_error( "FourTupleMap lookups were much slower than std::unordered_map" );
+  }
+}
+
+int main()
+{
+  try {
+    speed_test( 100000, 4000000 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,100 @@
+#include "common.hh"
+#include "random.hh"
+#include "timer_wheel.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// random schedules, cancels and advances, checked against a map ordered by expiry time
+void test_reference()
+{
+  auto rd = get_random_engine();
+  TimerWheel<uint64_t> wheel;
+  map<pair<uint64_t, uint64_t>, TimerWheel<uint64_t>::Handle> reference; // (expiry, id) -> handle
+  uint64_t next_id = 0;
+
+  for ( unsigned round = 0; round < 20000; ++round ) {
+    switch ( rd() % 4 ) {
+      case 0:
+      case 1: {
+        // mostly short delays, some spanning the coarser levels
+        const uint64_t delay = rd() % 8 == 0 ? rd() % 20000000 : rd() % 1000;
+        const uint64_t id = next_id++;
+        reference.emplace( pair { wheel.now() + max<uint64_t>( delay, 1 ), id }, wheel.schedule( delay, id ) );
+        break;
+      }
+      case 2:
+        if ( not reference.empty() ) {
+          auto victim = next( reference.begin(), static_cast<long>( rd() % reference.size() ) );
+          check( wheel.cancel( victim->second ), "cancel of a pending timer failed" );
+          check( not wheel.pending( victim->second ), "cancelled timer still pending" );
+          check( not wheel.cancel( victim->second ), "second cancel succeeded" );
+          reference.erase( victim );
+        }
+        break;
+      default: {
+        const uint64_t ms = rd() % 8 == 0 ? rd() % 100000 : rd() % 300;
+        const uint64_t end = wheel.now() + ms;
+        wheel.advance( ms, [&]( uint64_t&& id ) {
+          // timers due in the same millisecond may expire in any order
+          const auto it = reference.find( pair { wheel.now(), id } );
+          check( it != reference.end() and it->first.first == reference.begin()->first.first,
+                 "timer " + to_string( id ) + " expired at " + to_string( wheel.now() ) + " out of order" );
+          reference.erase( it );
+        } );
+        check( wheel.now() == end, "advance did not reach its end" );
+        check( reference.empty() or reference.begin()->first.first > end, "a due timer did not expire" );
+      }
+    }
+    check( wheel.size() == reference.size(), "size disagrees with reference" );
+  }
+}
+
+void test_stale_handles()
+{
+  TimerWheel<int> wheel;
+  auto first = wheel.schedule( 10, 1 );
+  int fired = 0;
+  wheel.advance( 10, [&]( int&& ) { ++fired; } );
+  check( fired == 1 and not wheel.pending( first ), "timer did not expire on time" );
+
+  // the expired timer's node is recycled; the old handle must not cancel the new timer
+  auto second = wheel.schedule( 10, 2 );
+  check( not wheel.cancel( first ), "a stale handle cancelled a recycled timer" );
+  check( wheel.pending( second ), "recycled timer was lost" );
+
+  // callbacks may re-arm timers, which expire later in the same advance
+  unsigned rearmed = 0;
+  wheel.advance( 100, [&]( int&& value ) {
+    if ( ++rearmed < 5 ) {
+      wheel.schedule( 10, move( value ) );
+    }
+  } );
+  check( rearmed == 5 and wheel.size() == 0, "re-armed timers did not expire" );
+  check( not wheel.pending( TimerWheel<int>::Handle {} ), "a default handle is pending" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    test_reference();
+    test_stale_handles();
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#include "random.hh"
+#include "timer_wheel.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// `timers` timers with deadlines up to a minute away, each re-armed when it expires (like retransmission and
+// keep-alive timers of idle connections), ticked once per millisecond: the wheel touches only the timers that
+// expire, while polling every connection's countdown touches all of them on every tick.
+void speed_test( const size_t timers, const uint64_t ticks )
+{
+  auto rd = get_random_engine();
+  uniform_int_distribution<uint64_t> delay { 1, 60000 };
+
+  TimerWheel<uint32_t> wheel;
+  for ( uint32_t i = 0; i < timers; ++i ) {
+    wheel.schedule( delay( rd ), i );
+  }
+
+  uint64_t wheel_expired = 0;
+  const auto wheel_start = steady_clock::now();
+  for ( uint64_t t = 0; t < ticks; ++t ) {
+    wheel.advance( 1, [&]( uint32_t&& id ) {
+      ++wheel_expired;
+      wheel.schedule( delay( rd ), id );
+    } );
+  }
+  const auto wheel_stop = steady_clock::now();
+
+  vector<uint64_t> countdowns;
+  countdowns.reserve( timers );
+  for ( size_t i = 0; i < timers; ++i ) {
+    countdowns.push_back( delay( rd ) );
+  }
+
+  uint64_t scan_expired = 0;
+  const auto scan_start = steady_clock::now();
+  for ( uint64_t t = 0; t < ticks; ++t ) {
+    for ( auto& countdown : countdowns ) {
+      if ( --countdown == 0 ) {
+        ++scan_expired;
+        countdown = delay( rd );
+      }
+    }
+  }
+  const auto scan_stop = steady_clock::now();
+
+  const auto ns_per_tick = [&]( auto start, auto stop ) {
+    return static_cast<double>( duration_cast<nanoseconds>( stop - start ).count() )
+           / static_cast<double>( ticks );
+  };
+  const double wheel_ns = ns_per_tick( wheel_start, wheel_stop );
+  const double scan_ns = ns_per_tick( scan_start, scan_stop );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Ticking " << timers << " timers for " << ticks << " ms: " << fixed << setprecision( 0 ) << wheel_ns
+       << " ns/tick with the timer wheel (" << wheel_expired << " expired), " << scan_ns
+       << " ns/tick polling every timer (" << scan_expired << " expired).\n";
+
+  debug_output << "            Timer wheel (" << timers << " timers): " << fixed << setprecision( 0 ) << wheel_ns
+               << " ns/tick, polling " << scan_ns << " ns/tick\n";
+
+  if ( wheel_ns > scan_ns ) {
+    throw runtime_error( "timer wheel ticks were slower than polling every timer" );
+  }
+}
+
+int main()
+{
+  try {
+    speed_test( 100000, 5000 );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+#include "exception.hh"
+#include "socket.hh"
+#include "tcp_config.hh"
+#include "tcp_minnow_socket.hh"
+#include "tun.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+// the tun144 setup of scripts/tun.sh: the kernel is 169.254.144.1, and minnow lives behind the device
+constexpr const char* TUN_DEVICE = "tun144";
+constexpr const char* KERNEL_ADDRESS = "169.254.144.1";
+constexpr const char* MINNOW_ADDRESS = "169.254.144.9";
+
+uint64_t packets_to_minnow()
+{
+  ifstream counter { string { "/sys/class/net/" } + TUN_DEVICE + "/statistics/tx_packets" };
+  uint64_t ret {};
+  counter >> ret;
+  return ret;
+}
+
+// (a device stays busy for a moment after its last user: io_uring lets go of the fd asynchronously)
+TunFD open_tun( const TunTapOptions options )
+{
+  for ( int attempt = 0;; ++attempt ) {
+    try {
+      return TunFD { TUN_DEVICE, options };
+    } catch ( const unix_error& e ) {
+      if ( e.code().value() != EBUSY or attempt == 100 ) {
+        throw;
+      }
+      this_thread::sleep_for( milliseconds( 10 ) );
+    }
+  }
+}
+
+// A kernel TCP server sends `bytes` to a minnow client over the TUN device, after a request in the other
+// direction. Returns the number of packets the client read.
+uint64_t tun_test( const bool offload, const size_t bytes )
+{
+  TunFD tun = open_tun( { .vnet_hdr = offload } );
+  if ( offload ) {
+    tun.set_offload( true );
+  }
+
+  TCPSocket server;
+  server.set_reuseaddr();
+  server.bind( Address { KERNEL_ADDRESS, 0 } );
+  server.listen();
+
+  const string request( 4000, 'q' ); // (whole segments: TCPSender::push spins on a short tail)
+  exception_ptr server_error;
+  thread server_thread { [&] {
+    try {
+      TCPSocket connection = server.accept();
+      string received;
+      while ( received.size() < request.size() and not connection.eof() ) {
+        string chunk;
+        connection.read( chunk );
+        received += chunk;
+      }
+      if ( received != request ) {
+        throw runtime_error( "the kernel received a garbled request" );
+      }
+      const string block( 65536, 'r' );
+      for ( size_t sent = 0; sent < bytes; ) {
+        sent += connection.write( string_view { block }.substr( 0, bytes - sent ) );
+      }
+    } catch ( ... ) {
+      server_error = current_exception();
+    }
+  } };
+
+  TCPOverIPv4MinnowSocket client { TCPOverIPv4OverTunFdAdapter { move( tun ) } };
+  FdAdapterConfig adapter_config;
+  adapter_config.source = { MINNOW_ADDRESS, to_string( 1024 + random_device()() % 60000 ) };
+  adapter_config.destination = server.local_address();
+  TCPConfig tcp_config;
+  tcp_config.isn = Wrap32 { random_device()() };
+  tcp_config.gso = offload; // (the request goes to the kernel as one GSO datagram)
+
+  const uint64_t packets_before = packets_to_minnow();
+  const auto start = steady_clock::now();
+  client.connect( tcp_config, adapter_config );
+  client.write( request );
+  size_t received = 0;
+  while ( not client.eof() ) {
+    string chunk;
+    client.read( chunk );
+    received += chunk.size();
+  }
+  const auto stop = steady_clock::now();
+  const uint64_t packets = packets_to_minnow() - packets_before;
+  client.wait_until_closed();
+  server_thread.join();
+  if ( server_error ) {
+    rethrow_exception( server_error );
+  }
+  if ( received != bytes ) {
+    throw runtime_error( "minnow received " + to_string( received ) + " of " + to_string( bytes ) + " bytes" );
+  }
+
+  const double seconds = duration<double>( stop - start ).count();
+  const double mbit_per_second = static_cast<double>( bytes ) * 8 / seconds / 1e6;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Kernel to minnow over " << TUN_DEVICE << ( offload ? " with virtio headers and TSO" : "" ) << ": "
+       << fixed << setprecision( 1 ) << mbit_per_second << " Mbit/s in " << packets << " packets ("
+       << setprecision( 0 ) << static_cast<double>( bytes ) / static_cast<double>( max<uint64_t>( packets, 1 ) )
+       << " bytes per packet).\n";
+
+  debug_output << "      TUN " << ( offload ? "(offload)" : "(plain)" ) << ": " << fixed << setprecision( 1 )
+               << mbit_per_second << " Mbit/s\n";
+
+  return packets;
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    try {
+      // (with virtio headers, a device whose offloads an earlier run left on can be opened, and reset)
+      TunFD probe = open_tun( { .vnet_hdr = true } );
+      probe.clear_offload();
+    } catch ( const exception& e ) {
+      cout << "(" << TUN_DEVICE << " is not available, so skipping: run scripts/tun.sh start first)\n";
+      return EXIT_SUCCESS;
+    }
+
+    constexpr size_t bytes = 1024 * 1024;
+    const uint64_t plain = tun_test( false, bytes );
+    const uint64_t offloaded = tun_test( true, bytes );
+    open_tun( { .vnet_hdr = true } ).clear_offload(); // (so that the device takes queues without virtio headers)
+    // (throughput is bound by the window: minnow only advertises a reopened window when it next sends)
+    cout << "  offload read " << fixed << setprecision( 1 )
+         << static_cast<double>( plain ) / static_cast<double>( max<uint64_t>( offloaded, 1 ) )
+         << "x fewer packets for the same bytes\n";
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,4 +1,5 @@
 #include "arp_message.hh"
+#include "header_layout.hh"
 
 #include <arpa/inet.h>
 #include <iomanip>
@@ -30,7 +31,41 @@ string ARPMessage::to_string() const
   return ss.str();
 }
 
+namespace {
+
+using namespace header_layout;
+
+using ARPLayout = Layout<ARPMessage::LENGTH,
+                         Field<0, 16, &ARPMessage::hardware_type>,
+                         Field<16, 16, &ARPMessage::protocol_type>,
+                         Field<32, 8, &ARPMessage::hardware_address_size>,
+                         Field<40, 8, &ARPMessage::protocol_address_size>,
+                         Field<48, 16, &ARPMessage::opcode>,
+                         Bytes<64, &ARPMessage::sender_ethernet_address>,
+                         Field<112, 32, &ARPMessage::sender_ip_address>,
+                         Bytes<144, &ARPMessage::target_ethernet_address>,
+                         Field<192, 32, &ARPMessage::target_ip_address>>;
+
+} // namespace
+
 void ARPMessage::parse( Parser& parser )
+{
+  ARPLayout::parse( *this, parser );
+  if ( not supported() ) {
+    parser.set_error();
+  }
+}
+
+void ARPMessage::serialize( Serializer& serializer ) const
+{
+  if ( not supported() ) {
+    throw runtime_error( "ARPMessage: unsupported field combination (must be Ethernet/IP, and request or reply)" );
+  }
+
+  ARPLayout::serialize( *this, serializer );
+}
+
+void ARPMessage::parse_by_hand( Parser& parser )
 {
   parser.integer( hardware_type );
   parser.integer( protocol_type );
@@ -56,7 +91,7 @@ void ARPMessage::parse( Parser& parser )
   parser.integer( target_ip_address );
 }
 
-void ARPMessage::serialize( Serializer& serializer ) const
+void ARPMessage::serialize_by_hand( Serializer& serializer ) const
 {
   if ( not supported() ) {
     throw runtime_error( "ARPMessage: unsupported field combination (must be Ethernet/IP, and request or reply)" );
@@ -27,4 +27,8 @@ struct ARPMessage
   bool supported() const;                         // 判断ARP消息是否被解析器支持
   void parse( Parser& parser );                   // 解析ARP消息
   void serialize( Serializer& serializer ) const; // 序列化ARP消息
+
+  // 手写的逐字段版本（作为参照，用于差分测试和基准测试）
+  void parse_by_hand( Parser& parser );
+  void serialize_by_hand( Serializer& serializer ) const;
 };
@@ -0,0 +1,228 @@
+#include "async.hh"
+
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+coroutine_handle<> Task::FinalAwaiter::await_suspend( coroutine_handle<promise_type> handle ) noexcept
+{
+  promise_type& promise = handle.promise();
+  if ( promise.continuation ) {
+    return promise.continuation;
+  }
+  promise.scheduler->finished( promise );
+  return noop_coroutine();
+}
+
+coroutine_handle<> Task::Awaiter::await_suspend( coroutine_handle<promise_type> parent ) noexcept
+{
+  child.promise().scheduler = parent.promise().scheduler;
+  child.promise().root = parent.promise().root;
+  child.promise().continuation = parent;
+  return child;
+}
+
+void Task::Awaiter::await_resume() const
+{
+  if ( child.promise().exception ) {
+    rethrow_exception( child.promise().exception );
+  }
+}
+
+Task::~Task()
+{
+  if ( handle_ ) {
+    handle_.destroy();
+  }
+}
+
+Task& Task::operator=( Task&& other ) noexcept
+{
+  if ( this != &other ) {
+    if ( handle_ ) {
+      handle_.destroy();
+    }
+    handle_ = exchange( other.handle_, {} );
+  }
+  return *this;
+}
+
+Scheduler::Scheduler( EventLoop& eventloop )
+  : eventloop_( eventloop ), category_( eventloop.add_category( "resume tasks awaiting fds" ) )
+{}
+
+Scheduler::~Scheduler()
+{
+  // the loop's rules refer to this Scheduler
+  for ( const auto& [key, wait] : fd_waits_ ) {
+    if ( wait->rule ) {
+      wait->rule->cancel();
+    }
+  }
+}
+
+void Scheduler::spawn( Task&& task )
+{
+  const auto handle = task.handle();
+  handle.promise().scheduler = this;
+  tasks_.emplace( handle.address(), move( task ) );
+  ready_.push_back( handle );
+}
+
+void Scheduler::run()
+{
+  stopped_ = false;
+  while ( true ) {
+    resume_ready();
+    if ( stopped_ or tasks_.empty() ) {
+      return;
+    }
+
+    if ( eventloop_.wait_next_event( -1 ) == EventLoop::Result::Exit and ready_.empty() ) {
+      throw runtime_error( "Scheduler: " + to_string( tasks_.size() )
+                           + " task(s) are waiting, but the event loop has nothing left to wait for" );
+    }
+  }
+}
+
+shared_ptr<Scheduler::FDWait> Scheduler::wait_for( FileDescriptor& fd,
+                                                   const Direction direction,
+                                                   const coroutine_handle<Task::promise_type> handle )
+{
+  if ( fd.closed() ) {
+    throw runtime_error( "Scheduler: a task awaited a closed fd" );
+  }
+
+  const pair key { fd.fd_num(), direction };
+  auto& wait = fd_waits_[key];
+  if ( not wait or wait->fd.closed() ) {
+    // (a new file, or one that took the number of a file since closed, whose rule must not park forever)
+    if ( wait and wait->rule ) {
+      wait->rule->cancel();
+    }
+    wait = make_shared<FDWait>( FDWait { .fd = fd.duplicate() } );
+  }
+  if ( wait->waiter ) {
+    throw runtime_error( "Scheduler: two tasks awaited fd " + to_string( key.first ) + " at once" );
+  }
+
+  Task::promise_type& root = *handle.promise().root;
+  if ( wait->owner != &root ) {
+    wait->owner = &root;
+    root.fds.push_back( key );
+  }
+  wait->waiter = handle;
+  wait->failed = false;
+
+  if ( wait->rule_id == 0 and direction == Direction::ErrorQueue ) {
+    const uint64_t id = next_rule_id_++;
+    wait->rule_id = id;
+    wait->rule = eventloop_.add_error_queue_rule(
+      category_,
+      fd,
+      [this, wait] { wake( *wait ); },
+      [wait] { return static_cast<bool>( wait->waiter ); },
+      [this, wait, id] {
+        if ( wait->rule_id == id ) {
+          wait->rule_id = 0;
+          wait->failed = true;
+          wake( *wait );
+        }
+      } );
+  } else if ( wait->rule_id == 0 ) {
+    const uint64_t id = next_rule_id_++;
+    wait->rule_id = id;
+    wait->rule = eventloop_.add_rule(
+      category_,
+      fd,
+      direction,
+      [this, wait] { wake( *wait ); },
+      [wait] { return static_cast<bool>( wait->waiter ); },
+      [this, wait, id, direction] {
+        if ( wait->rule_id == id ) {
+          // (an fd that hung up will never be writable; a read will find its EOF)
+          wait->rule_id = 0;
+          if ( direction == Direction::Out ) {
+            wait->failed = true;
+          }
+          wake( *wait );
+        }
+      },
+      [this, wait, id] {
+        if ( wait->rule_id == id ) {
+          wait->failed = true;
+          wake( *wait );
+        }
+      } );
+  }
+
+  return wait;
+}
+
+void Scheduler::wait_for( const ByteStream& stream,
+                          bool ( *ready )( const ByteStream& ),
+                          const coroutine_handle<Task::promise_type> handle )
+{
+  stream_waits_.push_back( { &stream, ready, handle } );
+}
+
+void Scheduler::wake( FDWait& wait )
+{
+  if ( wait.waiter ) {
+    ready_.push_back( exchange( wait.waiter, {} ) );
+  }
+}
+
+void Scheduler::resume_ready()
+{
+  while ( not stopped_ ) {
+    // the Tasks whose streams have changed join the queue
+    size_t waiting = 0;
+    for ( const StreamWait& wait : stream_waits_ ) {
+      if ( wait.ready( *wait.stream ) ) {
+        ready_.push_back( wait.waiter );
+      } else {
+        stream_waits_[waiting++] = wait;
+      }
+    }
+    stream_waits_.resize( waiting );
+
+    if ( ready_.empty() ) {
+      return;
+    }
+
+    while ( not ready_.empty() and not stopped_ ) {
+      const auto handle = ready_.front();
+      ready_.pop_front();
+      handle.resume();
+      reap_finished();
+    }
+  }
+}
+
+void Scheduler::reap_finished()
+{
+  exception_ptr exception;
+  for ( Task::promise_type* const root : finished_ ) {
+    for ( const auto& key : root->fds ) {
+      const auto wait = fd_waits_.find( key );
+      if ( wait != fd_waits_.end() and wait->second->owner == root ) {
+        if ( wait->second->rule ) {
+          wait->second->rule->cancel();
+        }
+        fd_waits_.erase( wait );
+      }
+    }
+
+    if ( root->exception and not exception ) {
+      exception = root->exception;
+    }
+    tasks_.erase( coroutine_handle<Task::promise_type>::from_promise( *root ).address() );
+  }
+  finished_.clear();
+
+  if ( exception ) {
+    rethrow_exception( exception );
+  }
+}
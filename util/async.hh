@@ -0,0 +1,225 @@
+#pragma once
+
+#include "byte_stream.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Scheduler;
+
+//! \brief A coroutine run by a Scheduler
+//! \details A Task starts suspended. It runs once it is spawned on a Scheduler, or when another Task awaits it:
+//! the awaiting Task then resumes when it finishes (and rethrows its exception, if it threw one).
+class Task
+{
+public:
+  struct promise_type;
+
+  //! Ends a Task: resumes the Task awaiting it, or tells the Scheduler that a spawned Task has finished
+  struct FinalAwaiter
+  {
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend( std::coroutine_handle<promise_type> handle ) noexcept;
+    void await_resume() const noexcept {}
+  };
+
+  struct promise_type
+  {
+    Scheduler* scheduler {};
+    promise_type* root { this };             //!< the spawned Task that this one runs as part of
+    std::coroutine_handle<> continuation {}; //!< the Task awaiting this one
+    std::exception_ptr exception {};
+    std::vector<std::pair<int, Direction>> fds {}; //!< (spawned Tasks) the fds awaited, whose rules end with it
+
+    Task get_return_object() { return Task { std::coroutine_handle<promise_type>::from_promise( *this ) }; }
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void return_void() const {}
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  //! Runs a Task as part of the Task that awaits it
+  struct Awaiter
+  {
+    std::coroutine_handle<promise_type> child;
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend( std::coroutine_handle<promise_type> parent ) noexcept;
+    void await_resume() const;
+  };
+
+  explicit Task( std::coroutine_handle<promise_type> handle ) : handle_( handle ) {}
+  ~Task();
+
+  Task( const Task& ) = delete;
+  Task& operator=( const Task& ) = delete;
+  Task( Task&& other ) noexcept : handle_( std::exchange( other.handle_, {} ) ) {}
+  Task& operator=( Task&& other ) noexcept;
+
+  Awaiter operator co_await() && { return { handle_ }; }
+
+  std::coroutine_handle<promise_type> handle() const { return handle_; }
+
+private:
+  std::coroutine_handle<promise_type> handle_;
+};
+
+//! \brief Runs Tasks on an EventLoop
+//! \details A Task that awaits an fd (`co_await fd.readable()`) is resumed once the EventLoop finds the fd
+//! ready; each fd and direction awaited has one rule, which stays registered (parked while no Task awaits it)
+//! until the Task that awaited it last finishes. A Task that awaits a ByteStream (`co_await reader.data()`,
+//! `co_await writer.space()`) is resumed once another Task has changed the stream so that it can proceed.
+//! Resumed Tasks run between calls to EventLoop::wait_next_event, never inside the loop's callbacks.
+class Scheduler
+{
+public:
+  explicit Scheduler( EventLoop& eventloop );
+  ~Scheduler();
+
+  Scheduler( const Scheduler& ) = delete;
+  Scheduler& operator=( const Scheduler& ) = delete;
+  Scheduler( Scheduler&& ) = delete;
+  Scheduler& operator=( Scheduler&& ) = delete;
+
+  //! Adds a Task, which starts running in the next call to run()
+  void spawn( Task&& task );
+
+  //! Runs the Tasks (serving the EventLoop while they wait) until all have finished, or until one calls stop()
+  //! \throws the exception of a Task that threw one, or std::runtime_error if Tasks are left waiting for what
+  //! cannot happen (the EventLoop has nothing left to wait for)
+  void run();
+
+  //! Makes run() return once the running Task suspends (the other Tasks stay suspended)
+  void stop() { stopped_ = true; }
+
+  //! Number of Tasks spawned and not yet finished
+  size_t tasks() const { return tasks_.size(); }
+
+  //! An fd and direction that Tasks await
+  struct FDWait
+  {
+    FileDescriptor fd;
+    std::coroutine_handle<> waiter {};
+    bool failed {};                               //!< the fd had an error (or hung up) while awaited
+    uint64_t rule_id {};                          //!< the rule that watches the fd (0 once the loop dropped it)
+    std::optional<EventLoop::RuleHandle> rule {}; //!< (to cancel it when its owner finishes)
+    const Task::promise_type* owner {};           //!< the spawned Task that awaited the fd last
+  };
+
+  //! Suspends `handle` until `fd` is ready in `direction`
+  std::shared_ptr<FDWait> wait_for( FileDescriptor& fd,
+                                    Direction direction,
+                                    std::coroutine_handle<Task::promise_type> handle );
+
+  //! Suspends `handle` until `ready( stream )`
+  void wait_for( const ByteStream& stream,
+                 bool ( *ready )( const ByteStream& ),
+                 std::coroutine_handle<Task::promise_type> handle );
+
+  //! Called by a spawned Task when it finishes
+  void finished( Task::promise_type& root ) { finished_.push_back( &root ); }
+
+private:
+  struct StreamWait
+  {
+    const ByteStream* stream {};
+    bool ( *ready )( const ByteStream& ) {};
+    std::coroutine_handle<> waiter {};
+  };
+
+  EventLoop& eventloop_;
+  size_t category_;
+  std::unordered_map<void*, Task> tasks_ {}; //!< by their handles' addresses
+  std::deque<std::coroutine_handle<>> ready_ {};
+  std::map<std::pair<int, Direction>, std::shared_ptr<FDWait>> fd_waits_ {};
+  std::vector<StreamWait> stream_waits_ {};
+  std::vector<Task::promise_type*> finished_ {};
+  uint64_t next_rule_id_ { 1 };
+  bool stopped_ {};
+
+  void wake( FDWait& wait );
+
+  //! Resumes Tasks until none is ready to run
+  void resume_ready();
+
+  //! Forgets the spawned Tasks that have finished, and the rules of the fds they awaited
+  //! \throws the exception of the first of them that threw one
+  void reap_finished();
+};
+
+//! Awaiter of FileDescriptor::readable(), FileDescriptor::writable() and FileDescriptor::error_queue()
+//! \details Resumes with true once the fd is ready (or, when reading, hung up), or with false if it had an error
+//! (or, when writing, hung up; or, awaiting its error queue, was closed). (GCC 12 miscompiles a coroutine with a
+//! co_await in an `if` condition: await into a variable first.)
+class FDAwaiter
+{
+  FileDescriptor& fd_;
+  Direction direction_;
+  std::shared_ptr<Scheduler::FDWait> wait_ {};
+
+public:
+  explicit FDAwaiter( FileDescriptor::Readiness readiness )
+    : fd_( readiness.fd )
+    , direction_( readiness.error_queue ? Direction::ErrorQueue
+                  : readiness.writable  ? Direction::Out
+                                        : Direction::In )
+  {}
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend( std::coroutine_handle<Task::promise_type> handle )
+  {
+    wait_ = handle.promise().scheduler->wait_for( fd_, direction_, handle );
+  }
+  bool await_resume() const { return not wait_->failed; }
+};
+
+//! Awaiter of Reader::data() and Writer::space()
+class StreamAwaiter
+{
+  const ByteStream& stream_;
+  bool ( *ready_ )( const ByteStream& );
+
+public:
+  StreamAwaiter( const ByteStream& stream, bool ( *ready )( const ByteStream& ) )
+    : stream_( stream ), ready_( ready )
+  {}
+
+  bool await_ready() const { return ready_( stream_ ); }
+  void await_suspend( std::coroutine_handle<Task::promise_type> handle ) const
+  {
+    handle.promise().scheduler->wait_for( stream_, ready_, handle );
+  }
+  void await_resume() const {}
+};
+
+inline FDAwaiter operator co_await( FileDescriptor::Readiness readiness )
+{
+  return FDAwaiter { readiness };
+}
+
+inline StreamAwaiter operator co_await( Reader::Data data )
+{
+  return { data.reader, []( const ByteStream& stream ) {
+            const Reader& reader = static_cast<const Reader&>( stream ); // NOLINT(*-static-cast-downcast)
+            return reader.bytes_buffered() > 0 or reader.is_finished() or reader.has_error();
+          } };
+}
+
+inline StreamAwaiter operator co_await( Writer::Space space )
+{
+  return { space.writer, []( const ByteStream& stream ) {
+            const Writer& writer = static_cast<const Writer&>( stream ); // NOLINT(*-static-cast-downcast)
+            return writer.available_capacity() > 0 or writer.is_closed() or writer.has_error();
+          } };
+}
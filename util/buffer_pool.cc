@@ -0,0 +1,210 @@
+#include "buffer_pool.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+struct PooledBuffer::Slot
+{
+  BufferPool::State* state {};
+  char* data {};
+  size_t refs {};
+  Slot* next_free {};
+};
+
+struct BufferPool::State
+{
+  size_t buffer_size;
+  size_t buffers_per_slab;
+  vector<unique_ptr<char[]>> memory {};                  // NOLINT(*-avoid-c-arrays)
+  vector<unique_ptr<PooledBuffer::Slot[]>> slot_slabs {}; // NOLINT(*-avoid-c-arrays)
+  PooledBuffer::Slot* free {};
+  size_t in_use {};
+  bool orphaned {}; //!< the BufferPool is gone (free the state once no buffer is in use)
+
+  void grow()
+  {
+    auto& memory_slab = memory.emplace_back( make_unique<char[]>( buffer_size * buffers_per_slab ) ); // NOLINT
+    auto& slots = slot_slabs.emplace_back( make_unique<PooledBuffer::Slot[]>( buffers_per_slab ) );  // NOLINT
+    for ( size_t i = 0; i < buffers_per_slab; ++i ) {
+      slots[i] = { this, memory_slab.get() + i * buffer_size, 0, free };
+      free = &slots[i];
+    }
+  }
+};
+
+BufferPool::BufferPool( const size_t buffer_size, const size_t buffers_per_slab ) : state_( nullptr )
+{
+  if ( buffer_size == 0 or buffers_per_slab == 0 ) {
+    throw runtime_error( "BufferPool: buffers and slabs must not be empty" );
+  }
+  state_ = new State { buffer_size, buffers_per_slab };
+}
+
+BufferPool::~BufferPool()
+{
+  release();
+}
+
+BufferPool::BufferPool( BufferPool&& other ) noexcept : state_( exchange( other.state_, nullptr ) ) {}
+
+BufferPool& BufferPool::operator=( BufferPool&& other ) noexcept
+{
+  if ( this != &other ) {
+    release();
+    state_ = exchange( other.state_, nullptr );
+  }
+  return *this;
+}
+
+void BufferPool::release()
+{
+  if ( not state_ ) {
+    return;
+  }
+  if ( state_->in_use == 0 ) {
+    delete state_;
+  } else {
+    state_->orphaned = true;
+  }
+  state_ = nullptr;
+}
+
+PooledBuffer BufferPool::get()
+{
+  if ( not state_->free ) {
+    state_->grow();
+  }
+  PooledBuffer::Slot* const slot = state_->free;
+  state_->free = slot->next_free;
+  ++state_->in_use;
+  return { slot, state_->buffer_size };
+}
+
+size_t BufferPool::buffer_size() const
+{
+  return state_->buffer_size;
+}
+
+size_t BufferPool::slabs() const
+{
+  return state_->memory.size();
+}
+
+size_t BufferPool::in_use() const
+{
+  return state_->in_use;
+}
+
+PooledBuffer::PooledBuffer( Slot* slot, const size_t size ) : slot_( slot ), size_( size )
+{
+  slot_->refs = 1;
+}
+
+PooledBuffer::PooledBuffer( const PooledBuffer& other )
+  : slot_( other.slot_ ), offset_( other.offset_ ), size_( other.size_ )
+{
+  if ( slot_ ) {
+    ++slot_->refs;
+  }
+}
+
+PooledBuffer& PooledBuffer::operator=( const PooledBuffer& other )
+{
+  if ( this != &other ) {
+    if ( other.slot_ ) {
+      ++other.slot_->refs;
+    }
+    release();
+    slot_ = other.slot_;
+    offset_ = other.offset_;
+    size_ = other.size_;
+  }
+  return *this;
+}
+
+PooledBuffer::PooledBuffer( PooledBuffer&& other ) noexcept
+  : slot_( exchange( other.slot_, nullptr ) )
+  , offset_( exchange( other.offset_, 0 ) )
+  , size_( exchange( other.size_, 0 ) )
+{}
+
+PooledBuffer& PooledBuffer::operator=( PooledBuffer&& other ) noexcept
+{
+  if ( this != &other ) {
+    release();
+    slot_ = exchange( other.slot_, nullptr );
+    offset_ = exchange( other.offset_, 0 );
+    size_ = exchange( other.size_, 0 );
+  }
+  return *this;
+}
+
+void PooledBuffer::release()
+{
+  if ( not slot_ ) {
+    return;
+  }
+  Slot* const slot = exchange( slot_, nullptr );
+  offset_ = size_ = 0;
+  if ( --slot->refs > 0 ) {
+    return;
+  }
+
+  BufferPool::State* const state = slot->state;
+  slot->next_free = state->free;
+  state->free = slot;
+  if ( --state->in_use == 0 and state->orphaned ) {
+    delete state;
+  }
+}
+
+char* PooledBuffer::data()
+{
+  return slot_ ? slot_->data + offset_ : nullptr;
+}
+
+const char* PooledBuffer::data() const
+{
+  return slot_ ? slot_->data + offset_ : nullptr;
+}
+
+size_t PooledBuffer::capacity() const
+{
+  return slot_ ? slot_->state->buffer_size - offset_ : 0;
+}
+
+void PooledBuffer::resize( const size_t size )
+{
+  if ( size > capacity() ) {
+    throw runtime_error( "PooledBuffer: resize beyond the end of the buffer" );
+  }
+  size_ = size;
+}
+
+void PooledBuffer::remove_prefix( const size_t n )
+{
+  if ( n > size_ ) {
+    throw runtime_error( "PooledBuffer: remove_prefix beyond the end of the view" );
+  }
+  offset_ += n;
+  size_ -= n;
+}
+
+PooledBuffer PooledBuffer::substr( const size_t pos, const size_t length ) const
+{
+  if ( pos > size_ ) {
+    throw out_of_range( "PooledBuffer::substr" );
+  }
+  PooledBuffer ret { *this };
+  ret.offset_ += pos;
+  ret.size_ = min( length, size_ - pos );
+  return ret;
+}
+
+size_t PooledBuffer::use_count() const
+{
+  return slot_ ? slot_->refs : 0;
+}
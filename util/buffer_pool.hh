@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+class BufferPool;
+
+//! \brief A reference-counted view of (part of) one buffer from a BufferPool
+//! \details Copies and substr() share the buffer; it goes back to its pool when the last view of it is dropped.
+//! Like the pool itself, views must stay on the thread that uses the pool.
+class PooledBuffer
+{
+public:
+  //! Storage of one buffer, and its reference count
+  struct Slot;
+
+  PooledBuffer() = default;
+  ~PooledBuffer() { release(); }
+
+  PooledBuffer( const PooledBuffer& other );
+  PooledBuffer& operator=( const PooledBuffer& other );
+  PooledBuffer( PooledBuffer&& other ) noexcept;
+  PooledBuffer& operator=( PooledBuffer&& other ) noexcept;
+
+  char* data();
+  const char* data() const;
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  //! Bytes from the start of the view to the end of its buffer
+  size_t capacity() const;
+
+  //! Grows or shrinks the view, within its buffer
+  void resize( size_t size );
+
+  //! Narrows the view from the front
+  void remove_prefix( size_t n );
+
+  //! \returns a view of part of this one, sharing its buffer
+  PooledBuffer substr( size_t pos, size_t length = SIZE_MAX ) const;
+
+  std::string_view view() const { return { data(), size_ }; }
+  operator std::string_view() const { return view(); } // NOLINT(*-explicit-*)
+
+  //! Number of views sharing the buffer (0 for an empty PooledBuffer)
+  size_t use_count() const;
+
+private:
+  friend class BufferPool;
+
+  Slot* slot_ {};
+  size_t offset_ {};
+  size_t size_ {};
+
+  PooledBuffer( Slot* slot, size_t size );
+  void release();
+};
+
+//! \brief A pool of fixed-size buffers for reads to land in
+//! \details Buffers are carved out of slabs of `buffers_per_slab` at a time, and a buffer whose last view is
+//! dropped goes on a free list to be handed out again: once the pool has as many buffers as are ever in use at
+//! once, getting a buffer allocates nothing. A pool may be destroyed while views of its buffers are still held;
+//! its slabs are then freed with the last of them. Not thread-safe: use one pool per thread (or per shard).
+class BufferPool
+{
+public:
+  explicit BufferPool( size_t buffer_size = 16384, size_t buffers_per_slab = 64 );
+  ~BufferPool();
+
+  BufferPool( const BufferPool& ) = delete;
+  BufferPool& operator=( const BufferPool& ) = delete;
+  BufferPool( BufferPool&& other ) noexcept;
+  BufferPool& operator=( BufferPool&& other ) noexcept;
+
+  //! \returns a view of a whole free buffer (growing the pool by a slab if none is free)
+  PooledBuffer get();
+
+  size_t buffer_size() const;
+
+  //! Number of slabs allocated so far
+  size_t slabs() const;
+
+  //! Number of buffers that are held by at least one view
+  size_t in_use() const;
+
+  //! What a pool's buffers share (kept until the pool is gone and none of its buffers is in use)
+  struct State;
+
+private:
+  State* state_;
+
+  void release();
+};
@@ -0,0 +1,171 @@
+#include "checksum.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <endian.h>
+#include <stdexcept>
+
+#if defined( __x86_64__ )
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// adds with end-around carry (one's-complement addition of 64-bit words)
+uint64_t add_carry( const uint64_t a, const uint64_t b )
+{
+  const uint64_t sum = a + b;
+  return sum + ( sum < b );
+}
+
+// folds a one's-complement sum to 16 bits (keeping it nonzero unless it is a sum of zeros)
+uint16_t fold( uint64_t sum )
+{
+  while ( sum > 0xffff ) {
+    sum = ( sum >> 16 ) + static_cast<uint16_t>( sum );
+  }
+  return sum;
+}
+
+// The sums below are of the 16-bit words in host byte order, and congruent (modulo 0xffff) to the true sum.
+
+uint64_t sum_scalar( const char* data, size_t len )
+{
+  uint64_t sum0 = 0;
+  uint64_t sum1 = 0;
+  for ( ; len >= 16; data += 16, len -= 16 ) {
+    uint64_t word0 {};
+    uint64_t word1 {};
+    memcpy( &word0, data, 8 );
+    memcpy( &word1, data + 8, 8 );
+    sum0 = add_carry( sum0, word0 );
+    sum1 = add_carry( sum1, word1 );
+  }
+  uint64_t sum = add_carry( sum0, sum1 );
+
+  if ( len >= 8 ) {
+    uint64_t word {};
+    memcpy( &word, data, 8 );
+    sum = add_carry( sum, word );
+    data += 8;
+    len -= 8;
+  }
+  for ( ; len >= 2; data += 2, len -= 2 ) {
+    uint16_t word {};
+    memcpy( &word, data, 2 );
+    sum = add_carry( sum, word );
+  }
+  return sum;
+}
+
+#if defined( __x86_64__ )
+
+// Each 32-bit lane of an accumulator gains at most 2 * 0xffff per vector, so it is emptied into the 64-bit
+// total every BLOCK vectors, before it can overflow.
+constexpr size_t BLOCK = 16384;
+
+__attribute__( ( target( "sse2" ) ) ) uint64_t sum_sse2( const char* data, size_t len )
+{
+  const __m128i low_halves = _mm_set1_epi32( 0xffff );
+  uint64_t total = 0;
+  while ( len >= 16 ) {
+    const size_t vectors = min( len / 16, BLOCK );
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    for ( size_t i = 0; i < vectors; ++i, data += 16 ) {
+      // NOLINTNEXTLINE(*-reinterpret-cast)
+      const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data ) );
+      acc0 = _mm_add_epi32( acc0, _mm_and_si128( v, low_halves ) );
+      acc1 = _mm_add_epi32( acc1, _mm_srli_epi32( v, 16 ) );
+    }
+    len -= vectors * 16;
+
+    alignas( 16 ) uint32_t lanes[8]; // NOLINT(*-avoid-c-arrays)
+    _mm_store_si128( reinterpret_cast<__m128i*>( lanes ), acc0 );     // NOLINT(*-reinterpret-cast)
+    _mm_store_si128( reinterpret_cast<__m128i*>( lanes + 4 ), acc1 ); // NOLINT(*-reinterpret-cast)
+    for ( const uint32_t lane : lanes ) {
+      total += lane;
+    }
+  }
+  return add_carry( total, sum_scalar( data, len ) );
+}
+
+__attribute__( ( target( "avx2" ) ) ) uint64_t sum_avx2( const char* data, size_t len )
+{
+  const __m256i low_halves = _mm256_set1_epi32( 0xffff );
+  uint64_t total = 0;
+  while ( len >= 32 ) {
+    const size_t vectors = min( len / 32, BLOCK );
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    for ( size_t i = 0; i < vectors; ++i, data += 32 ) {
+      // NOLINTNEXTLINE(*-reinterpret-cast)
+      const __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( data ) );
+      acc0 = _mm256_add_epi32( acc0, _mm256_and_si256( v, low_halves ) );
+      acc1 = _mm256_add_epi32( acc1, _mm256_srli_epi32( v, 16 ) );
+    }
+    len -= vectors * 32;
+
+    alignas( 32 ) uint32_t lanes[16]; // NOLINT(*-avoid-c-arrays)
+    _mm256_store_si256( reinterpret_cast<__m256i*>( lanes ), acc0 );     // NOLINT(*-reinterpret-cast)
+    _mm256_store_si256( reinterpret_cast<__m256i*>( lanes + 8 ), acc1 ); // NOLINT(*-reinterpret-cast)
+    for ( const uint32_t lane : lanes ) {
+      total += lane;
+    }
+  }
+  _mm256_zeroupper(); // (or the SSE2 code that finishes the buffer pays for dirty upper halves)
+  return add_carry( total, sum_sse2( data, len ) );
+}
+
+#endif
+
+} // namespace
+
+bool InternetChecksum::supported( const Kernel kernel )
+{
+  switch ( kernel ) {
+    case Kernel::Scalar:
+      return true;
+#if defined( __x86_64__ )
+    case Kernel::SSE2:
+      return __builtin_cpu_supports( "sse2" );
+    case Kernel::AVX2:
+      return __builtin_cpu_supports( "avx2" );
+#endif
+    default:
+      return false;
+  }
+}
+
+InternetChecksum::Kernel InternetChecksum::best_kernel()
+{
+  static const Kernel best = supported( Kernel::AVX2 )   ? Kernel::AVX2
+                             : supported( Kernel::SSE2 ) ? Kernel::SSE2
+                                                         : Kernel::Scalar;
+  return best;
+}
+
+uint16_t InternetChecksum::sum_words( const string_view data, const Kernel kernel )
+{
+  uint64_t sum {};
+  switch ( kernel ) {
+#if defined( __x86_64__ )
+    case Kernel::AVX2:
+      sum = sum_avx2( data.data(), data.size() );
+      break;
+    case Kernel::SSE2:
+      sum = sum_sse2( data.data(), data.size() );
+      break;
+#endif
+    case Kernel::Scalar:
+      sum = sum_scalar( data.data(), data.size() );
+      break;
+    default:
+      throw runtime_error( "InternetChecksum: unsupported kernel" );
+  }
+
+  // (the sum of the words in host order, swapped, is the sum of the words in network order)
+  return be16toh( fold( sum ) );
+}
@@ -2,40 +2,80 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 //! The internet checksum algorithm
+//! \details The sum over each buffer is taken a machine word (or a vector register) at a time, in host byte order,
+//! and only the folded result is swapped into network order: one's-complement addition does not care about byte
+//! order ([RFC 1071](\ref rfc::rfc1071), section 2(B)).
 class InternetChecksum
 {
+public:
+  //! The implementations of the sum over a buffer
+  enum class Kernel : uint8_t
+  {
+    Scalar, //!< 64-bit words, with end-around carry
+    SSE2,   //!< 16-byte vectors
+    AVX2,   //!< 32-byte vectors
+  };
+
+  //! The fastest kernel the CPU supports (chosen once, at run time)
+  static Kernel best_kernel();
+
+  //! Whether the CPU supports `kernel`
+  static bool supported( Kernel kernel );
+
 private:
-  uint32_t sum_;
+  uint64_t sum_;
   bool parity_ {};
 
+  //! One's-complement sum of the big-endian 16-bit words of `data` (an even number of bytes), folded to 16 bits
+  static uint16_t sum_words( std::string_view data, Kernel kernel );
+
 public:
   explicit InternetChecksum( const uint32_t sum = 0 ) : sum_( sum ) {}
-  void add( std::string_view data )
+
+  void add( std::string_view data ) { add( data, best_kernel() ); }
+
+  //! Adds `data` using a given kernel (for tests and benchmarks)
+  void add( std::string_view data, const Kernel kernel )
   {
-    for ( const uint8_t i : data ) {
-      uint16_t val = i;
-      if ( not parity_ ) {
-        val <<= 8;
-      }
-      sum_ += val;
-      parity_ = !parity_;
+    if ( data.empty() ) {
+      return;
+    }
+
+    // a byte left over from the previous buffer is the high half of a word, so this one starts with a low half
+    if ( parity_ ) {
+      sum_ += static_cast<uint8_t>( data.front() );
+      data.remove_prefix( 1 );
+      parity_ = false;
+    }
+
+    sum_ += sum_words( data.substr( 0, data.size() & ~size_t { 1 } ), kernel );
+
+    if ( data.size() % 2 ) {
+      sum_ += static_cast<uint16_t>( static_cast<uint8_t>( data.back() ) << 8 );
+      parity_ = true;
     }
   }
 
-  uint16_t value() const
+  //! The running sum before complementing (folded to 16 bits, but 0 only for a sum of zeros); used to seed another
+  //! InternetChecksum incrementally.
+  //! \note Only meaningful after an even number of bytes has been added.
+  uint32_t partial_sum() const
   {
-    uint32_t ret = sum_;
+    uint64_t ret = sum_;
 
     while ( ret > 0xffff ) {
       ret = ( ret >> 16 ) + static_cast<uint16_t>( ret );
     }
 
-    return ~ret;
+    return ret;
   }
 
+  uint16_t value() const { return ~partial_sum(); }
+
   void add( const std::vector<std::string>& data )
   {
     for ( const auto& x : data ) {
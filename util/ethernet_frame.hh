@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ethernet_header.hh"
+#include "packet_buffer.hh"
 #include "parser.hh"
 
 #include <vector>
@@ -8,8 +9,8 @@
 // 以太网帧结构体
 struct EthernetFrame
 {
-  EthernetHeader header {};            // 以太网帧头部
-  std::vector<std::string> payload {}; // 数据负载
+  EthernetHeader header {};             // 以太网帧头部
+  std::vector<SharedBuffer> payload {}; // 数据负载（共享读入的缓冲区，不拷贝）
 
   // 解析以太网帧
   void parse( Parser& parser )
@@ -24,4 +25,7 @@ struct EthernetFrame
     header.serialize( serializer ); // 序列化帧头部
     serializer.buffer( payload );   // 序列化负载数据
   }
+
+  // 序列化为一个连续的缓冲区（头部写入负载所在 PacketBuffer 的预留空间，不拷贝负载）
+  SharedBuffer serialize_packet() const { return prepend_header( ::serialize( header ), payload ); }
 };
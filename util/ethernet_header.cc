@@ -1,4 +1,5 @@
 #include "ethernet_header.hh"
+#include "header_layout.hh"
 
 #include <iomanip>
 #include <sstream>
@@ -41,7 +42,28 @@ string EthernetHeader::to_string() const
   return ss.str();
 }
 
+namespace {
+
+using namespace header_layout;
+
+using EthernetLayout = Layout<EthernetHeader::LENGTH,
+                              Bytes<0, &EthernetHeader::dst>,
+                              Bytes<48, &EthernetHeader::src>,
+                              Field<96, 16, &EthernetHeader::type>>;
+
+} // namespace
+
 void EthernetHeader::parse( Parser& parser )
+{
+  EthernetLayout::parse( *this, parser );
+}
+
+void EthernetHeader::serialize( Serializer& serializer ) const
+{
+  EthernetLayout::serialize( *this, serializer );
+}
+
+void EthernetHeader::parse_by_hand( Parser& parser )
 {
   // read destination address
   for ( auto& b : dst ) {
@@ -57,7 +79,7 @@ void EthernetHeader::parse( Parser& parser )
   parser.integer( type );
 }
 
-void EthernetHeader::serialize( Serializer& serializer ) const
+void EthernetHeader::serialize_by_hand( Serializer& serializer ) const
 {
   // write destination address
   for ( const auto& b : dst ) {
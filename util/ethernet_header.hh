@@ -34,4 +34,8 @@ struct EthernetHeader
 
   // 序列化头部信息
   void serialize( Serializer& serializer ) const;
+
+  // 手写的逐字段版本（作为参照，用于差分测试和基准测试）
+  void parse_by_hand( Parser& parser );
+  void serialize_by_hand( Serializer& serializer ) const;
 };
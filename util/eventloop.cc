@@ -2,17 +2,73 @@
 #include "exception.hh"
 #include "socket.hh"
 
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <climits>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <sys/stat.h>
 
 using namespace std;
+using namespace std::chrono;
 
 unsigned int EventLoop::FDRule::service_count() const
 {
   return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
+namespace {
+
+// (epoll reports errors whatever events are asked for: an error-queue rule asks for none)
+uint32_t epoll_events( const Direction direction )
+{
+  switch ( direction ) {
+    case Direction::In:
+      return EPOLLIN;
+    case Direction::Out:
+      return EPOLLOUT;
+    default:
+      return 0;
+  }
+}
+
+// A rule is finished once its fd is closed, or has reached EOF for a reading rule
+bool finished( const FileDescriptor& fd, const Direction direction )
+{
+  return fd.closed() or ( direction == Direction::In and fd.eof() );
+}
+
+// the provided buffers of each io_uring buffer group (one per buffer size): about this many bytes, in all
+constexpr size_t DATAGRAM_BUFFER_BYTES = size_t { 4 } << 20;
+constexpr size_t MIN_DATAGRAM_BUFFERS = 8;
+constexpr size_t MAX_DATAGRAM_BUFFERS = 512;
+constexpr unsigned GROUP_SHIFT = 48; // a datagram rule's user_data: its buffer group above its serial number
+constexpr unsigned READS_IN_FLIGHT = 8; // per datagram rule on an fd that is not a socket
+constexpr size_t MAX_DATAGRAMS_PER_READ = 64;
+
+} // namespace
+
+EventLoop::EventLoop( const Backend backend )
+  : _epoll( CheckSystemCall( "epoll_create1", ::epoll_create1( EPOLL_CLOEXEC ) ) )
+{
+  _rule_categories.reserve( 64 );
+  _events.resize( 256 );
+
+  if ( backend == Backend::IoUring and IoUring::supported() ) {
+    try {
+      _ring = make_unique<IoUring>( 256 );
+    } catch ( const unix_error& ) {
+      return; // not supported by this kernel (or not allowed): stay with epoll
+    }
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.fd = _ring->fd().fd_num();
+    CheckSystemCall( "epoll_ctl", ::epoll_ctl( _epoll.fd_num(), EPOLL_CTL_ADD, _ring->fd().fd_num(), &event ) );
+  }
+}
+
 size_t EventLoop::add_category( const string& name )
 {
   if ( _rule_categories.size() >= _rule_categories.capacity() ) {
@@ -23,6 +79,75 @@ size_t EventLoop::add_category( const string& name )
   return _rule_categories.size() - 1;
 }
 
+uint64_t EventLoop::served( const size_t category_id ) const
+{
+  return _rule_categories.at( category_id ).served;
+}
+
+void EventLoop::summary( ostream& out ) const
+{
+  const auto flags = out.flags();
+  out << "EventLoop: " << syscalls() << " system calls";
+  if constexpr ( profiling ) {
+    out << ", " << _wakeups << " wakeups, " << fixed << setprecision( 1 ) << static_cast<double>( _wait_ns ) / 1e6
+        << " ms waiting";
+  }
+  out << "\n" << setw( 12 ) << "served";
+  if constexpr ( profiling ) {
+    out << setw( 12 ) << "total ms" << setw( 10 ) << "mean us" << setw( 10 ) << "max us" << setw( 14 ) << "bytes";
+  }
+  out << "  category\n";
+
+  for ( const auto& category : _rule_categories ) {
+    out << setw( 12 ) << category.served;
+    if constexpr ( profiling ) {
+      const double total_ms = static_cast<double>( category.total_ns ) / 1e6;
+      const double mean_us
+        = category.served ? static_cast<double>( category.total_ns ) / 1e3 / static_cast<double>( category.served )
+                          : 0;
+      out << fixed << setprecision( 1 ) << setw( 12 ) << total_ms << setw( 10 ) << mean_us << setw( 10 )
+          << static_cast<double>( category.max_ns ) / 1e3 << setw( 14 ) << category.bytes;
+    }
+    out << "  " << category.name << "\n";
+  }
+  out.flags( flags );
+}
+
+void EventLoop::dump_summaries_on( const int signal )
+{
+  struct sigaction action {};
+  action.sa_handler = []( int ) { _dump_requests.fetch_add( 1, memory_order_relaxed ); };
+  sigemptyset( &action.sa_mask );
+  CheckSystemCall( "sigaction", ::sigaction( signal, &action, nullptr ) );
+}
+
+void EventLoop::check_dump_request()
+{
+  if constexpr ( profiling ) {
+    const uint64_t requests = _dump_requests.load( memory_order_relaxed );
+    if ( requests != _dumps_seen ) {
+      _dumps_seen = requests;
+      summary( cerr );
+    }
+  }
+}
+
+template<typename Callback>
+void EventLoop::run_callback( const size_t category_id, Callback&& callback )
+{
+  ++_rule_categories[category_id].served;
+  if constexpr ( profiling ) {
+    const auto start = steady_clock::now();
+    callback();
+    const auto ns = static_cast<uint64_t>( duration_cast<nanoseconds>( steady_clock::now() - start ).count() );
+    RuleCategory& category = _rule_categories[category_id];
+    category.total_ns += ns;
+    category.max_ns = max( category.max_ns, ns );
+  } else {
+    callback();
+  }
+}
+
 EventLoop::BasicRule::BasicRule( size_t s_category_id, InterestT s_interest, CallbackT s_callback )
   : category_id( s_category_id ), interest( move( s_interest ) ), callback( move( s_callback ) )
 {}
@@ -39,6 +164,28 @@ EventLoop::FDRule::FDRule( BasicRule&& base,
   , error( move( s_error ) )
 {}
 
+EventLoop::DatagramRule::DatagramRule( BasicRule&& base,
+                                       FileDescriptor&& s_fd,
+                                       DatagramCallbackT s_on_datagrams,
+                                       CallbackT s_cancel,
+                                       CallbackT s_error,
+                                       uint64_t s_id,
+                                       uint16_t s_buffer_group )
+  : BasicRule( base )
+  , fd( move( s_fd ) )
+  , on_datagrams( move( s_on_datagrams ) )
+  , cancel( move( s_cancel ) )
+  , error( move( s_error ) )
+  , id( s_id )
+  , buffer_group( s_buffer_group )
+  , source( datagram_source( fd ) )
+  , multishot( source == DatagramSource::Socket )
+{}
+
+EventLoop::TimerRule::TimerRule( BasicRule&& base, steady_clock::time_point s_deadline, milliseconds s_period )
+  : BasicRule( base ), deadline( s_deadline ), period( s_period )
+{}
+
 EventLoop::RuleHandle EventLoop::add_rule( size_t category_id,
                                            FileDescriptor& fd,
                                            Direction direction,
@@ -51,10 +198,110 @@ EventLoop::RuleHandle EventLoop::add_rule( size_t category_id,
     throw out_of_range( "bad category_id" );
   }
 
-  _fd_rules.emplace_back( make_shared<FDRule>(
-    BasicRule { category_id, interest, callback }, fd.duplicate(), direction, cancel, error ) );
+  auto rule = make_shared<FDRule>(
+    BasicRule { category_id, interest, callback }, fd.duplicate(), direction, cancel, error );
+  register_rule( rule );
+  return RuleHandle { rule };
+}
+
+EventLoop::RuleHandle EventLoop::add_error_queue_rule( const size_t category_id,
+                                                       FileDescriptor& fd,
+                                                       const CallbackT& callback,
+                                                       const InterestT& interest,
+                                                       const CallbackT& cancel )
+{
+  if ( category_id >= _rule_categories.size() ) {
+    throw out_of_range( "bad category_id" );
+  }
+
+  auto rule = make_shared<FDRule>(
+    BasicRule { category_id, interest, callback }, fd.duplicate(), Direction::ErrorQueue, cancel, [] {} );
+  register_rule( rule );
+  return RuleHandle { rule };
+}
 
-  return RuleHandle { _fd_rules.back() };
+void EventLoop::register_rule( const shared_ptr<FDRule>& rule )
+{
+  rule->cancellations = _cancellations;
+
+  // If the fd number belonged to a file that has since been closed, its old rules are finished.
+  const int fd_num = rule->fd.fd_num();
+  if ( const auto existing = _registrations.find( fd_num );
+       existing != _registrations.end() and existing->second.rules.front()->fd.closed() ) {
+    for ( const auto& old_rule : vector { existing->second.rules } ) {
+      remove_rule( old_rule, true );
+    }
+  }
+
+  _fd_rules.push_back( rule );
+  const auto [registration, inserted] = _registrations.try_emplace( fd_num );
+  registration->second.rules.push_back( rule );
+
+  if ( inserted ) {
+    epoll_event event {};
+    event.events = epoll_events( rule->direction );
+    event.data.fd = fd_num;
+    ++_syscalls;
+    if ( ::epoll_ctl( _epoll.fd_num(), EPOLL_CTL_ADD, fd_num, &event ) != 0 ) {
+      if ( errno != EPERM ) {
+        throw unix_error( "epoll_ctl" );
+      }
+      registration->second.always_ready = true;
+      _always_ready.push_back( fd_num );
+    }
+    registration->second.events = event.events;
+  } else {
+    update_registration( fd_num, registration->second );
+  }
+}
+
+EventLoop::RuleHandle EventLoop::add_datagram_rule( size_t category_id,
+                                                    FileDescriptor& fd,
+                                                    const DatagramCallbackT& callback,
+                                                    const InterestT& interest,
+                                                    const CallbackT& cancel, // NOLINT(*-easily-swappable-*)
+                                                    const CallbackT& error,
+                                                    const size_t buffer_size )
+{
+  if ( category_id >= _rule_categories.size() ) {
+    throw out_of_range( "bad category_id" );
+  }
+  if ( buffer_size == 0 or buffer_size > UINT32_MAX ) {
+    throw out_of_range( "bad datagram buffer size" );
+  }
+
+  if ( not _ring ) {
+    const DatagramSource source = datagram_source( fd );
+    if ( source != DatagramSource::Socket ) {
+      fd.set_blocking( false ); // (each batch is read until the fd would block)
+    }
+    auto reader = make_shared<FileDescriptor>( fd.duplicate() );
+    return add_rule(
+      category_id,
+      fd,
+      Direction::In,
+      [this, reader, source, buffer_size, callback] { read_datagrams( *reader, source, buffer_size, callback ); },
+      interest,
+      cancel,
+      error );
+  }
+
+  // rules with buffers of the same size share a buffer group
+  auto group = _buffer_groups.find( buffer_size );
+  if ( group == _buffer_groups.end() ) {
+    const auto count = static_cast<uint16_t>(
+      bit_floor( clamp( DATAGRAM_BUFFER_BYTES / buffer_size, MIN_DATAGRAM_BUFFERS, MAX_DATAGRAM_BUFFERS ) ) );
+    group = _buffer_groups.emplace( buffer_size, _ring->add_buffer_group( count, buffer_size ) ).first;
+  }
+
+  // (reads are armed by the next wait_next_event, once the rule's interest can be asked)
+  const uint64_t id = ( uint64_t { group->second } << GROUP_SHIFT ) | _next_datagram_rule_id++;
+  auto rule = make_shared<DatagramRule>(
+    BasicRule { category_id, interest, [] {} }, fd.duplicate(), callback, cancel, error, id, group->second );
+  rule->cancellations = _cancellations;
+  _datagram_rules.emplace( id, rule );
+
+  return RuleHandle { rule };
 }
 
 EventLoop::RuleHandle EventLoop::add_rule( const size_t category_id,
@@ -70,19 +317,153 @@ EventLoop::RuleHandle EventLoop::add_rule( const size_t category_id,
   return RuleHandle { _non_fd_rules.back() };
 }
 
+EventLoop::RuleHandle EventLoop::add_timer_rule( const size_t category_id,
+                                                 const uint64_t delay_ms,
+                                                 const CallbackT& callback,
+                                                 const uint64_t period_ms )
+{
+  if ( category_id >= _rule_categories.size() ) {
+    throw out_of_range( "bad category_id" );
+  }
+
+  auto rule = make_shared<TimerRule>( BasicRule { category_id, [] { return true; }, callback },
+                                      steady_clock::now() + milliseconds { delay_ms },
+                                      milliseconds { period_ms } );
+  rule->cancellations = _cancellations;
+  _timers.push_back( rule );
+  push_heap( _timers.begin(), _timers.end(), later );
+
+  return RuleHandle { rule };
+}
+
 void EventLoop::RuleHandle::cancel()
 {
   const shared_ptr<BasicRule> rule_shared_ptr = rule_weak_ptr_.lock();
-  if ( rule_shared_ptr ) {
+  if ( rule_shared_ptr and not rule_shared_ptr->cancel_requested ) {
     rule_shared_ptr->cancel_requested = true;
+    if ( rule_shared_ptr->cancellations ) {
+      ++*rule_shared_ptr->cancellations;
+    }
+  }
+}
+
+void EventLoop::update_registration( const int fd_num, Registration& registration )
+{
+  uint32_t events = 0;
+  for ( const auto& rule : registration.rules ) {
+    if ( not rule->parked ) {
+      events |= epoll_events( rule->direction );
+    }
+  }
+
+  // (a closed fd has already left the epoll set)
+  if ( events == registration.events or registration.always_ready or registration.rules.front()->fd.closed() ) {
+    registration.events = events;
+    return;
+  }
+
+  epoll_event event {};
+  event.events = events;
+  event.data.fd = fd_num;
+  ++_syscalls;
+  CheckSystemCall( "epoll_ctl", ::epoll_ctl( _epoll.fd_num(), EPOLL_CTL_MOD, fd_num, &event ) );
+  registration.events = events;
+}
+
+void EventLoop::remove_rule( const shared_ptr<FDRule>& rule, const bool call_cancel )
+{
+  const auto it = find( _fd_rules.begin(), _fd_rules.end(), rule );
+  if ( it == _fd_rules.end() ) {
+    return; // already removed
+  }
+  _fd_rules.erase( it );
+  rule->cancel_requested = true; // so that a rule already picked for this iteration is skipped
+
+  if ( rule->parked ) {
+    *find( _parked.begin(), _parked.end(), rule ) = _parked.back();
+    _parked.pop_back();
+  }
+
+  const int fd_num = rule->fd.fd_num();
+  auto& registration = _registrations.at( fd_num );
+  auto& rules = registration.rules;
+  rules.erase( find( rules.begin(), rules.end(), rule ) );
+
+  if ( not rules.empty() ) {
+    update_registration( fd_num, registration );
+  } else {
+    if ( registration.always_ready ) {
+      _always_ready.erase( find( _always_ready.begin(), _always_ready.end(), fd_num ) );
+    } else if ( not rule->fd.closed() ) {
+      ++_syscalls;
+      CheckSystemCall( "epoll_ctl", ::epoll_ctl( _epoll.fd_num(), EPOLL_CTL_DEL, fd_num, nullptr ) );
+    }
+    _registrations.erase( fd_num );
+  }
+
+  if ( call_cancel ) {
+    rule->cancel();
   }
 }
 
+void EventLoop::park( const shared_ptr<FDRule>& rule )
+{
+  rule->parked = true;
+  _parked.push_back( rule );
+  update_registration( rule->fd.fd_num(), _registrations.at( rule->fd.fd_num() ) );
+}
+
+void EventLoop::unpark( const shared_ptr<FDRule>& rule )
+{
+  rule->parked = false;
+  *find( _parked.begin(), _parked.end(), rule ) = _parked.back();
+  _parked.pop_back();
+  update_registration( rule->fd.fd_num(), _registrations.at( rule->fd.fd_num() ) );
+}
+
+void EventLoop::revisit_parked()
+{
+  for ( size_t i = 0; i < _parked.size(); ) {
+    const auto rule = _parked[i];
+    if ( finished( rule->fd, rule->direction ) ) {
+      remove_rule( rule, true ); // (moves another parked rule to index i)
+    } else if ( rule->interest() ) {
+      unpark( rule );
+    } else {
+      ++i;
+    }
+  }
+}
+
+//! \details Starts from the rule that was interested last time, which usually still is.
+bool EventLoop::find_interested_rule()
+{
+  for ( size_t remaining = _fd_rules.size(); remaining > 0 and not _fd_rules.empty(); --remaining ) {
+    _witness %= _fd_rules.size();
+    const auto rule = _fd_rules[_witness];
+
+    if ( rule->parked ) {
+      ++_witness;
+    } else if ( finished( rule->fd, rule->direction ) ) {
+      remove_rule( rule, true ); // (moves the next rule to index _witness)
+    } else if ( rule->interest() ) {
+      return true;
+    } else {
+      park( rule );
+      ++_witness;
+    }
+  }
+  return false;
+}
+
 // NOLINTBEGIN(*-cognitive-complexity)
 // NOLINTBEGIN(*-signed-bitwise)
 EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
 {
+  check_dump_request();
+
   // first, handle the non-file-descriptor-related rules
+  bool non_fd_fired = false;
   {
     for ( auto it = _non_fd_rules.begin(); it != _non_fd_rules.end(); ) {
       auto& this_rule = **it;
@@ -102,125 +483,515 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
         }
 
         rule_fired = true;
-        this_rule.callback();
+        run_callback( this_rule.category_id, this_rule.callback );
       }
 
-      if ( rule_fired ) {
+      if ( rule_fired and not _dispatch.serve_all ) {
         return Result::Success; /* only serve one rule on each iteration */
       }
+      non_fd_fired |= rule_fired;
 
       ++it;
     }
   }
 
-  // now the file-descriptor-related rules. poll any "interested" file descriptors
-  vector<pollfd> pollfds {};
-  pollfds.reserve( _fd_rules.size() );
-  bool something_to_poll = false;
+  // rules cancelled through a RuleHandle are forgotten right away (without calling their cancel callbacks), so
+  // that the objects they capture can be destroyed
+  if ( *_cancellations ) {
+    for ( const auto& rule : vector { _fd_rules } ) {
+      if ( rule->cancel_requested ) {
+        remove_rule( rule, false );
+      }
+    }
+    for ( auto it = _datagram_rules.begin(); it != _datagram_rules.end(); ) {
+      const auto rule = ( it++ )->second;
+      if ( rule->cancel_requested ) {
+        remove_datagram_rule( rule, false );
+      }
+    }
+    if ( erase_if( _timers, []( const auto& timer ) { return timer->cancel_requested; } ) > 0 ) {
+      make_heap( _timers.begin(), _timers.end(), later );
+    }
+    *_cancellations = 0;
+  }
+
+  revisit_parked();
 
-  // set up the pollfd for each rule
-  for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ) { // NOTE: it gets erased or incremented in loop body
-    auto& this_rule = **it;
+  // datagrams held back while their rules were uninterested are delivered as soon as their interest returns
+  const bool delivered = ( _ring and serve_datagram_rules() ) or non_fd_fired;
 
-    if ( this_rule.cancel_requested ) {
-      //      this_rule.cancel();
-      //      if rule is cancelled externally, no need to call the cancellation callback
-      //      this makes it easier to cancel rules and delete captured objects right away
-      it = _fd_rules.erase( it );
-      continue;
+  // quit if there is nothing left to wait for
+  if ( not find_interested_rule() and not datagram_rule_interested() and not delivered and _timers.empty() ) {
+    return Result::Exit;
+  }
+
+  // wait until one of the fds satisfies one of the rules (writeable/readable)
+  vector<pair<int, uint32_t>> ready;
+  poll_ready( ready, delivered ? 0 : timeout_for_timers( timeout_ms ) );
+
+  if ( ready.empty() ) {
+    const bool fired = fire_timers();
+    return delivered or fired ? Result::Success : Result::Timeout;
+  }
+
+  if ( _dispatch.serve_all ) {
+    // serve every ready rule, and then the rules that are still ready, until each has used up its budget
+    serve_ready( ready );
+    for ( unsigned round = 1; round < _dispatch.budget; ++round ) {
+      ready.clear();
+      poll_ready( ready, 0 );
+      if ( ready.empty() ) {
+        break;
+      }
+      serve_ready( ready );
+    }
+  } else {
+    // serve one ready fd, taking turns among the fds that are ready together
+    serve_ready( { ready.at( _turn++ % ready.size() ) } );
+  }
+
+  fire_timers();
+  return Result::Success;
+}
+
+void EventLoop::poll_ready( vector<pair<int, uint32_t>>& ready, const int timeout_ms )
+{
+  // fds that epoll cannot watch are always ready
+  for ( const int fd_num : _always_ready ) {
+    if ( const uint32_t events = _registrations.at( fd_num ).events ) {
+      ready.emplace_back( fd_num, events );
+    }
+  }
+
+  const int timeout = ready.empty() ? timeout_ms : 0;
+  const auto wait_start = steady_clock::now();
+  int count = 0;
+  for ( int remaining = timeout;; ) {
+    ++_syscalls;
+    count = ::epoll_wait( _epoll.fd_num(), _events.data(), static_cast<int>( _events.size() ), remaining );
+    if ( count >= 0 ) {
+      break;
+    }
+    // io_uring completes requests by interrupting the thread that submitted them, and signals (such as a request
+    // for a summary) interrupt it too: either way, epoll_wait ends early
+    if ( errno != EINTR ) {
+      throw unix_error( "epoll_wait" );
+    }
+    check_dump_request();
+    if ( timeout > 0 ) {
+      const auto waited = duration_cast<milliseconds>( steady_clock::now() - wait_start ).count();
+      remaining = static_cast<int>( max<int64_t>( timeout - waited, 0 ) );
+    }
+  }
+  for ( int i = 0; i < count; ++i ) {
+    ready.emplace_back( int { _events[i].data.fd }, uint32_t { _events[i].events } );
+  }
+
+  if constexpr ( profiling ) {
+    if ( timeout != 0 ) {
+      _wait_ns += static_cast<uint64_t>( duration_cast<nanoseconds>( steady_clock::now() - wait_start ).count() );
     }
+    _wakeups += count > 0;
+  }
+}
 
-    if ( this_rule.direction == Direction::In && this_rule.fd.eof() ) {
-      // no more reading on this rule, it's reached eof
-      this_rule.cancel();
-      it = _fd_rules.erase( it );
+void EventLoop::serve_ready( const vector<pair<int, uint32_t>>& ready )
+{
+  // (a callback may add or remove rules, so each fd's rules are looked up afresh)
+  for ( const auto& [fd_num, revents] : ready ) {
+    if ( _ring and fd_num == _ring->fd().fd_num() ) {
+      reap_completions();
+      serve_datagram_rules();
       continue;
     }
 
-    if ( this_rule.fd.closed() ) {
-      this_rule.cancel();
-      it = _fd_rules.erase( it );
+    auto registration = _registrations.find( fd_num );
+    if ( registration == _registrations.end() ) {
       continue;
     }
+    uint32_t events = revents;
+    if ( revents & EPOLLERR ) {
+      events = serve_error_queue( registration->second, revents );
+      registration = _registrations.find( fd_num ); // (the callbacks may have changed the fd's rules)
+      if ( registration == _registrations.end() ) {
+        continue;
+      }
+    }
+    for ( const auto& rule : vector { registration->second.rules } ) {
+      serve( rule, events );
+    }
+  }
+}
 
-    if ( this_rule.interest() ) {
-      pollfds.push_back( { this_rule.fd.fd_num(), static_cast<int16_t>( this_rule.direction ), 0 } );
-      something_to_poll = true;
-    } else {
-      pollfds.push_back( { this_rule.fd.fd_num(), 0, 0 } ); // placeholder --- we still want errors
+//! \details EPOLLERR is level-triggered, and epoll reports it whatever events are asked for, so an error-queue
+//! rule claims it only while the rule is interested (and so will read the queue, or have it read). SO_ERROR is
+//! not consulted: reading it would clear a real error before the other rules could see it. A real error still
+//! reaches them through their own reads and writes, or once no error-queue rule is interested.
+uint32_t EventLoop::serve_error_queue( const Registration& registration, const uint32_t revents )
+{
+  vector<shared_ptr<FDRule>> error_queue_rules;
+  for ( const auto& rule : registration.rules ) {
+    if ( rule->direction == Direction::ErrorQueue and not rule->cancel_requested ) {
+      error_queue_rules.push_back( rule );
     }
-    ++it;
+  }
+  if ( error_queue_rules.empty() ) {
+    return revents;
   }
 
-  // quit if there is nothing left to poll
-  if ( not something_to_poll ) {
-    return Result::Exit;
+  bool claimed = false;
+  for ( const auto& rule : error_queue_rules ) {
+    if ( not rule->cancel_requested and rule->interest() ) {
+      run_callback( rule->category_id, rule->callback );
+      claimed = true;
+    }
+  }
+  if ( claimed ) {
+    return revents & ~uint32_t { EPOLLERR };
   }
 
-  // call poll -- wait until one of the fds satisfies one of the rules (writeable/readable)
-  if ( 0 == CheckSystemCall( "poll", ::poll( pollfds.data(), pollfds.size(), timeout_ms ) ) ) {
-    return Result::Timeout;
-  }
-
-  // go through the poll results
-  for ( auto [it, idx] = make_pair( _fd_rules.begin(), static_cast<size_t>( 0 ) ); it != _fd_rules.end(); ++idx ) {
-    const auto& this_pollfd = pollfds.at( idx );
-    auto& this_rule = **it;
-
-    const auto poll_error = static_cast<bool>( this_pollfd.revents & ( POLLERR | POLLNVAL ) );
-    if ( poll_error ) {
-      /* see if fd is a socket */
-      int socket_error = 0;
-      socklen_t optlen = sizeof( socket_error );
-      const int ret = getsockopt( this_rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
-      if ( ret == -1 and errno == ENOTSOCK ) {
-        cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( this_rule.category_id ).name
-             << "\"\n";
-      } else if ( ret == -1 ) {
-        throw unix_error( "getsockopt" );
-      } else if ( optlen != sizeof( socket_error ) ) {
-        throw runtime_error( "unexpected length from getsockopt: " + to_string( optlen ) );
-      } else if ( socket_error ) {
-        cerr << "error on polled socket for rule \"" << _rule_categories.at( this_rule.category_id ).name
-             << "\": " << strerror( socket_error ) << "\n";
-      }
-
-      this_rule.error();
-      this_rule.cancel();
-      it = _fd_rules.erase( it );
-      continue;
+  // Nobody will read the queue: the error goes to the other rules (as if there were no error-queue rules), and
+  // the error-queue rules finish with them, so that the fd leaves the epoll set instead of reporting the error
+  // at every wait.
+  for ( const auto& rule : error_queue_rules ) {
+    remove_rule( rule, true );
+  }
+  return revents;
+}
+
+void EventLoop::serve( const shared_ptr<FDRule>& rule, const uint32_t revents )
+{
+  auto& this_rule = *rule;
+  if ( this_rule.cancel_requested or this_rule.direction == Direction::ErrorQueue ) {
+    return; // (error-queue rules are served by serve_error_queue)
+  }
+
+  if ( revents & EPOLLERR ) {
+    /* see if fd is a socket */
+    int socket_error = 0;
+    socklen_t optlen = sizeof( socket_error );
+    const int ret = getsockopt( this_rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
+    if ( ret == -1 and errno == ENOTSOCK ) {
+      cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( this_rule.category_id ).name
+           << "\"\n";
+    } else if ( ret == -1 ) {
+      throw unix_error( "getsockopt" );
+    } else if ( optlen != sizeof( socket_error ) ) {
+      throw runtime_error( "unexpected length from getsockopt: " + to_string( optlen ) );
+    } else if ( socket_error ) {
+      cerr << "error on polled socket for rule \"" << _rule_categories.at( this_rule.category_id ).name
+           << "\": " << strerror( socket_error ) << "\n";
+    }
+
+    this_rule.error();
+    remove_rule( rule, true );
+    return;
+  }
+
+  const auto poll_ready = not this_rule.parked and ( revents & epoll_events( this_rule.direction ) );
+  const auto poll_hup = static_cast<bool>( revents & EPOLLHUP );
+  if ( poll_hup && ( ( not this_rule.parked && !poll_ready ) or ( this_rule.direction == Direction::Out ) ) ) {
+    // if we asked for the status, and the _only_ condition was a hangup, this FD is defunct:
+    //   - if it was POLLIN and nothing is readable, no more will ever be readable
+    //   - if it was POLLOUT, it will not be writable again
+    // additionally, consider FD defunct if rule will only query for Direction::Out
+    remove_rule( rule, true );
+    return;
+  }
+
+  if ( not poll_ready ) {
+    return;
+  }
+
+  if ( finished( this_rule.fd, this_rule.direction ) ) {
+    remove_rule( rule, true );
+    return;
+  }
+
+  // the fd is ready, but the rule may not be interested any more
+  if ( not this_rule.interest() ) {
+    park( rule );
+    return;
+  }
+
+  // we only want to call callback if revents includes the event we asked for
+  const auto count_before = this_rule.service_count();
+  const auto bytes_moved = [&] {
+    return this_rule.direction == Direction::In ? this_rule.fd.bytes_read() : this_rule.fd.bytes_written();
+  };
+  const uint64_t bytes_before = profiling ? bytes_moved() : 0;
+  run_callback( this_rule.category_id, this_rule.callback );
+  if constexpr ( profiling ) {
+    _rule_categories[this_rule.category_id].bytes += bytes_moved() - bytes_before;
+  }
+
+  if ( count_before == this_rule.service_count() and ( not this_rule.fd.closed() ) and this_rule.interest() ) {
+    const auto& category = _rule_categories.at( this_rule.category_id );
+    throw runtime_error( "EventLoop: busy wait detected: rule \"" + category.name + "\" did not "
+                         + ( this_rule.direction == Direction::In ? "read" : "write" ) + " fd "
+                         + to_string( this_rule.fd.fd_num() ) + " and is still interested (callback run "
+                         + to_string( category.served ) + " times for this category)" );
+  }
+
+  if ( finished( this_rule.fd, this_rule.direction ) ) {
+    remove_rule( rule, true );
+  }
+}
+
+void EventLoop::read_datagrams( FileDescriptor& fd,
+                                const DatagramSource source,
+                                const size_t buffer_size,
+                                const DatagramCallbackT& callback )
+{
+  // each datagram gets a buffer_size slot (only the pages that datagrams are read into are ever touched)
+  if ( _datagram_buffer_size < MAX_DATAGRAMS_PER_READ * buffer_size ) {
+    _datagram_buffer_size = MAX_DATAGRAMS_PER_READ * buffer_size;
+    _datagram_buffer = make_unique_for_overwrite<char[]>( _datagram_buffer_size );
+  }
+  _datagrams.clear();
+
+  if ( source == DatagramSource::Socket ) {
+    // the first receive is known to find a datagram; one recvmmsg takes every one already queued
+    _datagram_messages.resize( MAX_DATAGRAMS_PER_READ );
+    _datagram_iovecs.resize( MAX_DATAGRAMS_PER_READ );
+    for ( size_t i = 0; i < MAX_DATAGRAMS_PER_READ; ++i ) {
+      _datagram_iovecs[i] = { &_datagram_buffer[i * buffer_size], buffer_size };
+      _datagram_messages[i] = {};
+      _datagram_messages[i].msg_hdr.msg_iov = &_datagram_iovecs[i];
+      _datagram_messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    ++_syscalls;
+    const size_t received = fd.recv_batch( _datagram_messages );
+    for ( size_t i = 0; i < received; ++i ) {
+      if ( _datagram_messages[i].msg_hdr.msg_flags & MSG_TRUNC ) {
+        ++_truncated;
+        continue;
+      }
+      _datagrams.emplace_back( &_datagram_buffer[i * buffer_size], _datagram_messages[i].msg_len );
+    }
+  } else {
+    // the fd is non-blocking: read until it has nothing more
+    for ( size_t i = 0; i < MAX_DATAGRAMS_PER_READ; ++i ) {
+      char* const slot = &_datagram_buffer[i * buffer_size];
+      ++_syscalls;
+      const size_t length = fd.read( span { slot, buffer_size } );
+      if ( length == 0 ) {
+        break; // (at EOF, or nothing more to read)
+      }
+      if ( truncated( source, length, buffer_size ) ) {
+        ++_truncated;
+        continue;
+      }
+      _datagrams.emplace_back( slot, length );
+    }
+  }
+
+  if ( not _datagrams.empty() ) {
+    callback( _datagrams );
+  }
+}
+
+EventLoop::DatagramSource EventLoop::datagram_source( const FileDescriptor& fd )
+{
+  int type = 0;
+  socklen_t length = sizeof( type );
+  if ( ::getsockopt( fd.fd_num(), SOL_SOCKET, SO_TYPE, &type, &length ) == 0 ) {
+    return type == SOCK_STREAM ? DatagramSource::Stream : DatagramSource::Socket;
+  }
+  struct stat status {};
+  CheckSystemCall( "fstat", ::fstat( fd.fd_num(), &status ) );
+  return S_ISCHR( status.st_mode ) ? DatagramSource::Device : DatagramSource::Stream;
+}
+
+bool EventLoop::truncated( const DatagramSource source, const size_t length, const size_t buffer_size )
+{
+  switch ( source ) {
+    case DatagramSource::Socket:
+      return length > buffer_size;
+    case DatagramSource::Device:
+      return length >= buffer_size;
+    default:
+      return false;
+  }
+}
+
+void EventLoop::reap_completions()
+{
+  _ring->drain( [&]( const IoUring::Completion& completion ) {
+    const bool has_buffer = completion.flags & IORING_CQE_F_BUFFER;
+    const auto it = _datagram_rules.find( completion.user_data );
+    if ( it == _datagram_rules.end() ) { // a removed rule's, or a cancellation's
+      if ( has_buffer ) {
+        _ring->recycle( static_cast<uint16_t>( completion.user_data >> GROUP_SHIFT ), completion );
+      }
+      return;
+    }
+
+    DatagramRule& rule = *it->second;
+    if ( not( completion.flags & IORING_CQE_F_MORE ) ) {
+      --rule.outstanding;
     }
 
-    const auto poll_ready = static_cast<bool>( this_pollfd.revents & this_pollfd.events );
-    const auto poll_hup = static_cast<bool>( this_pollfd.revents & POLLHUP );
-    if ( poll_hup && ( ( this_pollfd.events && !poll_ready ) or ( this_rule.direction == Direction::Out ) ) ) {
-      // if we asked for the status, and the _only_ condition was a hangup, this FD is defunct:
-      //   - if it was POLLIN and nothing is readable, no more will ever be readable
-      //   - if it was POLLOUT, it will not be writable again
-      // additionally, consider FD defunct if rule will only query for Direction::Out
-      this_rule.cancel();
-      it = _fd_rules.erase( it );
+    if ( completion.result == 0 and rule.source != DatagramSource::Socket ) {
+      rule.eof = true;
+      if ( has_buffer ) {
+        _ring->recycle( rule.buffer_group, completion );
+      }
+    } else if ( has_buffer
+                and truncated( rule.source,
+                               static_cast<size_t>( max( completion.result, 0 ) ),
+                               _ring->buffer_size( rule.buffer_group ) ) ) {
+      ++_truncated;
+      _ring->recycle( rule.buffer_group, completion );
+    } else if ( has_buffer ) {
+      rule.completed.push_back( completion );
+    } else if ( completion.result == -EINVAL and rule.multishot ) {
+      rule.multishot = false; // a kernel without multishot receive: use single receives
+    } else if ( completion.result < 0 and completion.result != -ENOBUFS and completion.result != -ECANCELED
+                and completion.result != -EINTR and completion.result != -EAGAIN ) {
+      rule.error_code = -completion.result;
+    } // (otherwise the rule's reads are armed again once it is interested and buffers have been recycled)
+  } );
+}
+
+bool EventLoop::serve_datagram_rules()
+{
+  bool delivered = false;
+  vector<shared_ptr<DatagramRule>> rules;
+  rules.reserve( _datagram_rules.size() );
+  for ( const auto& [id, rule] : _datagram_rules ) {
+    rules.push_back( rule );
+  }
+
+  for ( const auto& rule : rules ) {
+    if ( rule->cancel_requested ) {
       continue;
     }
 
-    if ( poll_ready ) {
-      // we only want to call callback if revents includes the event we asked for
-      const auto count_before = this_rule.service_count();
-      this_rule.callback();
+    if ( rule->error_code ) {
+      cerr << "error on datagram rule \"" << _rule_categories.at( rule->category_id ).name
+           << "\": " << strerror( rule->error_code ) << "\n";
+      rule->error();
+      remove_datagram_rule( rule, true );
+      continue;
+    }
 
-      if ( count_before == this_rule.service_count() and ( not this_rule.fd.closed() ) and this_rule.interest() ) {
-        throw runtime_error( "EventLoop: busy wait detected: rule \""
-                             + _rule_categories.at( this_rule.category_id ).name
-                             + "\" did not read/write fd and is still interested" );
+    const bool interested = rule->interest();
+    if ( interested and not rule->completed.empty() ) {
+      _datagrams.clear();
+      for ( const auto& completion : rule->completed ) {
+        _datagrams.push_back( _ring->buffer( rule->buffer_group, completion ) );
       }
+      run_callback( rule->category_id, [&] { rule->on_datagrams( _datagrams ); } );
+      if constexpr ( profiling ) {
+        for ( const auto datagram : _datagrams ) {
+          _rule_categories[rule->category_id].bytes += datagram.size();
+        }
+      }
+      for ( const auto& completion : rule->completed ) {
+        _ring->recycle( rule->buffer_group, completion );
+      }
+      rule->completed.clear();
+      delivered = true;
+    }
 
-      return Result::Success; /* only serve one rule on each iteration */
+    if ( rule->cancel_requested ) {
+      continue;
+    }
+    if ( rule->fd.closed() or ( rule->eof and rule->completed.empty() ) ) {
+      remove_datagram_rule( rule, true );
+      continue;
     }
 
-    ++it; // if we got here, it means we didn't call _fd_rules.erase()
+    if ( interested and rule->multishot and rule->outstanding == 0 ) {
+      _ring->prepare_recv( rule->fd.fd_num(), rule->buffer_group, rule->id, true );
+      ++rule->outstanding;
+    }
+    while ( interested and not rule->multishot and not rule->eof and rule->outstanding < READS_IN_FLIGHT ) {
+      if ( rule->source == DatagramSource::Socket ) {
+        _ring->prepare_recv( rule->fd.fd_num(), rule->buffer_group, rule->id, false );
+      } else {
+        _ring->prepare_read( rule->fd.fd_num(), rule->buffer_group, rule->id );
+      }
+      ++rule->outstanding;
+    }
   }
 
-  return Result::Success;
+  _ring->submit();
+  return delivered;
+}
+
+void EventLoop::remove_datagram_rule( const shared_ptr<DatagramRule>& rule, const bool call_cancel )
+{
+  if ( _datagram_rules.erase( rule->id ) == 0 ) {
+    return; // already removed
+  }
+  rule->cancel_requested = true;
+
+  if ( rule->outstanding > 0 ) {
+    _ring->prepare_cancel( rule->id );
+    _ring->submit();
+  }
+  for ( const auto& completion : rule->completed ) {
+    _ring->recycle( rule->buffer_group, completion );
+  }
+  rule->completed.clear();
+
+  if ( call_cancel ) {
+    rule->cancel();
+  }
+}
+
+bool EventLoop::datagram_rule_interested() const
+{
+  return any_of( _datagram_rules.begin(), _datagram_rules.end(), []( const auto& entry ) {
+    return not entry.second->cancel_requested and entry.second->interest();
+  } );
+}
+
+bool EventLoop::later( const shared_ptr<TimerRule>& a, const shared_ptr<TimerRule>& b )
+{
+  return a->deadline > b->deadline;
+}
+
+int EventLoop::timeout_for_timers( const int timeout_ms ) const
+{
+  if ( _timers.empty() ) {
+    return timeout_ms;
+  }
+
+  // (rounded up, so that the wait does not end just before the deadline)
+  const int64_t until_deadline = ceil<milliseconds>( _timers.front()->deadline - steady_clock::now() ).count();
+  const int timer_timeout = static_cast<int>( clamp<int64_t>( until_deadline, 0, INT_MAX ) );
+  return timeout_ms < 0 ? timer_timeout : min( timeout_ms, timer_timeout );
+}
+
+bool EventLoop::fire_timers()
+{
+  bool fired = false;
+  const auto now = steady_clock::now();
+  while ( not _timers.empty() and _timers.front()->deadline <= now ) {
+    pop_heap( _timers.begin(), _timers.end(), later );
+    const auto timer = move( _timers.back() );
+    _timers.pop_back();
+    if ( timer->cancel_requested ) {
+      continue;
+    }
+
+    run_callback( timer->category_id, timer->callback );
+    fired = true;
+
+    // a periodic timer that fell behind skips the periods it missed rather than firing in a burst
+    if ( timer->period.count() > 0 and not timer->cancel_requested ) {
+      timer->deadline += timer->period;
+      if ( timer->deadline <= now ) {
+        timer->deadline = now + timer->period;
+      }
+      _timers.push_back( timer );
+      push_heap( _timers.begin(), _timers.end(), later );
+    }
+  }
+  return fired;
 }
 // NOLINTEND(*-signed-bitwise)
 // NOLINTEND(*-cognitive-complexity)
@@ -1,32 +1,77 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <functional>
 #include <list>
 #include <memory>
 #include <ostream>
 #include <poll.h>
 #include <string_view>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unordered_map>
+#include <vector>
 
 #include "file_descriptor.hh"
+#include "io_uring.hh"
 
 //! Waits for events on file descriptors and executes corresponding callbacks.
+//! \details File descriptors stay registered with [epoll(7)](\ref man7::epoll) across calls. A rule's interest
+//! is asked when its fd is ready, and a rule that turns out not to be interested is "parked" (its direction is
+//! removed from the registration) until its interest returns. Idle fds therefore cost nothing per call, however
+//! many there are: each call looks only at the ready fds, the parked rules, and one interested rule (to know
+//! whether to exit).
+//!
+//! With the IoUring backend, datagram rules are read by the kernel ahead of time, into buffers registered with an
+//! [io_uring(7)](\ref man7::io_uring) instance: a burst of datagrams costs one wakeup and no system call per
+//! datagram. The instance's fd stands in for all datagram rules in the epoll set.
 class EventLoop
 {
 public:
+  //! How much one call of wait_next_event serves
+  struct Dispatch
+  {
+    bool serve_all { true }; //!< serve every ready rule (otherwise one rule per call)
+    unsigned budget { 1 };   //!< with serve_all: the most times one rule is served per call (readiness is
+                             //!< polled again between rounds, so every ready rule takes a turn in each round)
+  };
+
+  //! How datagram rules are read
+  enum class Backend
+  {
+    Epoll,  //!< recvmmsg(2) (or read(2) until it would block) once epoll reports the fd readable
+    IoUring //!< multishot receives and reads into registered buffers (falls back to Epoll if not supported)
+  };
+
   //! Indicates interest in reading (In) or writing (Out) a polled fd.
   enum class Direction : int16_t
   {
-    In = POLLIN,  //!< Callback will be triggered when Rule::fd is readable.
-    Out = POLLOUT //!< Callback will be triggered when Rule::fd is writable.
+    In = POLLIN,         //!< Callback will be triggered when Rule::fd is readable.
+    Out = POLLOUT,       //!< Callback will be triggered when Rule::fd is writable.
+    ErrorQueue = POLLERR //!< Callback will be triggered when Rule::fd has an error (see add_error_queue_rule).
   };
 
 private:
   using CallbackT = std::function<void( void )>;
   using InterestT = std::function<bool( void )>;
+  using DatagramCallbackT = std::function<void( const std::vector<std::string_view>& )>;
+
+#ifdef MINNOW_EVENTLOOP_PROFILING
+  static constexpr bool profiling = true;
+#else
+  static constexpr bool profiling = false; //!< time callbacks and waits (see etc/cflags.cmake)
+#endif
 
   struct RuleCategory
   {
     std::string name;
+    uint64_t served {};   //!< callbacks run for the category's rules
+    uint64_t total_ns {}; //!< (profiling) time spent in those callbacks
+    uint64_t max_ns {};   //!< (profiling) the longest of them
+    uint64_t bytes {};    //!< (profiling) bytes they read or wrote through the rules' fds (or datagram bytes)
   };
 
   struct BasicRule
@@ -35,6 +80,7 @@ private:
     InterestT interest;
     CallbackT callback;
     bool cancel_requested {};
+    std::shared_ptr<size_t> cancellations {}; //!< counts the loop's rules cancelled through a RuleHandle
 
     BasicRule( size_t s_category_id, InterestT s_interest, CallbackT s_callback );
   };
@@ -45,6 +91,7 @@ private:
     Direction direction; //!< Direction::In for reading from fd, Direction::Out for writing to fd.
     CallbackT cancel;    //!< A callback that is called when the rule is cancelled (e.g. on EOF or hangup)
     CallbackT error;     //!< A callback that is called when the fd has an error before cancellation
+    bool parked {};      //!< Was the rule found uninterested (so its direction is not registered)?
 
     FDRule( BasicRule&& base, FileDescriptor&& s_fd, Direction s_direction, CallbackT s_cancel, CallbackT s_error );
 
@@ -53,12 +100,187 @@ private:
     unsigned int service_count() const;
   };
 
+  //! What a datagram rule's fd is, which decides how it is read and how a datagram too long for its buffer shows
+  enum class DatagramSource : uint8_t
+  {
+    Socket, //!< a datagram socket: receives report the datagram's whole length (MSG_TRUNC)
+    Device, //!< reads (of a TUN device, say) are cut to the buffer, so one that fills it counts as truncated
+    Stream  //!< reads (of a pipe, say) are pieces of a stream, never truncated
+  };
+
+  static DatagramSource datagram_source( const FileDescriptor& fd );
+
+  //! A rule on an fd read by the IoUring backend
+  struct DatagramRule : public BasicRule
+  {
+    FileDescriptor fd;
+    DatagramCallbackT on_datagrams;
+    CallbackT cancel;
+    CallbackT error;
+    uint64_t id;                                   //!< user_data of the rule's requests
+    uint16_t buffer_group;                         //!< the provided buffers its requests read into
+    DatagramSource source;                         //!< (a socket is read by receives, anything else by reads)
+    bool multishot;                                //!< a socket, read by one multishot receive at a time
+    bool eof {};                                   //!< a read reached end of file
+    int error_code {};                             //!< errno of a request that failed
+    unsigned outstanding {};                       //!< requests submitted and not yet finished
+    std::vector<IoUring::Completion> completed {}; //!< datagrams received and not yet delivered
+
+    DatagramRule( BasicRule&& base,
+                  FileDescriptor&& s_fd,
+                  DatagramCallbackT s_on_datagrams,
+                  CallbackT s_cancel,
+                  CallbackT s_error,
+                  uint64_t s_id,
+                  uint16_t s_buffer_group );
+  };
+
+  //! A rule that runs at a time rather than when an fd is ready
+  struct TimerRule : public BasicRule
+  {
+    std::chrono::steady_clock::time_point deadline;
+    std::chrono::milliseconds period; //!< zero for a one-shot timer
+
+    TimerRule( BasicRule&& base, std::chrono::steady_clock::time_point s_deadline, std::chrono::milliseconds s_period );
+  };
+
+  //! The rules on one fd number, sharing one epoll registration
+  struct Registration
+  {
+    std::vector<std::shared_ptr<FDRule>> rules {};
+    uint32_t events {};   //!< epoll events currently registered
+    bool always_ready {}; //!< epoll cannot watch this fd (a regular file), which is always ready anyway
+  };
+
   std::vector<RuleCategory> _rule_categories {};
-  std::list<std::shared_ptr<FDRule>> _fd_rules {};
+  std::vector<std::shared_ptr<FDRule>> _fd_rules {}; //!< in the order they were added
   std::list<std::shared_ptr<BasicRule>> _non_fd_rules {};
 
+  FileDescriptor _epoll;
+  std::unordered_map<int, Registration> _registrations {};
+  std::vector<int> _always_ready {}; //!< fd numbers of the registrations that epoll cannot watch
+  std::vector<std::shared_ptr<FDRule>> _parked {};
+  size_t _witness {}; //!< index in _fd_rules where the search for an interested rule starts
+  std::shared_ptr<size_t> _cancellations { std::make_shared<size_t>() };
+  std::vector<epoll_event> _events {};
+  uint64_t _syscalls {}; //!< epoll and read system calls made by the loop itself
+
+  std::unique_ptr<IoUring> _ring {};
+  std::unordered_map<uint64_t, std::shared_ptr<DatagramRule>> _datagram_rules {};
+  uint64_t _next_datagram_rule_id { 1 };
+  std::unordered_map<size_t, uint16_t> _buffer_groups {}; //!< IoUring backend: group ID by buffer size
+  std::unique_ptr<char[]> _datagram_buffer {};             //!< Epoll backend: what a batch is read into
+  size_t _datagram_buffer_size {};
+  std::vector<mmsghdr> _datagram_messages {};
+  std::vector<iovec> _datagram_iovecs {};
+  std::vector<std::string_view> _datagrams {};
+  uint64_t _truncated {}; //!< datagrams dropped for being too long for their rule's buffers
+
+  std::vector<std::shared_ptr<TimerRule>> _timers {}; //!< a min-heap by deadline (see later())
+
+  uint64_t _wakeups {}; //!< (profiling) waits that ended with fds ready
+  uint64_t _wait_ns {}; //!< (profiling) time spent waiting for fds
+  static inline std::atomic<uint64_t> _dump_requests {}; //!< signals received (see dump_summaries_on())
+  uint64_t _dumps_seen { _dump_requests.load() };         //!< (signals before this loop existed are not its own)
+
+  Dispatch _dispatch {};
+  size_t _turn {}; //!< which of the ready fds to serve, when serving one per call
+
+  //! Adds an fd rule to the fd's registration
+  void register_rule( const std::shared_ptr<FDRule>& rule );
+
+  //! Runs the interested error-queue rules of an fd that reported an error (or, if none is, removes them all)
+  //! \returns `revents`, without EPOLLERR if an error-queue rule claimed it
+  uint32_t serve_error_queue( const Registration& registration, uint32_t revents );
+
+  //! Forgets a rule, first calling its cancel callback if `call_cancel`
+  void remove_rule( const std::shared_ptr<FDRule>& rule, bool call_cancel );
+  void park( const std::shared_ptr<FDRule>& rule );
+  void unpark( const std::shared_ptr<FDRule>& rule );
+
+  //! Tells epoll about changes to the events wanted by a registration's unparked rules
+  void update_registration( int fd_num, Registration& registration );
+
+  //! Gives parked rules whose interest has returned back to epoll, and forgets finished rules
+  void revisit_parked();
+
+  //! \returns whether any fd rule is interested, parking uninterested rules on the way
+  bool find_interested_rule();
+
+  //! Runs a rule's callback, counting it (and, when profiling, timing it) against its category
+  template<typename Callback>
+  void run_callback( size_t category_id, Callback&& callback );
+
+  //! Prints the summary to stderr if a dump was requested by signal since the last one
+  void check_dump_request();
+
+  //! Appends the fds that are ready (waiting up to `timeout_ms` for one to be) to `ready`
+  void poll_ready( std::vector<std::pair<int, uint32_t>>& ready, int timeout_ms );
+
+  //! Serves the rules of the ready fds
+  void serve_ready( const std::vector<std::pair<int, uint32_t>>& ready );
+
+  //! Runs one fd rule given the events epoll reported for its fd
+  void serve( const std::shared_ptr<FDRule>& rule, uint32_t revents );
+
+  //! Epoll backend: reads the datagrams already queued on a readable fd (until it would block) and passes them to
+  //! `callback`
+  void read_datagrams( FileDescriptor& fd,
+                       DatagramSource source,
+                       size_t buffer_size,
+                       const DatagramCallbackT& callback );
+
+  //! Does a datagram of `length` bytes (as reported by its read) not fit a buffer of `buffer_size`?
+  static bool truncated( DatagramSource source, size_t length, size_t buffer_size );
+
+  //! IoUring backend: sorts the completions reaped so far by rule
+  void reap_completions();
+
+  //! IoUring backend: delivers received datagrams to the interested rules, forgets finished rules, and arms
+  //! reads for interested rules that have none outstanding
+  //! \returns whether any datagrams were delivered
+  bool serve_datagram_rules();
+
+  //! Forgets a datagram rule, cancelling its outstanding requests, and then calls its cancel callback if
+  //! `call_cancel`
+  void remove_datagram_rule( const std::shared_ptr<DatagramRule>& rule, bool call_cancel );
+
+  bool datagram_rule_interested() const;
+
+  //! Heap order of _timers: the earliest deadline on top
+  static bool later( const std::shared_ptr<TimerRule>& a, const std::shared_ptr<TimerRule>& b );
+
+  //! Shortens an epoll_wait timeout to reach the earliest timer's deadline
+  int timeout_for_timers( int timeout_ms ) const;
+
+  //! Runs the timers that are due (rescheduling periodic ones)
+  //! \returns whether any timer ran
+  bool fire_timers();
+
 public:
-  EventLoop() { _rule_categories.reserve( 64 ); }
+  explicit EventLoop( Backend backend = Backend::Epoll );
+
+  //! The backend in use (Epoll if IoUring was asked for but is not supported)
+  Backend backend() const { return _ring ? Backend::IoUring : Backend::Epoll; }
+
+  void set_dispatch( const Dispatch& dispatch ) { _dispatch = dispatch; }
+
+  //! Number of callbacks run for the rules of a category
+  uint64_t served( size_t category_id ) const;
+
+  //! Prints the number of callbacks run for each category (and, when profiling, the time they took, the bytes
+  //! they moved, and the time spent waiting)
+  void summary( std::ostream& out ) const;
+
+  //! Makes every EventLoop print its summary to stderr (at its next wakeup) when the process receives `signal`
+  //! (when profiling)
+  static void dump_summaries_on( int signal = SIGUSR1 );
+
+  //! Number of system calls the loop has made to wait for events and to read datagram rules
+  uint64_t syscalls() const { return _syscalls + ( _ring ? _ring->enter_count() : 0 ); }
+
+  //! Number of datagrams that datagram rules dropped because they were too long for the rule's buffers
+  uint64_t truncated_datagrams() const { return _truncated; }
 
   //! Returned by each call to EventLoop::wait_next_event.
   enum class Result
@@ -97,7 +319,48 @@ public:
     const CallbackT& callback,
     const InterestT& interest = [] { return true; } );
 
-  //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
+  //! Adds a rule that runs `callback` when `fd` reports an error, to read messages from the fd's error queue (such
+  //! as the completions of [MSG_ZEROCOPY](https://docs.kernel.org/networking/msg_zerocopy.html) sends) with
+  //! MSG_ERRQUEUE
+  //! \details While the rule is interested (a socket with sends to complete, say), it keeps the loop waiting, and
+  //! the fd's other rules do not see the error: a real one reaches them through their reads and writes. When the
+  //! fd reports an error that no error-queue rule is interested in, the other rules see it, and the error-queue
+  //! rules are cancelled (the error would otherwise be reported again at every wait).
+  RuleHandle add_error_queue_rule(
+    size_t category_id,
+    FileDescriptor& fd,
+    const CallbackT& callback,
+    const InterestT& interest = [] { return true; },
+    const CallbackT& cancel = [] {} );
+
+  //! Largest datagram a datagram rule receives unless told otherwise: any UDP datagram over IPv4
+  static constexpr size_t DEFAULT_DATAGRAM_BUFFER_SIZE = 65536;
+
+  //! Adds a rule that receives the datagrams (or reads) arriving on an fd, several at a time
+  //! \details Each callback gets every datagram received since the last one; the views are valid only during
+  //! the callback. Each datagram is read into a buffer of `buffer_size` bytes: one that does not fit is dropped
+  //! (see truncated_datagrams()) rather than passed on cut short. On a device such as TUN, whose reads do not
+  //! say how much was cut off, that includes a datagram that exactly fills the buffer. With the Epoll backend,
+  //! the fd is made non-blocking.
+  RuleHandle add_datagram_rule(
+    size_t category_id,
+    FileDescriptor& fd,
+    const DatagramCallbackT& callback,
+    const InterestT& interest = [] { return true; },
+    const CallbackT& cancel = [] {},
+    const CallbackT& error = [] {},
+    size_t buffer_size = DEFAULT_DATAGRAM_BUFFER_SIZE );
+
+  //! Adds a rule that runs `callback` once, `delay_ms` from now, and then (if `period_ms` is not zero) every
+  //! `period_ms` until it is cancelled
+  //! \details A pending timer keeps wait_next_event from returning Exit, and bounds how long it waits.
+  RuleHandle add_timer_rule( size_t category_id,
+                             uint64_t delay_ms,
+                             const CallbackT& callback,
+                             uint64_t period_ms = 0 );
+
+  //! Calls [epoll_wait(2)](\ref man2::epoll_wait) (for no longer than until the earliest timer's deadline) and
+  //! then executes callback for each ready fd and each timer that is due.
   Result wait_next_event( int timeout_ms );
 
   // convenience function to add category and rule at the same time
@@ -106,6 +369,24 @@ public:
   {
     return add_rule( add_category( name ), std::forward<Targs>( Fargs )... );
   }
+
+  template<typename... Targs>
+  auto add_datagram_rule( const std::string& name, Targs&&... Fargs )
+  {
+    return add_datagram_rule( add_category( name ), std::forward<Targs>( Fargs )... );
+  }
+
+  template<typename... Targs>
+  auto add_error_queue_rule( const std::string& name, Targs&&... Fargs )
+  {
+    return add_error_queue_rule( add_category( name ), std::forward<Targs>( Fargs )... );
+  }
+
+  template<typename... Targs>
+  auto add_timer_rule( const std::string& name, Targs&&... Fargs )
+  {
+    return add_timer_rule( add_category( name ), std::forward<Targs>( Fargs )... );
+  }
 };
 
 using Direction = EventLoop::Direction;
@@ -14,11 +14,20 @@
 class FdAdapterBase
 {
 private:
-  FdAdapterConfig _cfg {}; //!< Configuration values
-  bool _listen = false;    //!< Is the connected TCP FSM in listen state?
+  FdAdapterConfig _cfg {};     //!< Configuration values
+  bool _listen = false;        //!< Is the connected TCP FSM in listen state?
+  uint64_t _cfg_generation {}; //!< Bumped whenever mutable access to the configuration is handed out
 
 protected:
-  FdAdapterConfig& config_mutable() { return _cfg; }
+  FdAdapterConfig& config_mutable()
+  {
+    ++_cfg_generation;
+    return _cfg;
+  }
+
+  //! \brief Get the configuration generation
+  //! \returns a counter that changes whenever the configuration may have changed (for caches derived from it)
+  uint64_t config_generation() const { return _cfg_generation; }
 
 public:
   //! \brief Set the listening flag
@@ -35,7 +44,7 @@ public:
 
   //! \brief Get the current configuration (mutable)
   //! \returns a mutable reference
-  FdAdapterConfig& config_mut() { return _cfg; }
+  FdAdapterConfig& config_mut() { return config_mutable(); }
 
   //! Called periodically when time elapses
   void tick( const size_t unused [[maybe_unused]] ) {}
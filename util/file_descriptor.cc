@@ -1,11 +1,14 @@
 #include "file_descriptor.hh"
 
+#include "buffer_pool.hh"
 #include "exception.hh"
 
 #include <algorithm>
+#include <cerrno>
 #include <fcntl.h>
 #include <iostream>
 #include <stdexcept>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/uio.h>
@@ -95,7 +98,7 @@ void FileDescriptor::read( string& buffer )
     throw unix_error { "read" };
   }
 
-  register_read();
+  register_read( bytes_read );
 
   if ( bytes_read == 0 ) {
     internal_fd_->eof_ = true;
@@ -108,6 +111,62 @@ void FileDescriptor::read( string& buffer )
   buffer.resize( bytes_read );
 }
 
+void FileDescriptor::read( PooledBuffer& buffer )
+{
+  buffer.resize( buffer.capacity() );
+  const ssize_t bytes_read = ::read( fd_num(), buffer.data(), buffer.size() );
+  if ( bytes_read < 0 ) {
+    if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
+      buffer.resize( 0 );
+      return;
+    }
+    throw unix_error { "read" };
+  }
+
+  register_read( bytes_read );
+
+  if ( bytes_read == 0 ) {
+    internal_fd_->eof_ = true;
+  }
+
+  buffer.resize( bytes_read );
+}
+
+size_t FileDescriptor::read( const span<char> buffer )
+{
+  const ssize_t bytes_read = ::read( fd_num(), buffer.data(), buffer.size() );
+  if ( bytes_read < 0 ) {
+    if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
+      return 0;
+    }
+    throw unix_error { "read" };
+  }
+
+  register_read( bytes_read );
+
+  if ( bytes_read == 0 ) {
+    internal_fd_->eof_ = true;
+  }
+
+  return bytes_read;
+}
+
+size_t FileDescriptor::recv_batch( const span<mmsghdr> msgs )
+{
+  const int received = ::recvmmsg( fd_num(), msgs.data(), msgs.size(), MSG_DONTWAIT, nullptr );
+  if ( received < 0 and ( errno == EAGAIN or errno == EWOULDBLOCK ) ) {
+    return 0;
+  }
+  CheckSystemCall( "recvmmsg", received );
+
+  size_t bytes = 0;
+  for ( int i = 0; i < received; ++i ) {
+    bytes += msgs[i].msg_len;
+  }
+  register_read( bytes );
+  return received;
+}
+
 void FileDescriptor::read( vector<string>& buffers )
 {
   if ( buffers.empty() ) {
@@ -134,7 +193,7 @@ void FileDescriptor::read( vector<string>& buffers )
     throw unix_error { "read" };
   }
 
-  register_read();
+  register_read( bytes_read );
 
   if ( bytes_read > static_cast<ssize_t>( total_size ) ) {
     throw runtime_error( "read() read more than requested" );
@@ -178,12 +237,16 @@ size_t FileDescriptor::write( const vector<string_view>& buffers )
 
   const ssize_t bytes_written
     = CheckSystemCall( "writev", ::writev( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) ) );
-  register_write();
 
   if ( bytes_written == 0 and total_size != 0 ) {
+    if ( internal_fd_->non_blocking_ ) {
+      return 0; // (EAGAIN: the fd is full)
+    }
     throw runtime_error( "write returned 0 given non-empty input buffer" );
   }
 
+  register_write( bytes_written );
+
   if ( bytes_written > static_cast<ssize_t>( total_size ) ) {
     throw runtime_error( "write wrote more than length of input buffer" );
   }
@@ -191,6 +254,28 @@ size_t FileDescriptor::write( const vector<string_view>& buffers )
   return bytes_written;
 }
 
+size_t FileDescriptor::splice( FileDescriptor& destination, const size_t length )
+{
+  // (SPLICE_F_NONBLOCK: never wait on the pipe; the other fd waits, or not, as it was set)
+  const ssize_t bytes_moved
+    = ::splice( fd_num(), nullptr, destination.fd_num(), nullptr, length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+  if ( bytes_moved < 0 ) {
+    if ( errno == EAGAIN ) {
+      return 0;
+    }
+    throw unix_error { "splice" };
+  }
+
+  register_read( bytes_moved );
+  destination.register_write( bytes_moved );
+
+  if ( bytes_moved == 0 and length != 0 ) {
+    internal_fd_->eof_ = true;
+  }
+
+  return bytes_moved;
+}
+
 void FileDescriptor::set_blocking( bool blocking )
 {
   int flags = CheckSystemCall( "fcntl", fcntl( fd_num(), F_GETFL ) ); // NOLINT(*-vararg)
@@ -1,10 +1,15 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <limits>
 #include <memory>
+#include <span>
 #include <vector>
 
+class PooledBuffer;
+struct mmsghdr;
+
 // A reference-counted handle to a file descriptor
 class FileDescriptor
 {
@@ -20,6 +25,8 @@ class FileDescriptor
     bool non_blocking_ = false; // Flag indicating whether FDWrapper::fd_ is non-blocking
     unsigned read_count_ = 0;   // The number of times FDWrapper::fd_ has been read
     unsigned write_count_ = 0;  // The numberof times FDWrapper::fd_ has been written
+    uint64_t bytes_read_ = 0;    // The number of bytes read from FDWrapper::fd_
+    uint64_t bytes_written_ = 0; // The number of bytes written to FDWrapper::fd_
 
     // Construct from a file descriptor number returned by the kernel
     explicit FDWrapper( int fd );
@@ -49,8 +56,17 @@ protected:
   static constexpr size_t kReadBufferSize = 16384;
 
   void set_eof() { internal_fd_->eof_ = true; }
-  void register_read() { ++internal_fd_->read_count_; }   // increment read count
-  void register_write() { ++internal_fd_->write_count_; } // increment write count
+  // increment read/write count (and byte count)
+  void register_read( size_t bytes = 0 )
+  {
+    ++internal_fd_->read_count_;
+    internal_fd_->bytes_read_ += bytes;
+  }
+  void register_write( size_t bytes = 0 )
+  {
+    ++internal_fd_->write_count_;
+    internal_fd_->bytes_written_ += bytes;
+  }
 
   template<typename T>
   T CheckSystemCall( std::string_view s_attempt, T return_value ) const;
@@ -65,16 +81,40 @@ public:
   // Read into `buffer`
   void read( std::string& buffer );
   void read( std::vector<std::string>& buffers );
+  // Read into `buffer` from a BufferPool (up to the end of its buffer, which no other view should be using)
+  void read( PooledBuffer& buffer );
+  // Read into `buffer`; returns the number of bytes read (0 at EOF, which sets eof(), or if the fd is non-blocking
+  // and has nothing to read)
+  size_t read( std::span<char> buffer );
+  // Receive the datagrams already queued on a socket, up to one per entry of `msgs`, with one recvmmsg(2) (which
+  // does not wait for any); returns the number received (each entry's msg_len is its length)
+  size_t recv_batch( std::span<mmsghdr> msgs );
 
   // Attempt to write a buffer
-  // returns number of bytes written
+  // returns number of bytes written (0 if the fd is non-blocking and full)
   size_t write( std::string_view buffer );
   size_t write( const std::vector<std::string_view>& buffers );
   size_t write( const std::vector<std::string>& buffers );
 
+  // Move up to `length` bytes to `destination` with splice(2), without copying them through userspace (one of the
+  // two must be a pipe); returns the number moved (0 if either side would block, or at EOF, which sets eof())
+  size_t splice( FileDescriptor& destination, size_t length );
+
   // Close the underlying file descriptor
   void close() { internal_fd_->close(); }
 
+  // What a coroutine awaits (see async.hh) to resume once the fd is readable or writable, or has messages on
+  // its error queue (such as completions of MSG_ZEROCOPY sends)
+  struct Readiness
+  {
+    FileDescriptor& fd;
+    bool writable;
+    bool error_queue = false;
+  };
+  Readiness readable() { return { *this, false }; }
+  Readiness writable() { return { *this, true }; }
+  Readiness error_queue() { return { *this, false, true }; }
+
   // Copy a FileDescriptor explicitly, increasing the FDWrapper refcount
   FileDescriptor duplicate() const;
 
@@ -90,6 +130,8 @@ public:
   bool closed() const { return internal_fd_->closed_; }                   // closed flag state
   unsigned int read_count() const { return internal_fd_->read_count_; }   // number of reads
   unsigned int write_count() const { return internal_fd_->write_count_; } // number of writes
+  uint64_t bytes_read() const { return internal_fd_->bytes_read_; }       // number of bytes read
+  uint64_t bytes_written() const { return internal_fd_->bytes_written_; } // number of bytes written
 
   // Copy/move constructor/assignment operators
   // FileDescriptor can be moved, but cannot be copied implicitly (see duplicate())
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//! The addresses and ports that identify one TCP connection, from this host's point of view
+struct FourTuple
+{
+  uint32_t local_ip {};
+  uint32_t remote_ip {};
+  uint16_t local_port {};
+  uint16_t remote_port {};
+
+  bool operator==( const FourTuple& other ) const = default;
+
+  //! Mixes all 96 bits, so connections that differ only in the remote port still spread across a table
+  uint64_t hash() const
+  {
+    uint64_t h = ( static_cast<uint64_t>( local_ip ) << 32 | remote_ip ) * 0x9E3779B97F4A7C15ULL;
+    h ^= ( static_cast<uint64_t>( local_port ) << 16 | remote_port ) * 0xC2B2AE3D27D4EB4FULL;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    return h ^ ( h >> 32 );
+  }
+};
+
+//! \brief An open-addressing hash map from FourTuple to T
+//! \details Keys and values live inline in one flat array of slots (linear probing, power-of-two size, at most
+//! half full), so a lookup usually touches a single cache line. Erase uses backward-shift deletion: there are no
+//! tombstones, so probe sequences stay short however many connections come and go.
+template<class T>
+class FourTupleMap
+{
+public:
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  //! \returns a pointer to the value stored for `key`, or nullptr if there is none
+  T* find( const FourTuple& key )
+  {
+    const size_t index = find_index( key );
+    return index == NOT_FOUND ? nullptr : &slots_[index].value;
+  }
+
+  const T* find( const FourTuple& key ) const
+  {
+    const size_t index = find_index( key );
+    return index == NOT_FOUND ? nullptr : &slots_[index].value;
+  }
+
+  //! Inserts `value` for `key` unless the key is already present
+  //! \returns a pointer to the value stored for `key`, and whether the insertion took place
+  std::pair<T*, bool> emplace( const FourTuple& key, T value )
+  {
+    if ( ( size_ + 1 ) * 2 > slots_.size() ) {
+      rehash( slots_.size() * 2 );
+    }
+
+    size_t index = home( key );
+    for ( ; slots_[index].occupied; index = next( index ) ) {
+      if ( slots_[index].key == key ) {
+        return { &slots_[index].value, false };
+      }
+    }
+
+    slots_[index] = Slot { key, true, std::move( value ) };
+    ++size_;
+    return { &slots_[index].value, true };
+  }
+
+  //! Removes `key` and its value
+  //! \returns whether the key was present
+  bool erase( const FourTuple& key )
+  {
+    size_t hole = find_index( key );
+    if ( hole == NOT_FOUND ) {
+      return false;
+    }
+
+    // Move later members of the probe run back into the hole whenever that doesn't put them before their home.
+    for ( size_t i = next( hole ); slots_[i].occupied; i = next( i ) ) {
+      const size_t distance_from_home = ( i - home( slots_[i].key ) ) & mask();
+      if ( distance_from_home >= ( ( i - hole ) & mask() ) ) {
+        slots_[hole] = std::move( slots_[i] );
+        hole = i;
+      }
+    }
+
+    slots_[hole] = Slot {};
+    --size_;
+    return true;
+  }
+
+  //! Calls `f( key, value )` for every entry; `f` must not insert or erase
+  template<class F>
+  void for_each( F&& f )
+  {
+    for ( auto& slot : slots_ ) {
+      if ( slot.occupied ) {
+        f( std::as_const( slot.key ), slot.value );
+      }
+    }
+  }
+
+private:
+  struct Slot
+  {
+    FourTuple key {};
+    bool occupied {};
+    T value {};
+  };
+
+  static constexpr size_t NOT_FOUND = -1;
+
+  std::vector<Slot> slots_ = std::vector<Slot>( 16 );
+  size_t size_ {};
+
+  size_t mask() const { return slots_.size() - 1; }
+  size_t home( const FourTuple& key ) const { return key.hash() & mask(); }
+  size_t next( size_t index ) const { return ( index + 1 ) & mask(); }
+
+  size_t find_index( const FourTuple& key ) const
+  {
+    for ( size_t index = home( key ); slots_[index].occupied; index = next( index ) ) {
+      if ( slots_[index].key == key ) {
+        return index;
+      }
+    }
+    return NOT_FOUND;
+  }
+
+  void rehash( size_t new_slot_count )
+  {
+    std::vector<Slot> old = std::exchange( slots_, std::vector<Slot>( new_slot_count ) );
+    for ( auto& slot : old ) {
+      if ( slot.occupied ) {
+        size_t index = home( slot.key );
+        while ( slots_[index].occupied ) {
+          index = next( index );
+        }
+        slots_[index] = std::move( slot );
+      }
+    }
+  }
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "parser.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+//! \file
+//! \brief Compile-time descriptions of fixed-size header layouts, from which parse and serialize code is generated
+//! \details A layout lists a header's fields in wire order, each as its bit offset and width and the member it maps
+//! to. The offsets are checked at compile time to tile the header exactly, and parse() and serialize() expand into
+//! a fixed sequence of loads, shifts and masks (stores, shifts and ORs) over a contiguous span, with no branches
+//! beyond those the member types themselves need. For example:
+//! ~~~{.cc}
+//! using Layout = header_layout::Layout<4,
+//!                                      header_layout::Field<0, 4, &Header::version>,
+//!                                      header_layout::Field<4, 12, &Header::length>,
+//!                                      header_layout::Reserved<16, 16>>;
+//! ~~~
+namespace header_layout {
+
+template<class>
+struct member_traits;
+
+template<class Owner, class T>
+struct member_traits<T Owner::*>
+{
+  using owner = Owner;
+  using type = T;
+};
+
+//! Loads an `N`-byte big-endian integer
+template<size_t N>
+uint64_t load_big_endian( const char* bytes )
+{
+  static_assert( N >= 1 and N <= 8 );
+  if constexpr ( N == 1 ) {
+    return static_cast<uint8_t>( bytes[0] );
+  } else if constexpr ( N == 2 or N == 4 or N == 8 ) {
+    using Word = std::conditional_t<N == 2, uint16_t, std::conditional_t<N == 4, uint32_t, uint64_t>>;
+    Word word {};
+    std::memcpy( &word, bytes, N );
+    return big_endian_to_host( word );
+  } else {
+    uint64_t value = 0;
+    for ( size_t i = 0; i < N; ++i ) {
+      value = ( value << 8 ) | static_cast<uint8_t>( bytes[i] );
+    }
+    return value;
+  }
+}
+
+//! ORs an `N`-byte big-endian integer into the bytes (which the fields sharing them leave alone)
+template<size_t N>
+void or_big_endian( char* bytes, const uint64_t value )
+{
+  for ( size_t i = 0; i < N; ++i ) {
+    const auto byte = static_cast<uint8_t>( value >> ( 8 * ( N - 1 - i ) ) );
+    bytes[i] = static_cast<char>( static_cast<uint8_t>( bytes[i] ) | byte );
+  }
+}
+
+//! An integer (or bool) field of `BitWidth` bits, `BitOffset` bits from the start of the header
+template<size_t BitOffset, size_t BitWidth, auto Member>
+struct Field
+{
+  using Header = typename member_traits<decltype( Member )>::owner;
+  using T = typename member_traits<decltype( Member )>::type;
+
+  static constexpr size_t BIT_OFFSET = BitOffset;
+  static constexpr size_t BIT_WIDTH = BitWidth;
+
+  static_assert( BitWidth >= 1 and BitWidth <= sizeof( T ) * 8 and ( BitWidth == 1 or not std::is_same_v<T, bool> ),
+                 "the field does not fit its member" );
+
+  static constexpr size_t FIRST_BYTE = BitOffset / 8;
+  static constexpr size_t BYTES = ( BitOffset % 8 + BitWidth + 7 ) / 8;
+  static constexpr size_t SHIFT = BYTES * 8 - BitOffset % 8 - BitWidth;
+  static constexpr uint64_t MASK = BitWidth == 64 ? ~uint64_t {} : ( uint64_t { 1 } << BitWidth ) - 1;
+  static constexpr bool WHOLE_BYTES = BitOffset % 8 == 0 and BitWidth % 8 == 0;
+
+  static_assert( BYTES <= 8, "the field spans more than eight bytes" );
+
+  static void read( Header& header, const char* bytes )
+  {
+    header.*Member = static_cast<T>( ( load_big_endian<BYTES>( bytes + FIRST_BYTE ) >> SHIFT ) & MASK );
+  }
+
+  static void write( const Header& header, char* bytes )
+  {
+    const uint64_t value = static_cast<uint64_t>( header.*Member ) & MASK;
+    if constexpr ( WHOLE_BYTES and ( BYTES == 2 or BYTES == 4 or BYTES == 8 ) ) {
+      using Word = std::conditional_t<BYTES == 2, uint16_t, std::conditional_t<BYTES == 4, uint32_t, uint64_t>>;
+      const Word word = host_to_big_endian( static_cast<Word>( value ) );
+      std::memcpy( bytes + FIRST_BYTE, &word, BYTES );
+    } else {
+      or_big_endian<BYTES>( bytes + FIRST_BYTE, value << SHIFT );
+    }
+  }
+};
+
+//! A field of raw bytes (such as an Ethernet address), copied as is to and from an array member
+template<size_t BitOffset, auto Member>
+struct Bytes
+{
+  using Header = typename member_traits<decltype( Member )>::owner;
+  using T = typename member_traits<decltype( Member )>::type;
+
+  static constexpr size_t BIT_OFFSET = BitOffset;
+  static constexpr size_t BIT_WIDTH = sizeof( T ) * 8;
+
+  static_assert( BitOffset % 8 == 0, "a byte field must start on a byte boundary" );
+
+  static void read( Header& header, const char* bytes )
+  {
+    std::memcpy( ( header.*Member ).data(), bytes + BitOffset / 8, sizeof( T ) );
+  }
+
+  static void write( const Header& header, char* bytes )
+  {
+    std::memcpy( bytes + BitOffset / 8, ( header.*Member ).data(), sizeof( T ) );
+  }
+};
+
+//! Bits with no member: ignored when parsing, and serialized as zeros
+template<size_t BitOffset, size_t BitWidth>
+struct Reserved
+{
+  static constexpr size_t BIT_OFFSET = BitOffset;
+  static constexpr size_t BIT_WIDTH = BitWidth;
+
+  static void read( const auto& /* header */, const char* /* bytes */ ) {}
+  static void write( const auto& /* header */, char* /* bytes */ ) {}
+};
+
+//! A header of `Length` bytes, made of `Fields` (in wire order, tiling it exactly)
+template<size_t Length, class... Fields>
+class Layout
+{
+  static consteval bool tiles_exactly()
+  {
+    size_t next = 0;
+    bool ok = true;
+    ( ( ok = ok and Fields::BIT_OFFSET == next, next = Fields::BIT_OFFSET + Fields::BIT_WIDTH ), ... );
+    return ok and next == Length * 8;
+  }
+
+  static_assert( tiles_exactly(), "the fields leave a gap, overlap, are out of order, or miss the length" );
+
+public:
+  static constexpr size_t LENGTH = Length;
+
+  template<class Header>
+  static void parse( Header& header, std::span<const char, Length> bytes )
+  {
+    ( Fields::read( header, bytes.data() ), ... );
+  }
+
+  //! \note `bytes` must be zeroed: fields that share a byte are ORed into it
+  template<class Header>
+  static void serialize( const Header& header, std::span<char, Length> bytes )
+  {
+    ( Fields::write( header, bytes.data() ), ... );
+  }
+
+  template<class Header>
+  static void parse( Header& header, Parser& parser )
+  {
+    std::array<char, Length> scratch {};
+    const std::string_view bytes = parser.contiguous( scratch );
+    if ( not bytes.empty() ) {
+      parse( header, std::span<const char, Length> { bytes.data(), Length } );
+    }
+  }
+
+  template<class Header>
+  static void serialize( const Header& header, Serializer& serializer )
+  {
+    serialize( header, std::span<char, Length> { serializer.allocate( Length ).data(), Length } );
+  }
+};
+
+} // namespace header_layout
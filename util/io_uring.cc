@@ -0,0 +1,222 @@
+#include "io_uring.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+int io_uring_setup( const unsigned entries, io_uring_params* params )
+{
+  return static_cast<int>( ::syscall( __NR_io_uring_setup, entries, params ) );
+}
+
+int io_uring_enter( const int fd, const unsigned to_submit )
+{
+  return static_cast<int>( ::syscall( __NR_io_uring_enter, fd, to_submit, 0, 0, nullptr, 0 ) );
+}
+
+int io_uring_register( const int fd, const unsigned opcode, void* arg, const unsigned nr_args )
+{
+  return static_cast<int>( ::syscall( __NR_io_uring_register, fd, opcode, arg, nr_args ) );
+}
+
+template<typename T>
+T* at_offset( void* base, const uint32_t offset )
+{
+  return reinterpret_cast<T*>( static_cast<char*>( base ) + offset ); // NOLINT(*-reinterpret-cast)
+}
+
+} // namespace
+
+IoUring::IoUring( const unsigned entries )
+  : fd_( CheckSystemCall( "io_uring_setup", io_uring_setup( entries, &params_ ) ) )
+{
+  // io_uring_setup reported where in the mappings the rings' fields are
+  const io_uring_params& params = params_;
+  const size_t sq_length = params.sq_off.array + params.sq_entries * sizeof( uint32_t );
+  const size_t cq_length = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+  void* sq_ring = nullptr;
+  void* cq_ring = nullptr;
+  if ( params.features & IORING_FEAT_SINGLE_MMAP ) {
+    sq_ring = cq_ring = map( max( sq_length, cq_length ), IORING_OFF_SQ_RING, fd_.fd_num() );
+  } else {
+    sq_ring = map( sq_length, IORING_OFF_SQ_RING, fd_.fd_num() );
+    cq_ring = map( cq_length, IORING_OFF_CQ_RING, fd_.fd_num() );
+  }
+
+  sq_.head = at_offset<uint32_t>( sq_ring, params.sq_off.head );
+  sq_.tail = at_offset<uint32_t>( sq_ring, params.sq_off.tail );
+  sq_.mask = *at_offset<uint32_t>( sq_ring, params.sq_off.ring_mask );
+  sq_.entries = params.sq_entries;
+  sq_.local_tail = sq_.submitted = *sq_.tail;
+  sq_.sqes = static_cast<io_uring_sqe*>(
+    map( params.sq_entries * sizeof( io_uring_sqe ), IORING_OFF_SQES, fd_.fd_num() ) );
+
+  // submission queue entry i always sits in slot i
+  uint32_t* const array = at_offset<uint32_t>( sq_ring, params.sq_off.array );
+  for ( uint32_t i = 0; i < params.sq_entries; ++i ) {
+    array[i] = i; // NOLINT(*-pointer-arithmetic)
+  }
+
+  cq_.head = at_offset<uint32_t>( cq_ring, params.cq_off.head );
+  cq_.tail = at_offset<uint32_t>( cq_ring, params.cq_off.tail );
+  cq_.mask = *at_offset<uint32_t>( cq_ring, params.cq_off.ring_mask );
+  cq_.cqes = at_offset<io_uring_cqe>( cq_ring, params.cq_off.cqes );
+}
+
+uint16_t IoUring::add_buffer_group( const uint16_t count, const size_t size )
+{
+  if ( count == 0 or ( count & ( count - 1 ) ) != 0 ) {
+    throw runtime_error( "IoUring: buffer count must be a power of two" );
+  }
+  if ( size == 0 or size > UINT32_MAX ) {
+    throw runtime_error( "IoUring: bad buffer size" );
+  }
+  const auto id = static_cast<uint16_t>( groups_.size() );
+
+  // the ring of provided buffers lives in our memory; the kernel takes buffers from its head
+  BufferGroup group { static_cast<io_uring_buf*>( map( count * sizeof( io_uring_buf ), 0, -1 ) ),
+                      count,
+                      size,
+                      make_unique_for_overwrite<char[]>( count * size ) };
+  io_uring_buf_reg registration {};
+  registration.ring_addr = reinterpret_cast<uint64_t>( group.ring ); // NOLINT(*-reinterpret-cast)
+  registration.ring_entries = count;
+  registration.bgid = id;
+  CheckSystemCall( "io_uring_register(IORING_REGISTER_PBUF_RING)",
+                   io_uring_register( fd_.fd_num(), IORING_REGISTER_PBUF_RING, &registration, 1 ) );
+
+  for ( uint16_t buffer = 0; buffer < count; ++buffer ) {
+    provide_buffer( group, buffer );
+  }
+  groups_.push_back( move( group ) );
+  return id;
+}
+
+IoUring::~IoUring()
+{
+  // closing the instance cancels its requests before the memory they refer to goes away
+  if ( not fd_.closed() ) {
+    fd_.close();
+  }
+  for ( const auto& [address, length] : mappings_ ) {
+    ::munmap( address, length );
+  }
+}
+
+bool IoUring::supported()
+{
+  static const bool result = [] {
+    try {
+      IoUring ring { 2 };
+      ring.add_buffer_group( 1, 1 );
+      return true;
+    } catch ( const unix_error& ) {
+      return false;
+    }
+  }();
+  return result;
+}
+
+void* IoUring::map( const size_t length, const off_t offset, const int fd )
+{
+  const int flags = fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED | MAP_POPULATE;
+  void* const address = ::mmap( nullptr, length, PROT_READ | PROT_WRITE, flags, fd, offset );
+  if ( address == MAP_FAILED ) { // NOLINT(*-cstyle-cast)
+    throw unix_error( "mmap" );
+  }
+  mappings_.push_back( { address, length } );
+  return address;
+}
+
+io_uring_sqe& IoUring::next_sqe()
+{
+  // make room by submitting what is queued, if the kernel has not consumed enough entries yet
+  if ( sq_.local_tail - std::atomic_ref { *sq_.head }.load( std::memory_order_acquire ) >= sq_.entries ) {
+    submit();
+  }
+  io_uring_sqe& sqe = sq_.sqes[sq_.local_tail++ & sq_.mask]; // NOLINT(*-pointer-arithmetic)
+  sqe = {};
+  return sqe;
+}
+
+void IoUring::prepare_recv( const int fd, const uint16_t group, const uint64_t user_data, const bool multishot )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_RECV;
+  sqe.fd = fd;
+  sqe.ioprio = multishot ? IORING_RECV_MULTISHOT : 0;
+  sqe.msg_flags = MSG_TRUNC; // (report the datagram's length, so a truncated one can be told apart)
+  sqe.flags = IOSQE_BUFFER_SELECT;
+  sqe.buf_group = group;
+  sqe.user_data = user_data;
+}
+
+void IoUring::prepare_read( const int fd, const uint16_t group, const uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_READ;
+  sqe.fd = fd;
+  sqe.off = UINT64_MAX; // at the file position (like read(2))
+  sqe.len = static_cast<uint32_t>( groups_.at( group ).size );
+  sqe.flags = IOSQE_BUFFER_SELECT;
+  sqe.buf_group = group;
+  sqe.user_data = user_data;
+}
+
+void IoUring::prepare_cancel( const uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_ASYNC_CANCEL;
+  sqe.fd = -1;
+  sqe.addr = user_data;
+  sqe.cancel_flags = IORING_ASYNC_CANCEL_ALL;
+  sqe.user_data = CANCEL_USER_DATA;
+}
+
+void IoUring::submit()
+{
+  if ( sq_.local_tail == sq_.submitted ) {
+    return;
+  }
+  std::atomic_ref { *sq_.tail }.store( sq_.local_tail, std::memory_order_release );
+  ++enter_count_;
+  const int submitted
+    = CheckSystemCall( "io_uring_enter", io_uring_enter( fd_.fd_num(), sq_.local_tail - sq_.submitted ) );
+  sq_.submitted += static_cast<uint32_t>( submitted );
+}
+
+string_view IoUring::buffer( const uint16_t group, const Completion& completion ) const
+{
+  const BufferGroup& buffers = groups_.at( group );
+  const size_t id = completion.flags >> IORING_CQE_BUFFER_SHIFT;
+  if ( id >= buffers.count ) {
+    throw runtime_error( "IoUring: completion names a buffer outside its group" );
+  }
+  return { &buffers.buffers[id * buffers.size],
+           min( static_cast<size_t>( max( completion.result, 0 ) ), buffers.size ) };
+}
+
+void IoUring::recycle( const uint16_t group, const Completion& completion )
+{
+  provide_buffer( groups_.at( group ), static_cast<uint16_t>( completion.flags >> IORING_CQE_BUFFER_SHIFT ) );
+}
+
+void IoUring::provide_buffer( BufferGroup& group, const uint16_t id )
+{
+  // The ring's tail shares its place with the first buffer's `resv` field. (io_uring_buf_ring is not used: in
+  // C++, the empty struct in its flexible array member moves `bufs` away from offset 0.)
+  uint16_t& tail = group.ring[0].resv; // NOLINT(*-pointer-arithmetic)
+  const uint16_t index = tail & ( group.count - 1 );
+  io_uring_buf& buf = group.ring[index]; // NOLINT(*-pointer-arithmetic)
+  buf.addr = reinterpret_cast<uint64_t>( &group.buffers[id * group.size] ); // NOLINT(*-reinterpret-cast)
+  buf.len = static_cast<uint32_t>( group.size );
+  buf.bid = id;
+  std::atomic_ref { tail }.store( static_cast<uint16_t>( tail + 1 ), std::memory_order_release );
+}
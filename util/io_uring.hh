@@ -0,0 +1,138 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+//! \brief A minimal [io_uring(7)](\ref man7::io_uring) instance, driven by raw system calls
+//! \details The submission and completion queues are mapped into user space, so queueing requests and reaping
+//! their completions costs no system call; only submit() enters the kernel. Reads pick their destination from a
+//! group of provided buffers (all of one size), which are handed back to the kernel with recycle() once their
+//! contents have been used.
+class IoUring
+{
+public:
+  //! One completion queue entry
+  struct Completion
+  {
+    uint64_t user_data {};
+    int32_t result {}; //!< bytes read (for a receive, the datagram's whole length), or -errno
+    uint32_t flags {}; //!< IORING_CQE_F_*
+  };
+
+  //! user_data of the requests that cancel other requests (their completions are of no interest)
+  static constexpr uint64_t CANCEL_USER_DATA = UINT64_MAX;
+
+  //! \param[in] entries is the size of the submission queue
+  //! \throws unix_error if the kernel does not support io_uring
+  explicit IoUring( unsigned entries );
+  ~IoUring();
+
+  IoUring( const IoUring& ) = delete;
+  IoUring& operator=( const IoUring& ) = delete;
+  IoUring( IoUring&& ) = delete;
+  IoUring& operator=( IoUring&& ) = delete;
+
+  //! Can an IoUring be set up on this kernel (and is it allowed to)?
+  static bool supported();
+
+  //! Readable whenever completions are waiting
+  FileDescriptor& fd() { return fd_; }
+
+  //! Registers a group of `count` provided buffers (a power of two) of `size` bytes each
+  //! \returns the group's ID
+  //! \throws unix_error if the kernel does not support provided buffer rings
+  uint16_t add_buffer_group( uint16_t count, size_t size );
+
+  //! The size of each buffer in a group
+  size_t buffer_size( uint16_t group ) const { return groups_.at( group ).size; }
+
+  //! Queues a receive on a socket into a provided buffer from `group`: if `multishot`, one completion, into its
+  //! own buffer, per datagram received until it is cancelled (a result is the datagram's length, even if the
+  //! buffer was too short to hold it all)
+  void prepare_recv( int fd, uint16_t group, uint64_t user_data, bool multishot );
+
+  //! Queues a single read into a provided buffer from `group` (for fds that are not sockets)
+  void prepare_read( int fd, uint16_t group, uint64_t user_data );
+
+  //! Queues the cancellation of every request with `user_data`
+  void prepare_cancel( uint64_t user_data );
+
+  //! Submits the queued requests (one system call, if any are queued)
+  void submit();
+
+  //! Calls `f( const Completion& )` for every completion reaped so far, without a system call
+  template<class F>
+  void drain( F&& f )
+  {
+    const uint32_t tail = std::atomic_ref { *cq_.tail }.load( std::memory_order_acquire );
+    uint32_t head = *cq_.head;
+    for ( ; head != tail; ++head ) {
+      const io_uring_cqe& cqe = cq_.cqes[head & cq_.mask];
+      const Completion completion { cqe.user_data, cqe.res, cqe.flags };
+      std::atomic_ref { *cq_.head }.store( head + 1, std::memory_order_release );
+      f( completion );
+    }
+  }
+
+  //! The contents of the provided buffer from `group` that `completion` was read into
+  std::string_view buffer( uint16_t group, const Completion& completion ) const;
+
+  //! Gives the provided buffer of `completion` back to the kernel
+  void recycle( uint16_t group, const Completion& completion );
+
+  //! Number of io_uring_enter system calls made so far
+  uint64_t enter_count() const { return enter_count_; }
+
+private:
+  struct Mapping
+  {
+    void* address {};
+    size_t length {};
+  };
+
+  io_uring_params params_ {}; //!< filled in by io_uring_setup (so declared before fd_)
+  FileDescriptor fd_;
+  std::vector<Mapping> mappings_ {};
+
+  struct
+  {
+    uint32_t* tail {};
+    uint32_t mask {};
+    io_uring_sqe* sqes {};
+    uint32_t local_tail {}; //!< requests queued but not yet published
+    uint32_t submitted {};  //!< requests published and submitted to the kernel
+    uint32_t entries {};
+    uint32_t* head {};
+  } sq_ {};
+
+  struct
+  {
+    uint32_t* head {};
+    uint32_t* tail {};
+    uint32_t mask {};
+    io_uring_cqe* cqes {};
+  } cq_ {};
+
+  //! A group of provided buffers, whose ID is its index in groups_
+  struct BufferGroup
+  {
+    io_uring_buf* ring {}; //!< the ring the kernel takes the group's buffers from
+    uint16_t count {};
+    size_t size {};
+    std::unique_ptr<char[]> buffers {}; //!< (left uninitialized: only what the kernel writes is touched)
+  };
+
+  std::vector<BufferGroup> groups_ {};
+  uint64_t enter_count_ {};
+
+  void* map( size_t length, off_t offset, int fd );
+  io_uring_sqe& next_sqe();
+  void provide_buffer( BufferGroup& group, uint16_t id );
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ipv4_header.hh"
+#include "packet_buffer.hh"
 #include "parser.hh"
 
 #include <memory>
@@ -10,8 +11,8 @@
 //! \brief [IPv4](\ref rfc::rfc791)互联网数据报
 struct IPv4Datagram
 {
-  IPv4Header header {};                // IPv4头部
-  std::vector<std::string> payload {}; // 数据负载
+  IPv4Header header {};                 // IPv4头部
+  std::vector<SharedBuffer> payload {}; // 数据负载（共享读入的缓冲区，不拷贝）
 
   // 解析IPv4数据报
   void parse( Parser& parser )
@@ -28,6 +29,9 @@ struct IPv4Datagram
       serializer.buffer( x ); // 序列化负载数据
     }
   }
+
+  // 序列化为一个连续的缓冲区（头部写入负载所在 PacketBuffer 的预留空间，不拷贝负载）
+  SharedBuffer serialize_packet() const { return prepend_header( ::serialize( header ), payload ); }
 };
 
 // 互联网数据报别名
@@ -1,5 +1,6 @@
 #include "ipv4_header.hh"
 #include "checksum.hh"
+#include "header_layout.hh"
 
 #include <arpa/inet.h>
 #include <array>
@@ -8,8 +9,72 @@
 
 using namespace std;
 
+namespace {
+
+using namespace header_layout;
+
+using IPv4Layout = Layout<IPv4Header::LENGTH,
+                          Field<0, 4, &IPv4Header::ver>,
+                          Field<4, 4, &IPv4Header::hlen>,
+                          Field<8, 8, &IPv4Header::tos>,
+                          Field<16, 16, &IPv4Header::len>,
+                          Field<32, 16, &IPv4Header::id>,
+                          Reserved<48, 1>,
+                          Field<49, 1, &IPv4Header::df>, // don't fragment
+                          Field<50, 1, &IPv4Header::mf>, // more fragments
+                          Field<51, 13, &IPv4Header::offset>,
+                          Field<64, 8, &IPv4Header::ttl>,
+                          Field<72, 8, &IPv4Header::proto>,
+                          Field<80, 16, &IPv4Header::cksum>,
+                          Field<96, 32, &IPv4Header::src>,
+                          Field<128, 32, &IPv4Header::dst>>;
+
+// checks the parsed fields, skips any options, and verifies the checksum
+void finish_parse( IPv4Header& header, Parser& parser )
+{
+  if ( header.ver != 4 ) {
+    parser.set_error();
+  }
+
+  if ( header.hlen < 5 ) {
+    parser.set_error();
+  }
+
+  if ( parser.has_error() ) {
+    return;
+  }
+
+  parser.remove_prefix( static_cast<uint64_t>( header.hlen ) * 4 - IPv4Header::LENGTH );
+
+  // Verify checksum
+  const uint16_t given_cksum = header.cksum;
+  header.compute_checksum();
+  if ( header.cksum != given_cksum ) {
+    parser.set_error();
+  }
+}
+
+} // namespace
+
 // Parse from string.
 void IPv4Header::parse( Parser& parser )
+{
+  IPv4Layout::parse( *this, parser );
+  finish_parse( *this, parser );
+}
+
+// Serialize the IPv4Header (does not recompute the checksum)
+void IPv4Header::serialize( Serializer& serializer ) const
+{
+  // consistency checks
+  if ( ver != 4 ) {
+    throw runtime_error( "wrong IP version" );
+  }
+
+  IPv4Layout::serialize( *this, serializer );
+}
+
+void IPv4Header::parse_by_hand( Parser& parser )
 {
   uint8_t first_byte {};
   parser.integer( first_byte );
@@ -31,30 +96,10 @@ void IPv4Header::parse( Parser& parser )
   parser.integer( src );
   parser.integer( dst );
 
-  if ( ver != 4 ) {
-    parser.set_error();
-  }
-
-  if ( hlen < 5 ) {
-    parser.set_error();
-  }
-
-  if ( parser.has_error() ) {
-    return;
-  }
-
-  parser.remove_prefix( static_cast<uint64_t>( hlen ) * 4 - IPv4Header::LENGTH );
-
-  // Verify checksum
-  const uint16_t given_cksum = cksum;
-  compute_checksum();
-  if ( cksum != given_cksum ) {
-    parser.set_error();
-  }
+  finish_parse( *this, parser );
 }
 
-// Serialize the IPv4Header (does not recompute the checksum)
-void IPv4Header::serialize( Serializer& serializer ) const
+void IPv4Header::serialize_by_hand( Serializer& serializer ) const
 {
   // consistency checks
   if ( ver != 4 ) {
@@ -106,13 +151,18 @@ uint32_t IPv4Header::pseudo_checksum() const
 
 void IPv4Header::compute_checksum()
 {
+  if ( ver != 4 ) {
+    throw runtime_error( "wrong IP version" );
+  }
+
+  // serialized on the stack (this runs for every datagram parsed or sent)
   cksum = 0;
-  Serializer s;
-  serialize( s );
+  array<char, LENGTH> bytes {};
+  IPv4Layout::serialize( *this, bytes );
 
   // calculate checksum -- taken over header only
   InternetChecksum check;
-  check.add( s.output() );
+  check.add( { bytes.data(), bytes.size() } );
   cksum = check.value();
 }
 
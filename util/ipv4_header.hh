@@ -62,4 +62,8 @@ struct IPv4Header
 
   void parse( Parser& parser );
   void serialize( Serializer& serializer ) const;
+
+  // 手写的逐字段版本（作为参照，用于差分测试和基准测试）
+  void parse_by_hand( Parser& parser );
+  void serialize_by_hand( Serializer& serializer ) const;
 };
@@ -7,7 +7,9 @@
 
 #include <optional>
 #include <random>
+#include <string_view>
 #include <utility>
+#include <vector>
 
 //! An adapter class that adds random dropping behavior to an FD adapter
 template<typename AdapterT>
@@ -49,6 +51,32 @@ public:
     return ret;
   }
 
+  //! \brief Read a burst from the underlying AdapterT instance, dropping each datagram independently
+  std::vector<TCPMessage> read_batch()
+    requires requires( AdapterT& a ) { a.read_batch(); }
+  {
+    auto batch = _adapter.read_batch();
+    std::erase_if( batch, [&]( const TCPMessage& ) { return _should_drop( false ); } );
+    return batch;
+  }
+
+  //! \brief Parse a datagram already read from the underlying AdapterT's fd, potentially dropping it
+  std::optional<TCPMessage> unwrap( std::string_view datagram )
+    requires requires( AdapterT& a, std::string_view d ) { a.unwrap( d ); }
+  {
+    if ( _should_drop( false ) ) {
+      return {};
+    }
+    return _adapter.unwrap( datagram );
+  }
+
+  //! \brief The size of read buffer the underlying AdapterT needs for any datagram it can be handed
+  size_t datagram_buffer_size() const
+    requires requires( const AdapterT& a ) { a.datagram_buffer_size(); }
+  {
+    return _adapter.datagram_buffer_size();
+  }
+
   //! \brief Write to the underlying AdapterT instance, potentially dropping the datagram to be written
   //! \param[in] seg is the packet to either write or drop
   void write( const TCPMessage& seg )
@@ -59,6 +87,20 @@ public:
     return _adapter.write( seg );
   }
 
+  //! \brief Send whatever the underlying AdapterT has queued
+  void flush()
+    requires requires( AdapterT& a ) { a.flush(); }
+  {
+    _adapter.flush();
+  }
+
+  //! \brief Does the underlying AdapterT read and write datagrams larger than the MTU?
+  bool offload() const
+    requires requires( const AdapterT& a ) { a.offload(); }
+  {
+    return _adapter.offload();
+  }
+
   //! \name
   //! Passthrough functions to the underlying AdapterT instance
 
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+//! \brief A lock-free queue that any number of threads push to and one thread pops from
+//! \details An intrusive linked list (after Dmitry Vyukov's MPSC queue): a push is one atomic exchange of the
+//! head and one store, so producers never wait for each other or for the consumer. The consumer owns the tail.
+//! A pop may briefly miss an element whose producer has exchanged the head but not yet linked it; the producer
+//! is still inside push() then, so a consumer that is woken after each push (see ShardedEventLoop) finds it.
+template<class T>
+class MPSCQueue
+{
+public:
+  MPSCQueue() : head_( new Node ), tail_( head_.load( std::memory_order_relaxed ) ) {}
+
+  ~MPSCQueue()
+  {
+    while ( tail_ ) {
+      Node* const next = tail_->next.load( std::memory_order_relaxed );
+      delete tail_;
+      tail_ = next;
+    }
+  }
+
+  MPSCQueue( const MPSCQueue& ) = delete;
+  MPSCQueue& operator=( const MPSCQueue& ) = delete;
+  MPSCQueue( MPSCQueue&& ) = delete;
+  MPSCQueue& operator=( MPSCQueue&& ) = delete;
+
+  //! Appends `value` (from any thread)
+  void push( T value )
+  {
+    Node* const node = new Node { {}, std::move( value ) };
+    Node* const previous = head_.exchange( node, std::memory_order_acq_rel );
+    previous->next.store( node, std::memory_order_release );
+  }
+
+  //! Removes the oldest value (only from the consuming thread)
+  //! \returns the value, or nothing if the queue is empty
+  std::optional<T> pop()
+  {
+    Node* const next = tail_->next.load( std::memory_order_acquire );
+    if ( not next ) {
+      return {};
+    }
+    std::optional<T> value { std::move( next->value ) };
+    next->value.reset();
+    delete tail_;
+    tail_ = next; // (the node popped is the new stub)
+    return value;
+  }
+
+private:
+  struct Node
+  {
+    std::atomic<Node*> next {};
+    std::optional<T> value {};
+  };
+
+  std::atomic<Node*> head_; //!< the last node pushed
+  Node* tail_;              //!< a stub, whose successor is the oldest value
+};
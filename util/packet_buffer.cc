@@ -0,0 +1,62 @@
+#include "packet_buffer.hh"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+size_t total_size( const auto& pieces )
+{
+  return accumulate(
+    pieces.begin(), pieces.end(), size_t {}, []( size_t sum, const auto& piece ) { return sum + piece.size(); } );
+}
+
+} // namespace
+
+PacketBuffer::PacketBuffer( span<const SharedBuffer> payload, const size_t headroom )
+  : storage_( make_unique_for_overwrite<char[]>( headroom + total_size( payload ) ) ) // NOLINT(*-c-arrays)
+  , capacity_( headroom + total_size( payload ) )
+  , start_( headroom )
+{
+  char* next = storage_.get() + start_;
+  for ( const auto& piece : payload ) {
+    next = copy( piece.view().begin(), piece.view().end(), next );
+  }
+}
+
+void PacketBuffer::prepend( span<const string> header )
+{
+  const size_t length = total_size( header );
+  if ( length > start_ ) {
+    throw runtime_error( "PacketBuffer: header does not fit in the headroom" );
+  }
+  start_ -= length;
+  char* next = storage_.get() + start_;
+  for ( const auto& piece : header ) {
+    next = copy( piece.begin(), piece.end(), next );
+  }
+}
+
+SharedBuffer prepend_header( span<const string> header, span<const SharedBuffer> payload )
+{
+  const size_t length = total_size( header );
+
+  if ( payload.size() == 1 ) {
+    const SharedBuffer& piece = payload.front();
+    PacketBuffer* const packet = piece.packet_;
+    if ( packet and piece.data() == packet->view().data() and packet->headroom() >= length ) {
+      packet->prepend( header );
+      SharedBuffer ret { piece };
+      ret.view_ = { packet->view().data(), length + piece.size() };
+      return ret;
+    }
+  }
+
+  PacketBuffer packet { payload, max( length, PacketBuffer::DEFAULT_HEADROOM ) };
+  packet.prepend( header );
+  return SharedBuffer { move( packet ) };
+}
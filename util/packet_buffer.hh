@@ -0,0 +1,42 @@
+#pragma once
+
+#include "shared_buffer.hh"
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+//! \brief The buffer of an outbound packet, with headroom reserved in front of its payload
+//! \details Like a Linux sk_buff: the payload is copied in once, and then each layer below writes its header into
+//! the headroom in front of what is already there, so that the finished frame is one contiguous buffer.
+class PacketBuffer
+{
+public:
+  //! Room for an Ethernet, an IPv4 and a TCP header (14 + 20 + 20 bytes, without options), rounded up
+  static constexpr size_t DEFAULT_HEADROOM = 64;
+
+  //! Copies in the payload (its only copy), leaving `headroom` bytes free in front of it
+  explicit PacketBuffer( std::span<const SharedBuffer> payload, size_t headroom = DEFAULT_HEADROOM );
+
+  std::string_view view() const { return { storage_.get() + start_, capacity_ - start_ }; }
+  size_t size() const { return capacity_ - start_; }
+
+  //! Bytes still free in front of the packet
+  size_t headroom() const { return start_; }
+
+  //! Writes the pieces of a serialized header into the headroom, in front of the packet
+  void prepend( std::span<const std::string> header );
+
+private:
+  std::unique_ptr<char[]> storage_; // NOLINT(*-avoid-c-arrays)
+  size_t capacity_;
+  size_t start_;
+};
+
+//! \returns the serialized `header` followed by `payload`, as one contiguous buffer. If `payload` is one view of a
+//! PacketBuffer that starts where the packet does (so no other view has claimed the headroom in front of it), the
+//! header is written into that headroom; otherwise the payload is copied once into a new PacketBuffer. The views
+//! of a PacketBuffer must stay on one thread, as its headroom is claimed without synchronization.
+SharedBuffer prepend_header( std::span<const std::string> header, std::span<const SharedBuffer> payload );
@@ -1,30 +1,63 @@
 #pragma once
 
+#include "shared_buffer.hh"
+
 #include <algorithm>
 #include <concepts>
 #include <cstdint>
 #include <cstring>
-#include <deque>
+#include <endian.h>
 #include <numeric>
 #include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+// Converts an integer between host byte order and network (big-endian) byte order
+template<std::unsigned_integral T>
+T big_endian_to_host( const T val )
+{
+  if constexpr ( sizeof( T ) == 1 ) {
+    return val;
+  } else if constexpr ( sizeof( T ) == 2 ) {
+    return be16toh( val );
+  } else if constexpr ( sizeof( T ) == 4 ) {
+    return be32toh( val );
+  } else {
+    static_assert( sizeof( T ) == 8 );
+    return be64toh( val );
+  }
+}
+
+template<std::unsigned_integral T>
+T host_to_big_endian( const T val )
+{
+  return big_endian_to_host( val ); // (the same byte swap, if any)
+}
+
 class Parser
 {
   class BufferList
   {
     uint64_t size_ {};
-    std::deque<std::string> buffer_ {};
-    uint64_t skip_ {};
+    std::vector<SharedBuffer> buffer_ {};
+    size_t first_ {}; // (the buffers before it have been parsed)
 
   public:
-    explicit BufferList( const std::vector<std::string>& buffers )
+    explicit BufferList( const std::vector<std::string>& buffers ) : buffer_( buffers.begin(), buffers.end() )
     {
-      for ( const auto& x : buffers ) {
-        append( x );
+      init();
+    }
+
+    explicit BufferList( std::vector<SharedBuffer> buffers ) : buffer_( std::move( buffers ) ) { init(); }
+
+    void init()
+    {
+      std::erase_if( buffer_, []( const SharedBuffer& x ) { return x.empty(); } );
+      for ( const auto& x : buffer_ ) {
+        size_ += x.size();
       }
     }
 
@@ -34,77 +67,67 @@ class Parser
 
     std::string_view peek() const
     {
-      if ( buffer_.empty() ) {
+      if ( first_ == buffer_.size() ) {
         throw std::runtime_error( "peek on empty BufferList" );
       }
-      return std::string_view { buffer_.front() }.substr( skip_ );
+      return buffer_[first_];
     }
 
     void remove_prefix( uint64_t len )
     {
-      while ( len and not buffer_.empty() ) {
+      while ( len and first_ < buffer_.size() ) {
         const uint64_t to_pop_now = std::min( len, peek().size() );
-        skip_ += to_pop_now;
+        buffer_[first_].remove_prefix( to_pop_now );
         len -= to_pop_now;
         size_ -= to_pop_now;
-        if ( skip_ == buffer_.front().size() ) {
-          buffer_.pop_front();
-          skip_ = 0;
+        if ( buffer_[first_].empty() ) {
+          ++first_;
         }
       }
     }
 
-    void dump_all( std::vector<std::string>& out )
+    // (the views share the input's buffers: nothing is copied)
+    void dump_all( std::vector<SharedBuffer>& out )
     {
-      out.clear();
-      if ( empty() ) {
-        return;
-      }
-      std::string first_str = std::move( buffer_.front() );
-      if ( skip_ ) {
-        first_str = first_str.substr( skip_ );
-      }
-      out.emplace_back( std::move( first_str ) );
-      buffer_.pop_front();
-      for ( auto&& x : buffer_ ) {
-        out.emplace_back( std::move( x ) );
-      }
+      out.assign( std::make_move_iterator( buffer_.begin() + first_ ), std::make_move_iterator( buffer_.end() ) );
+      clear();
     }
 
-    void dump_all( std::string& out )
+    void dump_all( SharedBuffer& out )
     {
-      std::vector<std::string> concat;
-      dump_all( concat );
-      if ( concat.size() == 1 ) {
-        out = std::move( concat.front() );
+      if ( buffer_.size() - first_ == 1 ) {
+        out = std::move( buffer_[first_] );
+        clear();
         return;
       }
+      std::string concat;
+      dump_all( concat );
+      out = std::move( concat );
+    }
 
-      out.clear();
-      for ( const auto& s : concat ) {
-        out.append( s );
-      }
+    void dump_all( std::vector<std::string>& out )
+    {
+      out.assign( buffer_.begin() + first_, buffer_.end() );
+      clear();
     }
 
-    std::vector<std::string_view> buffer() const
+    void dump_all( std::string& out )
     {
-      if ( empty() ) {
-        return {};
-      }
-      std::vector<std::string_view> ret;
-      ret.reserve( buffer_.size() );
-      auto tmp_skip = skip_;
-      for ( const auto& x : buffer_ ) {
-        ret.push_back( std::string_view { x }.substr( tmp_skip ) );
-        tmp_skip = 0;
+      out.clear();
+      out.reserve( size_ );
+      for ( auto x = buffer_.begin() + first_; x != buffer_.end(); ++x ) {
+        out.append( *x );
       }
-      return ret;
+      clear();
     }
 
-    void append( std::string str )
+    std::span<const SharedBuffer> buffer() const { return { buffer_.begin() + first_, buffer_.end() }; }
+
+    void clear()
     {
-      size_ += str.size();
-      buffer_.push_back( std::move( str ) );
+      buffer_.clear();
+      first_ = 0;
+      size_ = 0;
     }
   };
 
@@ -120,6 +143,7 @@ class Parser
 
 public:
   explicit Parser( const std::vector<std::string>& input ) : input_( input ) {}
+  explicit Parser( std::vector<SharedBuffer> input ) : input_( std::move( input ) ) {}
 
   const BufferList& input() const { return input_; }
 
@@ -135,17 +159,21 @@ public:
       return;
     }
 
-    if constexpr ( sizeof( T ) == 1 ) {
-      out = static_cast<uint8_t>( input_.peek().front() );
-      input_.remove_prefix( 1 );
+    // fast path: the integer lies within the front buffer, so it is one (unaligned) load and a byte swap
+    const std::string_view front = input_.peek();
+    if ( front.size() >= sizeof( T ) ) {
+      std::memcpy( &out, front.data(), sizeof( T ) );
+      out = big_endian_to_host( out );
+      input_.remove_prefix( sizeof( T ) );
       return;
-    } else {
-      out = static_cast<T>( 0 );
-      for ( size_t i = 0; i < sizeof( T ); i++ ) {
-        out <<= 8;
-        out |= static_cast<uint8_t>( input_.peek().front() );
-        input_.remove_prefix( 1 );
-      }
+    }
+
+    // slow path: the integer straddles two or more buffers
+    out = static_cast<T>( 0 );
+    for ( size_t i = 0; i < sizeof( T ); i++ ) {
+      out <<= 8;
+      out |= static_cast<uint8_t>( input_.peek().front() );
+      input_.remove_prefix( 1 );
     }
   }
 
@@ -164,9 +192,31 @@ public:
     }
   }
 
+  //! Consumes the next `scratch.size()` bytes, and returns a view of them: of the front buffer if they lie within
+  //! it, or else of their copy in `scratch`. (Empty, with the error set, if there are too few.)
+  std::string_view contiguous( std::span<char> scratch )
+  {
+    check_size( scratch.size() );
+    if ( has_error() ) {
+      return {};
+    }
+
+    const std::string_view front = input_.peek();
+    if ( front.size() >= scratch.size() ) {
+      input_.remove_prefix( scratch.size() );
+      return front.substr( 0, scratch.size() );
+    }
+
+    string( scratch );
+    return { scratch.data(), scratch.size() };
+  }
+
+  void all_remaining( std::vector<SharedBuffer>& out ) { input_.dump_all( out ); }
+  void all_remaining( SharedBuffer& out ) { input_.dump_all( out ); }
   void all_remaining( std::vector<std::string>& out ) { input_.dump_all( out ); }
   void all_remaining( std::string& out ) { input_.dump_all( out ); }
-  std::vector<std::string_view> buffer() const { return input_.buffer(); }
+  //! The input not yet parsed (views of the input's buffers)
+  std::span<const SharedBuffer> buffer() const { return input_.buffer(); }
 };
 
 class Serializer
@@ -181,12 +231,16 @@ public:
   template<std::unsigned_integral T>
   void integer( const T val )
   {
-    constexpr uint64_t len = sizeof( T );
+    const T big_endian = host_to_big_endian( val );
+    buffer_.append( reinterpret_cast<const char*>( &big_endian ), sizeof( T ) ); // NOLINT(*-reinterpret-cast)
+  }
 
-    for ( uint64_t i = 0; i < len; ++i ) {
-      const uint8_t byte_val = val >> ( ( len - i - 1 ) * 8 );
-      buffer_.push_back( byte_val );
-    }
+  //! Appends `len` zero bytes, and returns them to be filled in
+  std::span<char> allocate( const size_t len )
+  {
+    const size_t start = buffer_.size();
+    buffer_.resize( start + len );
+    return { buffer_.data() + start, len };
   }
 
   void buffer( std::string buf )
@@ -197,6 +251,8 @@ public:
     }
   }
 
+  void buffer( const SharedBuffer& buf ) { buffer( static_cast<std::string>( buf ) ); }
+
   void buffer( const std::vector<std::string>& bufs )
   {
     for ( const auto& b : bufs ) {
@@ -204,6 +260,13 @@ public:
     }
   }
 
+  void buffer( const std::vector<SharedBuffer>& bufs )
+  {
+    for ( const auto& b : bufs ) {
+      buffer( b );
+    }
+  }
+
   void flush()
   {
     if ( not buffer_.empty() ) {
@@ -217,6 +280,10 @@ public:
     flush();
     return output_;
   }
+
+  //! Hands back the bytes serialized since the last buffer() (to a caller that serializes in place, appending to
+  //! the string it gave the constructor)
+  std::string release_buffer() { return std::exchange( buffer_, {} ); }
 };
 
 // Helper to serialize any object (without constructing a Serializer of the caller's own)
@@ -228,6 +295,21 @@ std::vector<std::string> serialize( const T& obj )
   return s.output();
 }
 
+// Helper to serialize any object into the buffers of a payload (an EthernetFrame's or an IPv4Datagram's). Objects
+// that can serialize into a PacketBuffer do, so that the layers below write their headers in front, in place.
+template<class T>
+std::vector<SharedBuffer> serialize_payload( const T& obj )
+{
+  if constexpr ( requires { obj.serialize_packet(); } ) {
+    return { obj.serialize_packet() };
+  } else {
+    Serializer s;
+    obj.serialize( s );
+    const auto& buffers = s.output();
+    return { buffers.begin(), buffers.end() };
+  }
+}
+
 // Helper to parse any object (without constructing a Parser of the caller's own). Returns true if successful.
 template<class T, typename... Targs>
 bool parse( T& obj, const std::vector<std::string>& buffers, Targs&&... Fargs )
@@ -236,3 +318,12 @@ bool parse( T& obj, const std::vector<std::string>& buffers, Targs&&... Fargs )
   obj.parse( p, std::forward<Targs>( Fargs )... );
   return not p.has_error();
 }
+
+// (the same, for buffers that the parsed object's payload may go on sharing)
+template<class T, typename... Targs>
+bool parse( T& obj, std::vector<SharedBuffer> buffers, Targs&&... Fargs )
+{
+  Parser p { std::move( buffers ) };
+  obj.parse( p, std::forward<Targs>( Fargs )... );
+  return not p.has_error();
+}
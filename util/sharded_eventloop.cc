@@ -0,0 +1,171 @@
+#include "sharded_eventloop.hh"
+#include "exception.hh"
+
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace std;
+
+ShardedEventLoop::Shard::Shard()
+  : wakeup( CheckSystemCall( "eventfd", ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) )
+{}
+
+ShardedEventLoop::ShardedEventLoop( const size_t shards, const bool pin )
+{
+  if ( shards == 0 ) {
+    throw runtime_error( "ShardedEventLoop: needs at least one shard" );
+  }
+
+  // the CPUs this process may run on (its cpuset may not start at CPU 0)
+  cpu_set_t allowed;
+  CPU_ZERO( &allowed );
+  CheckSystemCall( "sched_getaffinity", ::sched_getaffinity( 0, sizeof( allowed ), &allowed ) );
+  vector<int> cpus;
+  for ( int cpu = 0; cpu < CPU_SETSIZE; ++cpu ) {
+    if ( CPU_ISSET( cpu, &allowed ) ) {
+      cpus.push_back( cpu );
+    }
+  }
+
+  shards_.reserve( shards );
+  try {
+    for ( size_t i = 0; i < shards; ++i ) {
+      Shard& shard = *shards_.emplace_back( make_unique<Shard>() );
+      shard.eventloop.add_rule( "run jobs posted to shard " + to_string( i ),
+                                shard.wakeup,
+                                Direction::In,
+                                [i, &shard] { run_jobs( i, shard ); } );
+      const int cpu = pin and not cpus.empty() ? cpus[i % cpus.size()] : -1;
+      shard.thread = thread( &ShardedEventLoop::serve, ref( shard ), cpu );
+    }
+  } catch ( ... ) {
+    stop();
+    throw;
+  }
+}
+
+ShardedEventLoop::~ShardedEventLoop()
+{
+  try {
+    stop();
+  } catch ( const exception& e ) {
+    cerr << "Exception in a ShardedEventLoop shard: " << e.what() << "\n";
+  }
+}
+
+size_t ShardedEventLoop::shard_for( const Socket& socket ) const
+{
+  const Address local = socket.local_address();
+  const Address peer = socket.peer_address();
+  return shard_for( FourTuple { .local_ip = local.ipv4_numeric(),
+                                .remote_ip = peer.ipv4_numeric(),
+                                .local_port = local.port(),
+                                .remote_port = peer.port() } );
+}
+
+void ShardedEventLoop::post( const size_t shard, Job job )
+{
+  Shard& target = *shards_.at( shard );
+  target.jobs.push( move( job ) );
+
+  // wake the shard, unless it has been woken since it last drained its queue (and so will see this job too)
+  if ( not target.notified.exchange( true, memory_order_acq_rel ) ) {
+    // (a raw write: the FileDescriptor's counters belong to the shard's thread)
+    const uint64_t one = 1;
+    CheckSystemCall( "write", ::write( target.wakeup.fd_num(), &one, sizeof( one ) ) );
+  }
+}
+
+void ShardedEventLoop::distribute( TCPSocket&& listener, ConnectionHandler handler )
+{
+  auto socket = make_shared<TCPSocket>( move( listener ) );
+  post( 0, [this, socket, handler = move( handler )]( size_t, EventLoop& eventloop ) {
+    eventloop.add_rule( "accept connections", *socket, Direction::In, [this, socket, handler] {
+      auto connection = make_shared<TCPSocket>( socket->accept() );
+      const size_t owner = shard_for( *connection );
+      if ( owner == 0 ) {
+        handler( 0, shards_[0]->eventloop, move( *connection ) );
+        return;
+      }
+      post( owner, [connection, handler]( size_t shard, EventLoop& loop ) {
+        handler( shard, loop, move( *connection ) );
+      } );
+    } );
+  } );
+}
+
+void ShardedEventLoop::stop()
+{
+  if ( stopped_ ) {
+    return;
+  }
+  stopped_ = true;
+
+  for ( size_t i = 0; i < shards_.size(); ++i ) {
+    post( i, [this]( size_t shard, EventLoop& ) { shards_[shard]->stopping = true; } );
+  }
+
+  exception_ptr exception;
+  for ( const auto& shard : shards_ ) {
+    if ( shard->thread.joinable() ) {
+      shard->thread.join();
+    }
+    if ( shard->exception and not exception ) {
+      exception = shard->exception;
+    }
+  }
+  if ( exception ) {
+    rethrow_exception( exception );
+  }
+}
+
+void ShardedEventLoop::summary( ostream& out ) const
+{
+  for ( size_t i = 0; i < shards_.size(); ++i ) {
+    out << "Shard " << i << ":\n";
+    shards_[i]->eventloop.summary( out );
+  }
+}
+
+void ShardedEventLoop::serve( Shard& shard, const int cpu )
+{
+  try {
+    if ( cpu >= 0 ) {
+      cpu_set_t cpus;
+      CPU_ZERO( &cpus );
+      CPU_SET( cpu, &cpus );
+      // (pthread functions return the error rather than setting errno)
+      const int error = ::pthread_setaffinity_np( ::pthread_self(), sizeof( cpus ), &cpus );
+      if ( error ) {
+        errno = error;
+        CheckSystemCall( "pthread_setaffinity_np", -1 );
+      }
+    }
+
+    while ( not shard.stopping ) {
+      shard.eventloop.wait_next_event( -1 );
+    }
+  } catch ( ... ) {
+    shard.exception = current_exception();
+  }
+}
+
+void ShardedEventLoop::run_jobs( const size_t index, Shard& shard )
+{
+  string counter( sizeof( uint64_t ), 0 );
+  shard.wakeup.read( counter );
+
+  // a job posted from here on wakes the shard again (an exchange, so that it synchronizes with the post that
+  // last set the flag, and the pops below see that post's job)
+  shard.notified.exchange( false, memory_order_acq_rel );
+
+  while ( auto job = shard.jobs.pop() ) {
+    ( *job )( index, shard.eventloop );
+  }
+}
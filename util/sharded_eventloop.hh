@@ -0,0 +1,93 @@
+#pragma once
+
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "four_tuple_map.hh"
+#include "mpsc_queue.hh"
+#include "socket.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+//! \brief EventLoops on worker threads, each owning a shard of the connections
+//! \details Each shard is an EventLoop served by its own thread (pinned to a CPU, one per shard while there are
+//! enough), and a connection belongs to the shard its FourTuple hashes to, as a NIC's receive-side scaling would
+//! steer its packets to one queue: its fds, streams and rules are only ever touched by that shard's thread, so
+//! the shards share nothing and need no locks.
+//!
+//! Other threads hand work to a shard by posting a job to it. Jobs go through a lock-free MPSCQueue, and a
+//! shard's thread is woken by an [eventfd(2)](\ref man2::eventfd) that the loop watches like any other fd: the
+//! first post after the shard last looked at its queue writes to the eventfd, and the posts that follow (until
+//! the shard runs them all) make no system call.
+class ShardedEventLoop
+{
+public:
+  //! Work for a shard, run on its thread with its index and its EventLoop
+  using Job = std::function<void( size_t shard, EventLoop& eventloop )>;
+
+  //! Serves a connection accepted by distribute(), on the thread of the shard it belongs to
+  using ConnectionHandler = std::function<void( size_t shard, EventLoop& eventloop, TCPSocket&& socket )>;
+
+  //! Starts `shards` worker threads (pinning each to one of the CPUs the process may run on, if `pin`)
+  explicit ShardedEventLoop( size_t shards, bool pin = true );
+
+  //! Stops the shards (see stop())
+  ~ShardedEventLoop();
+
+  ShardedEventLoop( const ShardedEventLoop& ) = delete;
+  ShardedEventLoop& operator=( const ShardedEventLoop& ) = delete;
+  ShardedEventLoop( ShardedEventLoop&& ) = delete;
+  ShardedEventLoop& operator=( ShardedEventLoop&& ) = delete;
+
+  size_t size() const { return shards_.size(); }
+
+  //! The shard that owns the connection `id`
+  size_t shard_for( const FourTuple& id ) const { return id.hash() % shards_.size(); }
+
+  //! The shard that owns an (IPv4) connected socket
+  size_t shard_for( const Socket& socket ) const;
+
+  //! Runs `job` on the thread of `shard` (from any thread), after the jobs posted to it before
+  void post( size_t shard, Job job );
+
+  //! Accepts connections on `listener` (in shard 0) and hands each to the shard it belongs to, which runs
+  //! `handler` with it
+  void distribute( TCPSocket&& listener, ConnectionHandler handler );
+
+  //! Lets each shard run the jobs posted to it so far, then stops its thread and waits for it; the shards' rules
+  //! are left behind with their EventLoops (which are destroyed with this ShardedEventLoop)
+  //! \throws the exception of the first job (or rule) that threw one, which also stopped its shard
+  void stop();
+
+  //! Prints each shard's EventLoop::summary (after stop())
+  void summary( std::ostream& out ) const;
+
+private:
+  struct Shard
+  {
+    EventLoop eventloop {};
+    FileDescriptor wakeup;           //!< an eventfd, written when a job is posted to an idle queue
+    MPSCQueue<Job> jobs {};          //!< posted by any thread, run by the shard's
+    std::atomic<bool> notified {};   //!< the eventfd was written and the queue is yet to be drained
+    bool stopping {};                //!< (only touched by the shard's thread)
+    std::exception_ptr exception {}; //!< what stopped the shard, read once its thread is joined
+    std::thread thread {};
+
+    Shard();
+  };
+
+  std::vector<std::unique_ptr<Shard>> shards_ {};
+  bool stopped_ {};
+
+  //! Serves the shard's EventLoop (on `cpu`, unless it is negative) until a job stops it (or throws)
+  static void serve( Shard& shard, int cpu );
+
+  //! Runs the jobs in the shard's queue
+  static void run_jobs( size_t index, Shard& shard );
+};
@@ -0,0 +1,78 @@
+#include "shared_buffer.hh"
+
+#include "packet_buffer.hh"
+
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+SharedBuffer::SharedBuffer( string str )
+{
+  if ( str.empty() ) {
+    return;
+  }
+  auto owner = make_shared<const string>( move( str ) );
+  view_ = *owner;
+  owner_ = move( owner );
+}
+
+SharedBuffer::SharedBuffer( PooledBuffer buffer )
+{
+  if ( buffer.empty() ) {
+    return;
+  }
+  pooled_ = move( buffer );
+  view_ = pooled_.view();
+}
+
+SharedBuffer::SharedBuffer( PacketBuffer packet )
+{
+  auto owner = make_shared<PacketBuffer>( move( packet ) );
+  view_ = owner->view();
+  packet_ = owner.get();
+  owner_ = move( owner );
+}
+
+// (a moved-from SharedBuffer is empty)
+SharedBuffer::SharedBuffer( SharedBuffer&& other ) noexcept
+  : owner_( move( other.owner_ ) )
+  , pooled_( move( other.pooled_ ) )
+  , view_( exchange( other.view_, {} ) )
+  , packet_( exchange( other.packet_, nullptr ) )
+{}
+
+SharedBuffer& SharedBuffer::operator=( SharedBuffer&& other ) noexcept
+{
+  owner_ = move( other.owner_ );
+  pooled_ = move( other.pooled_ );
+  view_ = exchange( other.view_, {} );
+  packet_ = exchange( other.packet_, nullptr );
+  return *this;
+}
+
+void SharedBuffer::remove_prefix( const size_t n )
+{
+  if ( n > view_.size() ) {
+    throw runtime_error( "SharedBuffer: remove_prefix beyond the end of the view" );
+  }
+  view_.remove_prefix( n );
+}
+
+void SharedBuffer::remove_suffix( const size_t n )
+{
+  if ( n > view_.size() ) {
+    throw runtime_error( "SharedBuffer: remove_suffix beyond the start of the view" );
+  }
+  view_.remove_suffix( n );
+}
+
+SharedBuffer SharedBuffer::substr( const size_t pos, const size_t length ) const
+{
+  if ( pos > view_.size() ) {
+    throw out_of_range( "SharedBuffer::substr" );
+  }
+  SharedBuffer ret { *this };
+  ret.view_ = view_.substr( pos, length );
+  return ret;
+}
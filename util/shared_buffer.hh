@@ -0,0 +1,76 @@
+#pragma once
+
+#include "buffer_pool.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+class PacketBuffer;
+
+//! \brief A reference-counted, read-only view of (part of) a buffer: a string it took over, or a buffer from a
+//! BufferPool
+//! \details Copies, substr() and remove_prefix() share the buffer, so that parsing a frame down to the payload of
+//! the TCP segment it carries only narrows views of the buffer the frame was read into. The buffer is freed (or
+//! goes back to its pool) with the last view of it. A pooled buffer is shared through its own reference count,
+//! so wrapping one (once per datagram read) allocates nothing.
+class SharedBuffer
+{
+public:
+  SharedBuffer() = default;
+  ~SharedBuffer() = default;
+  SharedBuffer( const SharedBuffer& other ) = default;
+  SharedBuffer& operator=( const SharedBuffer& other ) = default;
+  SharedBuffer( SharedBuffer&& other ) noexcept;
+  SharedBuffer& operator=( SharedBuffer&& other ) noexcept;
+
+  //! Takes over `str` (without copying its bytes)
+  SharedBuffer( std::string str ); // NOLINT(*-explicit-*)
+  SharedBuffer( const char* str ) : SharedBuffer( std::string { str } ) {} // NOLINT(*-explicit-*)
+
+  //! Shares a view of a buffer from a BufferPool
+  explicit SharedBuffer( PooledBuffer buffer );
+
+  //! Shares an outbound packet, whose headroom a lower layer may go on to claim (see prepend_header())
+  explicit SharedBuffer( PacketBuffer packet );
+
+  const char* data() const { return view_.data(); }
+  size_t size() const { return view_.size(); }
+  size_t length() const { return view_.size(); }
+  bool empty() const { return view_.empty(); }
+
+  std::string_view view() const { return view_; }
+  operator std::string_view() const { return view_; } // NOLINT(*-explicit-*)
+
+  //! A copy of the bytes
+  explicit operator std::string() const { return std::string { view_ }; }
+
+  //! Narrows the view from the front
+  void remove_prefix( size_t n );
+
+  //! Narrows the view from the back
+  void remove_suffix( size_t n );
+
+  //! \returns a view of part of this one, sharing its buffer
+  SharedBuffer substr( size_t pos, size_t length = SIZE_MAX ) const;
+
+  //! Compares the bytes (of another SharedBuffer, too)
+  bool operator==( std::string_view other ) const { return view_ == other; }
+
+  //! Number of views sharing the buffer (0 for an empty SharedBuffer)
+  long use_count() const
+  {
+    return pooled_.use_count() > 0 ? static_cast<long>( pooled_.use_count() ) : owner_.use_count();
+  }
+
+private:
+  friend SharedBuffer prepend_header( std::span<const std::string> header, std::span<const SharedBuffer> payload );
+
+  std::shared_ptr<const void> owner_ {};
+  PooledBuffer pooled_ {}; // (the owner, if it is a buffer from a BufferPool)
+  std::string_view view_ {};
+  PacketBuffer* packet_ {}; // (the owner, if it is a PacketBuffer)
+};
@@ -2,12 +2,21 @@
 
 #include "exception.hh"
 
+#include <array>
+#include <atomic>
+#include <cerrno>
 #include <cstddef>
+#include <cstring>
+#include <linux/errqueue.h>
 #include <linux/if_packet.h>
 #include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 #include <stdexcept>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#include <vector>
 
 using namespace std;
 
@@ -133,7 +142,7 @@ void DatagramSocket::recv( Address& source_address, string& payload )
     throw runtime_error( "recvfrom (oversized datagram)" );
   }
 
-  register_read();
+  register_read( recv_len );
   source_address = { datagram_source_address, fromlen };
   payload.resize( recv_len );
 }
@@ -142,13 +151,45 @@ void DatagramSocket::sendto( const Address& destination, const string_view paylo
 {
   CheckSystemCall(
     "sendto", ::sendto( fd_num(), payload.data(), payload.length(), 0, destination.raw(), destination.size() ) );
-  register_write();
+  register_write( payload.length() );
 }
 
 void DatagramSocket::send( const string_view payload )
 {
   CheckSystemCall( "send", ::send( fd_num(), payload.data(), payload.length(), 0 ) );
-  register_write();
+  register_write( payload.length() );
+}
+
+size_t DatagramSocket::send_batch( const span<mmsghdr> msgs )
+{
+  if ( msgs.empty() ) {
+    return 0;
+  }
+
+  const int sent = ::sendmmsg( fd_num(), msgs.data(), msgs.size(), 0 );
+  if ( sent < 0 and ( errno == EAGAIN or errno == EWOULDBLOCK ) ) {
+    return 0;
+  }
+  CheckSystemCall( "sendmmsg", sent );
+
+  size_t bytes = 0;
+  for ( int i = 0; i < sent; ++i ) {
+    bytes += msgs[i].msg_len;
+  }
+  register_write( bytes );
+  return sent;
+}
+
+bool UDPSocket::enable_gro()
+{
+  const int on = 1;
+  if ( ::setsockopt( fd_num(), IPPROTO_UDP, UDP_GRO, &on, sizeof( on ) ) == 0 ) {
+    return true;
+  }
+  if ( errno == ENOPROTOOPT ) {
+    return false;
+  }
+  throw unix_error { "setsockopt(UDP_GRO)" };
 }
 
 // mark the socket as listening for incoming connections
@@ -213,9 +254,271 @@ void Socket::throw_if_error() const
   }
 }
 
+bool Socket::enable_zerocopy()
+{
+  try {
+    setsockopt( SOL_SOCKET, SO_ZEROCOPY, int { true } );
+  } catch ( const unix_error& e ) {
+    if ( e.code().value() == ENOPROTOOPT or e.code().value() == EOPNOTSUPP ) {
+      return false;
+    }
+    throw;
+  }
+  return true;
+}
+
+//! \details The kernel numbers each zero-copy send that succeeds, from 0, and reports completions as ranges of
+//! those numbers; counting the sends is enough to know how many are still pending.
+size_t Socket::write_zerocopy( const string_view buffer )
+{
+  const ssize_t bytes_sent = ::send( fd_num(), buffer.data(), buffer.size(), MSG_ZEROCOPY );
+  if ( bytes_sent < 0 ) {
+    // (ENOBUFS: the socket's option memory is taken by notifications not yet read)
+    if ( errno == EAGAIN or errno == ENOBUFS ) {
+      return 0;
+    }
+    throw unix_error( "send" );
+  }
+
+  ++_zerocopy.sent;
+  register_write( bytes_sent );
+  return bytes_sent;
+}
+
+void Socket::reap_zerocopy()
+{
+  while ( true ) {
+    array<char, CMSG_SPACE( sizeof( sock_extended_err ) + sizeof( sockaddr_in6 ) )> control {};
+    msghdr message {};
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+    if ( ::recvmsg( fd_num(), &message, MSG_ERRQUEUE ) < 0 ) {
+      if ( errno == EAGAIN ) {
+        return; // (the error queue is empty)
+      }
+      throw unix_error( "recvmsg" );
+    }
+
+    for ( cmsghdr* cmsg = CMSG_FIRSTHDR( &message ); cmsg; cmsg = CMSG_NXTHDR( &message, cmsg ) ) {
+      const bool is_error = ( cmsg->cmsg_level == SOL_IP and cmsg->cmsg_type == IP_RECVERR )
+                            or ( cmsg->cmsg_level == SOL_IPV6 and cmsg->cmsg_type == IPV6_RECVERR );
+      sock_extended_err error {};
+      if ( is_error ) {
+        memcpy( &error, CMSG_DATA( cmsg ), sizeof( error ) );
+      }
+      if ( not is_error or error.ee_errno != 0 or error.ee_origin != SO_EE_ORIGIN_ZEROCOPY ) {
+        continue;
+      }
+      // sends ee_info through ee_data have completed (numbered mod 2^32)
+      const uint32_t completed = error.ee_data - error.ee_info + 1;
+      _zerocopy.completed += completed;
+      if ( error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED ) {
+        _zerocopy.copied += completed;
+      }
+    }
+  }
+}
+
+//! The rings shared with the kernel: `rx_blocks` receive blocks, then the transmit slots, in one mapping
+struct PacketSocket::Rings
+{
+  PacketRingGeometry geometry;
+  char* memory {};
+  size_t size {};
+
+  size_t next_block {};          //!< the receive block the kernel will hand over next
+  tpacket_block_desc* held {};   //!< the receive block whose frames were last returned
+  vector<string_view> frames {}; //!< (views into `held`)
+
+  size_t tx_slots {};
+  size_t next_slot {}; //!< the transmit slot to fill next
+
+  Rings( const PacketRingGeometry& g, char* m, size_t s ) : geometry( g ), memory( m ), size( s ) {}
+  ~Rings() { ::munmap( memory, size ); }
+  Rings( const Rings& ) = delete;
+  Rings& operator=( const Rings& ) = delete;
+
+  tpacket_block_desc* rx_block( size_t i ) const
+  {
+    return reinterpret_cast<tpacket_block_desc*>( memory + i * geometry.block_size ); // NOLINT(*-reinterpret-cast)
+  }
+
+  char* tx_slot( size_t i ) const
+  {
+    return memory + geometry.rx_blocks * geometry.block_size + i * geometry.tx_frame_size;
+  }
+};
+
+namespace {
+
+// the block and slot statuses are written by the kernel and by us, in turn
+uint32_t load_status( uint32_t& status )
+{
+  return atomic_ref<uint32_t> { status }.load( memory_order_acquire );
+}
+
+void store_status( uint32_t& status, const uint32_t value )
+{
+  atomic_ref<uint32_t> { status }.store( value, memory_order_release );
+}
+
+// where a frame starts in a transmit slot (the kernel's default, for TPACKET_V3)
+constexpr size_t TX_DATA_OFFSET = TPACKET3_HDRLEN - sizeof( sockaddr_ll );
+
+} // namespace
+
+PacketSocket::PacketSocket( const int type, const int protocol )
+  : DatagramSocket( AF_PACKET, type, protocol ), _rings()
+{}
+
+PacketSocket::~PacketSocket() = default;
+PacketSocket::PacketSocket( PacketSocket&& other ) noexcept = default;
+PacketSocket& PacketSocket::operator=( PacketSocket&& other ) noexcept = default;
+
 void PacketSocket::set_promiscuous()
 {
   setsockopt( SOL_PACKET,
               PACKET_ADD_MEMBERSHIP,
               packet_mreq { local_address().as<sockaddr_ll>()->sll_ifindex, PACKET_MR_PROMISC, {}, {} } );
 }
+
+void PacketSocket::set_ignore_outgoing()
+{
+  setsockopt( SOL_PACKET, PACKET_IGNORE_OUTGOING, int { 1 } );
+}
+
+void PacketSocket::bind_to_interface( const string& name )
+{
+  int protocol {};
+  getsockopt( SOL_SOCKET, SO_PROTOCOL, protocol );
+
+  sockaddr_ll address {};
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = static_cast<uint16_t>( protocol ); // (already in network byte order)
+  address.sll_ifindex = static_cast<int>( ::if_nametoindex( name.c_str() ) );
+  if ( address.sll_ifindex == 0 ) {
+    throw unix_error( "if_nametoindex " + name );
+  }
+  bind( Address { reinterpret_cast<const sockaddr*>( &address ), sizeof( address ) } ); // NOLINT(*-reinterpret-*)
+}
+
+//! \details The receive ring is TPACKET_V3: the kernel packs frames back to back into a block, and hands the
+//! block over when it is full or `retire_timeout_ms` after its first frame. The transmit ring (TPACKET_V3 too)
+//! has fixed-size slots.
+void PacketSocket::map_rings( const PacketRingGeometry& geometry )
+{
+  if ( _rings ) {
+    throw runtime_error( "PacketSocket: rings already mapped" );
+  }
+  if ( geometry.block_size % static_cast<size_t>( ::sysconf( _SC_PAGESIZE ) ) or geometry.rx_blocks == 0
+       or geometry.tx_frame_size < TX_DATA_OFFSET or geometry.block_size % geometry.tx_frame_size ) {
+    throw runtime_error( "PacketSocket: invalid ring geometry" );
+  }
+
+  setsockopt( SOL_PACKET, PACKET_VERSION, int { TPACKET_V3 } );
+
+  tpacket_req3 rx {};
+  rx.tp_block_size = geometry.block_size;
+  rx.tp_block_nr = geometry.rx_blocks;
+  rx.tp_frame_size = TPACKET_ALIGNMENT << 7; // (only a hint for TPACKET_V3, which packs frames)
+  rx.tp_frame_nr = geometry.block_size / rx.tp_frame_size * geometry.rx_blocks;
+  rx.tp_retire_blk_tov = geometry.retire_timeout_ms;
+  setsockopt( SOL_PACKET, PACKET_RX_RING, rx );
+
+  const size_t tx_slots = geometry.block_size / geometry.tx_frame_size * geometry.tx_blocks;
+  if ( geometry.tx_blocks ) {
+    tpacket_req3 tx {};
+    tx.tp_block_size = geometry.block_size;
+    tx.tp_block_nr = geometry.tx_blocks;
+    tx.tp_frame_size = geometry.tx_frame_size;
+    tx.tp_frame_nr = tx_slots;
+    setsockopt( SOL_PACKET, PACKET_TX_RING, tx );
+  }
+
+  const size_t size = geometry.block_size * ( geometry.rx_blocks + geometry.tx_blocks );
+  void* const memory = ::mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd_num(), 0 );
+  if ( memory == MAP_FAILED ) {
+    throw unix_error( "mmap" );
+  }
+  _rings = make_unique<Rings>( geometry, static_cast<char*>( memory ), size );
+  _rings->tx_slots = tx_slots;
+}
+
+span<const string_view> PacketSocket::next_rx_block()
+{
+  if ( not _rings ) {
+    throw runtime_error( "PacketSocket: next_rx_block() without rings" );
+  }
+  Rings& rings = *_rings;
+
+  // the frames last returned are done with: their whole block goes back to the kernel
+  rings.frames.clear();
+  if ( rings.held ) {
+    store_status( rings.held->hdr.bh1.block_status, TP_STATUS_KERNEL );
+    rings.held = nullptr;
+  }
+
+  tpacket_block_desc* const block = rings.rx_block( rings.next_block );
+  if ( not( load_status( block->hdr.bh1.block_status ) & TP_STATUS_USER ) ) {
+    return {};
+  }
+
+  const char* const base = reinterpret_cast<const char*>( block ); // NOLINT(*-reinterpret-cast)
+  size_t offset = block->hdr.bh1.offset_to_first_pkt;
+  size_t bytes = 0;
+  for ( uint32_t i = 0; i < block->hdr.bh1.num_pkts; ++i ) {
+    const auto* frame = reinterpret_cast<const tpacket3_hdr*>( base + offset ); // NOLINT(*-reinterpret-cast)
+    rings.frames.emplace_back( base + offset + frame->tp_mac, frame->tp_snaplen );
+    bytes += frame->tp_snaplen;
+    offset += frame->tp_next_offset;
+  }
+
+  rings.held = block;
+  rings.next_block = ( rings.next_block + 1 ) % rings.geometry.rx_blocks;
+  register_read( bytes );
+  return rings.frames;
+}
+
+bool PacketSocket::queue_tx( const string_view frame )
+{
+  if ( not _rings or _rings->tx_slots == 0 ) {
+    throw runtime_error( "PacketSocket: queue_tx() without a transmit ring" );
+  }
+  Rings& rings = *_rings;
+  if ( frame.size() > rings.geometry.tx_frame_size - TX_DATA_OFFSET ) {
+    throw runtime_error( "PacketSocket: frame too large for the transmit ring" );
+  }
+
+  char* const slot = rings.tx_slot( rings.next_slot );
+  auto* const header = reinterpret_cast<tpacket3_hdr*>( slot ); // NOLINT(*-reinterpret-cast)
+  const uint32_t status = load_status( header->tp_status );
+  if ( status == TP_STATUS_WRONG_FORMAT ) {
+    throw runtime_error( "PacketSocket: the kernel rejected a frame in the transmit ring" );
+  }
+  if ( status != TP_STATUS_AVAILABLE ) {
+    return false; // (still waiting to be sent)
+  }
+
+  memcpy( slot + TX_DATA_OFFSET, frame.data(), frame.size() );
+  header->tp_len = frame.size();
+  header->tp_next_offset = 0;
+  store_status( header->tp_status, TP_STATUS_SEND_REQUEST );
+  rings.next_slot = ( rings.next_slot + 1 ) % rings.tx_slots;
+  return true;
+}
+
+void PacketSocket::flush_tx()
+{
+  if ( not _rings or _rings->tx_slots == 0 ) {
+    throw runtime_error( "PacketSocket: flush_tx() without a transmit ring" );
+  }
+  const ssize_t bytes_sent = CheckSystemCall( "send", ::send( fd_num(), nullptr, 0, 0 ) );
+  register_write( bytes_sent );
+}
+
+uint64_t PacketSocket::take_drops()
+{
+  tpacket_stats_v3 stats {};
+  getsockopt( SOL_PACKET, PACKET_STATISTICS, stats ); // (reading the counters resets them)
+  return stats.tp_drops;
+}
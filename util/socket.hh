@@ -3,8 +3,13 @@
 #include "address.hh"
 #include "file_descriptor.hh"
 
+#include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
 #include <sys/socket.h>
 
 //! \brief Base class for network sockets (TCP, UDP, etc.)
@@ -56,6 +61,33 @@ public:
 
   //! Check for errors (will be seen on non-blocking sockets)
   void throw_if_error() const;
+
+  //! Ask for [MSG_ZEROCOPY](https://docs.kernel.org/networking/msg_zerocopy.html) sends (TCP and UDP sockets)
+  //! \returns false if the kernel (or the socket) does not have them
+  bool enable_zerocopy();
+
+  //! Send `buffer` without copying it into the kernel, which reads it in place until the send completes: the
+  //! caller must leave it unchanged until reap_zerocopy() has counted the completion
+  //! \returns the number of bytes sent (0 if the socket is full, or too many sends are waiting to complete)
+  size_t write_zerocopy( std::string_view buffer );
+
+  //! Read the completions of zero-copy sends from the socket's error queue (see FileDescriptor::error_queue)
+  void reap_zerocopy();
+
+  //! Zero-copy sends that have not yet completed
+  uint64_t zerocopy_pending() const { return _zerocopy.sent - _zerocopy.completed; }
+
+  //! Zero-copy sends that completed with the kernel copying the buffer after all (as it does over loopback)
+  uint64_t zerocopy_copied() const { return _zerocopy.copied; }
+
+private:
+  struct ZeroCopyCounts
+  {
+    uint64_t sent {};
+    uint64_t completed {};
+    uint64_t copied {};
+  };
+  ZeroCopyCounts _zerocopy {};
 };
 
 class DatagramSocket : public Socket
@@ -71,6 +103,10 @@ public:
 
   //! Send datagram to the socket's connected address (must call connect() first)
   void send( std::string_view payload );
+
+  //! Send one datagram per entry of `msgs` with one [sendmmsg(2)](\ref man2::sendmmsg)
+  //! \returns the number of datagrams sent (fewer than `msgs.size()` if a non-blocking socket's buffer filled)
+  size_t send_batch( std::span<mmsghdr> msgs );
 };
 
 //! A wrapper around [UDP sockets](\ref man7::udp)
@@ -82,6 +118,10 @@ class UDPSocket : public DatagramSocket
 public:
   //! Default: construct an unbound, unconnected UDP socket
   UDPSocket() : DatagramSocket( AF_INET, SOCK_DGRAM ) {}
+
+  //! Let the kernel coalesce datagrams received from one sender into one read ([UDP_GRO](\ref man7::udp))
+  //! \returns false if the kernel does not support it
+  bool enable_gro();
 };
 
 //! A wrapper around [TCP sockets](\ref man7::tcp)
@@ -103,13 +143,57 @@ public:
   TCPSocket accept();
 };
 
+//! Sizes of the rings that PacketSocket::map_rings() shares with the kernel
+struct PacketRingGeometry
+{
+  size_t block_size = 1 << 20;    //!< bytes per block (a multiple of the page size)
+  size_t rx_blocks = 16;          //!< blocks in the receive ring
+  size_t tx_blocks = 1;           //!< blocks in the transmit ring (0: none)
+  size_t tx_frame_size = 2048;    //!< bytes per transmit slot, header included
+  unsigned retire_timeout_ms = 1; //!< how long the kernel may hold a partly filled receive block
+};
+
 //! A wrapper around [packet sockets](\ref man7:packet)
+//! \details Frames may be received one per system call (recv(), or FileDescriptor::read), or, once map_rings()
+//! has set up [PACKET_MMAP](https://docs.kernel.org/networking/packet_mmap.html) rings, straight out of memory
+//! shared with the kernel: it fills TPACKET_V3 receive blocks with many frames each and hands each block over
+//! whole, and it sends every frame queued in the transmit ring with one system call.
 class PacketSocket : public DatagramSocket
 {
 public:
-  PacketSocket( const int type, const int protocol ) : DatagramSocket( AF_PACKET, type, protocol ) {}
+  PacketSocket( int type, int protocol );
+  ~PacketSocket();
+  PacketSocket( PacketSocket&& other ) noexcept;
+  PacketSocket& operator=( PacketSocket&& other ) noexcept;
 
   void set_promiscuous();
+
+  //! Receive only the frames arriving on the interface, not (a copy of) those leaving it
+  void set_ignore_outgoing();
+
+  //! Bind to one network interface, by name (the transmit ring sends through it)
+  void bind_to_interface( const std::string& name );
+
+  //! Map receive and transmit rings into memory (before or after binding)
+  void map_rings( const PacketRingGeometry& geometry );
+
+  //! \returns the frames of the next receive block that the kernel has handed over (none if it has not yet),
+  //! as views into the ring. They stay valid until the next call, which hands the block back to the kernel.
+  std::span<const std::string_view> next_rx_block();
+
+  //! Copy a frame into the transmit ring, to be sent by flush_tx()
+  //! \returns false if the ring is full (flush_tx() empties it)
+  bool queue_tx( std::string_view frame );
+
+  //! Send the frames queued in the transmit ring, with one system call (which waits until they are sent)
+  void flush_tx();
+
+  //! \returns how many frames the kernel has dropped for want of room, since the last call
+  uint64_t take_drops();
+
+private:
+  struct Rings;
+  std::unique_ptr<Rings> _rings;
 };
 
 //! A wrapper around [Unix-domain stream sockets](\ref man7::unix)
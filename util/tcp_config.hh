@@ -15,11 +15,14 @@ public:
   static constexpr size_t MAX_PAYLOAD_SIZE = 1000;  //!< Conservative max payload size for real Internet
   static constexpr uint16_t TIMEOUT_DFLT = 1000;    //!< Default re-transmit timeout is 1 second
   static constexpr unsigned MAX_RETX_ATTEMPTS = 8;  //!< Maximum re-transmit attempts before giving up
+  static constexpr size_t GSO_MAX_SIZE = 65535;     //!< Largest super-segment payload when GSO is enabled
 
   uint16_t rt_timeout = TIMEOUT_DFLT;      //!< Initial value of the retransmission timeout, in milliseconds
   size_t recv_capacity = DEFAULT_CAPACITY; //!< Receive capacity, in bytes
   size_t send_capacity = DEFAULT_CAPACITY; //!< Sender capacity, in bytes
   Wrap32 isn { 137 };                      //!< Default initial sequence number
+  bool gso = false;                        //!< Send super-segments of up to GSO_MAX_SIZE bytes (adapter splits)
+  size_t mss = MAX_PAYLOAD_SIZE;           //!< Largest payload per wire segment (a lost one is resent alone)
 };
 
 //! Config for classes derived from FdAdapter
@@ -29,6 +32,8 @@ public:
   Address source { "0", 0 };      //!< Source address and port
   Address destination { "0", 0 }; //!< Destination address and port
 
+  size_t mss = TCPConfig::MAX_PAYLOAD_SIZE; //!< Largest TCP payload per wire segment (super-segments are split)
+
   uint16_t loss_rate_dn = 0; //!< Downlink loss rate (for LossyFdAdapter)
   uint16_t loss_rate_up = 0; //!< Uplink loss rate (for LossyFdAdapter)
 };
@@ -5,6 +5,7 @@
 #include "file_descriptor.hh"
 #include "socket.hh"
 #include "tcp_config.hh"
+#include "tcp_over_udp.hh"
 #include "tcp_peer.hh"
 #include "tuntap_adapter.hh"
 
@@ -73,11 +74,14 @@ private:
   std::optional<TCPPeer> _tcp {};
 
   //! eventloop that handles all the events (new inbound datagram, new outbound bytes, new inbound bytes)
-  EventLoop _eventloop {};
+  EventLoop _eventloop { EventLoop::Backend::IoUring };
 
   //! Process events while specified condition is true
   void _tcp_loop( const std::function<bool()>& condition );
 
+  //! Timeout for the event loop: until the TCPPeer's next deadline
+  int _ms_until_deadline( uint64_t last_tick_ms ) const;
+
   //! Main loop of TCPPeer thread
   void _tcp_main();
 
@@ -98,6 +102,8 @@ private:
 
 using TCPOverIPv4MinnowSocket = TCPMinnowSocket<TCPOverIPv4OverTunFdAdapter>;
 using LossyTCPOverIPv4MinnowSocket = TCPMinnowSocket<LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>>;
+using TCPOverUDPMinnowSocket = TCPMinnowSocket<TCPOverUDPSocketAdapter>;
+using LossyTCPOverUDPMinnowSocket = TCPMinnowSocket<LossyFdAdapter<TCPOverUDPSocketAdapter>>;
 
 //! \class TCPMinnowSocket
 //! This class involves the simultaneous operation of two threads.
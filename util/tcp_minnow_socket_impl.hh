@@ -4,9 +4,11 @@
 #include "parser.hh"
 #include "tun.hh"
 
+#include <algorithm>
 #include <cstddef>
 #include <exception>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 #include <string>
 #include <sys/socket.h>
@@ -15,8 +17,6 @@
 #include <unistd.h>
 #include <utility>
 
-static constexpr size_t TCP_TICK_MS = 10;
-
 inline uint64_t timestamp_ms()
 {
   static_assert( std::is_same<std::chrono::steady_clock::duration, std::chrono::nanoseconds>::value );
@@ -24,13 +24,43 @@ inline uint64_t timestamp_ms()
   return std::chrono::steady_clock::now().time_since_epoch().count() / 1000000;
 }
 
+//! \param[in] last_tick_ms is when the TCPPeer was last ticked
+//! \returns how long the event loop may sleep before the TCPPeer next needs a tick (-1: until I/O arrives)
+template<TCPDatagramAdapter AdaptT>
+int TCPMinnowSocket<AdaptT>::_ms_until_deadline( uint64_t last_tick_ms ) const
+{
+  if ( not _tcp.has_value() or not _tcp->active() ) {
+    return -1;
+  }
+
+  const auto deadline = _tcp->next_deadline();
+  if ( not deadline.has_value() ) {
+    return -1;
+  }
+
+  const uint64_t elapsed = timestamp_ms() - last_tick_ms;
+  const uint64_t remaining = deadline.value() > elapsed ? deadline.value() - elapsed : 0;
+  return static_cast<int>( std::min<uint64_t>( remaining, std::numeric_limits<int>::max() ) );
+}
+
 //! \param[in] condition is a function returning true if loop should continue
+//! \details Instead of waking up on a fixed period, the loop sleeps until I/O arrives or until the TCPPeer's
+//! next deadline (retransmission timeout or end of linger), so an idle connection costs no wakeups and timers
+//! fire to the millisecond.
 template<TCPDatagramAdapter AdaptT>
 void TCPMinnowSocket<AdaptT>::_tcp_loop( const std::function<bool()>& condition )
 {
+  // an adapter that queues datagrams (to write them in batches) sends them before the loop sleeps or returns
+  const auto flush = [&] {
+    if constexpr ( requires { _datagram_adapter.flush(); } ) {
+      _datagram_adapter.flush();
+    }
+  };
+
   auto base_time = timestamp_ms();
   while ( condition() ) {
-    auto ret = _eventloop.wait_next_event( TCP_TICK_MS );
+    flush();
+    auto ret = _eventloop.wait_next_event( _ms_until_deadline( base_time ) );
     if ( ret == EventLoop::Result::Exit or _abort ) {
       break;
     }
@@ -46,6 +76,7 @@ void TCPMinnowSocket<AdaptT>::_tcp_loop( const std::function<bool()>& condition
       base_time = next_time;
     }
   }
+  flush();
 }
 
 //! \param[in] data_socket_pair is a pair of connected AF_UNIX SOCK_STREAM sockets
@@ -81,23 +112,58 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
   //    to the local stream socket back to the application)
 
   // rule 1: read from filtered packet stream and dump into TCPConnection
-  _eventloop.add_rule(
-    "receive TCP segment from the network",
-    _datagram_adapter.fd(),
-    Direction::In,
-    [&] {
-      if ( auto seg = _datagram_adapter.read() ) {
-        _tcp->receive( std::move( seg.value() ), [&]( auto x ) { _datagram_adapter.write( x ); } );
-      }
+  const auto report_fully_acked = [&] {
+    // debugging output:
+    if ( _thread_data.eof() and _tcp.value().sender().sequence_numbers_in_flight() == 0 and not _fully_acked ) {
+      std::cerr << "DEBUG: minnow outbound stream to " << _datagram_adapter.config().destination.to_string()
+                << " has been fully acknowledged.\n";
+      _fully_acked = true;
+    }
+  };
 
-      // debugging output:
-      if ( _thread_data.eof() and _tcp.value().sender().sequence_numbers_in_flight() == 0 and not _fully_acked ) {
-        std::cerr << "DEBUG: minnow outbound stream to " << _datagram_adapter.config().destination.to_string()
-                  << " has been fully acknowledged.\n";
-        _fully_acked = true;
-      }
-    },
-    [&] { return _tcp->active(); } );
+  // the event loop reads each burst of datagrams (with io_uring, ahead of time and without a system call each),
+  // into buffers that fit the largest datagram the adapter can be handed (offloaded ones too)
+  constexpr bool can_unwrap = requires( std::string_view datagram ) { _datagram_adapter.unwrap( datagram ); };
+
+  if constexpr ( can_unwrap ) {
+    size_t buffer_size = EventLoop::DEFAULT_DATAGRAM_BUFFER_SIZE;
+    if constexpr ( requires { _datagram_adapter.datagram_buffer_size(); } ) {
+      buffer_size = _datagram_adapter.datagram_buffer_size();
+    }
+    _eventloop.add_datagram_rule(
+      "receive TCP segments from the network",
+      _datagram_adapter.fd(),
+      [&, report_fully_acked]( const std::vector<std::string_view>& datagrams ) {
+        std::vector<TCPMessage> msgs;
+        for ( const auto datagram : datagrams ) {
+          if ( auto msg = _datagram_adapter.unwrap( datagram ) ) {
+            msgs.push_back( std::move( msg.value() ) );
+          }
+        }
+        _tcp->receive_batch( std::move( msgs ), [&]( auto x ) { _datagram_adapter.write( x ); } );
+        report_fully_acked();
+      },
+      [&] { return _tcp->active(); },
+      [] {},
+      [] {},
+      buffer_size );
+  } else {
+    _eventloop.add_rule(
+      "receive TCP segment from the network",
+      _datagram_adapter.fd(),
+      Direction::In,
+      [&, report_fully_acked] {
+        if constexpr ( requires { _datagram_adapter.read_batch(); } ) {
+          // hand the whole burst to TCPPeer so in-sequence segments are coalesced before reassembly
+          _tcp->receive_batch( _datagram_adapter.read_batch(),
+                               [&]( auto x ) { _datagram_adapter.write( x ); } );
+        } else if ( auto seg = _datagram_adapter.read() ) {
+          _tcp->receive( std::move( seg.value() ), [&]( auto x ) { _datagram_adapter.write( x ); } );
+        }
+        report_fully_acked();
+      },
+      [&] { return _tcp->active(); } );
+  }
 
   // rule 2: read from pipe into outbound buffer
   _eventloop.add_rule(
@@ -197,8 +263,9 @@ TCPMinnowSocket<AdaptT>::~TCPMinnowSocket()
   try {
     if ( _tcp_thread.joinable() ) {
       std::cerr << "Warning: unclean shutdown of TCPMinnowSocket\n";
-      // force the other side to exit
+      // force the other side to exit (the hangup wakes it up if it is waiting with no deadline)
       _abort.store( true );
+      ::shutdown( fd_num(), SHUT_RDWR );
       _tcp_thread.join();
     }
   } catch ( const std::exception& e ) {
@@ -226,7 +293,9 @@ void TCPMinnowSocket<AdaptT>::connect( const TCPConfig& c_tcp, const FdAdapterCo
     throw std::runtime_error( "connect() with TCPConnection already initialized" );
   }
 
-  _initialize_TCP( c_tcp );
+  TCPConfig cfg = c_tcp;
+  cfg.mss = c_ad.mss; // the adapter splits super-segments at this size, so retransmit in slices of it
+  _initialize_TCP( cfg );
 
   _datagram_adapter.config_mut() = c_ad;
 
@@ -261,7 +330,9 @@ void TCPMinnowSocket<AdaptT>::listen_and_accept( const TCPConfig& c_tcp, const F
     throw std::runtime_error( "listen_and_accept() with TCPConnection already initialized" );
   }
 
-  _initialize_TCP( c_tcp );
+  TCPConfig cfg = c_tcp;
+  cfg.mss = c_ad.mss; // the adapter splits super-segments at this size, so retransmit in slices of it
+  _initialize_TCP( cfg );
 
   _datagram_adapter.config_mut() = c_ad;
   _datagram_adapter.set_listening( true );
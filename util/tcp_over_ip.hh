@@ -4,13 +4,66 @@
 #include "ipv4_datagram.hh"
 #include "tcp_segment.hh"
 
+#include <array>
 #include <optional>
+#include <string_view>
+#include <vector>
 
 //! \brief A converter from TCP segments to serialized IPv4 datagrams
 class TCPOverIPv4Adapter : public FdAdapterBase
 {
 public:
-  std::optional<TCPMessage> unwrap_tcp_in_ip( const InternetDatagram& ip_dgram );
+  //! Length of the IPv4 and TCP headers written in front of each payload (no options)
+  static constexpr size_t HEADERS_LENGTH = IPv4Header::LENGTH + 20;
+
+  //! Serialized IPv4 + TCP headers of one outbound datagram
+  using Headers = std::array<char, HEADERS_LENGTH>;
+
+  //! \param[in] verify_checksum is false if the kernel has verified the TCP checksum, or left it to compute
+  std::optional<TCPMessage> unwrap_tcp_in_ip( const InternetDatagram& ip_dgram, bool verify_checksum = true );
 
   InternetDatagram wrap_tcp_in_ip( const TCPMessage& msg );
+
+  //! Fills `out` with the IPv4 + TCP headers that, followed by `msg.sender.payload`, form the same datagram as
+  //! serialize( wrap_tcp_in_ip( msg ) ), stamped from the cached per-connection header template
+  void stamp_tcp_in_ip( const TCPMessage& msg, Headers& out );
+
+  //! One wire segment produced by software segmentation: serialized IPv4 + TCP headers, and a view of the
+  //! slice of the original payload that follows them
+  struct WireSegment
+  {
+    Headers headers {};
+    std::string_view payload {};
+  };
+
+  //! Splits a TCP message (possibly a super-segment larger than `mss`) into wire segments of at most `mss`
+  //! payload bytes each (software GSO). The returned payload views refer to `msg`.
+  //! \param[in] partial_checksum leaves the TCP checksum to the kernel: the checksum field holds only the
+  //! pseudo-header sum, as checksum offload (CHECKSUM_PARTIAL) expects
+  std::vector<WireSegment> segment_tcp_in_ip( const TCPMessage& msg, size_t mss, bool partial_checksum = false );
+
+private:
+  //! Serialized headers with every per-datagram field zeroed, plus checksum sums over the constant fields
+  struct HeaderTemplate
+  {
+    Headers bytes {};
+    uint32_t ip_partial_sum {};     //!< IPv4 header sum, without total length
+    uint32_t tcp_partial_sum {};    //!< pseudo-header (addresses, protocol) and constant TCP fields
+    uint32_t pseudo_partial_sum {}; //!< pseudo-header alone (addresses, protocol)
+    std::optional<uint64_t> config_generation {};
+  };
+
+  HeaderTemplate _header_template {};
+
+  //! Returns the header template, rebuilding it if the adapter's configuration changed since it was built
+  const HeaderTemplate& header_template();
+
+  //! Stamps one datagram's headers from the template
+  void stamp_headers( const TCPMessage& msg,
+                      std::string_view payload,
+                      Wrap32 seqno,
+                      bool syn,
+                      bool fin,
+                      Headers& out,
+                      bool partial_checksum = false );
 };
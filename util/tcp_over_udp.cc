@@ -0,0 +1,263 @@
+#include "tcp_over_udp.hh"
+
+#include "checksum.hh"
+#include "parser.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <netinet/udp.h>
+#include <span>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+// the largest UDP payload, and the most datagrams one GSO send may be split into
+constexpr size_t MAX_UDP_PAYLOAD = 65507;
+constexpr size_t MAX_GSO_SEGMENTS = 64;
+
+// room for one control message: a UDP_SEGMENT size (uint16_t) to send, or a UDP_GRO size (int) received
+constexpr size_t CONTROL_SPACE = CMSG_SPACE( sizeof( int ) );
+
+// where the checksum is in a TCP header
+constexpr size_t TCP_CHECKSUM_OFFSET = 16;
+
+uint16_t port_of( const Address& address )
+{
+  return ntohs( address.as<sockaddr_in>()->sin_port );
+}
+
+} // namespace
+
+TCPOverUDPSocketAdapter::TCPOverUDPSocketAdapter( UDPSocket&& socket, const bool offload )
+  : socket_( move( socket ) )
+  , senders_( BATCH_SIZE )
+  , control_( BATCH_SIZE * CONTROL_SPACE )
+  , messages_( BATCH_SIZE )
+  , iovecs_( BATCH_SIZE )
+{
+  // (a kernel with UDP GRO also has UDP GSO, which needs no setup)
+  offload_ = offload and socket_.enable_gro();
+}
+
+size_t TCPOverUDPSocketAdapter::receive_buffer_size() const
+{
+  return offload_ ? MAX_UDP_PAYLOAD : max<size_t>( 2048, TCP_HEADER_LENGTH + config().mss );
+}
+
+optional<TCPMessage> TCPOverUDPSocketAdapter::read()
+{
+  if ( pending_.empty() ) {
+    pending_ = read_batch( 1 );
+    reverse( pending_.begin(), pending_.end() );
+  }
+  if ( pending_.empty() ) {
+    return {};
+  }
+  TCPMessage msg = move( pending_.back() );
+  pending_.pop_back();
+  return msg;
+}
+
+vector<TCPMessage> TCPOverUDPSocketAdapter::read_batch( const size_t max_datagrams )
+{
+  vector<TCPMessage> ret;
+  if ( not pending_.empty() ) {
+    ret.assign( make_move_iterator( pending_.rbegin() ), make_move_iterator( pending_.rend() ) );
+    pending_.clear();
+  }
+
+  const size_t count = min( max_datagrams, BATCH_SIZE );
+  const size_t buffer_size = receive_buffer_size();
+  if ( buffers_.buffer_size() != buffer_size ) {
+    buffers_ = BufferPool { buffer_size, BATCH_SIZE };
+    inbound_.clear();
+  }
+  inbound_.resize( BATCH_SIZE );
+
+  for ( size_t i = 0; i < count; ++i ) {
+    PooledBuffer& buffer = inbound_[i];
+    if ( buffer.empty() ) {
+      buffer = buffers_.get();
+    }
+    iovecs_[i] = { buffer.data(), buffer.size() };
+    messages_[i] = {};
+    msghdr& header = messages_[i].msg_hdr;
+    header.msg_name = &senders_[i];
+    header.msg_namelen = sizeof( sockaddr_storage );
+    header.msg_iov = &iovecs_[i];
+    header.msg_iovlen = 1;
+    if ( offload_ ) {
+      header.msg_control = control_.data() + i * CONTROL_SPACE;
+      header.msg_controllen = CONTROL_SPACE;
+    }
+  }
+
+  ++syscalls_;
+  const size_t received = socket_.recv_batch( span { messages_.data(), count } );
+
+  for ( size_t i = 0; i < received; ++i ) {
+    msghdr& header = messages_[i].msg_hdr;
+    if ( header.msg_flags & MSG_TRUNC ) {
+      continue;
+    }
+    inbound_[i].resize( messages_[i].msg_len );
+    const SharedBuffer data { move( inbound_[i] ) };
+
+    // datagrams the kernel coalesced (all of one size, but the last) come with that size
+    size_t segment_size = data.size();
+    for ( cmsghdr* cmsg = CMSG_FIRSTHDR( &header ); cmsg; cmsg = CMSG_NXTHDR( &header, cmsg ) ) {
+      if ( cmsg->cmsg_level == SOL_UDP and cmsg->cmsg_type == UDP_GRO ) {
+        int gro_size {};
+        memcpy( &gro_size, CMSG_DATA( cmsg ), sizeof( gro_size ) );
+        segment_size = max( gro_size, 1 );
+      }
+    }
+
+    for ( size_t offset = 0; offset < data.size(); offset += segment_size ) {
+      if ( auto msg = unwrap( data.substr( offset, segment_size ), senders_[i] ) ) {
+        ret.push_back( move( msg.value() ) );
+      }
+    }
+  }
+
+  return ret;
+}
+
+optional<TCPMessage> TCPOverUDPSocketAdapter::unwrap( SharedBuffer datagram, const sockaddr_storage& sender )
+{
+  if ( sender.ss_family != AF_INET ) {
+    return {};
+  }
+  const sockaddr_in& from = reinterpret_cast<const sockaddr_in&>( sender ); // NOLINT(*-reinterpret-cast)
+
+  // is the datagram from our peer?
+  if ( not listening() ) {
+    const sockaddr_in& peer = *config().destination.as<sockaddr_in>();
+    if ( from.sin_addr.s_addr != peer.sin_addr.s_addr or from.sin_port != peer.sin_port ) {
+      return {};
+    }
+  }
+
+  // is the payload a valid TCP segment, for us?
+  TCPSegment tcp_seg;
+  if ( not parse( tcp_seg, vector<SharedBuffer> { move( datagram ) }, 0 ) ) {
+    return {};
+  }
+  const bool to_us = tcp_seg.udinfo.dst_port == port_of( config().source );
+  if ( not to_us or tcp_seg.udinfo.src_port != ntohs( from.sin_port ) ) {
+    return {};
+  }
+
+  // the first SYN names the peer of a listening adapter
+  if ( listening() ) {
+    if ( not tcp_seg.message.sender.SYN or tcp_seg.message.sender.RST ) {
+      return {};
+    }
+    config_mutable().destination = Address { reinterpret_cast<const sockaddr*>( &from ), sizeof( from ) }; // NOLINT
+    set_listening( false );
+  }
+
+  return move( tcp_seg.message );
+}
+
+void TCPOverUDPSocketAdapter::append_segment( const TCPMessage& msg, // NOLINT(*-easily-swappable-*)
+                                              const string_view payload,
+                                              const Wrap32 seqno,
+                                              const bool syn,
+                                              const bool fin )
+{
+  const TCPSegment segment {
+    .message = { .sender = { .seqno = seqno, .SYN = syn, .FIN = fin, .RST = msg.sender.RST },
+                 .receiver = msg.receiver },
+    .udinfo = { .src_port = port_of( config().source ), .dst_port = port_of( config().destination ), .cksum = 0 },
+  };
+
+  const size_t start = outbound_.size();
+  Serializer serializer { move( outbound_ ) };
+  segment.serialize_header( serializer );
+  outbound_ = serializer.release_buffer();
+  outbound_.append( payload );
+
+  // (the checksum covers the segment alone, and is filled in once the payload is in place behind the header)
+  InternetChecksum check;
+  check.add( string_view { outbound_ }.substr( start ) );
+  const uint16_t cksum = host_to_big_endian( check.value() );
+  memcpy( outbound_.data() + start + TCP_CHECKSUM_OFFSET, &cksum, sizeof( cksum ) );
+}
+
+//! \details A super-segment is split into MSS-sized segments as TCPOverIPv4Adapter::segment_tcp_in_ip would
+//! split it (SYN on the first, FIN on the last). With GSO, the segments follow each other in one send, all
+//! `TCP_HEADER_LENGTH + mss` long but the last, which is just how the kernel will split it.
+void TCPOverUDPSocketAdapter::write( const TCPMessage& seg )
+{
+  const size_t mss = config().mss;
+  const string_view payload = seg.sender.payload;
+  const size_t count = payload.empty() ? 1 : ( payload.size() + mss - 1 ) / mss;
+  const size_t per_send
+    = offload_ ? max<size_t>( 1, min( MAX_GSO_SEGMENTS, MAX_UDP_PAYLOAD / ( TCP_HEADER_LENGTH + mss ) ) ) : 1;
+
+  for ( size_t i = 0; i < count; ) {
+    const size_t group = min( per_send, count - i );
+    Send send { .offset = outbound_.size() };
+    for ( size_t j = i; j < i + group; ++j ) {
+      append_segment( seg,
+                      payload.substr( j * mss, mss ),
+                      seg.sender.seqno + ( j == 0 ? 0 : seg.sender.SYN + j * mss ),
+                      seg.sender.SYN and j == 0,
+                      seg.sender.FIN and j + 1 == count );
+    }
+    send.length = outbound_.size() - send.offset;
+    if ( group > 1 ) {
+      send.segment_size = static_cast<uint16_t>( TCP_HEADER_LENGTH + mss );
+    }
+    sends_.push_back( send );
+    i += group;
+
+    if ( sends_.size() == BATCH_SIZE ) {
+      flush();
+    }
+  }
+}
+
+void TCPOverUDPSocketAdapter::flush()
+{
+  auto* const destination = const_cast<sockaddr*>( config().destination.raw() ); // NOLINT(*-const-cast)
+
+  for ( size_t done = 0; done < sends_.size(); ) {
+    const size_t count = min( sends_.size() - done, BATCH_SIZE );
+    for ( size_t i = 0; i < count; ++i ) {
+      const Send& send = sends_[done + i];
+      iovecs_[i] = { outbound_.data() + send.offset, send.length };
+      messages_[i] = {};
+      msghdr& header = messages_[i].msg_hdr;
+      header.msg_name = destination;
+      header.msg_namelen = config().destination.size();
+      header.msg_iov = &iovecs_[i];
+      header.msg_iovlen = 1;
+      if ( send.segment_size ) {
+        header.msg_control = control_.data() + i * CONTROL_SPACE;
+        header.msg_controllen = CMSG_SPACE( sizeof( uint16_t ) );
+        cmsghdr* const cmsg = CMSG_FIRSTHDR( &header );
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN( sizeof( uint16_t ) );
+        memcpy( CMSG_DATA( cmsg ), &send.segment_size, sizeof( uint16_t ) );
+      }
+    }
+
+    ++syscalls_;
+    const size_t sent = socket_.send_batch( span { messages_.data(), count } );
+    if ( sent == 0 ) {
+      break; // (a non-blocking socket is full: drop the rest, as a congested network would)
+    }
+    done += sent;
+  }
+
+  outbound_.clear();
+  sends_.clear();
+}
+
+//! Specialize LossyFdAdapter to TCPOverUDPSocketAdapter
+template class LossyFdAdapter<TCPOverUDPSocketAdapter>;
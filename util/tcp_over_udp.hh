@@ -0,0 +1,103 @@
+#pragma once
+
+#include "buffer_pool.hh"
+#include "fd_adapter.hh"
+#include "lossy_fd_adapter.hh"
+#include "shared_buffer.hh"
+#include "socket.hh"
+#include "tcp_segment.hh"
+#include "tuntap_adapter.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <vector>
+
+//! \brief A FD adapter that carries each TCP segment (header and payload, no IP header) as the payload of one UDP
+//! datagram, so that minnow can run over an ordinary UDP socket (on loopback, say) without a TUN device
+//! \details Datagrams are read with [recvmmsg(2)](\ref man2::recvmmsg) and written with
+//! [sendmmsg(2)](\ref man2::sendmmsg), up to BATCH_SIZE per system call: write() queues a segment, and flush()
+//! (or a full queue) sends the queue. With `offload`, each super-segment goes to the kernel as one UDP GSO send
+//! (UDP_SEGMENT) that it splits into MSS-sized datagrams, and datagrams that the kernel coalesces on receipt
+//! (UDP_GRO) are split again here. Datagrams are read into buffers from a BufferPool, which the payloads of the
+//! segments parsed from them go on sharing (without a copy).
+//!
+//! The TCP checksum covers the segment alone (there is no IP pseudo-header), and the TCP ports are those of the
+//! UDP addresses in config(). The socket must already be bound to config().source. config().destination is the
+//! peer; while listening, the adapter takes the sender of the first SYN as its peer.
+class TCPOverUDPSocketAdapter : public FdAdapterBase
+{
+public:
+  //! Most datagrams read or written per system call
+  static constexpr size_t BATCH_SIZE = 64;
+
+  //! Length of the TCP header in front of each payload (no options)
+  static constexpr size_t TCP_HEADER_LENGTH = 20;
+
+  //! \param[in] socket is a UDP socket bound to the address that the adapter's config() will name as source
+  //! \param[in] offload asks for UDP GSO and GRO (quietly not used if the kernel does not support them)
+  explicit TCPOverUDPSocketAdapter( UDPSocket&& socket, bool offload = false );
+
+  //! Reads one datagram (without waiting for one) and parses the TCP segment it carries, if it is valid and from
+  //! the peer (with GRO, a datagram may carry several: the rest are returned by the next reads)
+  std::optional<TCPMessage> read();
+
+  //! Reads every datagram already queued on the socket (up to `max_datagrams`, in one system call), for
+  //! TCPPeer::receive_batch
+  std::vector<TCPMessage> read_batch( size_t max_datagrams = BATCH_SIZE );
+
+  //! Queues a TCP segment (split into MSS-sized segments if it is a super-segment) for the next flush()
+  void write( const TCPMessage& seg );
+
+  //! Sends the queued segments
+  void flush();
+
+  //! Access underlying file descriptor
+  FileDescriptor& fd() { return socket_; }
+
+  //! Are UDP GSO and GRO in use?
+  bool offload() const { return offload_; }
+
+  //! Number of system calls made to read and write datagrams
+  uint64_t syscalls() const { return syscalls_; }
+
+private:
+  //! One queued datagram, in `outbound_`; with GSO, several of them sent as one
+  struct Send
+  {
+    size_t offset {};
+    size_t length {};
+    uint16_t segment_size {}; //!< the size of each datagram of a GSO send (0: one datagram)
+  };
+
+  UDPSocket socket_;
+  bool offload_ {};
+  uint64_t syscalls_ {};
+
+  std::string outbound_ {};    //!< queued datagrams, back to back
+  std::vector<Send> sends_ {}; //!< and where each send starts
+
+  BufferPool buffers_ {};                    //!< what datagrams are read into
+  std::vector<PooledBuffer> inbound_ {};     //!< BATCH_SIZE receive buffers (refilled once handed to payloads)
+  std::vector<sockaddr_storage> senders_ {}; //!< and the address each datagram came from
+  std::vector<char> control_ {};             //!< BATCH_SIZE control messages (UDP_SEGMENT, UDP_GRO)
+  std::vector<mmsghdr> messages_ {};         //!< (reused by each system call)
+  std::vector<iovec> iovecs_ {};             //!< (reused by each system call)
+  std::vector<TCPMessage> pending_ {};       //!< segments that read() found coalesced behind the one it returned
+
+  //! The receive buffers, big enough for the largest datagram the peer may send
+  size_t receive_buffer_size() const;
+
+  //! Appends one datagram carrying a TCP segment to `outbound_` (serializing its header in place)
+  void append_segment( const TCPMessage& msg, std::string_view payload, Wrap32 seqno, bool syn, bool fin );
+
+  //! Parses one datagram, filtering it by its sender and ports (and, while listening, adopting the peer)
+  std::optional<TCPMessage> unwrap( SharedBuffer datagram, const sockaddr_storage& sender );
+};
+
+static_assert( TCPDatagramAdapter<TCPOverUDPSocketAdapter> );
+static_assert( TCPDatagramAdapter<LossyFdAdapter<TCPOverUDPSocketAdapter>> );
@@ -7,8 +7,10 @@
 #include "tcp_sender.hh"
 #include "tcp_sender_message.hh"
 
+#include <algorithm>
 #include <functional>
 #include <optional>
+#include <vector>
 
 class TCPPeer
 {
@@ -35,6 +37,9 @@ public:
   }
   bool has_ackno() const { return receiver_.send().ackno.has_value(); }
 
+  /* Has the three-way handshake completed (both SYNs received and acknowledged)? */
+  bool established() const { return has_ackno() and sender_.syn_acked(); }
+
   /* Is the peer still active? */
   bool active() const
   {
@@ -47,6 +52,25 @@ public:
     return ( not any_errors ) and ( sender_active or receiver_active or lingering );
   }
 
+  /* Milliseconds until tick() next has something to do (retransmit, or stop lingering), or none if nothing is
+     pending; an event loop can sleep that long instead of ticking periodically */
+  std::optional<uint64_t> next_deadline() const
+  {
+    if ( not active() ) {
+      return {};
+    }
+
+    std::optional<uint64_t> deadline = sender_.ms_until_timeout();
+    const bool streams_finished = not sender_.sequence_numbers_in_flight() and sender_.reader().is_finished()
+                                  and receiver_.writer().is_closed();
+    if ( streams_finished ) {
+      // still active, so still lingering
+      const uint64_t linger_left = time_of_last_receipt_ + 10UL * cfg_.rt_timeout - cumulative_time_;
+      deadline = std::min( deadline.value_or( linger_left ), linger_left );
+    }
+    return deadline;
+  }
+
   void receive( TCPMessage msg, const TransmitFunction& transmit )
   {
     if ( not active() ) {
@@ -68,6 +92,7 @@ public:
     if ( receiver_.writer().is_closed() and not sender_.reader().is_finished() ) {
       linger_after_streams_finish_ = false;
     }
+    fin_received_ |= msg.sender.FIN;
 
     // Give incoming TCPSenderMessage to receiver.
     receiver_.receive( std::move( msg.sender ) );
@@ -81,13 +106,69 @@ public:
     }
   }
 
+  /* Receive a burst of messages from one adapter read, ending in the same state as receive() on each in turn,
+     but with a single reply for the whole batch. Runs of segments that only carry data go to the receiver
+     together, so that in-sequence ones are coalesced before reassembly; any other message (SYN, FIN, RST, or
+     no payload), and every message once a FIN has arrived, is received on its own, so that active(), the
+     keep-alive check and the linger decision see the state that message would have seen. */
+  void receive_batch( std::vector<TCPMessage> msgs, const TransmitFunction& transmit )
+  {
+    std::vector<TCPSenderMessage> run;
+    run.reserve( msgs.size() );
+    const auto flush = [&] {
+      if ( not run.empty() ) {
+        receiver_.receive_batch( std::move( run ) );
+        run.clear();
+      }
+    };
+
+    for ( auto& msg : msgs ) {
+      const bool data_only = msg.sender.sequence_length() > 0 and not msg.sender.SYN and not msg.sender.FIN
+                             and not msg.sender.RST and not msg.receiver.RST and not fin_received_;
+      if ( not data_only ) {
+        flush();
+      }
+      if ( not active() ) {
+        break;
+      }
+
+      // receive()'s bookkeeping (a data-only message always needs a reply, so the keep-alive check is moot)
+      time_of_last_receipt_ = cumulative_time_;
+      need_send_ |= ( msg.sender.sequence_length() > 0 );
+      if ( not data_only ) {
+        const auto our_ackno = receiver_.send().ackno;
+        need_send_ |= ( our_ackno.has_value() and msg.sender.seqno + 1 == our_ackno.value() );
+      }
+      if ( receiver_.writer().is_closed() and not sender_.reader().is_finished() ) {
+        linger_after_streams_finish_ = false;
+      }
+      fin_received_ |= msg.sender.FIN;
+
+      if ( data_only ) {
+        run.push_back( std::move( msg.sender ) );
+      } else {
+        receiver_.receive( std::move( msg.sender ) );
+      }
+      sender_.receive( msg.receiver );
+    }
+    flush();
+
+    if ( need_send_ ) {
+      send( sender_.make_empty_message(), transmit );
+    }
+  }
+
   // Testing interface
   const TCPReceiver& receiver() const { return receiver_; }
   const TCPSender& sender() const { return sender_; }
 
 private:
   TCPConfig cfg_;
-  TCPSender sender_ { ByteStream { cfg_.send_capacity }, cfg_.isn, cfg_.rt_timeout };
+  TCPSender sender_ { ByteStream { cfg_.send_capacity },
+                     cfg_.isn,
+                     cfg_.rt_timeout,
+                     cfg_.gso ? TCPConfig::GSO_MAX_SIZE : TCPConfig::MAX_PAYLOAD_SIZE,
+                     cfg_.mss };
   TCPReceiver receiver_ { Reassembler { ByteStream { cfg_.recv_capacity } } };
 
   bool need_send_ {};
@@ -100,6 +181,7 @@ private:
   }
 
   bool linger_after_streams_finish_ { true }; // one peer may need to linger to make sure all closure conditions met
+  bool fin_received_ {}; // (receive_batch stops coalescing: a run of data could complete the inbound stream)
   uint64_t cumulative_time_ {};
   uint64_t time_of_last_receipt_ {};
 };
@@ -1,5 +1,6 @@
 #include "tcp_segment.hh"
 #include "checksum.hh"
+#include "header_layout.hh"
 #include "wrapping_integers.hh"
 
 #include <cstddef>
@@ -8,16 +9,99 @@ static constexpr uint32_t TCPHeaderMinLen = 5; // 32-bit words
 
 using namespace std;
 
+class Wrap32Serializable : public Wrap32
+{
+public:
+  uint32_t raw_value() const { return raw_value_; }
+};
+
+namespace {
+
+using namespace header_layout;
+
+// the fixed part of a TCP header, field by field (a TCPSegment spreads them over its messages)
+struct TCPHeaderFields
+{
+  uint16_t src_port {};
+  uint16_t dst_port {};
+  uint32_t seqno {};
+  uint32_t ackno {};
+  uint8_t data_offset {};
+  bool ack {};
+  bool rst {};
+  bool syn {};
+  bool fin {};
+  uint16_t window_size {};
+  uint16_t cksum {};
+};
+
+using TCPLayout = Layout<TCPHeaderMinLen * 4,
+                         Field<0, 16, &TCPHeaderFields::src_port>,
+                         Field<16, 16, &TCPHeaderFields::dst_port>,
+                         Field<32, 32, &TCPHeaderFields::seqno>,
+                         Field<64, 32, &TCPHeaderFields::ackno>,
+                         Field<96, 4, &TCPHeaderFields::data_offset>,
+                         Reserved<100, 7>, // reserved bits, CWR, ECE, URG
+                         Field<107, 1, &TCPHeaderFields::ack>,
+                         Reserved<108, 1>, // PSH
+                         Field<109, 1, &TCPHeaderFields::rst>,
+                         Field<110, 1, &TCPHeaderFields::syn>,
+                         Field<111, 1, &TCPHeaderFields::fin>,
+                         Field<112, 16, &TCPHeaderFields::window_size>,
+                         Field<128, 16, &TCPHeaderFields::cksum>,
+                         Reserved<144, 16>>; // urgent pointer
+
+// skips any options or anything extra in the header, and takes the rest as the payload
+void finish_parse( TCPSegment& seg, Parser& parser, const uint8_t data_offset )
+{
+  if ( data_offset < TCPHeaderMinLen ) {
+    parser.set_error();
+  }
+  parser.remove_prefix( data_offset * 4 - TCPHeaderMinLen * 4 );
+
+  parser.all_remaining( seg.message.sender.payload );
+}
+
+} // namespace
+
 void TCPSegment::parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum )
 {
   /* verify checksum */
   InternetChecksum check { datagram_layer_pseudo_checksum };
-  check.add( parser.buffer() );
+  for ( const auto& x : parser.buffer() ) {
+    check.add( x );
+  }
   if ( check.value() ) {
     parser.set_error();
     return;
   }
 
+  parse( parser );
+}
+
+void TCPSegment::parse( Parser& parser )
+{
+  TCPHeaderFields fields;
+  TCPLayout::parse( fields, parser );
+
+  udinfo.src_port = fields.src_port;
+  udinfo.dst_port = fields.dst_port;
+  message.sender.seqno = Wrap32 { fields.seqno };
+  message.receiver.ackno = Wrap32 { fields.ackno };
+  if ( not fields.ack ) {
+    message.receiver.ackno.reset(); // no ACK
+  }
+  message.sender.RST = message.receiver.RST = fields.rst;
+  message.sender.SYN = fields.syn;
+  message.sender.FIN = fields.fin;
+  message.receiver.window_size = fields.window_size;
+  udinfo.cksum = fields.cksum;
+
+  finish_parse( *this, parser, fields.data_offset );
+}
+
+void TCPSegment::parse_by_hand( Parser& parser )
+{
   uint32_t raw32 {};
   uint16_t raw16 {};
   uint8_t octet {};
@@ -47,22 +131,34 @@ void TCPSegment::parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum
   parser.integer( udinfo.cksum );
   parser.integer( raw16 ); // urgent pointer
 
-  // skip any options or anything extra in the header
-  if ( data_offset < TCPHeaderMinLen ) {
-    parser.set_error();
-  }
-  parser.remove_prefix( data_offset * 4 - TCPHeaderMinLen * 4 );
+  finish_parse( *this, parser, data_offset );
+}
 
-  parser.all_remaining( message.sender.payload );
+void TCPSegment::serialize( Serializer& serializer ) const
+{
+  serialize_header( serializer );
+  serializer.buffer( message.sender.payload );
 }
 
-class Wrap32Serializable : public Wrap32
+void TCPSegment::serialize_header( Serializer& serializer ) const
 {
-public:
-  uint32_t raw_value() const { return raw_value_; }
-};
+  const TCPHeaderFields fields {
+    .src_port = udinfo.src_port,
+    .dst_port = udinfo.dst_port,
+    .seqno = Wrap32Serializable { message.sender.seqno }.raw_value(),
+    .ackno = Wrap32Serializable { message.receiver.ackno.value_or( Wrap32 { 0 } ) }.raw_value(),
+    .data_offset = TCPHeaderMinLen,
+    .ack = message.receiver.ackno.has_value(),
+    .rst = message.sender.RST or message.receiver.RST,
+    .syn = message.sender.SYN,
+    .fin = message.sender.FIN,
+    .window_size = message.receiver.window_size,
+    .cksum = udinfo.cksum,
+  };
+  TCPLayout::serialize( fields, serializer );
+}
 
-void TCPSegment::serialize( Serializer& serializer ) const
+void TCPSegment::serialize_by_hand( Serializer& serializer ) const
 {
   serializer.integer( udinfo.src_port );
   serializer.integer( udinfo.dst_port );
@@ -79,13 +175,21 @@ void TCPSegment::serialize( Serializer& serializer ) const
   serializer.buffer( message.sender.payload );
 }
 
+SharedBuffer TCPSegment::serialize_packet() const
+{
+  Serializer serializer;
+  serialize_header( serializer );
+  return prepend_header( serializer.output(), { &message.sender.payload, 1 } );
+}
+
 void TCPSegment::compute_checksum( uint32_t datagram_layer_pseudo_checksum )
 {
   udinfo.cksum = 0;
   Serializer s;
-  serialize( s );
+  serialize_header( s );
 
   InternetChecksum check { datagram_layer_pseudo_checksum };
   check.add( s.output() );
+  check.add( message.sender.payload );
   udinfo.cksum = check.value();
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "packet_buffer.hh"
 #include "parser.hh"
 #include "tcp_receiver_message.hh"
 #include "tcp_sender_message.hh"
@@ -17,7 +18,16 @@ struct TCPSegment
   UserDatagramInfo udinfo {};
 
   void parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum );
+  void parse( Parser& parser ); // (trusting a checksum that was verified, or left to compute, by the kernel)
   void serialize( Serializer& serializer ) const;
+  void serialize_header( Serializer& serializer ) const;
+
+  //! Serializes the segment into one PacketBuffer (copying in the payload), with headroom left for the layers below
+  SharedBuffer serialize_packet() const;
+
+  // the hand-written, field-by-field versions (the reference for differential tests and benchmarks)
+  void parse_by_hand( Parser& parser );
+  void serialize_by_hand( Serializer& serializer ) const;
 
   void compute_checksum( uint32_t datagram_layer_pseudo_checksum );
 };
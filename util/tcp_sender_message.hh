@@ -1,5 +1,6 @@
 #pragma once
 
+#include "shared_buffer.hh"
 #include "wrapping_integers.hh"
 
 #include <string>
@@ -15,7 +16,8 @@
  * 2) The SYN flag. If set, this segment is the beginning of the byte stream, and the seqno field
  *    contains the Initial Sequence Number (ISN) -- the zero point.
  *
- * 3) The payload: a substring (possibly empty) of the byte stream.
+ * 3) The payload: a substring (possibly empty) of the byte stream. (A received payload is a view of the buffer
+ *    that the datagram was read into.)
  *
  * 4) The FIN flag. If set, the payload represents the ending of the byte stream.
  *
@@ -27,7 +29,7 @@ struct TCPSenderMessage
   Wrap32 seqno { 0 };
 
   bool SYN {};
-  std::string payload {};
+  SharedBuffer payload {};
   bool FIN {};
 
   bool RST {};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "address.hh"
+#include "four_tuple_map.hh"
+#include "ipv4_datagram.hh"
+#include "tcp_config.hh"
+#include "tcp_over_ip.hh"
+#include "tcp_peer.hh"
+#include "timer_wheel.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <unordered_map>
+
+//! \brief Many TCP connections sharing one datagram interface (e.g. one TUN device served by one event loop)
+//! \details Each inbound IPv4 datagram is parsed once and demultiplexed by its four-tuple to the TCPPeer of
+//! that connection. A SYN that matches no connection is answered by the listener on its destination port
+//! without allocating a TCPPeer: the handshake is remembered in a compact SYN queue entry, or, once that queue is
+//! full, only in a SYN cookie carried by the ISN of the SYN/ACK. The TCPPeer (and its two ByteStreams) is created
+//! when the final ACK validates, and the connection joins the listener's accept queue.
+//!
+//! Time is kept by one TimerWheel: each connection and SYN queue entry arms a timer for its next deadline
+//! (retransmission, end of linger), so tick() only touches the ones that are due, however many are idle.
+class TCPStack
+{
+public:
+  //! Type of the function that writes one outbound datagram, given its serialized headers and its payload
+  using TransmitFunction = std::function<void( std::string_view headers, std::string_view payload )>;
+
+  //! \param[in] cfg is the configuration of every connection (each passive open gets its own ISN)
+  //! \param[in] transmit writes datagrams to the shared interface
+  //! \param[in] mss is the largest TCP payload per datagram (GSO super-segments are split to this size)
+  TCPStack( const TCPConfig& cfg, TransmitFunction transmit, size_t mss = TCPConfig::MAX_PAYLOAD_SIZE );
+
+  //! Accept connections to `local` (address "0" matches any local address)
+  //! \param[in] backlog is the most established connections that may wait in the accept queue
+  //! \param[in] syn_backlog is the most half-open connections kept in the SYN queue; beyond that the listener
+  //!                        answers with SYN cookies and keeps no state
+  void listen( const Address& local, size_t backlog = 128, size_t syn_backlog = 256 );
+
+  //! Pops the next established connection from the accept queue of the listener on `local_port`
+  std::optional<FourTuple> accept( uint16_t local_port );
+
+  //! Opens a connection from `local` to `remote` and sends its SYN
+  FourTuple connect( const Address& local, const Address& remote );
+
+  //! Parses an inbound IPv4 datagram and hands its TCP segment to the connection it belongs to
+  void receive( const InternetDatagram& dgram );
+
+  //! Sends whatever the application has written to the connection's outbound stream
+  void push( const FourTuple& id );
+
+  //! Advances time, running the connections and SYN queue entries whose timers expire, and forgets
+  //! connections that are finished and released by the application
+  void tick( uint64_t ms_since_last_tick );
+
+  //! The application is done with this connection: forget it as soon as TCP has finished with it
+  void release( const FourTuple& id );
+
+  //! \returns the connection's TCPPeer, or nullptr if the connection is unknown
+  TCPPeer* peer( const FourTuple& id );
+
+  //! Number of connections with a TCPPeer (established, or finished but not yet released)
+  size_t connection_count() const { return connections_.size(); }
+
+  //! Number of half-open connections remembered in SYN queues
+  size_t syn_queue_size() const { return syn_queue_.size(); }
+
+  //! How long a SYN cookie stays valid, at most two periods of its timestamp
+  static constexpr uint64_t SYN_COOKIE_PERIOD_MS = 64000;
+
+private:
+  //! What a timer belongs to: a connection, or a half-open connection in the SYN queue
+  struct Timer
+  {
+    FourTuple id {};
+    bool half_open {};
+  };
+
+  struct Connection
+  {
+    TCPOverIPv4Adapter adapter; //!< holds this four-tuple's addresses and outbound header template
+    TCPPeer peer;
+    size_t mss;
+    bool released {};
+    TimerWheel<Timer>::Handle timer {}; //!< armed for the peer's next deadline
+    uint64_t ticked_at;                 //!< time of the stack when the peer was last ticked
+
+    Connection( const TCPConfig& cfg, const FourTuple& id, size_t mss, uint64_t now );
+  };
+
+  //! A half-open passive connection: everything needed to resend the SYN/ACK and to validate the final ACK
+  struct SynQueueEntry
+  {
+    Wrap32 local_isn { 0 };
+    Wrap32 remote_isn { 0 };
+    TimerWheel<Timer>::Handle retransmit_timer {};
+    uint8_t retransmissions {};
+  };
+
+  struct Listener
+  {
+    uint32_t ip {}; //!< 0 matches any local address
+    size_t backlog {};
+    size_t syn_backlog {};
+    size_t syn_queue_size {};
+    std::deque<FourTuple> accept_queue {};
+  };
+
+  //! Payload sizes a SYN cookie can encode in its three MSS bits
+  static constexpr std::array<uint16_t, 8> SYN_COOKIE_MSS { 536, 1000, 1220, 1400, 1440, 1460, 4096, 8960 };
+
+  TCPConfig cfg_;
+  TransmitFunction transmit_;
+  size_t mss_;
+
+  FourTupleMap<std::unique_ptr<Connection>> connections_ {};
+  FourTupleMap<SynQueueEntry> syn_queue_ {};
+  std::unordered_map<uint16_t, Listener> listeners_ {};
+  std::default_random_engine rand_;
+  uint64_t syn_cookie_secret_;
+  TimerWheel<Timer> timers_ {};
+
+  Connection* find( const FourTuple& id );
+  Connection& add_connection( const FourTuple& id, const TCPConfig& cfg, size_t mss );
+  Listener* find_listener( const FourTuple& id );
+
+  //! Answers a SYN for `id` from the SYN queue, or with a SYN cookie if the queue is full
+  void receive_syn( const FourTuple& id, Listener& listener, const TCPMessage& msg );
+
+  //! Validates the final ACK of a passive open against the SYN queue or a SYN cookie, creating the connection
+  void receive_handshake_ack( const FourTuple& id, Listener& listener, TCPMessage msg );
+
+  //! Creates the TCPPeer of a passive open whose handshake has completed, and queues it for accept()
+  Connection& establish( const FourTuple& id,
+                         Listener& listener,
+                         Wrap32 local_isn,
+                         Wrap32 remote_isn,
+                         uint16_t window,
+                         size_t mss );
+
+  uint32_t syn_cookie( const FourTuple& id, Wrap32 remote_isn, uint64_t counter, size_t mss_index ) const;
+  std::optional<size_t> check_syn_cookie( const FourTuple& id, Wrap32 remote_isn, Wrap32 cookie ) const;
+
+  //! The SYN/ACK of a passive open, as its TCPPeer would send it
+  TCPMessage syn_ack( Wrap32 local_isn, Wrap32 remote_isn ) const;
+
+  //! Sends a segment that belongs to no TCPPeer (SYN/ACKs of half-open connections)
+  void send_stateless( const FourTuple& id, const TCPMessage& msg );
+
+  //! Brings the connection's TCPPeer up to the current time (before it sees a segment or new data)
+  void catch_up( Connection& conn );
+
+  //! After an event on a connection: forgets it if it is finished and released, or else re-arms its timer
+  void settle( const FourTuple& id, Connection& conn );
+
+  void expire( const Timer& timer );
+  void retransmit_syn_ack( const FourTuple& id );
+  void drop_half_open( const FourTuple& id, SynQueueEntry& entry );
+
+  void send( Connection& conn, const TCPMessage& msg );
+  TCPPeer::TransmitFunction transmit_for( Connection& conn );
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+//! \brief A hierarchical timing wheel: O(1) schedule and cancel, and advancing time touches only the timers
+//! that expire (plus an occasional cascade of a coarser slot)
+//! \details Time is counted in milliseconds. Four levels of 256 slots cover delays up to 2^32 ms (~49 days) at
+//! 1 ms resolution; longer delays are clamped. Timers live in a slab of nodes chained into per-slot intrusive
+//! lists, and handles carry a generation count so a stale handle can never cancel a recycled node.
+//!
+//! Each timer carries a value of type T saying what expired (e.g. an IP address or a connection's four-tuple),
+//! which advance() hands to its caller, so the wheel holds no callbacks and can be copied with its owner.
+template<class T>
+class TimerWheel
+{
+public:
+  //! Refers to one scheduled timer; default-constructed handles refer to none
+  class Handle
+  {
+    friend class TimerWheel;
+    uint32_t index_ { NIL };
+    uint32_t generation_ {};
+  };
+
+  //! Schedules `value` to expire in the first advance() that reaches now() + `delay_ms` (a delay of 0 expires
+  //! in the next advance)
+  Handle schedule( uint64_t delay_ms, T value )
+  {
+    uint32_t index = free_list_;
+    if ( index == NIL ) {
+      if ( nodes_.size() >= NIL ) {
+        throw std::runtime_error( "TimerWheel::schedule: too many timers" );
+      }
+      index = static_cast<uint32_t>( nodes_.size() );
+      nodes_.emplace_back();
+    } else {
+      free_list_ = nodes_[index].next;
+    }
+
+    Node& node = nodes_[index];
+    node.expiry = now_ + std::clamp<uint64_t>( delay_ms, 1, MAX_DELAY );
+    node.value = std::move( value );
+    place( index );
+    ++size_;
+
+    Handle handle;
+    handle.index_ = index;
+    handle.generation_ = node.generation;
+    return handle;
+  }
+
+  //! Cancels the timer if it is still pending, and resets `handle`
+  //! \returns whether a pending timer was cancelled
+  bool cancel( Handle& handle )
+  {
+    const bool was_pending = pending( handle );
+    if ( was_pending ) {
+      unlink( handle.index_ );
+      release( handle.index_ );
+    }
+    handle = Handle {};
+    return was_pending;
+  }
+
+  //! \returns whether `handle` refers to a timer that has neither expired nor been cancelled
+  bool pending( const Handle& handle ) const
+  {
+    return handle.index_ < nodes_.size() and nodes_[handle.index_].generation == handle.generation_
+           and nodes_[handle.index_].slot != NO_SLOT;
+  }
+
+  //! Moves time forward by `ms` milliseconds, calling `on_expire( T&& )` for every timer that expires on the
+  //! way, in expiry order, with now() at its expiry time. `on_expire` may schedule and cancel timers.
+  //! \details Time moves one millisecond at a time while timers are pending (each step looks at one slot, and
+  //! at a coarser slot whenever a finer level wraps around), and jumps straight to the end once none are.
+  template<class F>
+  void advance( uint64_t ms, F&& on_expire )
+  {
+    const uint64_t end = now_ + ms;
+    while ( now_ < end ) {
+      if ( size_ == 0 ) {
+        now_ = end;
+        return;
+      }
+
+      ++now_;
+      for ( size_t level = 1; level < LEVELS and ( now_ & ( span( level ) - 1 ) ) == 0; ++level ) {
+        cascade( level );
+      }
+
+      // Every node in the current level-0 slot expires now: delays below 256 ms never wrap onto it.
+      const size_t slot = now_ & ( SLOTS - 1 );
+      while ( slot_heads_[slot] != NIL ) {
+        const uint32_t index = slot_heads_[slot];
+        unlink( index );
+        T value = std::move( nodes_[index].value );
+        release( index );
+        on_expire( std::move( value ) );
+      }
+    }
+  }
+
+  //! Milliseconds advanced since construction
+  uint64_t now() const { return now_; }
+
+  //! Number of pending timers
+  size_t size() const { return size_; }
+
+private:
+  static constexpr uint32_t NIL = UINT32_MAX;
+  static constexpr uint16_t NO_SLOT = UINT16_MAX;
+  static constexpr unsigned SLOT_BITS = 8;
+  static constexpr size_t SLOTS = 1 << SLOT_BITS;
+  static constexpr size_t LEVELS = 4;
+  static constexpr uint64_t MAX_DELAY = ( uint64_t { 1 } << ( SLOT_BITS * LEVELS ) ) - 1;
+
+  //! Milliseconds covered by one slot of `level` + 1, i.e. by a whole turn of `level`
+  static constexpr uint64_t span( size_t level ) { return uint64_t { 1 } << ( SLOT_BITS * level ); }
+
+  struct Node
+  {
+    uint64_t expiry {};
+    T value {};
+    uint32_t generation {};
+    uint32_t prev { NIL };
+    uint32_t next { NIL };
+    uint16_t slot { NO_SLOT }; //!< level * SLOTS + index of the list holding this node, while pending
+  };
+
+  std::vector<Node> nodes_ {};
+  uint32_t free_list_ { NIL };
+  std::array<uint32_t, LEVELS * SLOTS> slot_heads_ = [] {
+    std::array<uint32_t, LEVELS * SLOTS> heads {};
+    heads.fill( NIL );
+    return heads;
+  }();
+  uint64_t now_ {};
+  size_t size_ {};
+
+  //! Chains a pending node into the finest level whose span covers the time left until its expiry, in the
+  //! slot selected by that level's digit of the expiry time
+  void place( uint32_t index )
+  {
+    Node& node = nodes_[index];
+    const uint64_t delta = node.expiry - now_;
+
+    size_t level = 0;
+    while ( level + 1 < LEVELS and delta >= span( level + 1 ) ) {
+      ++level;
+    }
+    const size_t slot = level * SLOTS + ( ( node.expiry >> ( SLOT_BITS * level ) ) & ( SLOTS - 1 ) );
+
+    node.slot = static_cast<uint16_t>( slot );
+    node.prev = NIL;
+    node.next = slot_heads_[slot];
+    if ( node.next != NIL ) {
+      nodes_[node.next].prev = index;
+    }
+    slot_heads_[slot] = index;
+  }
+
+  void unlink( uint32_t index )
+  {
+    Node& node = nodes_[index];
+    if ( node.prev != NIL ) {
+      nodes_[node.prev].next = node.next;
+    } else {
+      slot_heads_[node.slot] = node.next;
+    }
+    if ( node.next != NIL ) {
+      nodes_[node.next].prev = node.prev;
+    }
+    node.slot = NO_SLOT;
+    node.prev = node.next = NIL;
+  }
+
+  void release( uint32_t index )
+  {
+    Node& node = nodes_[index];
+    node.value = T {};
+    ++node.generation;
+    node.next = free_list_;
+    free_list_ = index;
+    --size_;
+  }
+
+  //! Re-places every node of the `level` slot that time has just reached
+  void cascade( size_t level )
+  {
+    const size_t slot = level * SLOTS + ( ( now_ >> ( SLOT_BITS * level ) ) & ( SLOTS - 1 ) );
+    uint32_t index = std::exchange( slot_heads_[slot], NIL );
+    while ( index != NIL ) {
+      const uint32_t next = nodes_[index].next;
+      place( index );
+      index = next;
+    }
+  }
+};
@@ -2,18 +2,45 @@
 #include "exception.hh"
 
 #include <cstring>
+#include <stdexcept>
 #include <fcntl.h>
+#include <linux/ethtool.h>
 #include <linux/if.h>
 #include <linux/if_tun.h>
+#include <linux/sockios.h>
+#include <sys/socket.h>
 #include <sys/ioctl.h>
 
 static constexpr const char* CLONEDEV = "/dev/net/tun";
 
 using namespace std;
 
+namespace {
+
+// Has checksum or segmentation offload been turned on for the device (by TUNSETOFFLOAD, from this or an earlier
+// fd: the setting outlives the fd)?
+bool offloads_enabled( const string& devname )
+{
+  const FileDescriptor socket { ::CheckSystemCall( "socket", ::socket( AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0 ) ) };
+  for ( const uint32_t command : { ETHTOOL_GTXCSUM, ETHTOOL_GTSO } ) {
+    ethtool_value value { command, 0 };
+    struct ifreq request
+    {};
+    strncpy( static_cast<char*>( request.ifr_name ), devname.data(), IFNAMSIZ - 1 );
+    request.ifr_data = reinterpret_cast<char*>( &value ); // NOLINT(*-reinterpret-cast)
+    if ( ioctl( socket.fd_num(), SIOCETHTOOL, &request ) == 0 and value.data ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
 //! \param[in] devname is the name of the TUN or TAP device, specified at its creation.
 //! \param[in] is_tun is `true` for a TUN device (expects IP datagrams), or `false` for a TAP device (expects
 //! Ethernet frames)
+//! \param[in] options asks for a queue of a multi-queue device, or for virtio headers
 //!
 //! To create a TUN device, you should already have run
 //!
@@ -21,13 +48,16 @@ using namespace std;
 //!
 //! as root before calling this function.
 
-TunTapFD::TunTapFD( const string& devname, const bool is_tun )
+TunTapFD::TunTapFD( const string& devname, const bool is_tun, const TunTapOptions options )
   : FileDescriptor( ::CheckSystemCall( "open", open( CLONEDEV, O_RDWR | O_CLOEXEC ) ) )
+  , _vnet_hdr( options.vnet_hdr )
 {
   struct ifreq tun_req
   {};
 
-  tun_req.ifr_flags = static_cast<int16_t>( ( is_tun ? IFF_TUN : IFF_TAP ) | IFF_NO_PI ); // no packetinfo
+  tun_req.ifr_flags = static_cast<int16_t>( ( is_tun ? IFF_TUN : IFF_TAP ) | IFF_NO_PI // no packetinfo
+                                            | ( options.multi_queue ? IFF_MULTI_QUEUE : 0 )
+                                            | ( options.vnet_hdr ? IFF_VNET_HDR : 0 ) );
 
   // copy devname to ifr_name, making sure to null terminate
 
@@ -35,4 +65,39 @@ TunTapFD::TunTapFD( const string& devname, const bool is_tun )
   tun_req.ifr_name[IFNAMSIZ - 1] = '\0';
 
   CheckSystemCall( "ioctl", ioctl( fd_num(), TUNSETIFF, static_cast<void*>( &tun_req ) ) );
+
+  // Offloads outlive the fd that turned them on, and are shared by all of a device's queues. Without virtio
+  // headers to describe them, packets would arrive with checksums left to compute, or larger than the MTU; the
+  // device is not ours to change (other queues may be using them), so refuse it.
+  if ( not _vnet_hdr and offloads_enabled( devname ) ) {
+    throw runtime_error( "TunTapFD: " + devname
+                         + " has checksum or segmentation offloads turned on, which need virtio headers "
+                           "(TunTapOptions::vnet_hdr); to turn them off, run `ethtool -K "
+                         + devname + " tx off tso off`" );
+  }
+}
+
+void TunTapFD::set_offload( const bool tso )
+{
+  if ( not _vnet_hdr ) {
+    throw runtime_error( "TunTapFD: offloads need virtio headers (TunTapOptions::vnet_hdr)" );
+  }
+  const unsigned int offloads = TUN_F_CSUM | ( tso ? TUN_F_TSO4 : 0U );
+  CheckSystemCall( "ioctl(TUNSETOFFLOAD)", ioctl( fd_num(), TUNSETOFFLOAD, offloads ) );
+}
+
+void TunTapFD::clear_offload()
+{
+  CheckSystemCall( "ioctl(TUNSETOFFLOAD)", ioctl( fd_num(), TUNSETOFFLOAD, 0 ) );
+}
+
+vector<TunFD> TunFD::open_queues( const string& devname, const size_t queues, TunTapOptions options )
+{
+  options.multi_queue = true;
+  vector<TunFD> ret;
+  ret.reserve( queues );
+  for ( size_t i = 0; i < queues; ++i ) {
+    ret.emplace_back( devname, options );
+  }
+  return ret;
 }
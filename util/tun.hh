@@ -2,7 +2,21 @@
 
 #include "file_descriptor.hh"
 
+#include <cstddef>
 #include <string>
+#include <vector>
+
+//! How to attach to a TUN or TAP device
+struct TunTapOptions
+{
+  //! Attach as one queue of a multi-queue device (created with `ip tuntap add ... multi_queue`); the kernel
+  //! spreads flows across the queues, so each queue can be served by its own thread
+  bool multi_queue {};
+
+  //! Prefix each packet read or written with a `struct virtio_net_hdr`, which carries checksum and segmentation
+  //! offload information (see TunTapFD::set_offload)
+  bool vnet_hdr {};
+};
 
 //! A FileDescriptor to a [Linux TUN/TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TunTapFD : public FileDescriptor
@@ -10,7 +24,23 @@ class TunTapFD : public FileDescriptor
 public:
   //! Open an existing persistent [TUN or TAP
   //! device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-  explicit TunTapFD( const std::string& devname, bool is_tun );
+  //! \throws runtime_error without `vnet_hdr` if the device has offloads turned on (see set_offload)
+  explicit TunTapFD( const std::string& devname, bool is_tun, TunTapOptions options = {} );
+
+  //! Is each packet prefixed with a `struct virtio_net_hdr`?
+  bool vnet_hdr() const { return _vnet_hdr; }
+
+  //! Lets the kernel hand over TCP/IPv4 packets whose checksum is left to compute (the virtio header says so)
+  //! and, with `tso`, TCP segments of up to 64 KiB that it has not split to the device's MTU (GRO and TSO)
+  //! \note Requires `vnet_hdr`. Packets written with a virtio header may use the same offloads either way.
+  //! The setting outlives this fd, and the device refuses queues without virtio headers until it is turned off.
+  void set_offload( bool tso );
+
+  //! Turns the device's offloads off again, for every queue (and for queues opened later without virtio headers)
+  void clear_offload();
+
+private:
+  bool _vnet_hdr;
 };
 
 //! A FileDescriptor to a [Linux TUN](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
@@ -18,7 +48,10 @@ class TunFD : public TunTapFD
 {
 public:
   //! Open an existing persistent [TUN device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-  explicit TunFD( const std::string& devname ) : TunTapFD( devname, true ) {}
+  explicit TunFD( const std::string& devname, TunTapOptions options = {} ) : TunTapFD( devname, true, options ) {}
+
+  //! Open `queues` queues of an existing persistent multi-queue TUN device, e.g. one per ShardedEventLoop shard
+  static std::vector<TunFD> open_queues( const std::string& devname, size_t queues, TunTapOptions options = {} );
 };
 
 //! A FileDescriptor to a [Linux TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
@@ -1,21 +1,140 @@
 #include "tuntap_adapter.hh"
 #include "parser.hh"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace std;
 
+namespace {
+
+constexpr size_t MAX_IPV4_LENGTH = 65535;
+constexpr size_t TCP_CKSUM_OFFSET = 16;
+
+// struct virtio_net_hdr from <linux/virtio_net.h> (which does not compile as C++), in host byte order
+struct VirtioNetHeader
+{
+  static constexpr uint8_t F_NEEDS_CSUM = 1; // the checksum is left to compute from csum_start
+  static constexpr uint8_t F_DATA_VALID = 2; // the checksum has been verified
+  static constexpr uint8_t GSO_TCPV4 = 1;
+
+  uint8_t flags {};
+  uint8_t gso_type {};
+  uint16_t hdr_len {};
+  uint16_t gso_size {};
+  uint16_t csum_start {};
+  uint16_t csum_offset {};
+};
+static_assert( sizeof( VirtioNetHeader ) == 10 );
+
+} // namespace
+
+TCPOverIPv4OverTunFdAdapter::TCPOverIPv4OverTunFdAdapter( TunFD&& tun )
+  : _tun( move( tun ) ), _buffers( _tun.vnet_hdr() ? sizeof( VirtioNetHeader ) + MAX_IPV4_LENGTH : 16384, 8 )
+{
+  _tun.set_blocking( false ); // (a burst is read until the device has nothing more)
+}
+
 optional<TCPMessage> TCPOverIPv4OverTunFdAdapter::read()
 {
-  vector<string> strs( 2 );
-  strs.front().resize( IPv4Header::LENGTH );
-  _tun.read( strs );
+  // (the buffer goes back to the pool once the segment's payload, a view of it, is dropped)
+  PooledBuffer datagram = _buffers.get();
+  _tun.read( datagram );
+  return unwrap_buffer( SharedBuffer { move( datagram ) } );
+}
+
+vector<TCPMessage> TCPOverIPv4OverTunFdAdapter::read_batch( const size_t max_datagrams )
+{
+  vector<TCPMessage> ret;
+
+  // the device is non-blocking: keep reading until it has no more datagrams queued
+  for ( size_t i = 0; i < max_datagrams; ++i ) {
+    PooledBuffer datagram = _buffers.get();
+    _tun.read( datagram );
+    if ( datagram.empty() ) {
+      break;
+    }
+    if ( auto msg = unwrap_buffer( SharedBuffer { move( datagram ) } ) ) {
+      ret.push_back( move( msg.value() ) );
+    }
+  }
+
+  return ret;
+}
+
+size_t TCPOverIPv4OverTunFdAdapter::datagram_buffer_size() const
+{
+  return ( _tun.vnet_hdr() ? sizeof( VirtioNetHeader ) : 0 ) + MAX_IPV4_LENGTH + 1;
+}
+
+optional<TCPMessage> TCPOverIPv4OverTunFdAdapter::unwrap( const string_view datagram )
+{
+  return unwrap_buffer( string { datagram } );
+}
+
+optional<TCPMessage> TCPOverIPv4OverTunFdAdapter::unwrap_buffer( SharedBuffer datagram )
+{
+  bool verify_checksum = true;
+  if ( _tun.vnet_hdr() ) {
+    VirtioNetHeader vnet {};
+    if ( datagram.size() < sizeof( vnet ) ) {
+      return {};
+    }
+    memcpy( &vnet, datagram.data(), sizeof( vnet ) );
+    datagram.remove_prefix( sizeof( vnet ) );
+    // the kernel has verified the checksum, or left it to compute (the packet never left this host)
+    verify_checksum = not( vnet.flags & ( VirtioNetHeader::F_NEEDS_CSUM | VirtioNetHeader::F_DATA_VALID ) );
+  }
 
   InternetDatagram ip_dgram;
-  const vector<string> buffers = { strs.at( 0 ), strs.at( 1 ) };
-  if ( parse( ip_dgram, buffers ) ) {
-    return unwrap_tcp_in_ip( ip_dgram );
+  if ( parse( ip_dgram, vector<SharedBuffer> { move( datagram ) } ) ) {
+    return unwrap_tcp_in_ip( ip_dgram, verify_checksum );
   }
   return {};
 }
 
+void TCPOverIPv4OverTunFdAdapter::write( const TCPMessage& seg )
+{
+  if ( _tun.vnet_hdr() ) {
+    write_offloaded( seg );
+    return;
+  }
+
+  if ( seg.sender.payload.size() <= config().mss ) {
+    Headers headers;
+    stamp_tcp_in_ip( seg, headers );
+    _tun.write( vector<string_view> { { headers.data(), headers.size() }, seg.sender.payload } );
+    return;
+  }
+
+  for ( const auto& wire : segment_tcp_in_ip( seg, config().mss ) ) {
+    _tun.write( vector<string_view> { { wire.headers.data(), wire.headers.size() }, wire.payload } );
+  }
+}
+
+//! \details Each datagram carries as many MSS-sized segments as fit in 64 KiB, for the kernel to split (GSO) and
+//! checksum. It repeats SYN on every segment it cuts, so a SYN goes in a datagram of its own.
+void TCPOverIPv4OverTunFdAdapter::write_offloaded( const TCPMessage& seg )
+{
+  const size_t mss = config().mss;
+  const size_t per_datagram
+    = seg.sender.SYN ? mss : max<size_t>( 1, ( MAX_IPV4_LENGTH - HEADERS_LENGTH ) / mss ) * mss;
+
+  for ( const auto& wire : segment_tcp_in_ip( seg, per_datagram, true ) ) {
+    VirtioNetHeader vnet {};
+    vnet.flags = VirtioNetHeader::F_NEEDS_CSUM;
+    vnet.csum_start = IPv4Header::LENGTH;
+    vnet.csum_offset = TCP_CKSUM_OFFSET;
+    if ( wire.payload.size() > mss ) {
+      vnet.gso_type = VirtioNetHeader::GSO_TCPV4;
+      vnet.gso_size = static_cast<uint16_t>( mss );
+      vnet.hdr_len = HEADERS_LENGTH;
+    }
+    _tun.write( vector<string_view> { { reinterpret_cast<const char*>( &vnet ), sizeof( vnet ) }, // NOLINT
+                                      { wire.headers.data(), wire.headers.size() },
+                                      wire.payload } );
+  }
+}
+
 //! Specialize LossyFdAdapter to TCPOverIPv4OverTunFdAdapter
 template class LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>;
@@ -1,12 +1,15 @@
 #pragma once
 
+#include "buffer_pool.hh"
 #include "tcp_over_ip.hh"
 #include "tcp_segment.hh"
 #include "tun.hh"
 
 #include <optional>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 template<class T>
 concept TCPDatagramAdapter = requires( T a, TCPMessage seg )
@@ -25,16 +28,34 @@ class TCPOverIPv4OverTunFdAdapter : public TCPOverIPv4Adapter
 {
 private:
   TunFD _tun;
+  BufferPool _buffers; //!< what datagrams are read into (one at a time)
+
+  //! Writes a TCP segment as datagrams with virtio headers, leaving segmentation and checksums to the kernel
+  void write_offloaded( const TCPMessage& seg );
+
+  //! Parses a datagram in place: the segment's payload is a view of `datagram`
+  std::optional<TCPMessage> unwrap_buffer( SharedBuffer datagram );
 
 public:
   //! Construct from a TunFD
-  explicit TCPOverIPv4OverTunFdAdapter( TunFD&& tun ) : _tun( std::move( tun ) ) {}
+  //! \details If the TunFD has virtio headers, the kernel segments and checksums what is written: a super-segment
+  //! goes out as one datagram of up to 64 KiB. With TunTapFD::set_offload, it may also hand over such datagrams.
+  explicit TCPOverIPv4OverTunFdAdapter( TunFD&& tun );
 
   //! Attempts to read and parse an IPv4 datagram containing a TCP segment related to the current connection
+  //! \details The device is non-blocking: with nothing to read, there is no segment.
   std::optional<TCPMessage> read();
 
+  //! Reads every datagram already queued on the TUN device (up to `max_datagrams`), for TCPPeer::receive_batch
+  std::vector<TCPMessage> read_batch( size_t max_datagrams = 64 );
+
+  //! Parses an IPv4 datagram that has already been read from the TUN device (by EventLoop::add_datagram_rule)
+  //! \details The view is only valid during the call, so the segment's payload is a copy.
+  std::optional<TCPMessage> unwrap( std::string_view datagram );
+
   //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device
-  void write( const TCPMessage& seg ) { _tun.write( serialize( wrap_tcp_in_ip( seg ) ) ); }
+  //! (super-segments larger than the configured MSS are split into several datagrams)
+  void write( const TCPMessage& seg );
 
   //! Access the underlying TUN device
   explicit operator TunFD&() { return _tun; }
@@ -44,6 +65,13 @@ public:
 
   //! Access underlying file descriptor
   FileDescriptor& fd() { return _tun; }
+
+  //! Are datagrams larger than the MTU read and written (with virtio headers)?
+  bool offload() const { return _tun.vnet_hdr(); }
+
+  //! A read buffer that holds any datagram the device hands over, with a byte to spare (so that a read that
+  //! fills the buffer shows a datagram was cut short)
+  size_t datagram_buffer_size() const;
 };
 
 static_assert( TCPDatagramAdapter<TCPOverIPv4OverTunFdAdapter> );